@@ -0,0 +1,291 @@
+#pragma once
+
+#include <numeric>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+#include "image.hpp"
+
+//
+// Packing small textures into layers of a texture array
+// - skyline bottom-left packer per page (cf. Jukka Jylänki, "A Thousand Ways to Pack the Bin")
+// - each item is surrounded by gutter and aligned so that it stays separated up to `num_levels_` mips
+// - either packed at once (cf. pack) or added to/removed from persistent pages over time (cf. Allocator)
+//
+
+namespace toy {
+namespace atlas {
+
+namespace {
+using std::vector;
+using glm::ivec2, glm::fvec4;
+}
+
+struct SkylinePacker {
+  struct Segment {
+    int x, y, width;
+  };
+  ivec2 size_;
+  vector<Segment> skyline_;
+  int64_t used_area_ = 0;
+
+  SkylinePacker(ivec2 size) : size_{size}, skyline_{{0, 0, size.x}} {}
+
+  // Lowest y where [x, x + width) fits on top of skyline starting from i-th segment
+  std::optional<int> _fit(size_t i, ivec2 rect) const {
+    int x = skyline_[i].x;
+    if (x + rect.x > size_.x) { return {}; }
+    int y = 0;
+    for (int remaining = rect.x; remaining > 0; i++) {
+      y = std::max(y, skyline_[i].y);
+      if (y + rect.y > size_.y) { return {}; }
+      remaining -= skyline_[i].width;
+    }
+    return y;
+  }
+
+  std::optional<ivec2> insert(ivec2 rect) {
+    // Choose lowest top edge, then narrowest segment
+    int best_top = INT32_MAX, best_width = INT32_MAX;
+    std::optional<size_t> best;
+    ivec2 position;
+    for (auto i : utils::Range{skyline_.size()}) {
+      auto y = _fit(i, rect);
+      if (!y) { continue; }
+      int top = *y + rect.y;
+      if (top < best_top || (top == best_top && skyline_[i].width < best_width)) {
+        best_top = top;
+        best_width = skyline_[i].width;
+        best = i;
+        position = {skyline_[i].x, *y};
+      }
+    }
+    if (!best) { return {}; }
+
+    // Insert new segment and trim ones under it
+    size_t i = *best;
+    skyline_.insert(skyline_.begin() + i, Segment{position.x, position.y + rect.y, rect.x});
+    for (size_t j = i + 1; j < skyline_.size();) {
+      auto& prev = skyline_[j - 1];
+      auto& seg = skyline_[j];
+      int overlap = prev.x + prev.width - seg.x;
+      if (overlap <= 0) { break; }
+      seg.x += overlap;
+      seg.width -= overlap;
+      if (seg.width > 0) { break; }
+      skyline_.erase(skyline_.begin() + j);
+    }
+
+    // Merge same height neighbors
+    for (size_t j = 0; j + 1 < skyline_.size();) {
+      if (skyline_[j].y == skyline_[j + 1].y) {
+        skyline_[j].width += skyline_[j + 1].width;
+        skyline_.erase(skyline_.begin() + j + 1);
+      } else {
+        j++;
+      }
+    }
+    used_area_ += int64_t(rect.x) * rect.y;
+    return position;
+  }
+};
+
+struct Layout {
+  struct Placement {
+    int layer = -1;     // -1 if it doesn't fit in page at all
+    ivec2 position;     // of content (i.e. excluding gutter)
+    ivec2 size;
+  };
+  ivec2 page_size_;
+  int gutter_;
+  int num_layers_ = 0;
+  vector<Placement> placements_;
+  int64_t content_area_ = 0;
+
+  // Content area over total pages area
+  float getEfficiency() const {
+    if (num_layers_ == 0) { return 0; }
+    return float(content_area_) / (float(page_size_.x) * page_size_.y * num_layers_);
+  }
+
+  // uv offset/scale of placement within its layer
+  static fvec4 getRect(const Placement& p, ivec2 page_size) {
+    return {
+      float(p.position.x) / page_size.x, float(p.position.y) / page_size.y,
+      float(p.size.x) / page_size.x, float(p.size.y) / page_size.y};
+  }
+
+  fvec4 getRect(size_t i) const { return getRect(placements_[i], page_size_); }
+};
+
+inline int alignUp(int x, int alignment) {
+  return (x + alignment - 1) / alignment * alignment;
+}
+
+// Item with its gutter (`gutter` is also used as alignment so that items stay apart down to log2(gutter) mip level)
+inline ivec2 getPaddedSize(ivec2 size, int gutter) {
+  return {alignUp(size.x + 2 * gutter, gutter), alignUp(size.y + 2 * gutter, gutter)};
+}
+
+// Mip levels where gutters still separate items
+inline int getNumLevels(int gutter) {
+  int result = 1;
+  for (int g = gutter; g > 1; g /= 2) { result++; }
+  return result;
+}
+
+// Pages which items are added to and removed from over time (cf. TextureAtlasRR in scene.hpp)
+// - item goes into a region released by earlier `remove` if any fits (its remainder is split into right and bottom),
+//   otherwise on top of the first page's skyline where it fits (or new page)
+// - page is reset to empty skyline once all its items are removed
+struct Allocator {
+  using Placement = Layout::Placement;
+  struct Region {
+    ivec2 position, size;
+  };
+  struct Page {
+    SkylinePacker packer;
+    vector<Region> released;
+    size_t num_items = 0;
+  };
+  ivec2 page_size_;
+  int gutter_;
+  vector<Page> pages_;
+  size_t num_items_ = 0;
+  int64_t content_area_ = 0;
+
+  Allocator(ivec2 page_size, int gutter) : page_size_{page_size}, gutter_{gutter} {}
+
+  // Layer is -1 if it doesn't fit in page at all
+  Placement insert(ivec2 size) {
+    Placement result;
+    auto padded = getPaddedSize(size, gutter_);
+    if (padded.x > page_size_.x || padded.y > page_size_.y) { return result; }
+
+    std::optional<ivec2> position;
+    int layer = 0;
+    for (; layer < (int)pages_.size(); layer++) {
+      auto& released = pages_[layer].released;
+      auto it = std::find_if(released.begin(), released.end(), [&](const Region& region) {
+        return padded.x <= region.size.x && padded.y <= region.size.y;
+      });
+      if (it == released.end()) { continue; }
+      auto region = *it;
+      released.erase(it);
+      if (region.size.x > padded.x) {
+        released.push_back({region.position + ivec2{padded.x, 0}, {region.size.x - padded.x, padded.y}});
+      }
+      if (region.size.y > padded.y) {
+        released.push_back({region.position + ivec2{0, padded.y}, {region.size.x, region.size.y - padded.y}});
+      }
+      position = region.position;
+      break;
+    }
+    if (!position) {
+      for (layer = 0; layer < (int)pages_.size(); layer++) {
+        if ((position = pages_[layer].packer.insert(padded))) { break; }
+      }
+    }
+    if (!position) {
+      position = pages_.emplace_back(Page{SkylinePacker{page_size_}}).packer.insert(padded);
+    }
+    pages_[layer].num_items++;
+    num_items_++;
+    content_area_ += int64_t(size.x) * size.y;
+    return {layer, *position + ivec2{gutter_, gutter_}, size};
+  }
+
+  void remove(const Placement& placement) {
+    if (placement.layer < 0) { return; }
+    auto& page = pages_[placement.layer];
+    TOY_ASSERT(page.num_items > 0);
+    page.released.push_back({placement.position - ivec2{gutter_, gutter_}, getPaddedSize(placement.size, gutter_)});
+    num_items_--;
+    content_area_ -= int64_t(placement.size.x) * placement.size.y;
+    if (--page.num_items == 0) {
+      page = Page{SkylinePacker{page_size_}};
+    }
+  }
+
+  // Content area over total pages area
+  float getEfficiency() const {
+    if (pages_.empty()) { return 0; }
+    return float(content_area_) / (float(page_size_.x) * page_size_.y * pages_.size());
+  }
+};
+
+inline Layout pack(const vector<ivec2>& sizes, ivec2 page_size, int gutter) {
+  Layout result;
+  result.page_size_ = page_size;
+  result.gutter_ = gutter;
+  result.placements_.resize(sizes.size());
+
+  // Taller first packs better for skyline
+  vector<size_t> order(sizes.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+    return std::tie(sizes[a].y, sizes[a].x) > std::tie(sizes[b].y, sizes[b].x);
+  });
+
+  Allocator allocator{page_size, gutter};
+  for (auto i : order) {
+    result.placements_[i] = allocator.insert(sizes[i]);
+  }
+  result.num_layers_ = allocator.pages_.size();
+  result.content_area_ = allocator.content_area_;
+  return result;
+}
+
+// Copy `src` into `dst` at `position` with `gutter` filled by wrapping around (i.e. for GL_REPEAT texcoords)
+inline void blit(const image::Image& src, image::Image& dst, ivec2 position, int gutter) {
+  for (int y = -gutter; y < src.size_.y + gutter; y++) {
+    int dst_y = position.y + y;
+    if (dst_y < 0 || dst_y >= dst.size_.y) { continue; }
+    const uint8_t* src_row = src.row((y % src.size_.y + src.size_.y) % src.size_.y);
+    uint8_t* dst_row = dst.row(dst_y);
+    for (int x = -gutter; x < src.size_.x + gutter; x++) {
+      int dst_x = position.x + x;
+      if (dst_x < 0 || dst_x >= dst.size_.x) { continue; }
+      int src_x = (x % src.size_.x + src.size_.x) % src.size_.x;
+      std::copy(&src_row[4 * src_x], &src_row[4 * src_x + 4], &dst_row[4 * dst_x]);
+    }
+  }
+}
+
+// Mip chain of each layer (only down to the level where gutters still separate items)
+inline vector<vector<image::Image>> composePages(const Layout& layout, const vector<const image::Image*>& images) {
+  int num_levels = getNumLevels(layout.gutter_);
+
+  vector<vector<image::Image>> result(layout.num_layers_);
+  for (auto& page : result) {
+    page.emplace_back(layout.page_size_);
+  }
+  for (auto i : utils::Range{images.size()}) {
+    auto& p = layout.placements_[i];
+    if (p.layer < 0) { continue; }
+    blit(*images[i], result[p.layer][0], p.position, layout.gutter_);
+  }
+  utils::parallelFor(0, result.size(), [&](size_t layer) {
+    auto& page = result[layer];
+    for (int level = 1; level < num_levels; level++) {
+      page.push_back(image::downsample(page.back(), 1));
+    }
+  }, utils::getNumThreads(result.size() * layout.page_size_.x * layout.page_size_.y));
+  return result;
+}
+
+// Mip chain of a single item with its gutter (same as its region of `composePages` since region is aligned),
+// which is to be uploaded at placement's position minus gutter
+inline vector<image::Image> composeTile(const image::Image& image, int gutter) {
+  vector<image::Image> result;
+  result.emplace_back(getPaddedSize(image.size_, gutter));
+  blit(image, result[0], {gutter, gutter}, gutter);
+  for (int level = 1; level < getNumLevels(gutter); level++) {
+    result.push_back(image::downsample(result.back(), 1));
+  }
+  return result;
+}
+
+} // namespace atlas
+} // namespace toy
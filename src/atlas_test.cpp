@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include "atlas.hpp"
+
+using namespace toy;
+using glm::ivec2;
+
+TEST(AtlasTest, SkylinePacker) {
+  atlas::SkylinePacker packer{{64, 64}};
+  std::vector<std::pair<ivec2, ivec2>> rects; // (position, size)
+  for (ivec2 size : {ivec2{32, 32}, ivec2{16, 48}, ivec2{16, 16}, ivec2{32, 16}, ivec2{16, 16}}) {
+    auto position = packer.insert(size);
+    ASSERT_TRUE(position);
+    rects.push_back({*position, size});
+  }
+  EXPECT_FALSE(packer.insert({64, 64}));
+
+  // Within bounds and no overlap
+  for (auto i : utils::Range{rects.size()}) {
+    auto [p, s] = rects[i];
+    EXPECT_TRUE(p.x >= 0 && p.y >= 0 && p.x + s.x <= 64 && p.y + s.y <= 64);
+    for (auto j : utils::Range{i}) {
+      auto [q, t] = rects[j];
+      bool separate = p.x + s.x <= q.x || q.x + t.x <= p.x || p.y + s.y <= q.y || q.y + t.y <= p.y;
+      EXPECT_TRUE(separate) << i << " " << j;
+    }
+  }
+  EXPECT_EQ(packer.used_area_, 32 * 32 + 16 * 48 + 16 * 16 + 32 * 16 + 16 * 16);
+}
+
+TEST(AtlasTest, pack) {
+  std::vector<ivec2> sizes = {{256, 256}, {100, 30}, {64, 64}, {2000, 10}};
+  for (int i = 0; i < 20; i++) { sizes.push_back({128, 128}); }
+  auto layout = atlas::pack(sizes, {512, 512}, 8);
+
+  EXPECT_EQ(layout.placements_[3].layer, -1); // too large
+  EXPECT_GT(layout.num_layers_, 1);
+  for (auto i : utils::Range{sizes.size()}) {
+    auto& p = layout.placements_[i];
+    if (i == 3) { continue; }
+    ASSERT_GE(p.layer, 0);
+    EXPECT_LT(p.layer, layout.num_layers_);
+    // Content is offset by gutter from aligned position
+    EXPECT_EQ(p.position.x % 8, 0);
+    EXPECT_EQ(p.position.y % 8, 0);
+    EXPECT_GE(p.position.x, 8);
+    EXPECT_LE(p.position.x + p.size.x + 8, 512);
+    EXPECT_LE(p.position.y + p.size.y + 8, 512);
+  }
+  EXPECT_GT(layout.getEfficiency(), 0.5);
+  EXPECT_LE(layout.getEfficiency(), 1);
+
+  auto rect = layout.getRect(0);
+  EXPECT_FLOAT_EQ(rect.z, 0.5);
+  EXPECT_FLOAT_EQ(rect.w, 0.5);
+}
+
+TEST(AtlasTest, blit) {
+  // Gutter repeats opposite edge so that bilinear filter at border behaves as GL_REPEAT
+  image::Image src{{2, 2}};
+  for (int i = 0; i < 4; i++) {
+    std::fill(&src.data_[4 * i], &src.data_[4 * i + 4], uint8_t(10 * (i + 1)));
+  }
+  image::Image dst{{6, 6}};
+  atlas::blit(src, dst, {2, 2}, 2);
+  EXPECT_EQ(dst.row(2)[4 * 2], 10);
+  EXPECT_EQ(dst.row(3)[4 * 3], 40);
+  EXPECT_EQ(dst.row(2)[4 * 1], 20); // left of (0, 0) is (1, 0)
+  EXPECT_EQ(dst.row(1)[4 * 2], 30); // above (0, 0) is (0, 1)
+  EXPECT_EQ(dst.row(0)[4 * 0], 10);
+
+  // Mip levels until gutter collapses
+  atlas::Layout layout = atlas::pack({{2, 2}}, {32, 32}, 8);
+  auto pages = atlas::composePages(layout, {&src});
+  ASSERT_EQ(pages.size(), 1);
+  EXPECT_EQ(pages[0].size(), 4);
+  EXPECT_EQ(pages[0][3].size_, (ivec2{4, 4}));
+}
+
+TEST(AtlasTest, Allocator) {
+  atlas::Allocator allocator{{64, 64}, 8};
+  auto a = allocator.insert({16, 16}); // (32x32 with gutter)
+  auto b = allocator.insert({16, 16});
+  auto c = allocator.insert({48, 16});
+  EXPECT_EQ(allocator.insert({100, 1}).layer, -1);
+  ASSERT_EQ(allocator.pages_.size(), 1);
+  EXPECT_EQ(allocator.num_items_, 3);
+
+  // Released region is reused by item which fits in it
+  allocator.remove(a);
+  auto d = allocator.insert({8, 8});
+  EXPECT_EQ(d.layer, 0);
+  EXPECT_EQ(d.position, a.position);
+  EXPECT_EQ(allocator.insert({40, 40}).layer, 1); // (new page)
+
+  // Page is emptied once all items are removed
+  for (auto& p : {b, c, d}) { allocator.remove(p); }
+  EXPECT_EQ(allocator.pages_[0].num_items, 0);
+  EXPECT_TRUE(allocator.pages_[0].released.empty());
+  EXPECT_EQ(allocator.insert({48, 48}).layer, 0);
+  EXPECT_EQ(allocator.num_items_, 2);
+  EXPECT_EQ(allocator.content_area_, 40 * 40 + 48 * 48);
+}
+
+TEST(AtlasTest, composeTile) {
+  // Same as its region within page
+  image::Image src{{4, 2}};
+  for (auto i : utils::Range{src.data_.size()}) { src.data_[i] = uint8_t(i * 7); }
+  auto layout = atlas::pack({{4, 2}}, {32, 32}, 4);
+  auto pages = atlas::composePages(layout, {&src});
+  auto tile = atlas::composeTile(src, 4);
+  ASSERT_EQ(tile.size(), pages[0].size());
+  auto origin = layout.placements_[0].position - 4;
+  for (auto level : utils::Range{tile.size()}) {
+    auto& image = tile[level];
+    EXPECT_EQ(image.size_, atlas::getPaddedSize({4, 2}, 4) / (1 << level));
+    for (int y = 0; y < image.size_.y; y++) {
+      auto row = pages[0][level].row((origin.y >> level) + y) + 4 * (origin.x >> level);
+      EXPECT_TRUE(std::equal(row, row + 4 * image.size_.x, image.row(y))) << level << " " << y;
+    }
+  }
+}
@@ -0,0 +1,366 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+#include "bench.hpp"
+#include "ibl.hpp"
+#include "lighting.hpp"
+#include "render_queue.hpp"
+#include "scene.hpp"
+#include "utils.hpp"
+
+//
+// Headless benchmarks with fixed workloads (i.e. no window, no GL)
+//
+// Usage:
+//   ./bench [--filter <substr>] [--json <out.json>] [--baseline <baseline.json>] [--threshold 0.1]
+//           [--min-time <seconds>] [--repetitions <n>]
+//
+// Exit code is 1 if any benchmark's median gets slower than baseline by more than threshold.
+//
+
+// Count heap allocations (reported as "allocs" per iteration)
+void* operator new(size_t size) {
+  toy::bench::num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto result = std::malloc(size ? size : 1)) { return result; }
+  throw std::bad_alloc{};
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace toy {
+
+using namespace scene;
+using glm::fvec2, glm::fvec3, glm::fvec4, glm::fmat4;
+using std::vector, std::string, std::shared_ptr, std::make_shared;
+
+// Fixed seed so that workloads are same for every run
+inline std::mt19937 getRng() { return std::mt19937{0x70793364}; }
+
+// UV sphere with `n` segments and `n / 2` rings
+inline shared_ptr<Mesh> makeSphere(int n) {
+  auto mesh = make_shared<Mesh>();
+  int rings = n / 2;
+  float pi = glm::pi<float>();
+  for (int j = 0; j <= rings; j++) {
+    for (int i = 0; i <= n; i++) {
+      fvec2 uv = {float(i) / n, float(j) / rings};
+      float theta = 2 * pi * uv.x, phi = pi * uv.y;
+      auto& v = mesh->vertices_.emplace_back();
+      v.position = {std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta)};
+      v.normal = v.position;
+      v.texcoord = uv;
+    }
+  }
+  for (int j = 0; j < rings; j++) {
+    for (int i = 0; i < n; i++) {
+      uint16_t a = j * (n + 1) + i, b = a + 1, c = a + (n + 1), d = c + 1;
+      mesh->indices_.insert(mesh->indices_.end(), {a, c, b, b, c, d});
+    }
+  }
+  return mesh;
+}
+
+// `nx` x `ny` grid of spheres on xy-plane sharing `num_materials` materials
+inline Scene makeGridScene(int nx, int ny, int num_materials, int num_textures, int sphere_segments) {
+  Scene scene;
+  auto mesh = makeSphere(sphere_segments);
+  mesh->bvh_.reset(new MeshBVH{*mesh});
+  vector<shared_ptr<Texture>> textures(num_textures);
+  for (auto& texture : textures) { texture = make_shared<Texture>(); }
+  vector<shared_ptr<Material>> materials(num_materials);
+  for (auto i : utils::Range{num_materials}) {
+    materials[i] = make_shared<Material>();
+    if (num_textures > 0 && i % 2 == 0) {
+      materials[i]->base_color_texture_ = textures[i % num_textures];
+    }
+  }
+  for (auto y : utils::Range{ny}) {
+    for (auto x : utils::Range{nx}) {
+      auto& node = scene.nodes_.emplace_back(new Node);
+      node->transform_[3] = fvec4{3.f * (x - nx / 2), 3.f * (y - ny / 2), 0, 1};
+      node->mesh_ = mesh;
+      node->material_ = materials[(y * nx + x) % num_materials];
+    }
+  }
+  return scene;
+}
+
+void registerBenchmarks(bench::Runner& runner) {
+  // glTF load (only when sample models are available)
+  for (auto name : {"Suzanne", "BoxTextured"}) {
+    auto path = getGltfModelPath(name);
+    if (!std::filesystem::exists(path)) {
+      fmt::print("(skip gltf::load/{} since {} is not found)\n", name, path);
+      continue;
+    }
+    runner.run(fmt::format("gltf::load/{}", name), [&]() {
+      auto assets = gltf::load(path.data());
+      bench::doNotOptimize(assets);
+    });
+  }
+
+  // BVH build (currently trivial but kept so that real BVH's build cost is tracked)
+  {
+    auto mesh = makeSphere(64);
+    runner.run("MeshBVH/build/sphere64", [&]() {
+      MeshBVH bvh{*mesh};
+      bench::doNotOptimize(bvh);
+    });
+  }
+
+  // Ray picking against 8x8 spheres from camera at z = 30 (a mix of hits and misses)
+  {
+    auto scene = makeGridScene(8, 8, 4, 0, 16);
+    vector<std::pair<fvec3, fvec3>> rays;
+    auto rng = getRng();
+    std::uniform_real_distribution<float> dist{-0.45f, 0.45f};
+    for (auto i : utils::Range{64}) {
+      (void)i;
+      rays.push_back({fvec3{0, 0, 30}, fvec3{dist(rng), dist(rng), -1}});
+    }
+    runner.run("rayIntersection/grid8x8/64rays", [&]() {
+      int num_hits = 0;
+      for (auto& [src, dir] : rays) {
+        num_hits += rayIntersection(scene, src, dir).result.hit;
+      }
+      bench::doNotOptimize(num_hits);
+    });
+
+    // Hover-like sweep where each ray is close to previous one (cf. ViewportPanel::_queryHover)
+    vector<fvec3> sweep;
+    for (auto i : utils::Range{64}) {
+      sweep.push_back(fvec3{-0.4f + 0.8f * i / 64, 0.05f, -1});
+    }
+    runner.run("rayIntersection/grid8x8/sweep64", [&]() {
+      int num_hits = 0;
+      for (auto& dir : sweep) {
+        num_hits += rayIntersection(scene, fvec3{0, 0, 30}, dir).result.hit;
+      }
+      bench::doNotOptimize(num_hits);
+    });
+    runner.run("rayIntersection/grid8x8/sweep64/hint", [&]() {
+      int num_hits = 0;
+      SceneRayIntersection last;
+      for (auto& dir : sweep) {
+        last = rayIntersection(scene, fvec3{0, 0, 30}, dir, &last);
+        num_hits += last.result.hit;
+      }
+      bench::doNotOptimize(num_hits);
+    });
+  }
+
+  // Clipping of random triangles/lines in clip space (roughly half of them need actual clipping)
+  {
+    auto rng = getRng();
+    std::uniform_real_distribution<float> dist{-2, 2};
+    auto randomPoint = [&]() { return fvec4{dist(rng), dist(rng), dist(rng), 1}; };
+    vector<vector<fvec4>> polys;
+    vector<std::array<fvec4, 2>> lines;
+    for (auto i : utils::Range{1024}) {
+      (void)i;
+      polys.push_back({randomPoint(), randomPoint(), randomPoint()});
+      lines.push_back({randomPoint(), randomPoint()});
+    }
+    runner.run("clip4D_ConvexPoly_ClipVolume/1024", [&]() {
+      size_t num_vertices = 0;
+      for (auto& poly : polys) {
+        num_vertices += utils::hit::clip4D_ConvexPoly_ClipVolume(poly).size();
+      }
+      bench::doNotOptimize(num_vertices);
+    });
+    runner.run("clip4D_ConvexPoly_ClipVolume/ClipPoly/1024", [&]() {
+      size_t num_vertices = 0;
+      utils::hit::ClipPoly result;
+      for (auto& poly : polys) {
+        utils::hit::clip4D_ConvexPoly_ClipVolume(poly.data(), poly.size(), result);
+        num_vertices += result.size();
+      }
+      bench::doNotOptimize(num_vertices);
+    });
+    utils::hit::ClipPolyBatch batch, batch_result;
+    for (auto& poly : polys) { batch.push(poly.data(), poly.size()); }
+    runner.run("clip4D_ConvexPoly_ClipVolume/ClipPolyBatch/1024", [&]() {
+      utils::hit::clip4D_ConvexPoly_ClipVolume(batch, batch_result);
+      bench::doNotOptimize(batch_result);
+    });
+    runner.run("clip4D_Line_ClipVolume/1024", [&]() {
+      size_t num_lines = 0;
+      for (auto& line : lines) {
+        num_lines += utils::hit::clip4D_Line_ClipVolume(line).has_value();
+      }
+      bench::doNotOptimize(num_lines);
+    });
+  }
+
+  // Clipping of random path in view frustum (same as DrawList3D::addPath before/after batching)
+  {
+    auto rng = getRng();
+    std::uniform_real_distribution<float> dist{-3, 3};
+    vector<fvec3> ps(1024);
+    for (auto& p : ps) { p = {dist(rng), dist(rng), dist(rng)}; }
+    fmat4 xform = glm::perspectiveRH_NO(glm::pi<float>() / 3, 1.f, 0.1f, 100.f);
+    xform[3] = xform * fvec4{0, 0, -4, 1}; // camera at z = 4
+    runner.run("clip4D_Line_ClipVolume/path/1024", [&]() {
+      size_t num_lines = 0;
+      for (auto i : utils::Range{ps.size() - 1}) {
+        num_lines += utils::hit::clip4D_Line_ClipVolume({xform * fvec4{ps[i], 1}, xform * fvec4{ps[i + 1], 1}}).has_value();
+      }
+      bench::doNotOptimize(num_lines);
+    });
+    utils::hit::LineClipper clipper;
+    runner.run("LineClipper/path/1024", [&]() {
+      clipper.clipPath(xform, ps.data(), ps.size(), /*closed*/ false);
+      bench::doNotOptimize(clipper.lines_);
+    });
+  }
+
+  // Transform decomposition of random TRS
+  {
+    auto rng = getRng();
+    std::uniform_real_distribution<float> dist{-3, 3}, scale_dist{0.1, 4};
+    vector<fmat4> xforms;
+    for (auto i : utils::Range{1024}) {
+      (void)i;
+      xforms.push_back(utils::composeTransform(
+          {scale_dist(rng), scale_dist(rng), scale_dist(rng)},
+          {dist(rng), dist(rng) / 2, dist(rng)},
+          {dist(rng), dist(rng), dist(rng)}));
+    }
+    runner.run("decomposeTransform/1024", [&]() {
+      fvec3 sum = {0, 0, 0};
+      for (auto& xform : xforms) {
+        auto [s, r, t] = utils::decomposeTransform(xform);
+        sum += s + r + t;
+      }
+      bench::doNotOptimize(sum);
+    });
+  }
+
+  // CPU-side draw list for multi-draw-indirect (64x64 nodes, 16 materials, 4 textures)
+  {
+    auto scene = makeGridScene(64, 64, 16, 4, 8);
+    vector<const Node*> nodes;
+    for (auto& node : scene.nodes_) { nodes.push_back(node.get()); }
+    DrawList draw_list;
+    runner.run("buildDrawList/4096", [&]() {
+      buildDrawList(nodes, draw_list, [](const Mesh& mesh) {
+        return GeometryArena::Range{0, (GLuint)mesh.indices_.size(), 0};
+      }, [](const Texture&) -> const AtlasPlacement* { return nullptr; });
+      bench::doNotOptimize(draw_list);
+    });
+  }
+
+  // Clustered light culling (16x9x24 clusters) with point/spot lights scattered in view frustum
+  {
+    lighting::ClusterGrid grid;
+    float yfov = glm::pi<float>() / 3, aspect = 16.f / 9.f;
+    grid.setup({16, 9, 24}, glm::perspectiveRH_NO(yfov, aspect, 0.001f, 1000.f), 0.05, 1000);
+    auto rng = getRng();
+    std::uniform_real_distribution<float> dist{-1, 1}, depth_dist{1, 50}, range_dist{0.5, 4};
+    vector<lighting::LightData> all_lights;
+    for (auto i : utils::Range{1000}) {
+      float d = depth_dist(rng);
+      fvec3 position = {d * std::tan(yfov / 2) * aspect * dist(rng), d * std::tan(yfov / 2) * dist(rng), -d};
+      auto type = (i % 4 == 0) ? lighting::kSpot : lighting::kPoint;
+      all_lights.push_back(lighting::makeLightData(
+          type, position, {dist(rng), dist(rng), dist(rng)}, {1, 1, 1}, 1, range_dist(rng), 0.3, 0.6));
+    }
+    for (auto n : {1, 10, 100, 1000}) {
+      vector<lighting::LightData> lights{all_lights.begin(), all_lights.begin() + n};
+      runner.run(fmt::format("ClusterGrid::build/{}", n), [&]() {
+        grid.build(lights);
+        bench::doNotOptimize(grid.indices_);
+      });
+    }
+  }
+
+  // Render queue sort with scene-like keys (pass, variant, material, mesh, depth)
+  // pushed in random order each iteration (i.e. no presorted input)
+  {
+    auto rng = getRng();
+    std::uniform_real_distribution<float> depth_dist{0.1, 1000};
+    for (size_t n : {10000, 100000, 1000000}) {
+      vector<uint64_t> keys;
+      for (auto i : utils::Range{n}) {
+        (void)i;
+        keys.push_back(render_queue::KeyPacker{}
+            .push(rng() % 8 == 0, 1).push(rng() % 64, 9).push(rng() % 256, 14).push(rng() % 1024, 14)
+            .push(render_queue::getDepthKey(depth_dist(rng), 24), 24).get());
+      }
+      render_queue::RenderQueue queue;
+      runner.run(fmt::format("RenderQueue::sort/{}", n), [&]() {
+        queue.clear();
+        for (auto i : utils::Range{n}) { queue.push(keys[i], i); }
+        queue.sort();
+        bench::doNotOptimize(queue.items_);
+      });
+    }
+  }
+
+  // IBL specular prefilter of 256^2 cubemap (noise so that nothing is constant) into 128^2 x 6 levels
+  {
+    auto rng = getRng();
+    std::uniform_real_distribution<float> dist{0, 4};
+    ibl::CubeImage image{256};
+    for (auto& v : image.data_) { v = {dist(rng), dist(rng), dist(rng)}; }
+    auto source = ibl::generateMipChain(image);
+    ibl::Params params;
+    vector<ibl::CubeImage> result;
+    runner.run("ibl::prefilterSpecular/128", [&]() {
+      result = ibl::prefilterSpecular(source, params);
+      bench::doNotOptimize(result);
+    });
+  }
+}
+
+} // namespace toy
+
+
+int main(const int argc, const char* argv[]) {
+  using namespace toy;
+  utils::Cli cli{argc, argv};
+  bench::Runner runner;
+  runner.filter_ = cli.getArg<std::string>("--filter").value_or("");
+  runner.min_time_ = cli.getArg<double>("--min-time").value_or(runner.min_time_);
+  runner.repetitions_ = cli.getArg<size_t>("--repetitions").value_or(runner.repetitions_);
+  auto json_path = cli.getArg<std::string>("--json");
+  auto baseline_path = cli.getArg<std::string>("--baseline");
+  auto threshold = cli.getArg<double>("--threshold").value_or(0.1);
+  if (cli.checkArg("--help")) {
+    fmt::print("{}", cli.help());
+    return 0;
+  }
+
+  registerBenchmarks(runner);
+
+  if (json_path) {
+    std::ofstream ostr{*json_path};
+    bench::writeJson(ostr, runner.results_);
+    if (!ostr) {
+      fmt::print(stderr, "failed to write {}\n", *json_path);
+      return 2;
+    }
+  }
+
+  if (baseline_path) {
+    std::ifstream istr{*baseline_path};
+    if (!istr) {
+      fmt::print(stderr, "failed to read {}\n", *baseline_path);
+      return 2;
+    }
+    auto comparisons = bench::compare(runner.results_, bench::readJson(istr), threshold);
+    bool regressed = false;
+    fmt::print("\n{:<48} {:>14} {:>14} {:>8}\n", "benchmark", "baseline (ns)", "current (ns)", "ratio");
+    for (auto& c : comparisons) {
+      fmt::print("{:<48} {:>14.1f} {:>14.1f} {:>7.3f}x{}\n",
+          c.name, c.baseline, c.current, c.ratio, c.regressed ? "  <-- REGRESSION" : "");
+      regressed = regressed || c.regressed;
+    }
+    if (regressed) {
+      return 1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <istream>
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+
+//
+// Minimal benchmark harness (cf. bench.cpp)
+// - each benchmark is a function running single iteration
+// - iteration count is calibrated so that one sample takes `min_time_ / repetitions_`
+// - statistics (per iteration) are over `repetitions_` samples
+// - heap allocations per iteration are counted when global `operator new` is replaced to increment `num_allocations`
+// - results are written as JSON (one benchmark per line) which is also read back as baseline
+//
+
+namespace toy {
+namespace bench {
+
+namespace {
+using std::string, std::vector;
+}
+
+// (cf. operator new in bench.cpp)
+inline std::atomic<size_t> num_allocations = 0;
+
+// Keep compiler from optimizing away `value` (same trick as google benchmark's DoNotOptimize)
+template<typename T>
+inline void doNotOptimize(T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : "+m"(value) : : "memory");
+#else
+  volatile auto sink = &value; (void)sink;
+#endif
+}
+
+struct Result {
+  string name;
+  size_t iterations = 0; // per sample
+  double mean = 0, median = 0, stddev = 0, min = 0, max = 0; // ns per iteration
+  double allocations = 0; // per iteration
+};
+
+inline Result computeResult(const string& name, size_t iterations, vector<double> samples) {
+  Result result{name, iterations};
+  if (samples.empty()) { return result; }
+  std::sort(samples.begin(), samples.end());
+  auto n = samples.size();
+  result.min = samples.front();
+  result.max = samples.back();
+  result.median = (n % 2) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+  for (auto s : samples) { result.mean += s; }
+  result.mean /= n;
+  for (auto s : samples) { result.stddev += (s - result.mean) * (s - result.mean); }
+  result.stddev = (n > 1) ? std::sqrt(result.stddev / (n - 1)) : 0;
+  return result;
+}
+
+struct Runner {
+  double min_time_ = 0.5; // seconds (for all samples of each benchmark)
+  size_t repetitions_ = 10;
+  string filter_;         // substring of name
+  vector<Result> results_;
+
+  template<typename Func>
+  void run(const string& name, Func&& func) {
+    if (!filter_.empty() && name.find(filter_) == string::npos) { return; }
+    using Clock = std::chrono::steady_clock;
+    auto measure = [&](size_t iterations) {
+      auto begin = Clock::now();
+      for (size_t i = 0; i < iterations; i++) { func(); }
+      return std::chrono::duration<double, std::nano>(Clock::now() - begin).count();
+    };
+
+    // Calibrate (also works as warmup)
+    double sample_time = 1e9 * min_time_ / repetitions_;
+    size_t iterations = 1;
+    for (double elapsed; (elapsed = measure(iterations)) < sample_time;) {
+      double scale = (elapsed > 0) ? std::min(10.0, 1.2 * sample_time / elapsed) : 10.0;
+      iterations = std::max<size_t>(iterations + 1, iterations * scale);
+    }
+
+    vector<double> samples;
+    size_t allocations_begin = num_allocations.load();
+    for (size_t i = 0; i < repetitions_; i++) {
+      samples.push_back(measure(iterations) / iterations);
+    }
+    size_t allocations = num_allocations.load() - allocations_begin;
+    auto& result = results_.emplace_back(computeResult(name, iterations, samples));
+    result.allocations = double(allocations) / (iterations * repetitions_);
+    fmt::print("{:<48} {:>14.1f} ns (+-{:>5.1f}%) x {:<8} {:>8.2f} allocs\n",
+        name, result.median, 100 * result.stddev / result.mean, iterations, result.allocations);
+  }
+};
+
+inline void writeJson(std::ostream& ostr, const vector<Result>& results) {
+  ostr << "{\"benchmarks\":[";
+  for (size_t i = 0; i < results.size(); i++) {
+    auto& r = results[i];
+    ostr << fmt::format(
+        "{}\n{{\"name\":\"{}\",\"iterations\":{},\"mean_ns\":{:.3f},\"median_ns\":{:.3f},"
+        "\"stddev_ns\":{:.3f},\"min_ns\":{:.3f},\"max_ns\":{:.3f},\"allocations\":{:.3f}}}",
+        i == 0 ? "" : ",", r.name, r.iterations, r.mean, r.median, r.stddev, r.min, r.max, r.allocations);
+  }
+  ostr << "\n]}\n";
+}
+
+// Only understands what `writeJson` writes (i.e. not general JSON)
+inline std::map<string, Result> readJson(std::istream& istr) {
+  std::map<string, Result> result;
+  auto getField = [](const string& line, const string& key) -> std::optional<string> {
+    auto pos = line.find("\"" + key + "\":");
+    if (pos == string::npos) { return {}; }
+    pos += key.size() + 3;
+    if (line[pos] == '"') {
+      return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+    }
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+  };
+  for (string line; std::getline(istr, line);) {
+    auto name = getField(line, "name");
+    if (!name) { continue; }
+    Result r{*name};
+    r.iterations = std::stoull(getField(line, "iterations").value_or("0"));
+    r.mean = std::stod(getField(line, "mean_ns").value_or("0"));
+    r.median = std::stod(getField(line, "median_ns").value_or("0"));
+    r.stddev = std::stod(getField(line, "stddev_ns").value_or("0"));
+    r.min = std::stod(getField(line, "min_ns").value_or("0"));
+    r.max = std::stod(getField(line, "max_ns").value_or("0"));
+    r.allocations = std::stod(getField(line, "allocations").value_or("0"));
+    result[r.name] = r;
+  }
+  return result;
+}
+
+struct Comparison {
+  string name;
+  double baseline, current; // median ns
+  double ratio;             // current / baseline
+  bool regressed;
+};
+
+// Regressed when median gets slower than `threshold` (e.g. 0.1 for 10%)
+inline vector<Comparison> compare(
+    const vector<Result>& results, const std::map<string, Result>& baseline, double threshold) {
+  vector<Comparison> comparisons;
+  for (auto& r : results) {
+    auto it = baseline.find(r.name);
+    if (it == baseline.end() || it->second.median <= 0) { continue; }
+    double ratio = r.median / it->second.median;
+    comparisons.push_back({r.name, it->second.median, r.median, ratio, ratio > 1 + threshold});
+  }
+  return comparisons;
+}
+
+} // namespace bench
+} // namespace toy
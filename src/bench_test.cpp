@@ -0,0 +1,40 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "bench.hpp"
+
+using namespace toy;
+
+TEST(BenchTest, computeResult) {
+  auto result = bench::computeResult("a", 10, {4, 1, 3, 2});
+  EXPECT_EQ(result.iterations, 10);
+  EXPECT_DOUBLE_EQ(result.median, 2.5);
+  EXPECT_DOUBLE_EQ(result.mean, 2.5);
+  EXPECT_DOUBLE_EQ(result.min, 1);
+  EXPECT_DOUBLE_EQ(result.max, 4);
+  EXPECT_NEAR(result.stddev, 1.291, 1e-3);
+}
+
+TEST(BenchTest, json_compare) {
+  std::vector<bench::Result> baseline = {
+      bench::computeResult("x/1", 1, {100}),
+      bench::computeResult("y/2", 2, {200}),
+  };
+  std::stringstream stream;
+  bench::writeJson(stream, baseline);
+  auto parsed = bench::readJson(stream);
+  ASSERT_EQ(parsed.size(), 2);
+  EXPECT_EQ(parsed["y/2"].iterations, 2);
+  EXPECT_DOUBLE_EQ(parsed["y/2"].median, 200);
+
+  std::vector<bench::Result> current = {
+      bench::computeResult("x/1", 1, {105}), // within threshold
+      bench::computeResult("y/2", 1, {300}), // regressed
+      bench::computeResult("z/3", 1, {1}),   // not in baseline
+  };
+  auto comparisons = bench::compare(current, parsed, 0.1);
+  ASSERT_EQ(comparisons.size(), 2);
+  EXPECT_FALSE(comparisons[0].regressed);
+  EXPECT_TRUE(comparisons[1].regressed);
+  EXPECT_DOUBLE_EQ(comparisons[1].ratio, 1.5);
+}
@@ -0,0 +1,481 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fstream>
+#include <optional>
+#include <vector>
+#include <stb_image.h>
+
+#include "utils.hpp"
+#include "image_bc.hpp"
+
+//
+// Image based lighting precomputed on CPU (cf. EXT_lights_image_based)
+// - equirectangular HDR is resampled into cubemap mip chain (source of filtered importance sampling)
+// - diffuse: irradiance as 9 spherical harmonics coefficients (already convolved with clamped cosine)
+// - specular: GGX prefiltered cubemap per roughness (= level / (num_levels - 1)), "split sum" with BRDF LUT
+// - faces/rows run in parallel, and importance samples are transformed/projected four at a time
+// - results are cached on disk ("TOYIBL" container) keyed by source file and parameters
+//
+// cf. Ramamoorthi and Hanrahan, "An Efficient Representation for Irradiance Environment Maps"
+//     Karis, "Real Shading in Unreal Engine 4"
+//     Colbert and Krivanek, "GPU-Based Importance Sampling"
+//
+
+namespace toy {
+namespace ibl {
+
+namespace {
+using std::vector, std::string;
+using glm::ivec2, glm::fvec2, glm::fvec3, glm::fvec4;
+}
+
+constexpr float kPi = 3.14159265358979f;
+
+// Face order and orientation follows GL (GL_TEXTURE_CUBE_MAP_POSITIVE_X + face)
+struct CubeImage {
+  int size_ = 0;
+  vector<fvec3> data_; // face major, then row major
+
+  CubeImage() = default;
+  CubeImage(int size) : size_{size}, data_(6 * size * size) {}
+
+  fvec3& at(int face, int x, int y) { return data_[(face * size_ + y) * size_ + x]; }
+  const fvec3& at(int face, int x, int y) const { return data_[(face * size_ + y) * size_ + x]; }
+};
+
+struct HdrImage {
+  ivec2 size_ = {0, 0};
+  vector<fvec3> data_;
+};
+
+struct Prefiltered {
+  std::array<fvec3, 9> sh_ = {}; // irradiance E(n) = sum_i sh_[i] * Y_i(n) (cf. evaluateSH9)
+  vector<CubeImage> specular_;
+  int brdf_lut_size_ = 0;
+  vector<fvec2> brdf_lut_;       // (scale, bias) of F0 at (NdotV, roughness)
+};
+
+struct Params {
+  int source_size_ = 256;   // cubemap resampled from equirect
+  int specular_size_ = 128;
+  int num_levels_ = 6;
+  int num_samples_ = 128;   // per texel of specular
+  int brdf_lut_size_ = 32;
+  int brdf_lut_samples_ = 256;
+};
+
+inline HdrImage loadHdr(const string& filename) {
+  HdrImage result;
+  auto data = stbi_loadf(filename.data(), &result.size_.x, &result.size_.y, nullptr, 3);
+  TOY_ASSERT_CUSTOM(data, fmt::format("stbi_loadf failed: {}", filename));
+  result.data_.assign(reinterpret_cast<fvec3*>(data), reinterpret_cast<fvec3*>(data) + result.size_.x * result.size_.y);
+  stbi_image_free(data);
+  return result;
+}
+
+//
+// Direction <-> texel
+//
+
+// (cf. "Cube Map Texture Selection" in GL spec)
+inline fvec3 getCubeDirection(int face, float s, float t) {
+  switch (face) {
+    case 0: return { 1, -t, -s};
+    case 1: return {-1, -t,  s};
+    case 2: return { s,  1,  t};
+    case 3: return { s, -1, -t};
+    case 4: return { s, -t,  1};
+    default: return {-s, -t, -1};
+  }
+}
+
+// Direction of texel center (not normalized)
+inline fvec3 getTexelDirection(int face, int x, int y, int size) {
+  return getCubeDirection(face, 2 * (x + 0.5f) / size - 1, 2 * (y + 0.5f) / size - 1);
+}
+
+// Returns face and (s, t) in [-1, 1]
+inline int getCubeFace(fvec3 d, float& s, float& t) {
+  fvec3 a = glm::abs(d);
+  if (a.x >= a.y && a.x >= a.z) {
+    s = (d.x > 0 ? -d.z : d.z) / a.x; t = -d.y / a.x;
+    return d.x > 0 ? 0 : 1;
+  }
+  if (a.y >= a.z) {
+    s = d.x / a.y; t = (d.y > 0 ? d.z : -d.z) / a.y;
+    return d.y > 0 ? 2 : 3;
+  }
+  s = (d.z > 0 ? d.x : -d.x) / a.z; t = -d.y / a.z;
+  return d.z > 0 ? 4 : 5;
+}
+
+// Solid angle of texel (cf. https://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/)
+inline float getTexelSolidAngle(int x, int y, int size) {
+  auto area = [](float s, float t) { return std::atan2(s * t, std::sqrt(s * s + t * t + 1)); };
+  float s0 = 2.f * x / size - 1, s1 = 2.f * (x + 1) / size - 1;
+  float t0 = 2.f * y / size - 1, t1 = 2.f * (y + 1) / size - 1;
+  return area(s0, t0) - area(s0, t1) - area(s1, t0) + area(s1, t1);
+}
+
+// Bilinear within face (clamped at face edges)
+inline fvec3 sampleFace(const CubeImage& image, int face, float s, float t) {
+  int n = image.size_;
+  float x = std::clamp((s + 1) / 2 * n - 0.5f, 0.f, n - 1.f);
+  float y = std::clamp((t + 1) / 2 * n - 0.5f, 0.f, n - 1.f);
+  int x0 = x, y0 = y;
+  int x1 = std::min(x0 + 1, n - 1), y1 = std::min(y0 + 1, n - 1);
+  float fx = x - x0, fy = y - y0;
+  return glm::mix(
+      glm::mix(image.at(face, x0, y0), image.at(face, x1, y0), fx),
+      glm::mix(image.at(face, x0, y1), image.at(face, x1, y1), fx), fy);
+}
+
+// Bilinear with horizontal wrap (+y is up, -z is the center of image)
+inline fvec3 sampleEquirect(const HdrImage& image, fvec3 d) {
+  d = glm::normalize(d);
+  float u = std::atan2(d.x, -d.z) / (2 * kPi) + 0.5f;
+  float v = std::acos(std::clamp(d.y, -1.f, 1.f)) / kPi;
+  ivec2 n = image.size_;
+  float x = u * n.x - 0.5f, y = std::clamp(v * n.y - 0.5f, 0.f, n.y - 1.f);
+  int x0 = std::floor(x), y0 = y;
+  int y1 = std::min(y0 + 1, n.y - 1);
+  float fx = x - x0, fy = y - y0;
+  auto at = [&](int i, int j) { return image.data_[j * n.x + ((i % n.x) + n.x) % n.x]; };
+  return glm::mix(glm::mix(at(x0, y0), at(x0 + 1, y0), fx), glm::mix(at(x0, y1), at(x0 + 1, y1), fx), fy);
+}
+
+//
+// Cubemap construction
+//
+
+inline CubeImage equirectToCube(const HdrImage& image, int size) {
+  CubeImage result{size};
+  utils::parallelFor(0, 6 * size, [&](size_t i) {
+    int face = i / size, y = i % size;
+    for (auto x : utils::Range{size}) {
+      result.at(face, x, y) = sampleEquirect(image, getTexelDirection(face, x, y, size));
+    }
+  }, utils::getNumThreads(6 * size * size));
+  return result;
+}
+
+inline CubeImage downsample(const CubeImage& image) {
+  CubeImage result{std::max(image.size_ / 2, 1)};
+  for (auto face : utils::Range{6}) {
+    for (auto y : utils::Range{result.size_}) {
+      for (auto x : utils::Range{result.size_}) {
+        result.at(face, x, y) = (
+            image.at(face, 2 * x, 2 * y) + image.at(face, 2 * x + 1, 2 * y) +
+            image.at(face, 2 * x, 2 * y + 1) + image.at(face, 2 * x + 1, 2 * y + 1)) / 4.f;
+      }
+    }
+  }
+  return result;
+}
+
+inline vector<CubeImage> generateMipChain(CubeImage image) {
+  vector<CubeImage> result;
+  result.push_back(std::move(image));
+  while (result.back().size_ > 1) {
+    result.push_back(downsample(result.back()));
+  }
+  return result;
+}
+
+//
+// Diffuse
+//
+
+inline std::array<float, 9> getSH9Basis(fvec3 n) {
+  return {
+    0.282095f,
+    0.488603f * n.y, 0.488603f * n.z, 0.488603f * n.x,
+    1.092548f * n.x * n.y, 1.092548f * n.y * n.z, 0.315392f * (3 * n.z * n.z - 1),
+    1.092548f * n.x * n.z, 0.546274f * (n.x * n.x - n.y * n.y),
+  };
+}
+
+inline fvec3 evaluateSH9(const std::array<fvec3, 9>& sh, fvec3 n) {
+  auto basis = getSH9Basis(n);
+  fvec3 result{0};
+  for (auto i : utils::Range{9}) { result += sh[i] * basis[i]; }
+  return result;
+}
+
+// Project radiance to SH9 and convolve with clamped cosine (i.e. multiply by A_l = pi, 2pi/3, pi/4)
+inline std::array<fvec3, 9> computeIrradianceSH9(const CubeImage& image) {
+  std::array<std::array<fvec3, 9>, 6> per_face = {};
+  utils::parallelFor(0, 6, [&](size_t face) {
+    auto& sh = per_face[face];
+    for (auto y : utils::Range{image.size_}) {
+      for (auto x : utils::Range{image.size_}) {
+        auto basis = getSH9Basis(glm::normalize(getTexelDirection(face, x, y, image.size_)));
+        fvec3 radiance = image.at(face, x, y) * getTexelSolidAngle(x, y, image.size_);
+        for (auto i : utils::Range{9}) { sh[i] += radiance * basis[i]; }
+      }
+    }
+  }, utils::getNumThreads(6 * image.size_ * image.size_));
+  std::array<fvec3, 9> result = {};
+  constexpr float kBand[9] = {kPi, 2 * kPi / 3, 2 * kPi / 3, 2 * kPi / 3, kPi / 4, kPi / 4, kPi / 4, kPi / 4, kPi / 4};
+  for (auto& sh : per_face) {
+    for (auto i : utils::Range{9}) { result[i] += sh[i] * kBand[i]; }
+  }
+  return result;
+}
+
+//
+// Specular
+//
+
+inline float radicalInverse(uint32_t bits) {
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return float(bits) * 2.3283064365386963e-10f; // / 0x100000000
+}
+
+inline fvec2 hammersley(uint32_t i, uint32_t n) {
+  return {float(i) / n, radicalInverse(i)};
+}
+
+// Half vector in tangent space (z = normal) distributed by GGX's D * NdotH
+inline fvec3 importanceSampleGGX(fvec2 xi, float roughness) {
+  float a = roughness * roughness;
+  float phi = 2 * kPi * xi.x;
+  float cos_theta = std::sqrt((1 - xi.y) / (1 + (a * a - 1) * xi.y));
+  float sin_theta = std::sqrt(1 - cos_theta * cos_theta);
+  return {sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta};
+}
+
+inline float distributionGGX(float NdotH, float roughness) {
+  float a2 = std::pow(roughness, 4.f);
+  float d = NdotH * NdotH * (a2 - 1) + 1;
+  return a2 / (kPi * d * d);
+}
+
+// Tangent space light directions (assuming N = V = R) with weight (NdotL) and source mip (by pdf)
+struct SampleSet {
+  vector<float> x_, y_, z_, lod_; // (padded to multiple of 4 by zero weight)
+  float total_weight_ = 0;
+};
+
+inline SampleSet makeSampleSet(float roughness, int num_samples, int source_size) {
+  SampleSet result;
+  for (auto i : utils::Range{num_samples}) {
+    fvec3 h = importanceSampleGGX(hammersley(i, num_samples), roughness);
+    fvec3 l = 2 * h.z * h - fvec3{0, 0, 1};
+    if (l.z <= 0) { continue; }
+    // pdf = D * NdotH / (4 * VdotH) = D / 4, then texel's solid angle vs sample's one
+    float pdf = distributionGGX(h.z, roughness) / 4;
+    float omega_s = 1 / (num_samples * pdf + 1e-6f);
+    float omega_p = 4 * kPi / (6 * source_size * source_size);
+    result.x_.push_back(l.x);
+    result.y_.push_back(l.y);
+    result.z_.push_back(l.z);
+    result.lod_.push_back(std::max(0.5f * std::log2(omega_s / omega_p) + 1, 0.f));
+    result.total_weight_ += l.z;
+  }
+  while (result.z_.size() % 4) {
+    result.x_.push_back(0); result.y_.push_back(0); result.z_.push_back(0); result.lod_.push_back(0);
+  }
+  return result;
+}
+
+// Weighted sum of source samples around `n` (four samples at once when SSE2)
+inline fvec3 prefilterTexel(const vector<CubeImage>& source, const SampleSet& samples, fvec3 n) {
+  fvec3 up = std::abs(n.z) < 0.999f ? fvec3{0, 0, 1} : fvec3{1, 0, 0};
+  fvec3 tx = glm::normalize(glm::cross(up, n));
+  fvec3 ty = glm::cross(n, tx);
+  int max_level = source.size() - 1;
+  fvec3 result{0};
+  auto fetch = [&](fvec3 d, float weight, float lod) {
+    float s, t;
+    int face = getCubeFace(d, s, t);
+    int level = std::min(int(lod + 0.5f), max_level);
+    result += sampleFace(source[level], face, s, t) * weight;
+  };
+
+  size_t i = 0, num = samples.z_.size();
+#ifdef TOY_SSE2
+  auto splat = [](float v) { return _mm_set1_ps(v); };
+  __m128 tx_x = splat(tx.x), tx_y = splat(tx.y), tx_z = splat(tx.z);
+  __m128 ty_x = splat(ty.x), ty_y = splat(ty.y), ty_z = splat(ty.z);
+  __m128 n_x = splat(n.x), n_y = splat(n.y), n_z = splat(n.z);
+  for (; i + 4 <= num; i += 4) {
+    __m128 lx = _mm_loadu_ps(&samples.x_[i]), ly = _mm_loadu_ps(&samples.y_[i]), lz = _mm_loadu_ps(&samples.z_[i]);
+    auto transform = [&](__m128 a, __m128 b, __m128 c) {
+      return _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, a), _mm_mul_ps(ly, b)), _mm_mul_ps(lz, c));
+    };
+    float dx[4], dy[4], dz[4];
+    _mm_storeu_ps(dx, transform(tx_x, ty_x, n_x));
+    _mm_storeu_ps(dy, transform(tx_y, ty_y, n_y));
+    _mm_storeu_ps(dz, transform(tx_z, ty_z, n_z));
+    for (auto k : utils::Range{4}) {
+      if (samples.z_[i + k] > 0) { fetch({dx[k], dy[k], dz[k]}, samples.z_[i + k], samples.lod_[i + k]); }
+    }
+  }
+#endif
+  for (; i < num; i++) {
+    if (samples.z_[i] > 0) {
+      fetch(samples.x_[i] * tx + samples.y_[i] * ty + samples.z_[i] * n, samples.z_[i], samples.lod_[i]);
+    }
+  }
+  return result / samples.total_weight_;
+}
+
+inline vector<CubeImage> prefilterSpecular(const vector<CubeImage>& source, const Params& params) {
+  vector<CubeImage> result;
+  for (auto level : utils::Range{params.num_levels_}) {
+    int size = std::max(params.specular_size_ >> level, 1);
+    float roughness = float(level) / std::max(params.num_levels_ - 1, 1);
+    auto& dst = result.emplace_back(size);
+    if (level == 0) {
+      // mirror (i.e. same as source at this size)
+      auto it = std::find_if(source.begin(), source.end(), [&](auto& mip) { return mip.size_ == size; });
+      TOY_ASSERT(it != source.end());
+      dst = *it;
+      continue;
+    }
+    auto samples = makeSampleSet(roughness, params.num_samples_, source[0].size_);
+    utils::parallelFor(0, 6 * size, [&](size_t i) {
+      int face = i / size, y = i % size;
+      for (auto x : utils::Range{size}) {
+        dst.at(face, x, y) = prefilterTexel(source, samples, glm::normalize(getTexelDirection(face, x, y, size)));
+      }
+    }, utils::getNumThreads(size_t(6) * size * size * params.num_samples_)); // (coarse levels go serial)
+  }
+  return result;
+}
+
+// Split sum's second term as (scale, bias) of F0 (cf. Karis)
+inline vector<fvec2> computeBrdfLut(int size, int num_samples) {
+  vector<fvec2> result(size * size);
+  utils::parallelFor(0, size, [&](size_t j) {
+    float roughness = (j + 0.5f) / size;
+    float a = roughness * roughness;
+    float k = a / 2; // (Schlick-GGX's k for IBL)
+    auto g1 = [&](float NdotX) { return NdotX / (NdotX * (1 - k) + k); };
+    for (auto i : utils::Range{size}) {
+      float NdotV = (i + 0.5f) / size;
+      fvec3 v = {std::sqrt(1 - NdotV * NdotV), 0, NdotV};
+      fvec2 sum{0};
+      for (auto s : utils::Range{num_samples}) {
+        fvec3 h = importanceSampleGGX(hammersley(s, num_samples), roughness);
+        float VdotH = glm::dot(v, h);
+        fvec3 l = 2 * VdotH * h - v;
+        if (l.z <= 0) { continue; }
+        float G = g1(l.z) * g1(NdotV);
+        float G_vis = G * std::max(VdotH, 0.f) / (h.z * NdotV);
+        float Fc = std::pow(1 - std::max(VdotH, 0.f), 5.f);
+        sum += fvec2{(1 - Fc) * G_vis, Fc * G_vis};
+      }
+      result[j * size + i] = sum / float(num_samples);
+    }
+  }, utils::getNumThreads(size_t(size) * size * num_samples));
+  return result;
+}
+
+inline Prefiltered prefilter(const HdrImage& image, const Params& params) {
+  TOY_ASSERT(params.source_size_ % params.specular_size_ == 0);
+  auto source = generateMipChain(equirectToCube(image, params.source_size_));
+  Prefiltered result;
+  // (small mip is enough for low frequency)
+  auto it = std::find_if(source.begin(), source.end(), [](auto& mip) { return mip.size_ <= 32; });
+  result.sh_ = computeIrradianceSH9(*it);
+  result.specular_ = prefilterSpecular(source, params);
+  result.brdf_lut_size_ = params.brdf_lut_size_;
+  result.brdf_lut_ = computeBrdfLut(params.brdf_lut_size_, params.brdf_lut_samples_);
+  return result;
+}
+
+//
+// On disk cache
+// - header, SH, then specular levels (largest first) and BRDF LUT as raw floats
+// - `key` identifies source and parameters (cf. getCacheKey), and mismatch is treated as cache miss
+//
+
+struct PrefilteredHeader {
+  char magic_[8] = {'T', 'O', 'Y', 'I', 'B', 'L', 0, 1};
+  uint64_t key_ = 0;
+  int32_t specular_size_ = 0;
+  int32_t num_levels_ = 0;
+  int32_t brdf_lut_size_ = 0;
+};
+
+inline std::optional<uint64_t> getCacheKey(const string& filename, const Params& params) {
+  auto key = image::getCacheKey(filename);
+  if (!key) { return {}; }
+  return utils::hashFnv1a(&params, sizeof(params), *key);
+}
+
+inline std::filesystem::path getCachePath(uint64_t key) {
+  return utils::getCacheDirectory("ibl") / fmt::format("{:016x}.toyibl", key);
+}
+
+inline bool save(const std::filesystem::path& path, const Prefiltered& data, uint64_t key) {
+  PrefilteredHeader header;
+  header.key_ = key;
+  header.specular_size_ = data.specular_.empty() ? 0 : data.specular_[0].size_;
+  header.num_levels_ = data.specular_.size();
+  header.brdf_lut_size_ = data.brdf_lut_size_;
+
+  // Write to temporary then rename so that concurrent/interrupted writes don't leave broken cache
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream ofs{tmp_path, std::ios::binary};
+    if (!ofs) { return false; }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(reinterpret_cast<const char*>(data.sh_.data()), sizeof(data.sh_));
+    for (auto& level : data.specular_) {
+      ofs.write(reinterpret_cast<const char*>(level.data_.data()), level.data_.size() * sizeof(fvec3));
+    }
+    ofs.write(reinterpret_cast<const char*>(data.brdf_lut_.data()), data.brdf_lut_.size() * sizeof(fvec2));
+    if (!ofs) { return false; }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmp_path, path, error);
+  return !error;
+}
+
+inline std::optional<Prefiltered> load(const std::filesystem::path& path, uint64_t key) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs) { return {}; }
+  PrefilteredHeader header, expected;
+  ifs.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!ifs || !std::equal(header.magic_, header.magic_ + 8, expected.magic_) || header.key_ != key) {
+    return {};
+  }
+  Prefiltered result;
+  ifs.read(reinterpret_cast<char*>(result.sh_.data()), sizeof(result.sh_));
+  for (auto level : utils::Range{header.num_levels_}) {
+    auto& image = result.specular_.emplace_back(std::max(header.specular_size_ >> level, 1));
+    ifs.read(reinterpret_cast<char*>(image.data_.data()), image.data_.size() * sizeof(fvec3));
+  }
+  result.brdf_lut_size_ = header.brdf_lut_size_;
+  result.brdf_lut_.resize(header.brdf_lut_size_ * header.brdf_lut_size_);
+  ifs.read(reinterpret_cast<char*>(result.brdf_lut_.data()), result.brdf_lut_.size() * sizeof(fvec2));
+  if (!ifs) { return {}; }
+  return result;
+}
+
+// Prefiltered data of HDR file either from disk cache or freshly computed (then cached)
+inline Prefiltered loadOrPrefilter(const string& filename, const Params& params = {}) {
+  auto key = getCacheKey(filename, params);
+  if (!key) { return prefilter(loadHdr(filename), params); }
+  auto path = getCachePath(*key);
+  if (auto result = load(path, *key)) {
+    return *result;
+  }
+  auto result = prefilter(loadHdr(filename), params);
+  save(path, result, *key);
+  return result;
+}
+
+} // namespace ibl
+} // namespace toy
@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+
+#include "ibl.hpp"
+
+using namespace toy;
+using glm::fvec3;
+
+namespace {
+
+// Sky-ish gradient (bright upper hemisphere)
+ibl::HdrImage makeTestImage(glm::ivec2 size) {
+  ibl::HdrImage result;
+  result.size_ = size;
+  for (int y = 0; y < size.y; y++) {
+    for (int x = 0; x < size.x; x++) {
+      float v = 1 - float(y) / size.y;
+      result.data_.push_back(fvec3{0.2f, 0.3f, 0.5f} + 2 * v * v * fvec3{1, 1, 1});
+    }
+  }
+  return result;
+}
+
+}
+
+TEST(IBLTest, getCubeFace) {
+  for (auto face : utils::Range{6}) {
+    float s, t;
+    EXPECT_EQ(ibl::getCubeFace(ibl::getCubeDirection(face, 0.25, -0.5), s, t), face);
+    EXPECT_NEAR(s, 0.25, 1e-6);
+    EXPECT_NEAR(t, -0.5, 1e-6);
+  }
+  // Solid angles sum up to sphere
+  float total = 0;
+  for (auto i : utils::Range{8 * 8}) { total += 6 * ibl::getTexelSolidAngle(i % 8, i / 8, 8); }
+  EXPECT_NEAR(total, 4 * ibl::kPi, 1e-4);
+}
+
+TEST(IBLTest, computeIrradianceSH9) {
+  // Constant radiance L = 1 gives irradiance E = pi in every direction
+  ibl::CubeImage image{16};
+  std::fill(image.data_.begin(), image.data_.end(), fvec3{1});
+  auto sh = ibl::computeIrradianceSH9(image);
+  for (auto n : {fvec3{1, 0, 0}, fvec3{0, -1, 0}, glm::normalize(fvec3{1, 2, 3})}) {
+    EXPECT_NEAR(ibl::evaluateSH9(sh, n).x, ibl::kPi, 1e-3);
+  }
+
+  // Brighter upward
+  auto sky = ibl::computeIrradianceSH9(ibl::equirectToCube(makeTestImage({64, 32}), 16));
+  EXPECT_GT(ibl::evaluateSH9(sky, {0, 1, 0}).x, ibl::evaluateSH9(sky, {0, -1, 0}).x);
+}
+
+TEST(IBLTest, prefilterSpecular) {
+  // Constant stays constant at any roughness
+  ibl::CubeImage image{32};
+  std::fill(image.data_.begin(), image.data_.end(), fvec3{0.5});
+  ibl::Params params;
+  params.specular_size_ = 16;
+  params.num_levels_ = 4;
+  params.num_samples_ = 32;
+  auto result = ibl::prefilterSpecular(ibl::generateMipChain(image), params);
+  ASSERT_EQ(result.size(), 4);
+  EXPECT_EQ(result[3].size_, 2);
+  for (auto& level : result) {
+    for (auto& v : level.data_) {
+      ASSERT_NEAR(v.x, 0.5, 1e-4);
+    }
+  }
+}
+
+TEST(IBLTest, computeBrdfLut) {
+  int size = 16;
+  auto lut = ibl::computeBrdfLut(size, 128);
+  for (auto& v : lut) {
+    EXPECT_GE(v.x, 0);
+    EXPECT_GE(v.y, 0);
+    EXPECT_LE(v.x + v.y, 1.01);
+  }
+  // Smooth surface viewed from above reflects almost all (i.e. F0 * 1 + 0)
+  auto smooth = lut[size - 1];
+  EXPECT_GT(smooth.x, 0.9);
+  EXPECT_LT(smooth.y, 0.05);
+  // Fresnel at grazing angle
+  EXPECT_GT(lut[0].y, lut[size - 1].y);
+}
+
+TEST(IBLTest, cache) {
+  ibl::Params params;
+  params.source_size_ = 16;
+  params.specular_size_ = 8;
+  params.num_levels_ = 3;
+  params.num_samples_ = 16;
+  params.brdf_lut_size_ = 8;
+  params.brdf_lut_samples_ = 16;
+  auto data = ibl::prefilter(makeTestImage({32, 16}), params);
+  EXPECT_EQ(data.specular_.size(), 3);
+
+  auto path = std::filesystem::temp_directory_path() / "toy-3d-ibl_test.toyibl";
+  EXPECT_TRUE(ibl::save(path, data, 1234));
+  EXPECT_FALSE(ibl::load(path, 4321));
+  auto loaded = ibl::load(path, 1234);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->sh_, data.sh_);
+  ASSERT_EQ(loaded->specular_.size(), 3);
+  EXPECT_EQ(loaded->specular_[2].size_, 2);
+  EXPECT_EQ(loaded->specular_[2].data_, data.specular_[2].data_);
+  EXPECT_EQ(loaded->brdf_lut_, data.brdf_lut_);
+  std::filesystem::remove(path);
+}
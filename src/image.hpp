@@ -0,0 +1,173 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <stb_image.h>
+
+#include "utils.hpp" // (TOY_SSE2)
+
+//
+// CPU side image processing for texture upload
+// - RGBA8 only (sRGB encoded color + linear alpha)
+// - mip chain by box filter in linear space (i.e. gamma-correct, 3-tap weighted one along odd size)
+//
+
+namespace toy {
+namespace image {
+
+namespace {
+using std::vector, std::string;
+using glm::ivec2;
+}
+
+struct Image {
+  ivec2 size_ = {0, 0};
+  vector<uint8_t> data_; // RGBA8
+
+  Image() = default;
+  Image(ivec2 size) : size_{size}, data_(4 * size.x * size.y) {}
+
+  uint8_t* row(int y) { return &data_[4 * size_.x * y]; }
+  const uint8_t* row(int y) const { return &data_[4 * size_.x * y]; }
+};
+
+inline Image load(const string& filename) {
+  ivec2 size;
+  auto data = stbi_load(filename.data(), &size.x, &size.y, nullptr, 4);
+  TOY_ASSERT_CUSTOM(data, fmt::format("stbi_load failed: {}", filename));
+  Image result{size};
+  std::copy(data, data + result.data_.size(), result.data_.begin());
+  stbi_image_free(data);
+  return result;
+}
+
+inline float srgbToLinear(float c) {
+  return (c <= 0.04045f) ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+inline float linearToSrgb(float c) {
+  return (c <= 0.0031308f) ? c * 12.92f : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+}
+
+// Lookup tables so that per-texel conversion doesn't go through `std::pow`
+struct SrgbTable {
+  constexpr static int kEncodeSize = 4096;
+  std::array<float, 256> decode_;             // 8bit sRGB -> linear
+  std::array<uint8_t, kEncodeSize> encode_;   // quantized linear -> 8bit sRGB
+
+  SrgbTable() {
+    for (int i = 0; i < 256; i++) {
+      decode_[i] = srgbToLinear(i / 255.f);
+    }
+    for (int i = 0; i < kEncodeSize; i++) {
+      float c = linearToSrgb((i + 0.5f) / kEncodeSize);
+      encode_[i] = static_cast<uint8_t>(std::min(255.f, c * 255.f + 0.5f));
+    }
+  }
+
+  static const SrgbTable& get() {
+    static SrgbTable instance;
+    return instance;
+  }
+
+  uint8_t encode(float c) const {
+    int i = static_cast<int>(c * kEncodeSize);
+    return encode_[std::clamp(i, 0, kEncodeSize - 1)];
+  }
+};
+
+inline int getNumLevels(ivec2 size) {
+  int num_levels = 1;
+  for (int s = std::max(size.x, size.y); s > 1; s /= 2) { num_levels++; }
+  return num_levels;
+}
+
+inline ivec2 getLevelSize(ivec2 size, int level) {
+  return glm::max(ivec2{1, 1}, ivec2{size.x >> level, size.y >> level});
+}
+
+// Source texels and their weights covering `x`-th destination texel along an axis of `size` (-> max(size / 2, 1))
+// - even: 2 texels (box)
+// - odd (2 m + 1 -> m): 3 texels weighted by overlap with destination texel (which spans 2 + 1 / m source texels)
+//   so that no source texel is dropped and content isn't shifted
+// - 1: itself
+struct DownsampleTaps {
+  int index[3];
+  float weight[3];
+  int size;
+};
+
+inline DownsampleTaps getDownsampleTaps(int size, int x) {
+  if (size == 1) { return {{0, 0, 0}, {1, 0, 0}, 1}; }
+  if (size % 2 == 0) { return {{2 * x, 2 * x + 1, 0}, {0.5f, 0.5f, 0}, 2}; }
+  int m = size / 2;
+  float s = 1.f / size;
+  return {{2 * x, 2 * x + 1, 2 * x + 2}, {(m - x) * s, m * s, (x + 1) * s}, 3};
+}
+
+// Half size image by filtering in linear space (box for even size, 3-tap weighted box for odd size cf. DownsampleTaps)
+inline Image downsample(const Image& src, size_t num_threads = 0) {
+  auto& table = SrgbTable::get();
+  Image dst{glm::max(ivec2{1, 1}, src.size_ / 2)};
+  vector<DownsampleTaps> taps_x(dst.size_.x);
+  for (int x = 0; x < dst.size_.x; x++) {
+    taps_x[x] = getDownsampleTaps(src.size_.x, x);
+  }
+
+  utils::parallelFor(0, dst.size_.y, [&](size_t y) {
+    auto taps_y = getDownsampleTaps(src.size_.y, y);
+    uint8_t* out = dst.row(y);
+    for (int x = 0; x < dst.size_.x; x++) {
+      auto& tx = taps_x[x];
+      float sum[4];
+#ifdef TOY_SSE2
+      // (r, g, b, a) of each texel in single register
+      __m128 acc = _mm_setzero_ps();
+      for (int j = 0; j < taps_y.size; j++) {
+        const uint8_t* row = src.row(taps_y.index[j]);
+        for (int i = 0; i < tx.size; i++) {
+          const uint8_t* p = &row[4 * tx.index[i]];
+          __m128 texel = _mm_setr_ps(table.decode_[p[0]], table.decode_[p[1]], table.decode_[p[2]], p[3] / 255.f);
+          acc = _mm_add_ps(acc, _mm_mul_ps(texel, _mm_set1_ps(taps_y.weight[j] * tx.weight[i])));
+        }
+      }
+      _mm_storeu_ps(sum, acc);
+#else
+      sum[0] = sum[1] = sum[2] = sum[3] = 0;
+      for (int j = 0; j < taps_y.size; j++) {
+        const uint8_t* row = src.row(taps_y.index[j]);
+        for (int i = 0; i < tx.size; i++) {
+          const uint8_t* p = &row[4 * tx.index[i]];
+          float w = taps_y.weight[j] * tx.weight[i];
+          for (int c = 0; c < 3; c++) { sum[c] += w * table.decode_[p[c]]; }
+          sum[3] += w * p[3] / 255.f;
+        }
+      }
+#endif
+      for (int c = 0; c < 3; c++) {
+        out[4 * x + c] = table.encode(sum[c]);
+      }
+      out[4 * x + 3] = static_cast<uint8_t>(sum[3] * 255.f + 0.5f);
+    }
+  }, utils::getNumThreads(dst.size_.x * dst.size_.y, num_threads));
+  return dst;
+}
+
+// Full chain down to 1x1 (level 0 is `base` itself)
+// - each level depends on previous one, so parallelism is over rows within a level
+inline vector<Image> generateMipChain(Image base, size_t num_threads = 0) {
+  vector<Image> result;
+  int num_levels = getNumLevels(base.size_);
+  result.reserve(num_levels);
+  result.push_back(std::move(base));
+  for (int level = 1; level < num_levels; level++) {
+    result.push_back(downsample(result.back(), num_threads));
+  }
+  return result;
+}
+
+} // namespace image
+} // namespace toy
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <optional>
+
+#include "image.hpp"
+
+//
+// Block compression (BC1 = DXT1, BC3 = DXT5) for base color textures
+// - endpoints by "range fit" along principal axis of 4x4 block (cf. squish, stb_dxt)
+// - encoded as is from sRGB bytes, so upload as GL_COMPRESSED_SRGB_*
+// - on disk cache ("TOYBC" container) so that png decode/encode is skipped on next load
+//
+
+namespace toy {
+namespace image {
+
+enum struct BlockFormat : uint32_t { kBC1 = 1, kBC3 = 3 };
+
+inline size_t getBlockSize(BlockFormat format) {
+  return (format == BlockFormat::kBC1) ? 8 : 16;
+}
+
+inline ivec2 getNumBlocks(ivec2 size) {
+  return (size + ivec2{3, 3}) / 4;
+}
+
+struct CompressedImage {
+  ivec2 size_ = {0, 0};
+  BlockFormat format_ = BlockFormat::kBC1;
+  vector<vector<uint8_t>> levels_; // level i has getNumBlocks(getLevelSize(size_, i)) blocks
+};
+
+namespace bc {
+
+using Block = std::array<glm::u8vec4, 16>;
+
+inline uint16_t encode565(glm::fvec3 c) {
+  auto r = static_cast<uint16_t>(std::clamp(c.x * 31.f / 255.f + 0.5f, 0.f, 31.f));
+  auto g = static_cast<uint16_t>(std::clamp(c.y * 63.f / 255.f + 0.5f, 0.f, 63.f));
+  auto b = static_cast<uint16_t>(std::clamp(c.z * 31.f / 255.f + 0.5f, 0.f, 31.f));
+  return (r << 11) | (g << 5) | b;
+}
+
+inline glm::ivec3 decode565(uint16_t c) {
+  int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+  return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+}
+
+inline void writeLE(uint8_t* dst, uint64_t value, int num_bytes) {
+  for (int i = 0; i < num_bytes; i++) { dst[i] = (value >> (8 * i)) & 0xff; }
+}
+
+inline uint64_t readLE(const uint8_t* src, int num_bytes) {
+  uint64_t result = 0;
+  for (int i = 0; i < num_bytes; i++) { result |= uint64_t(src[i]) << (8 * i); }
+  return result;
+}
+
+inline std::array<glm::ivec3, 4> getPalette(uint16_t c0, uint16_t c1, bool four_color) {
+  auto p0 = decode565(c0), p1 = decode565(c1);
+  if (four_color) {
+    return {p0, p1, (2 * p0 + p1) / 3, (p0 + 2 * p1) / 3};
+  }
+  return {p0, p1, (p0 + p1) / 2, glm::ivec3{0, 0, 0}};
+}
+
+// Nearest palette entry for each texel, returns squared error
+// - endpoints are swapped if needed so that color0 > color1 i.e. 4 color mode
+inline int fitIndices(const Block& block, uint16_t& c0, uint16_t& c1, uint32_t& indices) {
+  if (c0 < c1) { std::swap(c0, c1); }
+  indices = 0;
+  auto palette = getPalette(c0, c1, c0 != c1);
+  int error = 0;
+  for (int i = 0; i < 16; i++) {
+    glm::ivec3 p{block[i]};
+    int best = 0, best_dist = INT32_MAX;
+    for (int k = 0; k < ((c0 != c1) ? 4 : 1); k++) {
+      glm::ivec3 d = p - palette[k];
+      int dist = d.x * d.x + d.y * d.y + d.z * d.z;
+      if (dist < best_dist) { best = k; best_dist = dist; }
+    }
+    indices |= best << (2 * i);
+    error += best_dist;
+  }
+  return error;
+}
+
+// 8 bytes: (color0, color1, 2bit x 16 indices)
+inline void encodeColorBlock(const Block& block, uint8_t* dst) {
+  using glm::fvec3;
+
+  // Principal axis by a few power iterations on covariance
+  fvec3 mean{0, 0, 0};
+  for (auto& p : block) { mean += fvec3{p}; }
+  mean /= 16.f;
+  glm::fmat3 cov{0};
+  for (auto& p : block) {
+    fvec3 d = fvec3{p} - mean;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) { cov[i][j] += d[i] * d[j]; }
+    }
+  }
+  fvec3 axis{1, 1, 1};
+  for (int i = 0; i < 8; i++) {
+    fvec3 next = cov * axis;
+    float l = glm::length(next);
+    if (l < 1e-6f) { break; }
+    axis = next / l;
+  }
+
+  // Range fit: extremal projections along the axis, then pull in a bit for better mid-points
+  float t_min = FLT_MAX, t_max = -FLT_MAX;
+  for (auto& p : block) {
+    float t = glm::dot(fvec3{p} - mean, axis);
+    t_min = std::min(t_min, t);
+    t_max = std::max(t_max, t);
+  }
+  float inset = (t_max - t_min) / 16.f;
+  uint16_t c0 = encode565(mean + axis * (t_max - inset));
+  uint16_t c1 = encode565(mean + axis * (t_min + inset));
+
+  // Refine endpoints once by least squares with indices fixed (keep it only when error decreases)
+  uint32_t indices;
+  int error = fitIndices(block, c0, c1, indices);
+  if (error > 0 && c0 != c1) {
+    constexpr float kWeights[4] = {1, 0, 2.f / 3, 1.f / 3}; // weight of c0 for each index
+    float aa = 0, bb = 0, ab = 0;
+    fvec3 ax{0, 0, 0}, bx{0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+      float a = kWeights[(indices >> (2 * i)) & 3], b = 1 - a;
+      aa += a * a; bb += b * b; ab += a * b;
+      ax += a * fvec3{block[i]}; bx += b * fvec3{block[i]};
+    }
+    float det = aa * bb - ab * ab;
+    if (std::abs(det) > 1e-6f) {
+      uint16_t d0 = encode565((ax * bb - bx * ab) / det);
+      uint16_t d1 = encode565((bx * aa - ax * ab) / det);
+      uint32_t refined_indices;
+      if (d0 != d1 && fitIndices(block, d0, d1, refined_indices) < error) {
+        c0 = d0; c1 = d1; indices = refined_indices;
+      }
+    }
+  }
+  writeLE(dst + 0, c0, 2);
+  writeLE(dst + 2, c1, 2);
+  writeLE(dst + 4, indices, 4);
+}
+
+// `force_four_color` for BC3 where color block is always interpreted as 4 colors
+inline void decodeColorBlock(const uint8_t* src, Block& block, bool force_four_color) {
+  auto c0 = static_cast<uint16_t>(readLE(src + 0, 2));
+  auto c1 = static_cast<uint16_t>(readLE(src + 2, 2));
+  auto indices = static_cast<uint32_t>(readLE(src + 4, 4));
+  bool four_color = force_four_color || c0 > c1;
+  auto palette = getPalette(c0, c1, four_color);
+  for (int i = 0; i < 16; i++) {
+    int k = (indices >> (2 * i)) & 3;
+    glm::ivec3 c = palette[k];
+    block[i] = {c.x, c.y, c.z, (!four_color && k == 3) ? 0 : 255};
+  }
+}
+
+// 8 bytes: (alpha0, alpha1, 3bit x 16 indices) with alpha0 > alpha1 i.e. 8 alpha mode
+inline void encodeAlphaBlock(const Block& block, uint8_t* dst) {
+  int a0 = 0, a1 = 255;
+  for (auto& p : block) {
+    a0 = std::max<int>(a0, p.w);
+    a1 = std::min<int>(a1, p.w);
+  }
+  uint64_t indices = 0;
+  if (a0 != a1) {
+    for (int i = 0; i < 16; i++) {
+      // Nearest of 8 evenly spaced values (index 0 = a0, 1 = a1, 2..7 = inbetween from a0 to a1)
+      int step = (7 * (a0 - block[i].w) + (a0 - a1) / 2) / (a0 - a1);
+      uint64_t index = (step == 0) ? 0 : (step == 7) ? 1 : step + 1;
+      indices |= index << (3 * i);
+    }
+  }
+  dst[0] = a0;
+  dst[1] = a1;
+  writeLE(dst + 2, indices, 6);
+}
+
+inline void decodeAlphaBlock(const uint8_t* src, Block& block) {
+  int a0 = src[0], a1 = src[1];
+  std::array<int, 8> palette = {a0, a1};
+  for (int i = 2; i < 8; i++) {
+    palette[i] = (a0 > a1) ? ((8 - i) * a0 + (i - 1) * a1) / 7 : (i < 6) ? ((6 - i) * a0 + (i - 1) * a1) / 5 : (i == 6) ? 0 : 255;
+  }
+  uint64_t indices = readLE(src + 2, 6);
+  for (int i = 0; i < 16; i++) {
+    block[i].w = palette[(indices >> (3 * i)) & 7];
+  }
+}
+
+// Edge texels are repeated for partial blocks
+inline void fetchBlock(const Image& image, ivec2 block_xy, Block& block) {
+  for (int y = 0; y < 4; y++) {
+    const uint8_t* row = image.row(std::min(4 * block_xy.y + y, image.size_.y - 1));
+    for (int x = 0; x < 4; x++) {
+      const uint8_t* p = &row[4 * std::min(4 * block_xy.x + x, image.size_.x - 1)];
+      block[4 * y + x] = {p[0], p[1], p[2], p[3]};
+    }
+  }
+}
+
+inline void storeBlock(Image& image, ivec2 block_xy, const Block& block) {
+  for (int y = 0; y < 4 && 4 * block_xy.y + y < image.size_.y; y++) {
+    uint8_t* row = image.row(4 * block_xy.y + y);
+    for (int x = 0; x < 4 && 4 * block_xy.x + x < image.size_.x; x++) {
+      auto& p = block[4 * y + x];
+      std::copy(&p.x, &p.x + 4, &row[4 * (4 * block_xy.x + x)]);
+    }
+  }
+}
+
+} // namespace bc
+
+inline bool hasAlpha(const Image& image) {
+  for (size_t i = 3; i < image.data_.size(); i += 4) {
+    if (image.data_[i] != 255) { return true; }
+  }
+  return false;
+}
+
+inline vector<uint8_t> compress(const Image& image, BlockFormat format, size_t num_threads = 0) {
+  ivec2 num_blocks = getNumBlocks(image.size_);
+  size_t block_size = getBlockSize(format);
+  vector<uint8_t> result(num_blocks.x * num_blocks.y * block_size);
+  utils::parallelFor(0, num_blocks.y, [&](size_t by) {
+    bc::Block block;
+    for (int bx = 0; bx < num_blocks.x; bx++) {
+      uint8_t* dst = &result[(by * num_blocks.x + bx) * block_size];
+      bc::fetchBlock(image, {bx, by}, block);
+      if (format == BlockFormat::kBC3) {
+        bc::encodeAlphaBlock(block, dst);
+        dst += 8;
+      }
+      bc::encodeColorBlock(block, dst);
+    }
+  }, utils::getNumThreads(16 * num_blocks.x * num_blocks.y, num_threads));
+  return result;
+}
+
+inline Image decompress(const uint8_t* data, ivec2 size, BlockFormat format) {
+  Image result{size};
+  ivec2 num_blocks = getNumBlocks(size);
+  size_t block_size = getBlockSize(format);
+  bc::Block block;
+  for (int by = 0; by < num_blocks.y; by++) {
+    for (int bx = 0; bx < num_blocks.x; bx++) {
+      const uint8_t* src = &data[(by * num_blocks.x + bx) * block_size];
+      if (format == BlockFormat::kBC3) {
+        bc::decodeColorBlock(src + 8, block, true);
+        bc::decodeAlphaBlock(src, block);
+      } else {
+        bc::decodeColorBlock(src, block, false);
+      }
+      bc::storeBlock(result, {bx, by}, block);
+    }
+  }
+  return result;
+}
+
+// BC1 when fully opaque, otherwise BC3
+inline CompressedImage compress(const vector<Image>& mips, size_t num_threads = 0) {
+  TOY_ASSERT(!mips.empty());
+  CompressedImage result;
+  result.size_ = mips[0].size_;
+  result.format_ = hasAlpha(mips[0]) ? BlockFormat::kBC3 : BlockFormat::kBC1;
+  for (auto& mip : mips) {
+    result.levels_.push_back(compress(mip, result.format_, num_threads));
+  }
+  return result;
+}
+
+inline float computePSNR(const Image& a, const Image& b) {
+  TOY_ASSERT(a.size_ == b.size_);
+  double squared_error = 0;
+  for (size_t i = 0; i < a.data_.size(); i++) {
+    double d = double(a.data_[i]) - double(b.data_[i]);
+    squared_error += d * d;
+  }
+  double mse = squared_error / a.data_.size();
+  if (mse == 0) { return INFINITY; }
+  return 10 * std::log10(255.0 * 255.0 / mse);
+}
+
+//
+// On disk cache
+// - header, then (byte size, bytes) for each level
+// - `key` identifies source (cf. getCacheKey) and mismatch is treated as cache miss
+//
+
+struct CompressedImageHeader {
+  char magic_[8] = {'T', 'O', 'Y', 'B', 'C', 0, 0, 1};
+  uint64_t key_ = 0;
+  uint32_t format_ = 0;
+  int32_t width_ = 0, height_ = 0;
+  uint32_t num_levels_ = 0;
+};
+
+// From filename, file size and modification time (+ format version via header magic)
+// - nullopt when file can't be stat-ed, which callers treat as cache miss (and don't save)
+inline std::optional<uint64_t> getCacheKey(const string& filename) {
+  std::error_code error;
+  auto size = std::filesystem::file_size(filename, error);
+  if (error) { return {}; }
+  auto time = std::filesystem::last_write_time(filename, error).time_since_epoch().count();
+  if (error) { return {}; }
+  uint64_t key = utils::hashFnv1a(filename);
+  key = utils::hashFnv1a(&size, sizeof(size), key);
+  key = utils::hashFnv1a(&time, sizeof(time), key);
+  return key;
+}
+
+inline std::filesystem::path getCachePath(uint64_t key) {
+  return utils::getCacheDirectory("textures") / fmt::format("{:016x}.toybc", key);
+}
+
+inline bool save(const std::filesystem::path& path, const CompressedImage& image, uint64_t key) {
+  CompressedImageHeader header;
+  header.key_ = key;
+  header.format_ = static_cast<uint32_t>(image.format_);
+  header.width_ = image.size_.x;
+  header.height_ = image.size_.y;
+  header.num_levels_ = image.levels_.size();
+
+  // Write to temporary then rename so that concurrent/interrupted writes don't leave broken cache
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream ofs{tmp_path, std::ios::binary};
+    if (!ofs) { return false; }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto& level : image.levels_) {
+      uint32_t size = level.size();
+      ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+      ofs.write(reinterpret_cast<const char*>(level.data()), size);
+    }
+    if (!ofs) { return false; }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmp_path, path, error);
+  return !error;
+}
+
+inline std::optional<CompressedImage> load(const std::filesystem::path& path, uint64_t key) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs) { return {}; }
+  CompressedImageHeader header, expected;
+  ifs.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!ifs || !std::equal(header.magic_, header.magic_ + 8, expected.magic_) || header.key_ != key) {
+    return {};
+  }
+  CompressedImage result;
+  result.size_ = {header.width_, header.height_};
+  result.format_ = static_cast<BlockFormat>(header.format_);
+  if (header.num_levels_ != static_cast<uint32_t>(getNumLevels(result.size_))) { return {}; }
+  for (int i = 0; i < static_cast<int>(header.num_levels_); i++) {
+    ivec2 num_blocks = getNumBlocks(getLevelSize(result.size_, i));
+    uint32_t size = 0;
+    ifs.read(reinterpret_cast<char*>(&size), sizeof(size));
+    if (!ifs || size != num_blocks.x * num_blocks.y * getBlockSize(result.format_)) { return {}; }
+    auto& level = result.levels_.emplace_back(size);
+    ifs.read(reinterpret_cast<char*>(level.data()), size);
+  }
+  if (!ifs) { return {}; }
+  return result;
+}
+
+} // namespace image
+} // namespace toy
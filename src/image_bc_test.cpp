@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "image_bc.hpp"
+
+using namespace toy;
+
+namespace {
+
+// Smooth gradient + some noise-like pattern (roughly what photo/painted texture looks like)
+image::Image makeTestImage(glm::ivec2 size, bool alpha) {
+  image::Image result{size};
+  for (int y = 0; y < size.y; y++) {
+    for (int x = 0; x < size.x; x++) {
+      uint8_t* p = &result.row(y)[4 * x];
+      p[0] = 255 * x / size.x;
+      p[1] = 255 * y / size.y;
+      p[2] = 128 + 64 * std::sin(0.3 * x) * std::cos(0.2 * y);
+      p[3] = alpha ? 255 * (x + y) / (size.x + size.y) : 255;
+    }
+  }
+  return result;
+}
+
+}
+
+TEST(ImageBCTest, BC1) {
+  auto src = makeTestImage({64, 32}, false);
+  auto data = image::compress(src, image::BlockFormat::kBC1);
+  EXPECT_EQ(data.size(), 16 * 8 * 8);
+  auto dst = image::decompress(data.data(), src.size_, image::BlockFormat::kBC1);
+  EXPECT_GT(image::computePSNR(src, dst), 33);
+}
+
+TEST(ImageBCTest, BC3) {
+  auto src = makeTestImage({64, 32}, true);
+  auto data = image::compress(src, image::BlockFormat::kBC3);
+  EXPECT_EQ(data.size(), 16 * 8 * 16);
+  auto dst = image::decompress(data.data(), src.size_, image::BlockFormat::kBC3);
+  EXPECT_GT(image::computePSNR(src, dst), 33);
+}
+
+TEST(ImageBCTest, partial_block) {
+  // Non multiple of 4 and solid color (which should be exact up to 565 quantization)
+  image::Image src{{6, 3}};
+  for (size_t i = 0; i < src.data_.size(); i += 4) {
+    src.data_[i + 0] = 255; src.data_[i + 1] = 0; src.data_[i + 2] = 132; src.data_[i + 3] = 255;
+  }
+  auto data = image::compress(src, image::BlockFormat::kBC1);
+  EXPECT_EQ(data.size(), 2 * 8);
+  auto dst = image::decompress(data.data(), src.size_, image::BlockFormat::kBC1);
+  EXPECT_EQ(dst.row(2)[4 * 5 + 0], 255);
+  EXPECT_EQ(dst.row(2)[4 * 5 + 1], 0);
+  EXPECT_NEAR(dst.row(2)[4 * 5 + 2], 132, 4);
+}
+
+TEST(ImageBCTest, cache) {
+  auto mips = image::generateMipChain(makeTestImage({20, 12}, true));
+  auto compressed = image::compress(mips);
+  EXPECT_EQ(compressed.format_, image::BlockFormat::kBC3);
+  EXPECT_EQ(compressed.levels_.size(), 5);
+
+  auto path = std::filesystem::temp_directory_path() / "toy-3d-image_bc_test.toybc";
+  EXPECT_TRUE(image::save(path, compressed, 1234));
+  EXPECT_FALSE(image::load(path, 4321));
+  auto loaded = image::load(path, 1234);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->size_, compressed.size_);
+  EXPECT_EQ(loaded->levels_, compressed.levels_);
+
+  // Key changes with file's size and is unavailable when file doesn't exist
+  auto key = image::getCacheKey(path.string());
+  ASSERT_TRUE(key);
+  EXPECT_TRUE(image::save(path, image::compress({mips[1]}), 1234)); // (smaller)
+  EXPECT_NE(image::getCacheKey(path.string()), key);
+  std::filesystem::remove(path);
+  EXPECT_FALSE(image::getCacheKey(path.string()));
+}
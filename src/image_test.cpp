@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+
+#include "image.hpp"
+
+using namespace toy;
+
+TEST(ImageTest, getNumLevels) {
+  EXPECT_EQ(image::getNumLevels({1, 1}), 1);
+  EXPECT_EQ(image::getNumLevels({256, 256}), 9);
+  EXPECT_EQ(image::getNumLevels({300, 17}), 9);
+  EXPECT_EQ(image::getLevelSize({300, 17}, 5), (glm::ivec2{9, 1}));
+}
+
+TEST(ImageTest, SrgbTable) {
+  auto& table = image::SrgbTable::get();
+  for (int i = 0; i < 256; i++) {
+    EXPECT_EQ(table.encode(table.decode_[i]), i);
+  }
+}
+
+TEST(ImageTest, downsample) {
+  {
+    // Black/white checker averages to 50% linear intensity (i.e. not 128 in sRGB)
+    image::Image src{{4, 2}};
+    for (int y = 0; y < 2; y++) {
+      for (int x = 0; x < 4; x++) {
+        uint8_t v = ((x + y) % 2) ? 255 : 0;
+        uint8_t* p = &src.row(y)[4 * x];
+        p[0] = p[1] = p[2] = v;
+        p[3] = v;
+      }
+    }
+    image::Image dst = image::downsample(src, 1);
+    EXPECT_EQ(dst.size_, (glm::ivec2{2, 1}));
+    EXPECT_EQ(dst.row(0)[0], 188);
+    EXPECT_EQ(dst.row(0)[3], 128); // alpha is linear
+  }
+  {
+    // Odd size takes every texel weighted by overlap (3 -> 1 is plain average, 5 -> 2 is (2, 2, 1) and (1, 2, 2) / 5)
+    image::Image src{{3, 3}};
+    std::fill(src.data_.begin(), src.data_.end(), 0);
+    src.row(2)[4 * 2 + 3] = 255; // (alpha of corner texel)
+    auto mips = image::generateMipChain(src);
+    EXPECT_EQ(mips.size(), 2);
+    EXPECT_EQ(mips[1].size_, (glm::ivec2{1, 1}));
+    EXPECT_EQ(mips[1].data_[3], 28); // 255 / 9
+
+    image::Image row{{5, 1}};
+    std::fill(row.data_.begin(), row.data_.end(), 0);
+    row.row(0)[4 * 4 + 3] = 255;
+    row.row(0)[4 * 0 + 0] = 255; // (red of first texel: 2/5 linear)
+    image::Image dst = image::downsample(row, 1);
+    EXPECT_EQ(dst.size_, (glm::ivec2{2, 1}));
+    EXPECT_EQ(dst.row(0)[0], image::SrgbTable::get().encode(0.4f));
+    EXPECT_EQ(dst.row(0)[3], 0);
+    EXPECT_EQ(dst.row(0)[4 + 0], 0);
+    EXPECT_EQ(dst.row(0)[4 + 3], 102); // 255 * 2 / 5
+  }
+}
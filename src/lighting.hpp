@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "utils.hpp"
+
+//
+// Clustered light culling (cf. SceneRenderer in scene_example.cpp)
+// - view frustum is split into clusters i.e. screen tiles (x, y) times exponential depth slices (z)
+// - each light (sphere or cone in view space) is tested only against clusters within its screen/depth range,
+//   four clusters of a row at once (clusters' bounds are kept as SoA)
+// - result is a flat list of light indices per cluster (offset, count) so that
+//   fragment shader only evaluates lights affecting its cluster
+//
+// cf. Olsson et al., "Clustered Deferred and Forward Shading"
+//     https://github.com/KhronosGroup/glTF/blob/master/extensions/2.0/Khronos/KHR_lights_punctual/README.md
+//
+
+namespace toy {
+namespace lighting {
+
+namespace {
+using std::vector;
+using glm::ivec3, glm::uvec2, glm::fvec3, glm::fvec4, glm::fmat4;
+}
+
+enum LightType : int { kDirectional = 0, kPoint = 1, kSpot = 2 };
+
+// What shader reads per light (4 texels of RGBA32F texture buffer)
+struct LightData {
+  fvec4 position;  // (view space position, range) where range is 0 for directional
+  fvec4 direction; // (view space direction where light travels, type)
+  fvec4 color;     // (color * intensity, -)
+  fvec4 spot;      // (angle scale, angle offset, cos outer, sin outer)
+
+  LightType getType() const { return LightType(int(direction.w)); }
+};
+
+// Range where light becomes negligible when range is not given (i.e. intensity / d^2 < kRangeThreshold)
+constexpr float kRangeThreshold = 1.f / 256;
+
+inline float getEffectiveRange(float range, fvec3 color, float intensity) {
+  if (range > 0) { return range; }
+  return std::sqrt(std::max(color.x, std::max(color.y, color.z)) * intensity / kRangeThreshold);
+}
+
+inline LightData makeLightData(
+    LightType type, fvec3 position, fvec3 direction, fvec3 color, float intensity,
+    float range, float inner_cone_angle, float outer_cone_angle) {
+  LightData result;
+  result.position = fvec4{position, type == kDirectional ? 0 : getEffectiveRange(range, color, intensity)};
+  result.direction = fvec4{glm::normalize(direction), type};
+  result.color = fvec4{color * intensity, 0};
+  // cf. "Inner and Outer Cone Angles" in KHR_lights_punctual
+  float cos_outer = std::cos(outer_cone_angle);
+  float scale = 1 / std::max(0.001f, std::cos(inner_cone_angle) - cos_outer);
+  result.spot = fvec4{scale, -cos_outer * scale, cos_outer, std::sin(outer_cone_angle)};
+  return result;
+}
+
+// Squared distance between point and box (0 if inside)
+inline float distance2_Point_AABB(fvec3 p, fvec3 lo, fvec3 hi) {
+  fvec3 d = glm::max(glm::max(lo - p, p - hi), fvec3{0});
+  return glm::dot(d, d);
+}
+
+// Conservative cone vs sphere (cf. Bart Wronski, "Cull that cone!")
+inline bool intersect_Cone_Sphere(
+    fvec3 tip, fvec3 dir, float range, float cos_angle, float sin_angle, fvec3 center, float radius) {
+  fvec3 v = center - tip;
+  float v_len2 = glm::dot(v, v);
+  float v1_len = glm::dot(v, dir);
+  float distance = cos_angle * std::sqrt(std::max(v_len2 - v1_len * v1_len, 0.f)) - v1_len * sin_angle;
+  return !(distance > radius || v1_len > radius + range || v1_len < -radius);
+}
+
+struct ClusterGrid {
+  constexpr static int kMaxLightsPerCluster = 128;
+
+  // Parameters (bounds are recomputed only when changed)
+  ivec3 dims_ = {16, 9, 24};
+  float near_ = 0.1, far_ = 1000; // depth range of slices (clamped outside)
+  fmat4 projection_ = fmat4{1};   // view -> clip
+
+  // View space bounds of each cluster (index = (z * dims.y + y) * dims.x + x)
+  vector<float> lo_x_, lo_y_, lo_z_, hi_x_, hi_y_, hi_z_; // AABB
+  vector<float> c_x_, c_y_, c_z_, c_r_;                   // bounding sphere
+
+  // Result
+  vector<uvec2> clusters_;  // (offset, count) into indices_
+  vector<uint32_t> indices_;
+  size_t num_overflows_ = 0; // clusters with more lights than kMaxLightsPerCluster
+
+  // temporary (kept only to reuse allocation)
+  vector<uvec2> _pairs; // (cluster, light)
+
+  int getNumClusters() const { return dims_.x * dims_.y * dims_.z; }
+
+  // Slice of view space depth `d` (i.e. -z) as `log(d) * scale + bias` (cf. getSliceParams)
+  int getSlice(float d) const {
+    if (!(d > near_)) { return 0; }
+    int z = std::floor(std::log(d / near_) / std::log(far_ / near_) * dims_.z);
+    return std::clamp(z, 0, dims_.z - 1);
+  }
+
+  // (scale, bias) so that shader computes slice as above
+  glm::fvec2 getSliceParams() const {
+    float scale = dims_.z / std::log(far_ / near_);
+    return {scale, -std::log(near_) * scale};
+  }
+
+  float getSliceDepth(int z) const {
+    return near_ * std::pow(far_ / near_, float(z) / dims_.z);
+  }
+
+  void setup(ivec3 dims, const fmat4& projection, float near, float far) {
+    if (dims == dims_ && projection == projection_ && near == near_ && far == far_ && !lo_x_.empty()) {
+      return;
+    }
+    dims_ = dims;
+    projection_ = projection;
+    near_ = near;
+    far_ = far;
+    _computeBounds();
+  }
+
+  void _computeBounds() {
+    auto n = getNumClusters();
+    for (auto* v : {&lo_x_, &lo_y_, &lo_z_, &hi_x_, &hi_y_, &hi_z_, &c_x_, &c_y_, &c_z_, &c_r_}) {
+      v->resize(n);
+    }
+    // Point at view depth `d` on the ray through ndc `(nx, ny)`
+    auto& P = projection_;
+    auto unproject = [&](float nx, float ny, float d) {
+      return fvec3{(nx + P[2][0]) * d / P[0][0], (ny + P[2][1]) * d / P[1][1], -d};
+    };
+    for (auto z : utils::Range{dims_.z}) {
+      float d0 = getSliceDepth(z), d1 = getSliceDepth(z + 1);
+      for (auto y : utils::Range{dims_.y}) {
+        float ny0 = -1 + 2.f * y / dims_.y, ny1 = -1 + 2.f * (y + 1) / dims_.y;
+        for (auto x : utils::Range{dims_.x}) {
+          float nx0 = -1 + 2.f * x / dims_.x, nx1 = -1 + 2.f * (x + 1) / dims_.x;
+          fvec3 lo{FLT_MAX}, hi{-FLT_MAX};
+          for (auto d : {d0, d1}) {
+            for (auto ny : {ny0, ny1}) {
+              for (auto nx : {nx0, nx1}) {
+                auto p = unproject(nx, ny, d);
+                lo = glm::min(lo, p);
+                hi = glm::max(hi, p);
+              }
+            }
+          }
+          auto i = (z * dims_.y + y) * dims_.x + x;
+          fvec3 c = (lo + hi) / 2.f;
+          lo_x_[i] = lo.x; lo_y_[i] = lo.y; lo_z_[i] = lo.z;
+          hi_x_[i] = hi.x; hi_y_[i] = hi.y; hi_z_[i] = hi.z;
+          c_x_[i] = c.x; c_y_[i] = c.y; c_z_[i] = c.z;
+          c_r_[i] = glm::length(hi - c);
+        }
+      }
+    }
+  }
+
+  // Scalar version of what `_testRow` computes (also used as reference in test)
+  bool testCluster(const LightData& light, int i) const {
+    fvec3 p = light.position;
+    float r = light.position.w;
+    fvec3 lo = {lo_x_[i], lo_y_[i], lo_z_[i]}, hi = {hi_x_[i], hi_y_[i], hi_z_[i]};
+    if (distance2_Point_AABB(p, lo, hi) > r * r) { return false; }
+    if (light.getType() == kSpot) {
+      return intersect_Cone_Sphere(
+          p, light.direction, r, light.spot.z, light.spot.w, {c_x_[i], c_y_[i], c_z_[i]}, c_r_[i]);
+    }
+    return true;
+  }
+
+  // Clusters [begin, end) of a row hit by `light` (appended to `_pairs`)
+  void _testRow(const LightData& light, uint32_t light_index, int begin, int end) {
+    int i = begin;
+#ifdef TOY_SSE2
+    __m128 zero = _mm_setzero_ps();
+    __m128 px = _mm_set1_ps(light.position.x), py = _mm_set1_ps(light.position.y), pz = _mm_set1_ps(light.position.z);
+    __m128 r = _mm_set1_ps(light.position.w), r2 = _mm_mul_ps(r, r);
+    bool spot = light.getType() == kSpot;
+    __m128 dx = _mm_set1_ps(light.direction.x), dy = _mm_set1_ps(light.direction.y), dz = _mm_set1_ps(light.direction.z);
+    __m128 cos_angle = _mm_set1_ps(light.spot.z), sin_angle = _mm_set1_ps(light.spot.w);
+    for (; i + 4 <= end; i += 4) {
+      // sphere vs AABB
+      auto axis = [&](const vector<float>& lo, const vector<float>& hi, __m128 p) {
+        __m128 d = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&lo[i]), p), _mm_sub_ps(p, _mm_loadu_ps(&hi[i]))), zero);
+        return _mm_mul_ps(d, d);
+      };
+      __m128 d2 = _mm_add_ps(_mm_add_ps(axis(lo_x_, hi_x_, px), axis(lo_y_, hi_y_, py)), axis(lo_z_, hi_z_, pz));
+      __m128 hit = _mm_cmple_ps(d2, r2);
+
+      // cone vs cluster's bounding sphere (cf. intersect_Cone_Sphere)
+      if (spot) {
+        __m128 cr = _mm_loadu_ps(&c_r_[i]);
+        __m128 vx = _mm_sub_ps(_mm_loadu_ps(&c_x_[i]), px);
+        __m128 vy = _mm_sub_ps(_mm_loadu_ps(&c_y_[i]), py);
+        __m128 vz = _mm_sub_ps(_mm_loadu_ps(&c_z_[i]), pz);
+        __m128 v_len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz));
+        __m128 v1_len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, dx), _mm_mul_ps(vy, dy)), _mm_mul_ps(vz, dz));
+        __m128 distance = _mm_sub_ps(
+            _mm_mul_ps(cos_angle, _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(v_len2, _mm_mul_ps(v1_len, v1_len)), zero))),
+            _mm_mul_ps(v1_len, sin_angle));
+        __m128 culled = _mm_or_ps(_mm_or_ps(
+            _mm_cmpgt_ps(distance, cr),
+            _mm_cmpgt_ps(v1_len, _mm_add_ps(cr, r))),
+            _mm_cmplt_ps(v1_len, _mm_sub_ps(zero, cr)));
+        hit = _mm_andnot_ps(culled, hit);
+      }
+
+      int mask = _mm_movemask_ps(hit);
+      for (auto k : utils::Range{4}) {
+        if ((mask >> k) & 1) { _pairs.push_back({uint32_t(i + k), light_index}); }
+      }
+    }
+#endif
+    for (; i < end; i++) {
+      if (testCluster(light, i)) { _pairs.push_back({uint32_t(i), light_index}); }
+    }
+  }
+
+  void build(const vector<LightData>& lights) {
+    auto n = getNumClusters();
+    _pairs.clear();
+    auto& P = projection_;
+
+    for (auto light_index : utils::Range{lights.size()}) {
+      auto& light = lights[light_index];
+      if (light.getType() == kDirectional) { continue; }
+      fvec3 c = light.position;
+      float r = light.position.w;
+
+      // 1. depth range
+      float d_min = -c.z - r, d_max = -c.z + r;
+      if (d_max < near_ || d_min > far_) { continue; }
+      int z0 = getSlice(d_min), z1 = getSlice(d_max);
+
+      // 2. screen range from sphere's view space AABB (whole screen when it crosses camera plane)
+      int x0 = 0, x1 = dims_.x - 1, y0 = 0, y1 = dims_.y - 1;
+      if (d_min > 0) {
+        // extremes of `x / d` over [c.x - r, c.x + r] x [d_min, d_max]
+        auto extent = [&](float lo, float hi) {
+          return glm::fvec2{lo / (lo < 0 ? d_min : d_max), hi / (hi > 0 ? d_min : d_max)};
+        };
+        auto ex = extent(c.x - r, c.x + r) * P[0][0] - P[2][0];
+        auto ey = extent(c.y - r, c.y + r) * P[1][1] - P[2][1];
+        if (ex.y < -1 || ex.x > 1 || ey.y < -1 || ey.x > 1) { continue; }
+        auto tile = [](float ndc, int dim) { return std::clamp(int(std::floor((ndc + 1) / 2 * dim)), 0, dim - 1); };
+        x0 = tile(ex.x, dims_.x); x1 = tile(ex.y, dims_.x);
+        y0 = tile(ey.x, dims_.y); y1 = tile(ey.y, dims_.y);
+      }
+
+      // 3. test clusters in range
+      for (int z = z0; z <= z1; z++) {
+        for (int y = y0; y <= y1; y++) {
+          int row = (z * dims_.y + y) * dims_.x;
+          _testRow(light, light_index, row + x0, row + x1 + 1);
+        }
+      }
+    }
+
+    // 4. counting sort by cluster (capped by kMaxLightsPerCluster)
+    clusters_.assign(n, uvec2{0, 0});
+    for (auto& [cluster, _] : _pairs) { clusters_[cluster].y++; }
+    uint32_t offset = 0;
+    num_overflows_ = 0;
+    for (auto& cluster : clusters_) {
+      if (cluster.y > kMaxLightsPerCluster) {
+        cluster.y = kMaxLightsPerCluster;
+        num_overflows_++;
+      }
+      cluster.x = offset;
+      offset += cluster.y;
+      cluster.y = 0;
+    }
+    indices_.resize(offset);
+    for (auto& [cluster, light_index] : _pairs) {
+      auto& [cluster_offset, count] = clusters_[cluster];
+      auto next = cluster + 1 < clusters_.size() ? clusters_[cluster + 1].x : offset;
+      if (cluster_offset + count < next) {
+        indices_[cluster_offset + count++] = light_index;
+      }
+    }
+  }
+};
+
+} // namespace lighting
+} // namespace toy
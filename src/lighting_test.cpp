@@ -0,0 +1,81 @@
+#include <random>
+#include <gtest/gtest.h>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "lighting.hpp"
+
+using namespace toy;
+using glm::fvec3;
+
+TEST(LightingTest, getSlice) {
+  lighting::ClusterGrid grid;
+  grid.setup({4, 4, 8}, glm::perspectiveRH_NO(1.f, 1.f, 0.1f, 100.f), 1, 256);
+  EXPECT_EQ(grid.getSlice(0.5), 0);
+  EXPECT_EQ(grid.getSlice(1.5), 0);
+  EXPECT_EQ(grid.getSlice(2.5), 1); // 256^(1/8) = 2
+  EXPECT_EQ(grid.getSlice(100), 6);
+  EXPECT_EQ(grid.getSlice(1000), 7);
+
+  // Same as shader's `log(d) * scale + bias`
+  auto [scale, bias] = grid.getSliceParams();
+  EXPECT_NEAR(std::log(8.f) * scale + bias, 3, 1e-4);
+}
+
+TEST(LightingTest, intersect_Cone_Sphere) {
+  float angle = 0.5;
+  auto test = [&](fvec3 center, float radius) {
+    return lighting::intersect_Cone_Sphere({0, 0, 0}, {0, 0, -1}, 10, std::cos(angle), std::sin(angle), center, radius);
+  };
+  EXPECT_TRUE(test({0, 0, -5}, 0.1));
+  EXPECT_FALSE(test({0, 0, 5}, 1));   // behind
+  EXPECT_FALSE(test({0, 0, -12}, 1)); // beyond range
+  EXPECT_FALSE(test({5, 0, -1}, 1));  // outside of cone
+  EXPECT_TRUE(test({5, 0, -1}, 5));
+}
+
+TEST(LightingTest, ClusterGrid_build) {
+  lighting::ClusterGrid grid;
+  grid.setup({8, 6, 12}, glm::perspectiveRH_NO(1.f, 4.f / 3.f, 0.1f, 100.f), 0.5, 100);
+
+  std::mt19937 rng{0x70793364};
+  std::uniform_real_distribution<float> dist{-1, 1};
+  std::vector<lighting::LightData> lights;
+  lights.push_back(lighting::makeLightData(lighting::kDirectional, {}, {0, 0, -1}, {1, 1, 1}, 1, 0, 0, 0));
+  for (auto i : utils::Range{64}) {
+    fvec3 position = {20 * dist(rng), 20 * dist(rng), -25 + 25 * dist(rng)};
+    fvec3 direction = {dist(rng), dist(rng), dist(rng)};
+    auto type = (i % 2) ? lighting::kSpot : lighting::kPoint;
+    lights.push_back(lighting::makeLightData(type, position, direction, {1, 1, 1}, 1, 2 + 4 * std::abs(dist(rng)), 0.2, 0.6));
+  }
+  grid.build(lights);
+  ASSERT_EQ(grid.clusters_.size(), 8 * 6 * 12);
+  EXPECT_EQ(grid.num_overflows_, 0);
+
+  // Compare with brute force (clusters out of light's screen/depth range can be skipped
+  // since AABB of cluster is looser than cluster itself)
+  size_t num_total = 0, num_hits = 0;
+  for (auto i : utils::Range{grid.clusters_.size()}) {
+    auto [offset, count] = grid.clusters_[i];
+    std::vector<uint32_t> result{grid.indices_.begin() + offset, grid.indices_.begin() + offset + count};
+    for (auto light_index : result) {
+      EXPECT_NE(light_index, 0); // directional light is not clustered
+      EXPECT_TRUE(grid.testCluster(lights[light_index], i));
+    }
+    for (auto light_index : utils::Range{1u, (uint32_t)lights.size()}) {
+      num_total += grid.testCluster(lights[light_index], i);
+    }
+    num_hits += count;
+  }
+  EXPECT_GT(num_hits, 0);
+  EXPECT_LE(num_hits, num_total);
+  EXPECT_GT(num_hits, num_total * 0.8);
+
+  // Light at cluster's center hits it
+  {
+    int i = (5 * 6 + 2) * 8 + 3;
+    fvec3 center = {grid.c_x_[i], grid.c_y_[i], grid.c_z_[i]};
+    grid.build({lighting::makeLightData(lighting::kPoint, center, {0, 0, -1}, {1, 1, 1}, 1, 0.01, 0, 0)});
+    EXPECT_EQ(grid.clusters_[i].y, 1);
+    EXPECT_EQ(grid.indices_, (std::vector<uint32_t>{0}));
+  }
+}
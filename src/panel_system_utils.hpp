@@ -1,6 +1,8 @@
 #include "panel_system.hpp"
 #include "utils.hpp"
 #include "utils_imgui.hpp"
+#include "profiler.hpp"
+#include <fstream>
 
 // Demo components from imgui_demo.cpp (`static` is removed to make them external linkage)
 void ShowDemoWindowWidgets();
@@ -42,6 +44,147 @@ struct DemoPanel : Panel {
   }
 };
 
+// Timeline of a single frame and flame graph averaged over recent frames (cf. profiler.hpp)
+struct ProfilerPanel : Panel {
+  constexpr static const char* type = "Profiler";
+  static Panel* newPanelFunc() { return dynamic_cast<Panel*>(new ProfilerPanel); }
+
+  constexpr static int kFlameFrames = 60;
+  bool paused_ = false;
+  std::vector<profiler::Frame> frames_;
+  int selected_ = -1; // index of frames_ for timeline (-1 for latest)
+  char export_path_[256] = "trace.json";
+  std::string export_status_;
+
+  static ImU32 getColor(const char* name) {
+    auto hash = utils::hashFnv1a(name, std::strlen(name));
+    return ImColor::HSV((hash % 360) / 360.f, 0.5f, 0.6f);
+  }
+
+  // Rect with clipped label and tooltip, returns true if hovered
+  static bool addBar(ImDrawList* draw_list, ImVec2 p0, ImVec2 p1, const char* name, const std::string& tooltip) {
+    if (p1.x - p0.x < 1) { p1.x = p0.x + 1; }
+    draw_list->AddRectFilled(p0, p1, getColor(name));
+    ImVec4 clip{p0.x, p0.y, p1.x, p1.y};
+    draw_list->AddText(nullptr, 0, ImVec2{p0.x + 2, p0.y}, IM_COL32_WHITE, name, nullptr, 0, &clip);
+    bool hovered = ImGui::IsMouseHoveringRect(p0, p1);
+    if (hovered) {
+      ImGui::SetTooltip("%s\n%s", name, tooltip.data());
+    }
+    return hovered;
+  }
+
+  void UI_Timeline(const profiler::Frame& frame) {
+    auto tracks = profiler::Profiler::get().collect(frame.begin, frame.end);
+    auto draw_list = ImGui::GetWindowDrawList();
+    float row_height = ImGui::GetTextLineHeight() + 2;
+    float width = ImGui::GetContentRegionAvail().x;
+    float duration = frame.end - frame.begin;
+    for (auto& track : tracks) {
+      if (track.events.empty()) { continue; }
+      ImGui::TextDisabled("%s", track.name.data());
+      uint32_t max_depth = 0;
+      for (auto& event : track.events) { max_depth = std::max(max_depth, event.depth); }
+      ImVec2 origin = ImGui::GetCursorScreenPos();
+      ImVec2 size{width, row_height * (max_depth + 1)};
+      draw_list->PushClipRect(origin, {origin.x + size.x, origin.y + size.y}, true);
+      for (auto& event : track.events) {
+        float x0 = origin.x + width * ((int64_t)(event.begin - frame.begin) / duration);
+        float x1 = origin.x + width * ((int64_t)(event.end - frame.begin) / duration);
+        float y0 = origin.y + row_height * event.depth;
+        addBar(draw_list, {x0, y0}, {x1, y0 + row_height - 1}, event.name,
+            fmt::format("{:.3f} ms", (event.end - event.begin) / 1e6));
+      }
+      draw_list->PopClipRect();
+      ImGui::Dummy(size);
+    }
+  }
+
+  // Width is proportional to average time per frame over `frames`
+  void UI_FlameGraph(const std::vector<profiler::Frame>& frames) {
+    auto begin = frames.front().begin, end = frames.back().end;
+    auto tracks = profiler::Profiler::get().collect(begin, end);
+    auto draw_list = ImGui::GetWindowDrawList();
+    float row_height = ImGui::GetTextLineHeight() + 2;
+    float width = ImGui::GetContentRegionAvail().x;
+    float duration = end - begin;
+    for (auto& track : tracks) {
+      if (track.events.empty()) { continue; }
+      profiler::CallTree tree;
+      tree.add(track.events);
+      uint32_t max_depth = 0;
+      for (auto& node : tree.nodes_) { max_depth = std::max(max_depth, node.depth); }
+      ImGui::TextDisabled("%s (%.3f ms / frame)", track.name.data(), tree.nodes_[0].total / 1e6 / frames.size());
+      ImVec2 origin = ImGui::GetCursorScreenPos();
+
+      // Children are laid out left to right from parent's left edge
+      std::vector<std::pair<uint32_t, float>> stack = {{0, origin.x}};
+      while (!stack.empty()) {
+        auto [index, x] = stack.back();
+        stack.pop_back();
+        auto& node = tree.nodes_[index];
+        if (index > 0) {
+          float y0 = origin.y + row_height * (node.depth - 1);
+          addBar(draw_list, {x, y0}, {x + width * (node.total / duration), y0 + row_height - 1}, node.name,
+              fmt::format("{:.3f} ms / frame ({} calls)", node.total / 1e6 / frames.size(), node.count));
+        }
+        for (auto child : node.children) {
+          stack.push_back({child, x});
+          x += width * (tree.nodes_[child].total / duration);
+        }
+      }
+      ImGui::Dummy(ImVec2{width, row_height * max_depth});
+    }
+  }
+
+  void UI_Export() {
+    ImGui::InputText("##path", export_path_, sizeof(export_path_));
+    ImGui::SameLine();
+    if (ImGui::Button("Export trace") && !frames_.empty()) {
+      auto tracks = profiler::Profiler::get().collect(frames_.front().begin, frames_.back().end);
+      std::ofstream ostr{export_path_};
+      profiler::writeChromeTrace(ostr, tracks);
+      export_status_ = ostr ? fmt::format("exported {} frames", frames_.size()) : "failed to write";
+    }
+    if (!export_status_.empty()) {
+      ImGui::SameLine();
+      ImGui::TextDisabled("%s", export_status_.data());
+    }
+  }
+
+  void processUI() override {
+    if (!paused_) {
+      frames_ = profiler::Profiler::get().getFrames();
+      selected_ = -1;
+    }
+    ImGui::Checkbox("pause", &paused_);
+    ImGui::SameLine();
+    UI_Export();
+    if (frames_.empty()) { return; }
+
+    // Frame time history (click to inspect)
+    std::vector<float> durations;
+    for (auto& frame : frames_) { durations.push_back((frame.end - frame.begin) / 1e6); }
+    ImGui::PlotHistogram("##frames", durations.data(), durations.size(), 0, "frame time (ms)", 0, 33, ImVec2{-1, 60});
+    if (ImGui::IsItemClicked()) {
+      float t = (ImGui::GetMousePos().x - ImGui::GetItemRectMin().x) / ImGui::GetItemRectSize().x;
+      selected_ = std::clamp<int>(t * durations.size(), 0, durations.size() - 1);
+      paused_ = true;
+    }
+
+    auto& frame = frames_[selected_ < 0 ? frames_.size() - 1 : selected_];
+    if (ImGui::CollapsingHeader("Timeline", ImGuiTreeNodeFlags_DefaultOpen)) {
+      ImGui::Text("frame %llu : %.3f ms", (unsigned long long)frame.index, (frame.end - frame.begin) / 1e6);
+      UI_Timeline(frame);
+    }
+    if (ImGui::CollapsingHeader("Flame Graph", ImGuiTreeNodeFlags_DefaultOpen)) {
+      auto num_frames = std::min<size_t>(kFlameFrames, frames_.size());
+      ImGui::Text("average of last %zu frames", num_frames);
+      UI_FlameGraph({frames_.end() - num_frames, frames_.end()});
+    }
+  }
+};
+
 struct IconViewerPanel : Panel {
   constexpr static const char* type = "Icon Viewer";
   static Panel* newPanelFunc() { return dynamic_cast<Panel*>(new IconViewerPanel); }
@@ -0,0 +1,408 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <GL/gl3w.h>
+#include <fmt/format.h>
+
+#include "utils.hpp"
+
+//
+// Frame profiler
+// - `TOY_PROFILE_SCOPE("name")` records [begin, end) of enclosing scope (in ns) into per-thread ring buffer (aka track)
+// - `TOY_PROFILE_GPU_SCOPE(gpu_profiler, "name")` records GPU time of GL commands in between (cf. GpuProfiler)
+// - `Profiler::get().newFrame()` once per frame from main loop to mark frame boundaries
+//   (and `endFrame()` before idle wait so that it doesn't count as frame time)
+// - `writeChromeTrace` dumps events as Chrome trace JSON (chrome://tracing or https://ui.perfetto.dev)
+//
+// NOTE: names have to outlive profiler (i.e. string literals)
+//
+
+#define TOY_PROFILE_CONCAT_(A, B) A##B
+#define TOY_PROFILE_CONCAT(A, B) TOY_PROFILE_CONCAT_(A, B)
+
+#ifndef TOY_PROFILE_DISABLE
+#define TOY_PROFILE_SCOPE(NAME) \
+  ::toy::profiler::Scope TOY_PROFILE_CONCAT(_toy_profile_scope_, __LINE__){NAME}
+#define TOY_PROFILE_GPU_SCOPE(PROFILER, NAME) \
+  ::toy::profiler::GpuScope TOY_PROFILE_CONCAT(_toy_profile_gpu_scope_, __LINE__){PROFILER, NAME}
+#else
+#define TOY_PROFILE_SCOPE(NAME)
+#define TOY_PROFILE_GPU_SCOPE(PROFILER, NAME)
+#endif
+
+namespace toy {
+namespace profiler {
+
+namespace {
+using std::vector, std::string, std::shared_ptr;
+}
+
+inline uint64_t now() {
+  using namespace std::chrono;
+  return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Event {
+  const char* name;
+  uint64_t begin, end; // ns
+  uint32_t depth;      // nesting level within track
+};
+
+// Events from a single thread (or GPU queue) in order of their end
+// - single producer ring buffer i.e. `push` is lock-free and only called from owner thread
+// - `collect` copies events then drops ones which owner might have overwritten meanwhile
+struct Track {
+  constexpr static size_t kCapacity = 1 << 14;
+  string name_;
+  uint32_t id_;
+  uint32_t depth_ = 0; // (only touched by owner thread)
+  vector<Event> events_ = vector<Event>(kCapacity);
+  std::atomic<uint64_t> count_ = 0;
+  uint64_t retired_ = 0; // when owner is gone (cf. Profiler::removeTrack)
+
+  void push(const Event& event) {
+    auto count = count_.load(std::memory_order_relaxed);
+    events_[count % kCapacity] = event;
+    count_.store(count + 1, std::memory_order_release);
+  }
+
+  // Events overlapping with [begin, end)
+  void collect(uint64_t begin, uint64_t end, vector<Event>& result) {
+    auto count = count_.load(std::memory_order_acquire);
+    auto first = count - std::min<uint64_t>(count, kCapacity);
+    vector<Event> events;
+    for (auto i = first; i < count; i++) {
+      events.push_back(events_[i % kCapacity]);
+    }
+    // copy of index i is stale if owner has since reached i + kCapacity (+1 for the one it might be writing)
+    std::atomic_thread_fence(std::memory_order_acquire);
+    auto reached = count_.load(std::memory_order_relaxed) + 1;
+    auto num_stale = std::min<uint64_t>(reached - std::min(reached, first + kCapacity), events.size());
+    for (auto i = num_stale; i < events.size(); i++) {
+      auto& event = events[i];
+      if (begin < event.end && event.begin < end) {
+        result.push_back(event);
+      }
+    }
+  }
+};
+
+struct TrackEvents {
+  string name;
+  uint32_t id;
+  vector<Event> events;
+};
+
+struct Frame {
+  uint64_t index;
+  uint64_t begin, end;
+};
+
+struct Profiler {
+  constexpr static size_t kFrameHistory = 256;
+  std::mutex mutex_;
+  vector<shared_ptr<Track>> tracks_;
+  uint32_t next_track_id_ = 1;
+  vector<Frame> frames_ = vector<Frame>(kFrameHistory); // ring buffer
+  uint64_t frame_count_ = 0;
+  uint64_t frame_begin_ = 0;
+
+  static Profiler& get() {
+    static Profiler instance;
+    return instance;
+  }
+
+  shared_ptr<Track> addTrack(const string& name) {
+    std::lock_guard lock{mutex_};
+    auto& track = tracks_.emplace_back(new Track);
+    track->name_ = name;
+    track->id_ = next_track_id_++;
+    return track;
+  }
+
+  // When owner is gone (track is kept until its events fall out of frame history cf. `_pruneTracks`)
+  void removeTrack(Track& track) {
+    std::lock_guard lock{mutex_};
+    track.retired_ = now();
+  }
+
+  void _pruneTracks() {
+    if (frame_count_ < kFrameHistory) { return; }
+    auto oldest = frames_[frame_count_ % kFrameHistory].begin;
+    tracks_.erase(
+        std::remove_if(
+            tracks_.begin(), tracks_.end(),
+            [&](auto& track) { return track->retired_ > 0 && track->retired_ < oldest; }),
+        tracks_.end());
+  }
+
+  // Track of calling thread (created on first use and removed on thread exit)
+  static Track& getThreadTrack() {
+    struct ThreadTrack {
+      shared_ptr<Track> track = get().addTrack(
+          fmt::format("thread {}", std::hash<std::thread::id>{}(std::this_thread::get_id()) % 10000));
+      ~ThreadTrack() { get().removeTrack(*track); }
+    };
+    thread_local ThreadTrack thread_track;
+    return *thread_track.track;
+  }
+
+  void setThreadName(const string& name) {
+    auto& track = getThreadTrack();
+    std::lock_guard lock{mutex_};
+    track.name_ = name;
+  }
+
+  void newFrame() {
+    auto t = now();
+    std::lock_guard lock{mutex_};
+    _endFrame(t);
+    frame_begin_ = t;
+    _pruneTracks();
+  }
+
+  // Closes current frame before `newFrame` e.g. so that idle wait in between isn't counted
+  void endFrame() {
+    auto t = now();
+    std::lock_guard lock{mutex_};
+    _endFrame(t);
+  }
+
+  void _endFrame(uint64_t t) {
+    if (frame_begin_ > 0) {
+      frames_[frame_count_ % kFrameHistory] = {frame_count_, frame_begin_, t};
+      frame_count_++;
+    }
+    frame_begin_ = 0;
+  }
+
+  // Completed frames (oldest first)
+  vector<Frame> getFrames() {
+    std::lock_guard lock{mutex_};
+    vector<Frame> result;
+    for (auto i = frame_count_ - std::min<uint64_t>(frame_count_, kFrameHistory); i < frame_count_; i++) {
+      result.push_back(frames_[i % kFrameHistory]);
+    }
+    return result;
+  }
+
+  vector<TrackEvents> collect(uint64_t begin, uint64_t end) {
+    vector<shared_ptr<Track>> tracks;
+    vector<TrackEvents> result;
+    {
+      std::lock_guard lock{mutex_};
+      tracks = tracks_;
+      for (auto& track : tracks) {
+        result.push_back({track->name_, track->id_, {}});
+      }
+    }
+    for (auto i : utils::Range{tracks.size()}) {
+      tracks[i]->collect(begin, end, result[i].events);
+    }
+    return result;
+  }
+};
+
+struct Scope {
+  const char* name_;
+  uint64_t begin_;
+  Track& track_;
+
+  Scope(const char* name) : name_{name}, track_{Profiler::getThreadTrack()} {
+    track_.depth_++;
+    begin_ = now();
+  }
+
+  ~Scope() {
+    auto end = now();
+    track_.depth_--;
+    track_.push({name_, begin_, end, track_.depth_});
+  }
+};
+
+//
+// GPU time by GL_TIMESTAMP queries (unlike GL_TIME_ELAPSED, they can nest)
+// - results are read back in later frames when available (i.e. no stall) and pushed into its own track
+// - GPU timestamps are mapped to CPU clock by offset sampled at `newFrame`
+// - use only from thread where GL context is current
+//
+struct GpuProfiler {
+  struct Pending {
+    const char* name;
+    GLuint begin, end; // end = 0 while scope is open
+    uint32_t depth;
+  };
+  shared_ptr<Track> track_;
+  vector<GLuint> free_queries_;
+  vector<Pending> pending_; // in order of `begin`
+  vector<size_t> stack_;    // open scopes (index of `pending_`)
+  int64_t offset_ = 0;      // CPU clock - GPU clock
+
+  GpuProfiler(const string& name) : track_{Profiler::get().addTrack(name)} {}
+
+  ~GpuProfiler() {
+    Profiler::get().removeTrack(*track_);
+    for (auto& query : pending_) {
+      free_queries_.push_back(query.begin);
+      if (query.end) { free_queries_.push_back(query.end); }
+    }
+    glDeleteQueries(free_queries_.size(), free_queries_.data());
+  }
+
+  GLuint _newQuery() {
+    GLuint result;
+    if (free_queries_.empty()) {
+      glGenQueries(1, &result);
+    } else {
+      result = free_queries_.back();
+      free_queries_.pop_back();
+    }
+    return result;
+  }
+
+  void begin(const char* name) {
+    auto& query = pending_.emplace_back(Pending{name, _newQuery(), 0, (uint32_t)stack_.size()});
+    glQueryCounter(query.begin, GL_TIMESTAMP);
+    stack_.push_back(pending_.size() - 1);
+  }
+
+  void end() {
+    TOY_ASSERT(!stack_.empty());
+    auto& query = pending_[stack_.back()];
+    stack_.pop_back();
+    query.end = _newQuery();
+    glQueryCounter(query.end, GL_TIMESTAMP);
+  }
+
+  // Outside of any scope, once per frame
+  void newFrame() {
+    TOY_ASSERT(stack_.empty());
+    GLint64 gpu_now = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    offset_ = (int64_t)now() - gpu_now;
+
+    size_t num_done = 0;
+    for (auto& query : pending_) {
+      GLint available = 0;
+      glGetQueryObjectiv(query.end, GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available) { break; }
+      GLuint64 begin, end;
+      glGetQueryObjectui64v(query.begin, GL_QUERY_RESULT, &begin);
+      glGetQueryObjectui64v(query.end, GL_QUERY_RESULT, &end);
+      track_->push({query.name, begin + offset_, end + offset_, query.depth});
+      free_queries_.push_back(query.begin);
+      free_queries_.push_back(query.end);
+      num_done++;
+    }
+    pending_.erase(pending_.begin(), pending_.begin() + num_done);
+  }
+};
+
+struct GpuScope {
+  GpuProfiler* profiler_;
+
+  GpuScope(GpuProfiler* profiler, const char* name) : profiler_{profiler} {
+    if (profiler_) { profiler_->begin(name); }
+  }
+
+  ~GpuScope() {
+    if (profiler_) { profiler_->end(); }
+  }
+};
+
+//
+// Aggregation of events by call stack (i.e. flame graph)
+// - node 0 is root whose children are top level scopes
+//
+struct CallTree {
+  struct Node {
+    const char* name;
+    uint64_t total = 0; // ns
+    uint32_t count = 0;
+    uint32_t depth = 0;
+    vector<uint32_t> children;
+  };
+  vector<Node> nodes_ = {Node{""}};
+
+  uint32_t _getChild(uint32_t parent, const char* name) {
+    for (auto child : nodes_[parent].children) {
+      if (std::strcmp(nodes_[child].name, name) == 0) { return child; }
+    }
+    uint32_t result = nodes_.size();
+    nodes_.push_back({name, 0, 0, nodes_[parent].depth + 1, {}});
+    nodes_[parent].children.push_back(result);
+    return result;
+  }
+
+  // Events of a single track (parent is found by time containment)
+  void add(vector<Event> events) {
+    std::sort(events.begin(), events.end(), [](auto& a, auto& b) {
+      return std::tie(a.begin, a.depth) < std::tie(b.begin, b.depth);
+    });
+    vector<std::pair<uint32_t, uint64_t>> stack; // (node, end)
+    for (auto& event : events) {
+      while (!stack.empty() && stack.back().second <= event.begin) { stack.pop_back(); }
+      uint32_t parent = stack.empty() ? 0 : stack.back().first;
+      uint32_t node = _getChild(parent, event.name);
+      nodes_[node].total += event.end - event.begin;
+      nodes_[node].count++;
+      if (parent == 0) { nodes_[0].total += event.end - event.begin; }
+      stack.push_back({node, event.end});
+    }
+  }
+};
+
+inline string escapeJson(const char* s) {
+  string result;
+  for (; *s; s++) {
+    switch (*s) {
+      case '"':  result += "\\\""; break;
+      case '\\': result += "\\\\"; break;
+      case '\n': result += "\\n"; break;
+      default: {
+        if ((unsigned char)*s < 0x20) {
+          result += fmt::format("\\u{:04x}", (int)*s);
+        } else {
+          result += *s;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+// "Complete" events (ph = X) with microsecond timestamps and thread name metadata per track
+inline void writeChromeTrace(std::ostream& ostr, const vector<TrackEvents>& tracks) {
+  ostr << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&]() {
+    if (!first) { ostr << ","; }
+    first = false;
+  };
+  for (auto& track : tracks) {
+    separator();
+    ostr << fmt::format(
+        "\n{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+        track.id, escapeJson(track.name.data()));
+    for (auto& event : track.events) {
+      separator();
+      ostr << fmt::format(
+          "\n{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+          escapeJson(event.name), track.id, event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+    }
+  }
+  ostr << "\n]}\n";
+}
+
+} // namespace profiler
+} // namespace toy
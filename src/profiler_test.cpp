@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "profiler.hpp"
+
+using namespace toy;
+
+TEST(ProfilerTest, Scope) {
+  auto begin = profiler::now();
+  std::thread thread{[]() {
+    profiler::Profiler::get().setThreadName("test \"worker\"");
+    TOY_PROFILE_SCOPE("outer");
+    for (int i = 0; i < 2; i++) {
+      TOY_PROFILE_SCOPE("inner");
+    }
+  }};
+  thread.join();
+  auto end = profiler::now();
+
+  auto tracks = profiler::Profiler::get().collect(begin, end);
+  auto it = std::find_if(tracks.begin(), tracks.end(), [](auto& t) { return t.name == "test \"worker\""; });
+  ASSERT_NE(it, tracks.end());
+  auto& events = it->events;
+  ASSERT_EQ(events.size(), 3);
+  EXPECT_STREQ(events[0].name, "inner");
+  EXPECT_EQ(events[0].depth, 1);
+  EXPECT_STREQ(events[2].name, "outer");
+  EXPECT_EQ(events[2].depth, 0);
+  EXPECT_LE(events[2].begin, events[0].begin);
+  EXPECT_LE(events[1].end, events[2].end);
+
+  // Call tree
+  profiler::CallTree tree;
+  tree.add(events);
+  ASSERT_EQ(tree.nodes_.size(), 3);
+  auto& outer = tree.nodes_[tree.nodes_[0].children[0]];
+  EXPECT_STREQ(outer.name, "outer");
+  EXPECT_EQ(outer.total, tree.nodes_[0].total);
+  auto& inner = tree.nodes_[outer.children[0]];
+  EXPECT_STREQ(inner.name, "inner");
+  EXPECT_EQ(inner.count, 2);
+  EXPECT_EQ(inner.depth, 2);
+  EXPECT_LE(inner.total, outer.total);
+
+  // Chrome trace
+  std::ostringstream ostr;
+  profiler::writeChromeTrace(ostr, {*it});
+  auto json = ostr.str();
+  EXPECT_NE(json.find(R"("args":{"name":"test \"worker\""})"), std::string::npos);
+  EXPECT_NE(json.find(R"({"name":"outer","ph":"X")"), std::string::npos);
+  EXPECT_EQ(json.back(), '\n');
+}
+
+TEST(ProfilerTest, Frames) {
+  auto& profiler = profiler::Profiler::get();
+  auto count = profiler.frame_count_;
+  profiler.newFrame();
+  profiler.newFrame();
+  profiler.newFrame();
+  auto frames = profiler.getFrames();
+  ASSERT_GE(frames.size(), 2);
+  EXPECT_EQ(profiler.frame_count_, count + (count == 0 ? 2 : 3));
+  EXPECT_EQ(frames.back().index + 1, profiler.frame_count_);
+  EXPECT_LE(frames[frames.size() - 2].end, frames.back().begin);
+}
+
+TEST(ProfilerTest, Track) {
+  auto& profiler = profiler::Profiler::get();
+  auto track = profiler.addTrack("test track");
+  for (uint64_t i = 0; i < profiler::Track::kCapacity + 10; i++) {
+    track->push({"event", i, i + 1, 0});
+  }
+  std::vector<profiler::Event> events;
+  track->collect(0, ~uint64_t{0}, events);
+  ASSERT_GE(events.size(), profiler::Track::kCapacity - 1); // (oldest might be dropped as possibly overwritten)
+  EXPECT_EQ(events.back().begin, profiler::Track::kCapacity + 9);
+
+  // Removed track is kept until it falls out of frame history
+  auto has_track = [&]() {
+    auto tracks = profiler.collect(0, 1);
+    return std::any_of(tracks.begin(), tracks.end(), [](auto& t) { return t.name == "test track"; });
+  };
+  profiler.removeTrack(*track);
+  profiler.newFrame();
+  EXPECT_TRUE(has_track());
+  for (size_t i = 0; i <= profiler::Profiler::kFrameHistory; i++) {
+    profiler.newFrame();
+  }
+  EXPECT_FALSE(has_track());
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <GL/gl3w.h>
+#include <fmt/format.h>
+
+#include "utils.hpp"
+#include "profiler.hpp"
+
+//
+// Shader program cache
+// - programs are identified by hash of (sources after injecting defines, driver identity)
+// - in memory, same program is shared while someone holds it (e.g. renderers of multiple viewports)
+// - on disk, linked binary (glGetProgramBinary) is saved so that compilation is skipped on next launch
+// - binary rejected by driver (e.g. after driver update) falls back to compilation and is overwritten
+//
+// NOTE: programs are shared between contexts sharing objects, so single cache serves UI and render thread
+//
+
+namespace toy {
+namespace utils {
+namespace gl {
+
+namespace {
+using std::string, std::vector, std::shared_ptr;
+}
+
+// Insert `text` right after "#version" line (or at the beginning when there's no such line)
+inline string insertAfterVersion(const string& source, const string& text) {
+  size_t pos = 0;
+  auto version = source.find("#version");
+  if (version != string::npos && version == source.find_first_not_of(" \t\r\n")) {
+    pos = source.find('\n', version);
+    pos = (pos == string::npos) ? source.size() : pos + 1;
+  }
+  if (pos == source.size() && pos > 0 && source.back() != '\n') { return source + "\n" + text; }
+  return source.substr(0, pos) + text + source.substr(pos);
+}
+
+// Insert "#define <define>" lines after "#version" line
+inline string injectDefines(const string& source, const vector<string>& defines) {
+  if (defines.empty()) { return source; }
+  string lines;
+  for (auto& define : defines) {
+    lines += "#define " + define + "\n";
+  }
+  return insertAfterVersion(source, lines);
+}
+
+//
+// On disk format
+// - header, then `size_` bytes of binary
+// - `key` mismatch (i.e. hash collision of file name) is treated as cache miss
+//
+
+struct ProgramBinaryHeader {
+  char magic_[8] = {'T', 'O', 'Y', 'P', 'R', 'O', 'G', 1};
+  uint64_t key_ = 0;
+  uint32_t format_ = 0; // binaryFormat of glGetProgramBinary
+  uint32_t size_ = 0;
+};
+
+struct ProgramBinary {
+  GLenum format_ = 0;
+  vector<char> data_;
+};
+
+inline bool saveProgramBinary(const std::filesystem::path& path, const ProgramBinary& binary, uint64_t key) {
+  ProgramBinaryHeader header;
+  header.key_ = key;
+  header.format_ = binary.format_;
+  header.size_ = binary.data_.size();
+
+  // Write to temporary then rename so that concurrent/interrupted writes don't leave broken cache
+  auto tmp_path = path;
+  tmp_path += ".tmp";
+  {
+    std::ofstream ofs{tmp_path, std::ios::binary};
+    if (!ofs) { return false; }
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(binary.data_.data(), binary.data_.size());
+    if (!ofs) { return false; }
+  }
+  std::error_code error;
+  std::filesystem::rename(tmp_path, path, error);
+  return !error;
+}
+
+inline std::optional<ProgramBinary> loadProgramBinary(const std::filesystem::path& path, uint64_t key) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs) { return {}; }
+  ProgramBinaryHeader header, expected;
+  ifs.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!ifs || !std::equal(header.magic_, header.magic_ + 8, expected.magic_) || header.key_ != key) {
+    return {};
+  }
+  ProgramBinary result;
+  result.format_ = header.format_;
+  result.data_.resize(header.size_);
+  ifs.read(result.data_.data(), header.size_);
+  if (!ifs) { return {}; }
+  return result;
+}
+
+struct ProgramCache {
+  struct Stats {
+    size_t num_shared_ = 0;   // found in memory
+    size_t num_loaded_ = 0;   // from disk
+    size_t num_compiled_ = 0;
+    size_t num_rejected_ = 0; // binaries rejected by driver
+  };
+
+  std::mutex mutex_;
+  std::map<uint64_t, std::weak_ptr<Program>> programs_;
+  std::optional<bool> support_binary_; // checked on first use (i.e. when context is current)
+  uint64_t driver_key_ = 0;
+  bool use_disk_ = true;
+  std::filesystem::path directory_;
+  Stats stats_;
+
+  static ProgramCache& get() {
+    static ProgramCache instance;
+    return instance;
+  }
+
+  void _initialize() {
+    GLint num_formats = 0;
+    if (gl3wIsSupported(4, 1) || hasExtension("GL_ARB_get_program_binary")) {
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+    }
+    support_binary_ = num_formats > 0;
+
+    // Binary is valid only for the same driver
+    for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+      auto value = reinterpret_cast<const char*>(glGetString(name));
+      driver_key_ = hashFnv1a(string{value ? value : ""}, driver_key_);
+    }
+    directory_ = getCacheDirectory("programs");
+  }
+
+  static uint64_t getKey(const string& vs_src, const string& fs_src, uint64_t driver_key) {
+    auto key = hashFnv1a(vs_src, driver_key);
+    uint8_t separator = 0; // so that moving text between sources changes key
+    key = hashFnv1a(&separator, 1, key);
+    return hashFnv1a(fs_src, key);
+  }
+
+  shared_ptr<Program> getProgram(const char* vs_src, const char* fs_src, const vector<string>& defines = {}) {
+    std::lock_guard lock{mutex_};
+    if (!support_binary_) { _initialize(); }
+    auto vs = injectDefines(vs_src, defines);
+    auto fs = injectDefines(fs_src, defines);
+    auto key = getKey(vs, fs, driver_key_);
+    if (auto it = programs_.find(key); it != programs_.end()) {
+      if (auto program = it->second.lock()) {
+        stats_.num_shared_++;
+        return program;
+      }
+    }
+
+    // On miss, drop entries of programs nobody holds anymore (so that map doesn't grow with stale keys)
+    for (auto it = programs_.begin(); it != programs_.end();) {
+      it = it->second.expired() ? programs_.erase(it) : std::next(it);
+    }
+
+    bool use_disk = use_disk_ && *support_binary_;
+    auto path = directory_ / fmt::format("{:016x}.toyprog", key);
+    shared_ptr<Program> result;
+    if (use_disk) {
+      result = _load(path, key);
+    }
+    if (!result) {
+      TOY_PROFILE_SCOPE("ProgramCache::compile");
+      result.reset(new Program{vs.data(), fs.data(), use_disk});
+      stats_.num_compiled_++;
+      if (use_disk) { _save(path, key, *result); }
+    }
+    programs_[key] = result;
+    return result;
+  }
+
+  shared_ptr<Program> _load(const std::filesystem::path& path, uint64_t key) {
+    auto binary = loadProgramBinary(path, key);
+    if (!binary) { return {}; }
+    GLuint handle = glCreateProgram();
+    glProgramBinary(handle, binary->format_, binary->data_.data(), binary->data_.size());
+    GLint status = GL_FALSE;
+    glGetProgramiv(handle, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+      glDeleteProgram(handle);
+      stats_.num_rejected_++;
+      return {};
+    }
+    stats_.num_loaded_++;
+    return std::make_shared<Program>(handle);
+  }
+
+  void _save(const std::filesystem::path& path, uint64_t key, const Program& program) {
+    GLint size = 0;
+    glGetProgramiv(program.handle_, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) { return; }
+    ProgramBinary binary;
+    binary.data_.resize(size);
+    glGetProgramBinary(program.handle_, size, nullptr, &binary.format_, binary.data_.data());
+    saveProgramBinary(path, binary, key);
+  }
+
+  Stats getStats() {
+    std::lock_guard lock{mutex_};
+    return stats_;
+  }
+};
+
+} // namespace gl
+} // namespace utils
+} // namespace toy
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+
+#include "program_cache.hpp"
+
+using namespace toy;
+
+TEST(ProgramCacheTest, injectDefines) {
+  using utils::gl::injectDefines;
+  EXPECT_EQ(injectDefines("\n#version 330\nvoid main() {}\n", {}), "\n#version 330\nvoid main() {}\n");
+  EXPECT_EQ(
+      injectDefines("\n#version 330\nvoid main() {}\n", {"A", "B 2"}),
+      "\n#version 330\n#define A\n#define B 2\nvoid main() {}\n");
+  EXPECT_EQ(injectDefines("void main() {}\n", {"A"}), "#define A\nvoid main() {}\n");
+  EXPECT_EQ(injectDefines("#version 330", {"A"}), "#version 330\n#define A\n");
+}
+
+TEST(ProgramCacheTest, getKey) {
+  using Cache = utils::gl::ProgramCache;
+  auto key = Cache::getKey("vs", "fs", 0);
+  EXPECT_EQ(Cache::getKey("vs", "fs", 0), key);
+  EXPECT_NE(Cache::getKey("vsf", "s", 0), key);
+  EXPECT_NE(Cache::getKey("vs", "fs", 1), key); // different driver
+}
+
+TEST(ProgramCacheTest, saveProgramBinary) {
+  utils::gl::ProgramBinary binary{0x1234, {'a', 'b', 'c'}};
+  auto path = std::filesystem::temp_directory_path() / "toy-3d-program_cache_test.toyprog";
+  EXPECT_TRUE(utils::gl::saveProgramBinary(path, binary, 1234));
+  EXPECT_FALSE(utils::gl::loadProgramBinary(path, 4321));
+  auto loaded = utils::gl::loadProgramBinary(path, 1234);
+  ASSERT_TRUE(loaded);
+  EXPECT_EQ(loaded->format_, binary.format_);
+  EXPECT_EQ(loaded->data_, binary.data_);
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+
+#include "utils.hpp"
+
+//
+// Draw items ordered by packed 64-bit sort keys (cf. SceneRenderer::_sortDraws, ShadowRenderer::draw)
+// - each pass pushes (key, payload) per visible item, where key packs what the pass sorts by from the most
+//   significant bits e.g. (pass, program, material, mesh, depth) (cf. KeyPacker) and payload indexes pass's own data
+// - sorted by LSD radix sort (cf. utils::RadixSorter), so digits shared by all keys (e.g. unused fields) cost nothing
+//   and large queues are sorted on threads
+// - sort is stable i.e. items with equal key keep submission order
+//
+// cf. Ericson, "Order your graphics draw calls around!"
+//
+
+namespace toy {
+namespace render_queue {
+
+namespace {
+using std::vector;
+}
+
+struct Item {
+  uint64_t key;
+  uint32_t payload;
+};
+
+// Packs fields into key from the most significant bits (value is clamped to its width)
+struct KeyPacker {
+  uint64_t key_ = 0;
+  int bits_ = 0;
+
+  KeyPacker& push(uint64_t value, int bits) {
+    TOY_ASSERT(0 < bits && bits_ + bits <= 64);
+    uint64_t max = (bits == 64) ? ~uint64_t{0} : (uint64_t{1} << bits) - 1;
+    bits_ += bits;
+    key_ |= std::min(value, max) << (64 - bits_);
+    return *this;
+  }
+
+  uint64_t get() const { return key_; }
+};
+
+// Top `bits` of depth's sortable bits (i.e. coarser but same order), flipped for descending order (e.g. back to front)
+inline uint64_t getDepthKey(float depth, int bits, bool descending = false) {
+  TOY_ASSERT(0 < bits && bits <= 32);
+  uint64_t result = utils::floatToSortable(depth) >> (32 - bits);
+  return descending ? (~result & ((uint64_t{1} << bits) - 1)) : result;
+}
+
+struct RenderQueue {
+  constexpr static size_t kParallelThreshold = 1 << 16; // (thread spawn costs more below this)
+  vector<Item> items_, tmp_;
+  utils::RadixSorter<uint64_t> sorter_;
+  size_t num_threads_ = 0; // for large queues (0 for hardware concurrency)
+
+  void clear() { items_.clear(); }
+  size_t size() const { return items_.size(); }
+  void push(uint64_t key, uint32_t payload) { items_.push_back({key, payload}); }
+
+  void sort() {
+    size_t num_chunks = 1;
+    if (items_.size() >= kParallelThreshold) {
+      num_chunks = num_threads_ ? num_threads_ : std::max(1u, std::thread::hardware_concurrency());
+    }
+    tmp_.resize(items_.size());
+    auto result = sorter_.sortItems(
+        items_.data(), tmp_.data(), items_.size(), [](const Item& item) { return item.key; }, num_chunks);
+    if (result != items_.data()) { items_.swap(tmp_); }
+  }
+
+  // Index of first item whose key is not less than `key` (after `sort`), e.g. where a pass starts
+  size_t lowerBound(uint64_t key) const {
+    auto it = std::lower_bound(items_.begin(), items_.end(), key, [](const Item& item, uint64_t key) {
+      return item.key < key;
+    });
+    return it - items_.begin();
+  }
+};
+
+} // namespace render_queue
+} // namespace toy
@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <random>
+
+#include "render_queue.hpp"
+
+using namespace toy;
+
+TEST(RenderQueueTest, KeyPacker) {
+  auto key = render_queue::KeyPacker{}.push(1, 1).push(0x1ff, 9).push(1000, 4).get();
+  EXPECT_EQ(key, (uint64_t{1} << 63) | (uint64_t{0x1ff} << 54) | (uint64_t{0xf} << 50)); // (clamped to 4 bits)
+  EXPECT_THROW(render_queue::KeyPacker{}.push(0, 60).push(0, 5), std::runtime_error);
+}
+
+TEST(RenderQueueTest, getDepthKey) {
+  std::vector<float> depths = {-1, 0, 0.5, 1, 100, 1e6};
+  for (auto i : utils::Range{depths.size() - 1}) {
+    EXPECT_LE(render_queue::getDepthKey(depths[i], 24), render_queue::getDepthKey(depths[i + 1], 24));
+    EXPECT_GE(render_queue::getDepthKey(depths[i], 24, true), render_queue::getDepthKey(depths[i + 1], 24, true));
+    EXPECT_LT(render_queue::getDepthKey(depths[i], 32), render_queue::getDepthKey(depths[i + 1], 32));
+  }
+  EXPECT_LT(render_queue::getDepthKey(0, 16, true), uint64_t{1} << 16);
+}
+
+TEST(RenderQueueTest, sort) {
+  // Same as std::stable_sort both below and above parallel threshold
+  std::mt19937 rng{0};
+  for (size_t size : {size_t{100}, render_queue::RenderQueue::kParallelThreshold + 123}) {
+    render_queue::RenderQueue queue;
+    queue.num_threads_ = 4;
+    for (auto i : utils::Range{size}) {
+      auto key = render_queue::KeyPacker{}.push(rng() % 2, 1).push(rng() % 8, 9).push(rng() % 1000, 24).get();
+      queue.push(key, i);
+    }
+    auto expected = queue.items_;
+    std::stable_sort(expected.begin(), expected.end(), [](auto& a, auto& b) { return a.key < b.key; });
+    queue.sort();
+    ASSERT_EQ(queue.size(), size);
+    for (auto i : utils::Range{size}) {
+      ASSERT_EQ(queue.items_[i].key, expected[i].key);
+      ASSERT_EQ(queue.items_[i].payload, expected[i].payload);
+    }
+
+    // Where second pass starts
+    auto pass1 = render_queue::KeyPacker{}.push(1, 1).get();
+    auto it = std::find_if(expected.begin(), expected.end(), [&](auto& item) { return item.key >= pass1; });
+    EXPECT_EQ(queue.lowerBound(pass1), it - expected.begin());
+  }
+}
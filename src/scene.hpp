@@ -3,15 +3,26 @@
 #include <cgltf.h>
 #include <glm/ext/matrix_clip_space.hpp>
 #include <stb_image.h>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+#include <future>
+#include <atomic>
 
 #include "utils.hpp"
+#include "image.hpp"
+#include "image_bc.hpp"
+#include "atlas.hpp"
+#include "ibl.hpp"
+#include "render_queue.hpp"
 
 //
 // Initial Strategy
 // - no hierarchy (simply Scene <--1-many--> Node)
 // - shared_ptr for automatic reference counting
 // - GPU resource is owned by "XxxRR" counterpart ("RR" stands for "Render Resource")
-//   which is not allocated until rendering it (cf. `SceneRenderer` in scene_example.cpp).
+//   which is not allocated until rendering it and is kept by renderer keyed by asset id
+//   (cf. RRMap and `SceneRenderer` in scene_example.cpp), so assets themselves are never written by renderer.
 //
 
 namespace toy {
@@ -22,9 +33,15 @@ using std::string, std::vector, std::shared_ptr, std::unique_ptr;
 using glm::ivec2, glm::fvec2, glm::fvec3, glm::fvec4, glm::fmat3, glm::fmat4;
 }
 
-struct MeshRR; struct TextureRR; struct MeshBVH;
+struct MeshBVH;
 struct Node; struct Mesh; struct Texture; struct Material;
 
+// Unique among all assets of process (never reused unlike address)
+inline uint64_t newAssetId() {
+  static std::atomic<uint64_t> counter = 0;
+  return ++counter;
+}
+
 struct VertexAttrs {
   fvec3 position;
   fvec3 normal;
@@ -34,25 +51,35 @@ struct VertexAttrs {
 };
 
 struct Mesh {
-  unique_ptr<MeshRR> rr_;
+  uint64_t id_ = newAssetId();
   unique_ptr<MeshBVH> bvh_;
   string name_;
   vector<uint16_t> indices_; // 2**16 = 65536
   vector<VertexAttrs> vertices_;
+  bool has_vertex_color_ = false; // otherwise VertexAttrs::color is all default
+  bool has_normal_ = false;
 };
 
 struct Texture {
-  unique_ptr<TextureRR> rr_;
+  uint64_t id_ = newAssetId();
   string name_;
   string filename_;
-  ivec2 size_;
 };
 
+// cf. glTF material.alphaMode
+enum struct AlphaMode : uint8_t { kOpaque, kMask, kBlend };
+
 struct Material {
   string name_;
   fvec4 base_color_factor_ = {1, 1, 1, 1};
   shared_ptr<Texture> base_color_texture_;
   bool use_base_color_texture_ = true;
+  AlphaMode alpha_mode_ = AlphaMode::kOpaque;
+  float alpha_cutoff_ = 0.5; // only for kMask
+  bool double_sided_ = false; // i.e. no back face culling and back face is lit by flipped normal
+  float metallic_factor_ = 1;
+  float roughness_factor_ = 1;
+  bool unlit_ = false; // KHR_materials_unlit
 };
 
 struct Node {
@@ -62,6 +89,27 @@ struct Node {
   shared_ptr<Material> material_;
 };
 
+// cf. KHR_lights_punctual
+enum struct LightType : uint8_t { kDirectional, kPoint, kSpot };
+
+struct Light {
+  string name_;
+  fmat4 transform_ = fmat4{1}; // light points to -z
+  LightType type_ = LightType::kPoint;
+  fvec3 color_ = {1, 1, 1};
+  float intensity_ = 1; // candela (point/spot) or lux (directional)
+  float range_ = 0;     // 0 if unlimited
+  float inner_cone_angle_ = 0;
+  float outer_cone_angle_ = std::acos(-1) / 4;
+};
+
+// Image based lighting from equirectangular HDR (prefiltered on load, cf. ibl::loadOrPrefilter)
+struct Environment {
+  uint64_t id_ = newAssetId();
+  string filename_;
+  ibl::Prefiltered data_;
+};
+
 struct Camera {
   fmat4 transform_ = fmat4{1};
   float yfov_ = std::acos(-1) / 3.; // 60deg
@@ -96,8 +144,82 @@ struct Camera {
 struct Scene {
   Camera camera_;
   vector<shared_ptr<Node>> nodes_;
+  vector<shared_ptr<Light>> lights_;
+  shared_ptr<Environment> environment_;
+  float environment_intensity_ = 1;
 };
 
+// Copy of what renderer reads from scene so that UI can keep editing it (cf. RenderThread in scene_example.cpp)
+// - only drawable nodes are copied together with their materials (shared ones stay shared), and lights
+// - meshes, textures and environment are referenced as is since they are read-only after loading
+//   (their RR is kept on renderer side cf. RRMap, and the snapshot keeps them alive while renderer reads them)
+inline Scene makeSnapshot(const Scene& scene) {
+  Scene result;
+  result.camera_ = scene.camera_;
+  result.nodes_.reserve(scene.nodes_.size());
+  std::unordered_map<const Material*, shared_ptr<Material>> materials;
+  for (auto& node : scene.nodes_) {
+    if (!node->mesh_) { continue; }
+    auto& copy = result.nodes_.emplace_back(new Node{*node});
+    if (node->material_) {
+      auto& material = materials[node->material_.get()];
+      if (!material) {
+        material.reset(new Material{*node->material_});
+      }
+      copy->material_ = material;
+    }
+  }
+  for (auto& light : scene.lights_) {
+    result.lights_.emplace_back(new Light{*light});
+  }
+  result.environment_ = scene.environment_;
+  result.environment_intensity_ = scene.environment_intensity_;
+  return result;
+}
+
+// Hash of what affects rendered image (O(scene), so per frame change tracking uses SceneManager's versions instead)
+// - meshes and textures are hashed by identity since their CPU data is immutable after loading
+inline uint64_t getSignature(const Camera& camera, uint64_t hash = 0xcbf29ce484222325ull) {
+  hash = utils::hashFnv1a(&camera.transform_, sizeof(camera.transform_), hash);
+  float params[] = {camera.yfov_, camera.aspect_ratio_, camera.znear_, camera.zfar_};
+  return utils::hashFnv1a(params, sizeof(params), hash);
+}
+
+inline uint64_t getSignature(const Scene& scene, uint64_t hash = 0xcbf29ce484222325ull) {
+  hash = getSignature(scene.camera_, hash);
+  for (auto& node : scene.nodes_) {
+    const void* ptrs[] = {node.get(), node->mesh_.get(), node->material_.get()};
+    hash = utils::hashFnv1a(ptrs, sizeof(ptrs), hash);
+    hash = utils::hashFnv1a(&node->transform_, sizeof(node->transform_), hash);
+    if (auto& material = node->material_) {
+      const void* texture = material->base_color_texture_.get();
+      hash = utils::hashFnv1a(&texture, sizeof(texture), hash);
+      hash = utils::hashFnv1a(&material->base_color_factor_, sizeof(material->base_color_factor_), hash);
+      hash = utils::hashFnv1a(&material->use_base_color_texture_, sizeof(bool), hash);
+      hash = utils::hashFnv1a(&material->alpha_mode_, sizeof(AlphaMode), hash);
+      hash = utils::hashFnv1a(&material->alpha_cutoff_, sizeof(float), hash);
+      hash = utils::hashFnv1a(&material->double_sided_, sizeof(bool), hash);
+      float factors[] = {material->metallic_factor_, material->roughness_factor_};
+      hash = utils::hashFnv1a(factors, sizeof(factors), hash);
+      hash = utils::hashFnv1a(&material->unlit_, sizeof(bool), hash);
+    }
+  }
+  for (auto& light : scene.lights_) {
+    hash = utils::hashFnv1a(&light->transform_, sizeof(light->transform_), hash);
+    float params[] = {
+        float(light->type_), light->color_.x, light->color_.y, light->color_.z, light->intensity_,
+        light->range_, light->inner_cone_angle_, light->outer_cone_angle_};
+    hash = utils::hashFnv1a(params, sizeof(params), hash);
+  }
+  const void* environment = scene.environment_.get();
+  hash = utils::hashFnv1a(&environment, sizeof(environment), hash);
+  hash = utils::hashFnv1a(&scene.environment_intensity_, sizeof(float), hash);
+  return hash;
+}
+
+// All meshes' vertex/index data live in a single arena (cf. SceneRenderer)
+using GeometryArena = utils::gl::GeometryArena<VertexAttrs, uint16_t>;
+
 struct AssetRepository {
   string name_;
   string filename_;
@@ -105,6 +227,7 @@ struct AssetRepository {
   vector<shared_ptr<Material>> materials_;
   vector<shared_ptr<Mesh>> meshes_;
   vector<shared_ptr<Texture>> textures_;
+  vector<shared_ptr<Light>> lights_;
 };
 
 
@@ -112,67 +235,772 @@ struct AssetRepository {
 // RR counterparts
 //
 
+// Renderer-owned RR of assets keyed by asset id (cf. SceneRenderer)
+// - RR is released by `collect` once its asset is destroyed, so that GL resource is released on renderer's thread
+//   even when the last reference is dropped by other thread (cf. RenderThread)
+template<typename TAsset, typename TRR>
+struct RRMap {
+  struct Entry {
+    std::weak_ptr<TAsset> asset_;
+    unique_ptr<TRR> rr_;
+  };
+  std::unordered_map<uint64_t, Entry> entries_;
+
+  TRR* find(const TAsset& asset) const {
+    auto it = entries_.find(asset.id_);
+    return it == entries_.end() ? nullptr : it->second.rr_.get();
+  }
+
+  TRR& at(const TAsset& asset) const {
+    auto rr = find(asset);
+    TOY_ASSERT(rr);
+    return *rr;
+  }
+
+  TRR& emplace(const shared_ptr<TAsset>& asset, unique_ptr<TRR> rr) {
+    auto& entry = entries_[asset->id_];
+    entry.asset_ = asset;
+    entry.rr_ = std::move(rr);
+    return *entry.rr_;
+  }
+
+  // Returns number of released ones
+  size_t collect() {
+    size_t result = 0;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      bool expired = it->second.asset_.expired();
+      result += expired;
+      it = expired ? entries_.erase(it) : std::next(it);
+    }
+    return result;
+  }
+};
+
 struct MeshRR {
-  Mesh& owner_;
-  utils::gl::VertexRenderer base_;
+  TOY_CLASS_DELETE_COPY(MeshRR)
+  GeometryArena& arena_;
+  GeometryArena::Range range_;
 
-  MeshRR(Mesh& owner) : owner_{owner} {
-    base_.setData(owner.vertices_, owner.indices_);
+  MeshRR(const Mesh& mesh, GeometryArena& arena) : arena_{arena} {
+    range_ = arena.add(mesh.vertices_, mesh.indices_);
   }
+
+  ~MeshRR() { arena_.release(range_); }
+
+  void draw() const { arena_.draw(range_); }
 };
 
 struct TextureRR {
-  Texture& owner_;
   utils::gl::Texture base_;
+  size_t byte_size_ = 0;
+
+  // CPU side data prepared off the GL thread (cf. TextureResidencyManager)
+  // - either block compressed (from disk cache or freshly encoded) or plain RGBA8 mip chain
+  struct Source {
+    vector<image::Image> mips_;
+    std::optional<image::CompressedImage> compressed_;
+
+    // Sub chain starting from the first level not larger than `max_size`
+    Source tail(int max_size) const {
+      Source result;
+      if (compressed_) {
+        auto& src = *compressed_;
+        auto& dst = result.compressed_.emplace();
+        dst.format_ = src.format_;
+        for (auto level : utils::Range{src.levels_.size()}) {
+          auto size = image::getLevelSize(src.size_, level);
+          if (std::max(size.x, size.y) > max_size) { continue; }
+          if (dst.levels_.empty()) { dst.size_ = size; }
+          dst.levels_.push_back(src.levels_[level]);
+        }
+        return result;
+      }
+      for (auto& mip : mips_) {
+        if (std::max(mip.size_.x, mip.size_.y) <= max_size) {
+          result.mips_.push_back(mip);
+        }
+      }
+      return result;
+    }
+  };
+
+  TextureRR(const Source& source) {
+    ivec2 size;
+    if (auto& compressed = source.compressed_) {
+      size = compressed->size_;
+      GLenum internal_format = (compressed->format_ == image::BlockFormat::kBC1)
+          ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+      base_.setStorage(size, compressed->levels_.size(), internal_format);
+      for (auto level : utils::Range{compressed->levels_.size()}) {
+        auto& data = compressed->levels_[level];
+        base_.setCompressedSubData(level, image::getLevelSize(size, level), internal_format, data);
+        byte_size_ += data.size();
+      }
+    } else {
+      auto& mips = source.mips_;
+      TOY_ASSERT(!mips.empty());
+      size = mips[0].size_;
+      base_.setStorage(size, mips.size(), GL_SRGB8_ALPHA8);
+      for (auto level : utils::Range{mips.size()}) {
+        base_.setSubData(level, mips[level].size_, mips[level].data_.data());
+        byte_size_ += mips[level].data_.size();
+      }
+    }
+    base_.setFilterTrilinear();
+  }
+
+  static Source prepare(const string& filename, bool compress, size_t num_threads = 0) {
+    Source result;
+    if (compress) {
+      auto key = image::getCacheKey(filename);
+      if (key) {
+        result.compressed_ = image::load(image::getCachePath(*key), *key);
+      }
+      if (!result.compressed_) {
+        auto mips = image::generateMipChain(image::load(filename), num_threads);
+        result.compressed_ = image::compress(mips, num_threads);
+        if (key) { image::save(image::getCachePath(*key), *result.compressed_, *key); }
+      }
+      return result;
+    }
+    result.mips_ = image::generateMipChain(image::load(filename), num_threads);
+    return result;
+  }
+};
+
+// Small textures packed into layers of a texture array whose pages persist while textures come and go
+// (cf. atlas::Allocator and SceneRenderer::_addToAtlas)
+// - array is reallocated with more layers when allocator adds page (old layers are copied on GPU)
+// - layers of emptied pages are kept to be reused
+struct TextureAtlasRR {
+  TOY_CLASS_DELETE_COPY(TextureAtlasRR)
+  atlas::Allocator allocator_;
+  unique_ptr<utils::gl::Texture> base_;
+  int num_layers_ = 0; // allocated ones
+  GLuint framebuffer_; // (for copying layers)
+
+  TextureAtlasRR(ivec2 page_size, int gutter) : allocator_{page_size, gutter} {
+    glGenFramebuffers(1, &framebuffer_);
+  }
+
+  ~TextureAtlasRR() {
+    glDeleteFramebuffers(1, &framebuffer_);
+  }
+
+  // Uploads image's mip chain (cf. atlas::composeTile) where it's placed (layer is -1 if it doesn't fit at all)
+  atlas::Layout::Placement insert(const image::Image& image) {
+    auto placement = allocator_.insert(image.size_);
+    if (placement.layer < 0) { return placement; }
+    if (placement.layer >= num_layers_) {
+      _reallocate(std::max(2 * num_layers_, placement.layer + 1));
+    }
+    auto tile = atlas::composeTile(image, allocator_.gutter_);
+    auto origin = placement.position - allocator_.gutter_;
+    for (auto level : utils::Range{tile.size()}) {
+      auto& mip = tile[level];
+      base_->setSubDataArray(level, placement.layer, mip.size_, mip.data_.data(), origin / (1 << level));
+    }
+    return placement;
+  }
+
+  void remove(const atlas::Layout::Placement& placement) {
+    allocator_.remove(placement);
+  }
+
+  // Copy each layer and level through framebuffer (i.e. no glCopyImageSubData on GL 3.3)
+  void _reallocate(int num_layers) {
+    auto texture = std::make_unique<utils::gl::Texture>();
+    texture->target_ = GL_TEXTURE_2D_ARRAY;
+    auto num_levels = atlas::getNumLevels(allocator_.gutter_);
+    texture->setStorageArray(allocator_.page_size_, num_layers, num_levels, GL_SRGB8_ALPHA8);
+    texture->setFilterTrilinear();
+    if (base_) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer_);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, texture->handle_);
+      for (auto level : utils::Range{num_levels}) {
+        auto size = glm::max(ivec2{1, 1}, allocator_.page_size_ / (1 << level));
+        for (auto layer : utils::Range{num_layers_}) {
+          glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, base_->handle_, level, layer);
+          glCopyTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, 0, 0, size.x, size.y);
+        }
+      }
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+    base_ = std::move(texture);
+    num_layers_ = num_layers;
+  }
+};
+
+// Where texture is packed within atlas (used instead of TextureRR for small textures), released with texture
+struct AtlasPlacement {
+  TOY_CLASS_DELETE_COPY(AtlasPlacement)
+  TextureAtlasRR& atlas_;
+  atlas::Layout::Placement placement_;
+  fvec4 rect_; // uv offset and scale within the layer
+
+  AtlasPlacement(TextureAtlasRR& atlas, const image::Image& image) : atlas_{atlas} {
+    placement_ = atlas.insert(image);
+    rect_ = atlas::Layout::getRect(placement_, atlas.allocator_.page_size_);
+  }
+
+  ~AtlasPlacement() { atlas_.remove(placement_); }
+};
+
+struct EnvironmentRR {
+  utils::gl::Texture specular_, brdf_lut_;
+  size_t byte_size_ = 0;
 
-  TextureRR(Texture& owner) : owner_{owner} {
-    auto data = stbi_load(owner_.filename_.data(), &owner_.size_.x, &owner_.size_.y, nullptr, 4);
-    TOY_ASSERT_CUSTOM(data, fmt::format("stbi_load failed: {}", owner_.filename_));
-    base_.setData(owner_.size_, data);
-    stbi_image_free(data);
+  EnvironmentRR(const Environment& environment) {
+    auto& data = environment.data_;
+    TOY_ASSERT(!data.specular_.empty());
+    specular_.format_triple_ = {GL_RGB16F, GL_RGB, GL_FLOAT};
+    specular_.setStorageCube(data.specular_[0].size_, data.specular_.size(), GL_RGB16F);
+    for (auto level : utils::Range{data.specular_.size()}) {
+      auto& image = data.specular_[level];
+      size_t face_size = image.size_ * image.size_;
+      for (auto face : utils::Range{6}) {
+        specular_.setSubDataCube(level, face, image.size_, &image.data_[face * face_size]);
+      }
+      byte_size_ += 6 * face_size * 6; // (RGB16F)
+    }
+    specular_.params_[GL_TEXTURE_MIN_FILTER] = GL_LINEAR_MIPMAP_LINEAR;
+    specular_.params_[GL_TEXTURE_MAG_FILTER] = GL_LINEAR;
+    specular_.applyParams();
+
+    brdf_lut_.format_triple_ = {GL_RG16F, GL_RG, GL_FLOAT};
+    brdf_lut_.params_ = {
+        {GL_TEXTURE_MIN_FILTER, GL_LINEAR}, {GL_TEXTURE_MAG_FILTER, GL_LINEAR},
+        {GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE}, {GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE}};
+    brdf_lut_.setData({data.brdf_lut_size_, data.brdf_lut_size_}, data.brdf_lut_.data());
+    byte_size_ += data.brdf_lut_.size() * 4;
   }
 };
 
-// TODO: implement bvh (currently traverses all triangle...)
+//
+// Keeps full resolution textures within VRAM budget by evicting least recently used ones
+// - `acquire` during draw marks texture as used and returns what's resident now
+//   (i.e. low mips while full one is streamed asynchronously)
+// - `update` once per frame to finish streaming and to evict
+//
+struct TextureResidencyManager {
+  constexpr static int kLowMipSize = 32;
+  constexpr static size_t kMaxPending = 4;
+
+  struct Entry {
+    std::weak_ptr<Texture> texture_;
+    unique_ptr<TextureRR> rr_;     // full mip chain (can be evicted)
+    unique_ptr<TextureRR> low_rr_; // only small mips, always resident
+    uint64_t last_used_frame_ = 0;
+    std::future<TextureRR::Source> pending_;
+    string error_; // of the last loading, never retried (i.e. stays low res or not drawn at all)
+  };
+
+  std::unordered_map<uint64_t, Entry> entries_; // by Texture::id_
+  uint64_t frame_ = 1;
+  size_t budget_ = size_t{256} << 20;
+  bool compress_ = false;
+
+  // stats
+  size_t used_ = 0, used_low_ = 0;
+  size_t num_resident_ = 0, num_pending_ = 0;
+  size_t num_evicted_ = 0, num_streamed_ = 0, num_failed_ = 0;
+
+  // Initial upload of already prepared source (cf. SceneRenderer::updateRenderResouce)
+  void add(const shared_ptr<Texture>& texture, const TextureRR::Source& source) {
+    auto& entry = entries_[texture->id_];
+    entry.texture_ = texture;
+    entry.last_used_frame_ = frame_;
+    entry.low_rr_.reset(new TextureRR(source.tail(kLowMipSize)));
+    entry.rr_.reset(new TextureRR(source));
+  }
+
+  // Texture which couldn't be prepared (so that it's not tried again)
+  void addFailed(const shared_ptr<Texture>& texture, const string& error) {
+    auto& entry = entries_[texture->id_];
+    entry.texture_ = texture;
+    entry.last_used_frame_ = frame_;
+    _setError(*texture, entry, error);
+  }
+
+  void _setError(const Texture& texture, Entry& entry, const string& error) {
+    fmt::print(stderr, "texture loading failed ({}): {}\n", texture.filename_, error);
+    entry.error_ = error;
+    num_failed_++;
+  }
+
+  bool contains(const Texture& texture) const {
+    return entries_.count(texture.id_);
+  }
+
+  GLuint acquire(const Texture& texture) {
+    auto it = entries_.find(texture.id_);
+    if (it == entries_.end()) { return 0; }
+    auto& entry = it->second;
+    entry.last_used_frame_ = frame_;
+    if (entry.rr_) {
+      return entry.rr_->base_.handle_;
+    }
+    if (!entry.pending_.valid() && entry.error_.empty() && num_pending_ < kMaxPending) {
+      num_pending_++;
+      entry.pending_ = std::async(std::launch::async, [filename = texture.filename_, compress = compress_]() {
+        return TextureRR::prepare(filename, compress, 1);
+      });
+    }
+    return entry.low_rr_ ? entry.low_rr_->base_.handle_ : 0;
+  }
+
+  // Least recently used first among ones not used since last update until usage fits in budget
+  struct EvictionCandidate {
+    uint64_t last_used_frame_;
+    size_t byte_size_;
+  };
+  static vector<size_t> selectEvictions(
+      const vector<EvictionCandidate>& candidates, size_t used, size_t budget, uint64_t frame) {
+    vector<size_t> order;
+    for (auto i : utils::Range{candidates.size()}) {
+      if (candidates[i].last_used_frame_ < frame) { order.push_back(i); }
+    }
+    std::sort(order.begin(), order.end(), [&](auto a, auto b) {
+      return candidates[a].last_used_frame_ < candidates[b].last_used_frame_;
+    });
+    vector<size_t> result;
+    for (auto i : order) {
+      if (used <= budget) { break; }
+      used -= candidates[i].byte_size_;
+      result.push_back(i);
+    }
+    return result;
+  }
+
+  void update() {
+    // Finish streaming
+    for (auto& [id, entry] : entries_) {
+      if (!entry.pending_.valid()) { continue; }
+      if (entry.pending_.wait_for(std::chrono::seconds{0}) != std::future_status::ready) { continue; }
+      num_pending_--;
+      try {
+        auto source = entry.pending_.get();
+        if (!entry.texture_.expired()) {
+          entry.rr_.reset(new TextureRR(source));
+          num_streamed_++;
+        }
+      } catch (std::exception& e) {
+        if (auto texture = entry.texture_.lock()) {
+          _setError(*texture, entry, e.what());
+        }
+      }
+    }
+
+    // Forget destroyed textures (pending ones are dropped when ready above)
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      bool expired = it->second.texture_.expired() && !it->second.pending_.valid();
+      it = expired ? entries_.erase(it) : std::next(it);
+    }
+
+    // Usage and eviction
+    vector<Entry*> resident;
+    vector<EvictionCandidate> candidates;
+    used_ = used_low_ = num_resident_ = 0;
+    for (auto& [id, entry] : entries_) {
+      if (entry.texture_.expired()) { continue; }
+      if (entry.low_rr_) { used_low_ += entry.low_rr_->byte_size_; }
+      if (!entry.rr_) { continue; }
+      used_ += entry.rr_->byte_size_;
+      num_resident_++;
+      resident.push_back(&entry);
+      candidates.push_back({entry.last_used_frame_, entry.rr_->byte_size_});
+    }
+    for (auto i : selectEvictions(candidates, used_, budget_, frame_)) {
+      resident[i]->rr_.reset();
+      used_ -= candidates[i].byte_size_;
+      num_resident_--;
+      num_evicted_++;
+    }
+    frame_++;
+  }
+};
+
+// TODO: implement bvh (currently traverses all triangle but whole mesh is culled by its bounds)
 struct MeshBVH {
   Mesh& owner_;
-  MeshBVH(Mesh& mesh) : owner_{mesh} {}
+  fvec3 lo_ = fvec3{FLT_MAX}, hi_ = fvec3{-FLT_MAX}; // bounds in mesh coordinate
+
+  MeshBVH(Mesh& mesh) : owner_{mesh} {
+    for (auto& v : mesh.vertices_) {
+      lo_ = glm::min(lo_, v.position);
+      hi_ = glm::max(hi_, v.position);
+    }
+  }
 
   struct RayTestResult {
     bool hit;
     std::array<fvec3, 3> face;
     fvec3 point;
     float t;
+    uint32_t triangle = 0; // index of `face` (i.e. indices_[3 * triangle + i])
   };
 
-  RayTestResult rayTest(const fvec3& src, const fvec3& dir) {
+  // Closest hit nearer than `t_max`
+  RayTestResult rayTest(const fvec3& src, const fvec3& dir, float t_max = FLT_MAX) {
+    RayTestResult result = { .hit = false, .t = t_max };
+    auto t_bounds = utils::hit::Ray_AABB(src, dir, lo_, hi_);
+    if (!t_bounds || !(*t_bounds < t_max)) { return result; }
+    for (auto k : utils::Range{owner_.indices_.size() / 3}) {
+      _rayTestTriangle(src, dir, k, result);
+    }
+    return result;
+  }
+
+  // Single triangle (e.g. previous hit as first candidate cf. rayIntersection's `hint`)
+  RayTestResult rayTestTriangle(const fvec3& src, const fvec3& dir, uint32_t triangle, float t_max = FLT_MAX) {
+    RayTestResult result = { .hit = false, .t = t_max };
+    if (3 * size_t(triangle) + 2 < owner_.indices_.size()) {
+      _rayTestTriangle(src, dir, triangle, result);
+    }
+    return result;
+  }
+
+  void _rayTestTriangle(const fvec3& src, const fvec3& dir, uint32_t k, RayTestResult& result) {
     auto& vs = owner_.vertices_;
     auto& is = owner_.indices_;
-    RayTestResult result = { .hit = false, .t = FLT_MAX };
+    size_t l = 3 * k;
+    fvec3& p0 = vs[is[l + 0]].position;
+    fvec3& p1 = vs[is[l + 1]].position;
+    fvec3& p2 = vs[is[l + 2]].position;
+    auto tmp_result = utils::hit::Ray_Triangle(src, dir, p0, p1, p2);
+    if (!tmp_result.valid) { return; }
+
+    fvec2& uv = tmp_result.uv;
+    bool hit = uv.x >= 0 && uv.y >= 0 && (uv.x + uv.y <= 1);
+    if (!hit) { return; }
+    if (!(tmp_result.t < result.t)) { return; }
 
-    for (auto k : utils::Range{is.size() / 3}) {
-      size_t l = 3 * k;
-      fvec3& p0 = vs[is[l + 0]].position;
-      fvec3& p1 = vs[is[l + 1]].position;
-      fvec3& p2 = vs[is[l + 2]].position;
-      auto tmp_result = utils::hit::Ray_Triangle(src, dir, p0, p1, p2);
-      if (!tmp_result.valid) { continue; }
+    result.hit = true;
+    result.t = tmp_result.t;
+    result.face = {p0, p1, p2};
+    result.point = tmp_result.p;
+    result.triangle = k;
+  }
+};
+
+struct SceneRayIntersection {
+  MeshBVH::RayTestResult result;
+  shared_ptr<Node> node;
+};
 
-      fvec2& uv = tmp_result.uv;
-      bool hit = uv.x >= 0 && uv.y >= 0 && (uv.x + uv.y <= 1);
-      if (!hit) { continue; }
-      if (!(tmp_result.t < result.t)) { continue; }
+// Closest hit among all nodes' meshes (in scene coordinate)
+// - `hint` (e.g. previous hit of nearby ray) is tested first so that farther nodes are culled by bounds early
+//   (parameter t is same in node's coordinate since ray is transformed as a whole)
+// - when hinted triangle is hit, its node isn't walked again (i.e. it's taken as closest within that node,
+//   which holds for coherent rays such as hover unless mesh occludes itself)
+inline SceneRayIntersection rayIntersection(
+    const Scene& scene, const fvec3& src, const fvec3& dir, const SceneRayIntersection* hint = nullptr) {
+  MeshBVH::RayTestResult result = { .hit = false, .t = FLT_MAX };
+  shared_ptr<Node> hit_node;
 
-      result.hit = true;
-      result.t = tmp_result.t;
-      result.face = {p0, p1, p2};
-      result.point = tmp_result.p;
+  auto test = [&](const shared_ptr<Node>& node, std::optional<uint32_t> triangle) {
+    fmat4 inv_transform = glm::inverse(node->transform_);
+    fvec3 node_src = inv_transform * fvec4{src, 1};
+    fvec3 node_dir = fmat3{inv_transform} * dir;
+    auto& bvh = *node->mesh_->bvh_;
+    auto tmp_result = triangle
+        ? bvh.rayTestTriangle(node_src, node_dir, *triangle, result.t)
+        : bvh.rayTest(node_src, node_dir, result.t);
+    if (!tmp_result.hit) { return; }
+
+    result.hit = true;
+    result.t = tmp_result.t;
+    result.triangle = tmp_result.triangle;
+    result.point = fvec3{node->transform_ * fvec4{tmp_result.point, 1}};
+    for (auto i : utils::Range{3}) {
+      result.face[i] = fvec3{node->transform_ * fvec4{tmp_result.face[i], 1}};
     }
+    hit_node = node;
+  };
+
+  const Node* tested = nullptr;
+  if (hint && hint->result.hit && hint->node && hint->node->mesh_) {
+    test(hint->node, hint->result.triangle);
+    if (result.hit) { tested = hint->node.get(); }
+  }
+  for (auto& node : scene.nodes_) {
+    if (!node->mesh_ || node.get() == tested) { continue; }
+    test(node, {});
+  }
+
+  return SceneRayIntersection{result, hit_node};
+}
+
+//
+// Shader variant as bitmask of features used by a draw (cf. SceneRenderer::getProgram)
+// - each bit becomes "#define" so that each program only pays for what it uses (i.e. no uniform branch)
+// - variants are compiled lazily on first use and draws are bucketed by variant
+//
+using ShaderVariant = uint32_t;
 
+namespace shader_variant {
+  enum : ShaderVariant {
+    kBaseColorTexture = 1 << 0,
+    kBaseColorAtlas   = 1 << 1, // (only with kBaseColorTexture)
+    kVertexColor      = 1 << 2,
+    kAlphaMask        = 1 << 3,
+    kAlphaBlend       = 1 << 4,
+    kLighting         = 1 << 5, // (only with normals and not unlit)
+    kDebugOverdraw    = 1 << 6, // (added by renderer, cf. SceneRenderer::Settings::debug_overdraw_)
+    kDoubleSided      = 1 << 7,
+    kWeightedOit      = 1 << 8, // (added by renderer for kAlphaBlend, cf. SceneRenderer::Settings::use_weighted_oit_)
+  };
+
+  inline const char* kDefines[] = {
+    "HAS_BASE_COLOR_TEXTURE",
+    "BASE_COLOR_ATLAS",
+    "HAS_VERTEX_COLOR",
+    "ALPHA_MODE_MASK",
+    "ALPHA_MODE_BLEND",
+    "LIGHTING",
+    "DEBUG_OVERDRAW",
+    "DOUBLE_SIDED",
+    "WEIGHTED_OIT",
+  };
+}
+
+// `atlased` when base color texture is packed into atlas (which is renderer's decision cf. AtlasPlacement)
+inline ShaderVariant getShaderVariant(const Mesh& mesh, const Material* material, bool atlased = false) {
+  using namespace shader_variant;
+  ShaderVariant result = 0;
+  if (mesh.has_vertex_color_) { result |= kVertexColor; }
+  if (mesh.has_normal_ && !(material && material->unlit_)) { result |= kLighting; }
+  if (!material) { return result; }
+  if (material->base_color_texture_ && material->use_base_color_texture_) {
+    result |= kBaseColorTexture;
+    if (atlased) { result |= kBaseColorAtlas; }
+  }
+  if (material->alpha_mode_ == AlphaMode::kMask) { result |= kAlphaMask; }
+  if (material->alpha_mode_ == AlphaMode::kBlend) { result |= kAlphaBlend; }
+  if (material->double_sided_) { result |= kDoubleSided; }
+  return result;
+}
+
+inline vector<string> getShaderDefines(ShaderVariant variant) {
+  vector<string> result;
+  for (auto i : utils::Range{std::size(shader_variant::kDefines)}) {
+    if (variant & (1u << i)) { result.push_back(shader_variant::kDefines[i]); }
+  }
+  return result;
+}
+
+//
+// Sort keys of draws for render_queue::RenderQueue (cf. SceneRenderer::_sortDraws), fields from the most significant bits
+// - opaque:      (pass 0, variant, material, mesh, depth front to back) when submitted per node, or
+//                (pass 0, variant, texture, depth front to back) with multi-draw where each (variant, texture) becomes
+//                a single bucket (cf. buildDrawList) so that draws within it are simply front to back (for early-z)
+// - transparent: (pass 1, depth back to front) or same fields as per node opaque with weighted OIT
+// - texture, material and mesh are ids by first appearance since `clear`
+// - draws are `add`ed first so that `build` sizes id fields by this frame's id counts and depth takes the remaining bits
+//   (i.e. ids are never clamped, which would interleave draws of different state by depth)
+//
+struct DrawKeyBuilder {
+  constexpr static int kPassBits = 1, kVariantBits = 9;
+  constexpr static int kMinDepthBits = 8, kMaxDepthBits = 32;
+  static_assert(shader_variant::kWeightedOit < (1u << kVariantBits));
+
+  struct Draw {
+    ShaderVariant variant;
+    uint32_t texture, material, mesh; // ids
+    float depth;
+  };
+
+  bool multi_draw_ = false;
+  bool weighted_oit_ = false;
+  std::unordered_map<const void*, uint32_t> texture_ids_, material_ids_, mesh_ids_;
+  vector<Draw> draws_;
+
+  // Field widths of last `build`
+  int texture_bits_ = 0, material_bits_ = 0, mesh_bits_ = 0, depth_bits_ = 0;
+
+  void clear() {
+    texture_ids_.clear();
+    material_ids_.clear();
+    mesh_ids_.clear();
+    draws_.clear();
+  }
+
+  static uint32_t _getId(std::unordered_map<const void*, uint32_t>& ids, const void* ptr) {
+    return ids.emplace(ptr, ids.size()).first->second;
+  }
+
+  // Bits to hold ids [0, count) (at least 1 for KeyPacker)
+  static int _getIdBits(size_t count) {
+    int result = 1;
+    while (result < 32 && (uint64_t{1} << result) < count) { result++; }
     return result;
   }
+
+  // `texture` is what's bound for the draw (i.e. atlas when atlased and nullptr when untextured), `depth` is view depth
+  // (payload of its key is the order of `add`)
+  void add(ShaderVariant variant, const void* texture, const Material* material, const Mesh* mesh, float depth) {
+    bool blend = variant & shader_variant::kAlphaBlend;
+    Draw draw{variant, 0, 0, 0, depth};
+    if (blend && !weighted_oit_) {
+      // (depth only)
+    } else if (multi_draw_ && !blend) {
+      draw.texture = _getId(texture_ids_, texture);
+    } else {
+      draw.material = _getId(material_ids_, material);
+      draw.mesh = _getId(mesh_ids_, mesh);
+    }
+    draws_.push_back(draw);
+  }
+
+  void build(render_queue::RenderQueue& queue) {
+    texture_bits_ = _getIdBits(texture_ids_.size());
+    material_bits_ = _getIdBits(material_ids_.size());
+    mesh_bits_ = _getIdBits(mesh_ids_.size());
+    int remaining = 64 - kPassBits - kVariantBits;
+    int state_bits = std::max(texture_bits_, material_bits_ + mesh_bits_);
+    TOY_ASSERT(state_bits + kMinDepthBits <= remaining); // (2^23 materials and meshes wouldn't fit in memory anyway)
+    depth_bits_ = std::min(remaining - state_bits, kMaxDepthBits);
+    for (auto i : utils::Range{draws_.size()}) {
+      queue.push(_getKey(draws_[i]), i);
+    }
+  }
+
+  uint64_t _getKey(const Draw& draw) const {
+    bool blend = draw.variant & shader_variant::kAlphaBlend;
+    render_queue::KeyPacker key;
+    key.push(blend, kPassBits);
+    if (blend && !weighted_oit_) {
+      return key.push(render_queue::getDepthKey(draw.depth, 32, true), 32).get();
+    }
+    key.push(draw.variant, kVariantBits);
+    if (multi_draw_ && !blend) {
+      key.push(draw.texture, texture_bits_);
+    } else {
+      key.push(draw.material, material_bits_).push(draw.mesh, mesh_bits_);
+    }
+    return key.push(render_queue::getDepthKey(draw.depth, depth_bits_), depth_bits_).get();
+  }
+
+  // Where transparent ones start (cf. render_queue::RenderQueue::lowerBound)
+  static uint64_t getTransparentBegin() {
+    return render_queue::KeyPacker{}.push(1, kPassBits).get();
+  }
 };
 
+//
+// CPU-side draw list for multi-draw-indirect submission (cf. SceneRenderer::_prepareMultiIndirect)
+// - each node with mesh becomes a single DrawElementsIndirectCommand
+//   whose `base_instance` indexes per-draw data (i.e. instanced vertex attribute with divisor 1)
+// - commands keep the order of given nodes (i.e. sorted by render queue cf. SceneRenderer::_sortDraws) and
+//   consecutive ones of the same shader variant and base color texture make a bucket,
+//   which is submitted by a single glMultiDrawElementsIndirect
+//
+struct DrawData {
+  uint32_t transform_index;
+  uint32_t material_index;
+};
+
+// std430 layout
+struct MaterialData {
+  fvec4 base_color_factor = {1, 1, 1, 1};
+  int32_t use_base_color_texture = 0; // (not read by shader since variant decides)
+  int32_t atlas_layer = -1;
+  float alpha_cutoff = 0.5;
+  int32_t _padding[1] = {};
+  fvec4 atlas_rect = {0, 0, 1, 1};
+  float metallic = 1;
+  float roughness = 1;
+  int32_t _padding2[2] = {};
+};
+
+struct DrawList {
+  struct Bucket {
+    ShaderVariant variant;
+    const Texture* texture;       // nullptr for untextured or atlased draws
+    const TextureAtlasRR* atlas;  // non-null for atlased draws
+    uint32_t offset;      // into commands_
+    uint32_t count;
+  };
+  vector<utils::gl::DrawElementsIndirectCommand> commands_;
+  vector<DrawData> draw_data_;
+  vector<fmat4> transforms_;
+  vector<MaterialData> materials_;
+  vector<Bucket> buckets_;
+
+  // temporary (kept only to reuse allocation)
+  std::unordered_map<const Material*, uint32_t> _material_indices;
+
+  void clear() {
+    commands_.clear();
+    draw_data_.clear();
+    transforms_.clear();
+    materials_.clear();
+    buckets_.clear();
+    _material_indices.clear();
+  }
+};
+
+// `nodes` have mesh and are in submission order,
+// `get_range(const Mesh&)` returns GeometryArena::Range of the mesh and
+// `get_placement(const Texture&)` returns `const AtlasPlacement*` (nullptr when not atlased)
+// (these are parameters so that draw list generation can run without GL resource e.g. for benchmark)
+template<typename GetRangeFunc, typename GetPlacementFunc>
+inline void buildDrawList(
+    const vector<const Node*>& nodes, DrawList& result, GetRangeFunc get_range, GetPlacementFunc get_placement) {
+  result.clear();
+
+  // 0th material for nodes without material
+  result.materials_.emplace_back();
+
+  for (auto node : nodes) {
+    TOY_ASSERT(node->mesh_);
+    auto draw_index = (uint32_t)result.draw_data_.size();
+    result.transforms_.push_back(node->transform_);
+
+    uint32_t material_index = 0;
+    const Texture* texture = nullptr;
+    const AtlasPlacement* placement = nullptr;
+    const TextureAtlasRR* atlas = nullptr;
+    if (auto& mat = node->material_) {
+      auto [it, inserted] = result._material_indices.try_emplace(mat.get(), result.materials_.size());
+      material_index = it->second;
+      bool use_texture = mat->base_color_texture_ && mat->use_base_color_texture_;
+      if (use_texture) {
+        texture = mat->base_color_texture_.get();
+        placement = get_placement(*texture);
+        atlas = placement ? &placement->atlas_ : nullptr;
+      }
+      if (inserted) {
+        auto& data = result.materials_.emplace_back();
+        data.base_color_factor = mat->base_color_factor_;
+        data.use_base_color_texture = use_texture;
+        data.alpha_cutoff = mat->alpha_cutoff_;
+        data.metallic = mat->metallic_factor_;
+        data.roughness = mat->roughness_factor_;
+        if (atlas) {
+          data.atlas_layer = placement->placement_.layer;
+          data.atlas_rect = placement->rect_;
+        }
+      }
+      if (atlas) {
+        texture = nullptr;
+      }
+    }
+    result.draw_data_.push_back({draw_index, material_index});
+
+    // new bucket when state changes from previous draw
+    auto variant = getShaderVariant(*node->mesh_, node->material_.get(), atlas);
+    auto* bucket = result.buckets_.empty() ? nullptr : &result.buckets_.back();
+    if (!bucket || bucket->variant != variant || bucket->texture != texture || bucket->atlas != atlas) {
+      bucket = &result.buckets_.emplace_back(DrawList::Bucket{variant, texture, atlas, draw_index, 0});
+    }
+    bucket->count++;
+
+    auto range = get_range(*node->mesh_);
+    result.commands_.push_back({range.count, 1, range.first_index, range.base_vertex, draw_index});
+  }
+}
+
 //
 // gltf importer with cgltf
 // cf. https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md
@@ -261,11 +1089,22 @@ namespace gltf {
       if (gmat->has_pbr_metallic_roughness) {
         auto& pbr = gmat->pbr_metallic_roughness;
         mat->base_color_factor_ = *(fvec4*)(pbr.base_color_factor);
+        mat->metallic_factor_ = pbr.metallic_factor;
+        mat->roughness_factor_ = pbr.roughness_factor;
         if (pbr.base_color_texture.texture) {
           mat->base_color_texture_ = ref_map_texture[pbr.base_color_texture.texture];
           TOY_ASSERT(mat->base_color_texture_);
         }
       }
+      switch (gmat->alpha_mode) {
+        case cgltf_alpha_mode_opaque: mat->alpha_mode_ = AlphaMode::kOpaque; break;
+        case cgltf_alpha_mode_mask: mat->alpha_mode_ = AlphaMode::kMask; break;
+        case cgltf_alpha_mode_blend: mat->alpha_mode_ = AlphaMode::kBlend; break;
+        default:;
+      }
+      mat->alpha_cutoff_ = gmat->alpha_cutoff;
+      mat->double_sided_ = gmat->double_sided;
+      mat->unlit_ = gmat->unlit;
     }
 
     // 4. load mesh
@@ -334,6 +1173,8 @@ namespace gltf {
         TOY_ASSERT(is_zero_or_num(prim.tangents.size()));
         TOY_ASSERT(is_zero_or_num(prim.texcoords.size()));
         TOY_ASSERT(is_zero_or_num(prim.colors.size()));
+        mesh->has_vertex_color_ = prim.colors.size() > 0;
+        mesh->has_normal_ = prim.normals.size() > 0;
         if (prim.colors.size() == 0) {
           prim.colors = {num, fvec4{1, 1, 1, 1}};
         }
@@ -366,6 +1207,26 @@ namespace gltf {
       cgltf_node_transform_local(gnode, (float*)&node->transform_);
     }
 
+    // 6. load light (KHR_lights_punctual)
+    for (auto [i, gnode] : Enumerate{gdata->nodes, gdata->nodes_count}) {
+      auto glight = gnode->light;
+      if (!glight) { continue; }
+
+      auto& light = result.lights_.emplace_back(new Light);
+      light->name_ = glight->name ? glight->name : fmt::format("Light ({})", i);
+      cgltf_node_transform_world(gnode, (float*)&light->transform_);
+      switch (glight->type) {
+        case cgltf_light_type_directional: light->type_ = LightType::kDirectional; break;
+        case cgltf_light_type_spot: light->type_ = LightType::kSpot; break;
+        default: light->type_ = LightType::kPoint;
+      }
+      light->color_ = *(fvec3*)(glight->color);
+      light->intensity_ = glight->intensity;
+      light->range_ = glight->range;
+      light->inner_cone_angle_ = glight->spot_inner_cone_angle;
+      light->outer_cone_angle_ = glight->spot_outer_cone_angle;
+    }
+
     return result;
   }
 
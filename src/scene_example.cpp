@@ -1,9 +1,18 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
 #include "window.hpp"
 #include "panel_system.hpp"
 #include "panel_system_utils.hpp"
 #include "utils.hpp"
 #include "utils_imgui.hpp"
 #include "scene.hpp"
+#include "lighting.hpp"
+#include "shadow.hpp"
+#include "render_queue.hpp"
+#include "profiler.hpp"
+#include "program_cache.hpp"
 
 namespace toy {
 
@@ -11,80 +20,1166 @@ using namespace scene;
 using glm::ivec2, glm::fvec2, glm::fvec3, glm::fvec4, glm::fmat4;
 using std::map, std::vector, std::string, std::unique_ptr, std::shared_ptr, std::weak_ptr;
 
-// TODO:
-// - is it possible to do similar thing without embedding unique_ptr<XxxRR> within Mesh, Texture, etc... ??
-//   and possibly move those OpenGL resource to be owned by this "SceneRenderer" ??
+// Draws viewport's 3D overlay (cf. utils::imgui::Overlay3D) into framebuffer already having scene's color/depth
+struct OverlayRenderer {
+  using Overlay3D = utils::imgui::Overlay3D;
+  shared_ptr<utils::gl::Program> line_program_, grid_program_;
+  unique_ptr<utils::gl::Buffer> segment_buffer_;
+  GLuint line_vertex_array_, grid_vertex_array_;
+
+  OverlayRenderer() {
+    #include "scene_example_shaders.hpp"
+    auto& program_cache = utils::gl::ProgramCache::get();
+    line_program_ = program_cache.getProgram(overlay_line_vertex_shader_source, overlay_line_fragment_shader_source);
+    grid_program_ = program_cache.getProgram(overlay_grid_vertex_shader_source, overlay_grid_fragment_shader_source);
+    segment_buffer_.reset(new utils::gl::Buffer{GL_ARRAY_BUFFER});
+    glGenVertexArrays(1, &line_vertex_array_);
+    glGenVertexArrays(1, &grid_vertex_array_); // (no attributes but core profile requires one bound)
+
+    // per-segment data as instanced attribute (quad's vertices are from gl_VertexID)
+    using Segment = Overlay3D::Segment;
+    glBindVertexArray(line_vertex_array_);
+    glBindBuffer(GL_ARRAY_BUFFER, segment_buffer_->handle_);
+    for (auto [name, offset] : {
+        std::pair{"seg_p0_", offsetof(Segment, p0)},
+        std::pair{"seg_p1_", offsetof(Segment, p1)},
+        std::pair{"seg_color_", offsetof(Segment, color)}}) {
+      auto location = glGetAttribLocation(line_program_->handle_, name);
+      TOY_ASSERT(location != -1);
+      glEnableVertexAttribArray(location);
+      glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Segment), (GLvoid*)offset);
+      glVertexAttribDivisor(location, 1);
+    }
+  }
+
+  ~OverlayRenderer() {
+    glDeleteVertexArrays(1, &line_vertex_array_);
+    glDeleteVertexArrays(1, &grid_vertex_array_);
+  }
+
+  void draw(const Overlay3D& overlay, const Camera& camera, const gl::Framebuffer& framebuffer) {
+    if (overlay.empty()) { return; }
+    TOY_PROFILE_SCOPE("OverlayRenderer::draw");
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.getDrawHandle());
+    glViewport(0, 0, framebuffer.size_.x, framebuffer.size_.y);
+
+    // Blend over scene (depth tested but not written so that overlay doesn't occlude itself)
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glDisable(GL_CULL_FACE);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+
+    fmat4 sceneCo_to_clipCo = camera.get_sceneCo_to_clipCo();
+    if (!overlay.grids.empty()) {
+      glUseProgram(grid_program_->handle_);
+      grid_program_->setUniform("sceneCo_to_clipCo_", sceneCo_to_clipCo);
+      grid_program_->setUniform("clipCo_to_sceneCo_", glm::inverse(sceneCo_to_clipCo));
+      glBindVertexArray(grid_vertex_array_);
+      for (auto& grid : overlay.grids) {
+        grid_program_->setUniform("plane_", grid.plane);
+        grid_program_->setUniform("grid_", fvec4{grid.bound, grid.division, grid.alpha.x, grid.alpha.y});
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+      }
+    }
+
+    glUseProgram(line_program_->handle_);
+    line_program_->setUniform("sceneCo_to_clipCo_", sceneCo_to_clipCo);
+    line_program_->setUniform("viewport_size_", fvec4{framebuffer.size_, 0, 0});
+    glBindVertexArray(line_vertex_array_);
+    for (auto segments : {&overlay.segments, &overlay.segments_on_top}) {
+      if (segments->empty()) { continue; }
+      if (segments == &overlay.segments_on_top) { glDisable(GL_DEPTH_TEST); }
+      segment_buffer_->setData(*segments);
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, segments->size());
+    }
+
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_LESS);
+    glDisable(GL_BLEND);
+  }
+};
+
+// GPU picking by drawing (node, triangle) ids into framebuffer's id attachment (cf. gl::Framebuffer::setIds)
+// - node id is 1-based index among drawable nodes at `draw` (kept as `Pending::nodes` so that result is resolved
+//   to the same nodes even when scene changed before readback) and triangle id is 1-based index within mesh
+//   (0 for background)
+// - requested region is read back into PBO and collected once its fence is signaled (i.e. no stall, usually next frame)
+struct PickingRenderer {
+  struct Request {
+    uint64_t id;
+    ivec2 offset, size; // in framebuffer pixels (y up)
+  };
+  struct Result {
+    uint64_t request_id;
+    ivec2 size;
+    vector<glm::uvec2> ids; // row major (bottom row first)
+    vector<std::weak_ptr<Node>> nodes; // by node id - 1
+
+    // Unique node ids (without background)
+    vector<uint32_t> getNodeIds() const {
+      vector<uint32_t> result;
+      for (auto& id : ids) {
+        if (id.x) { result.push_back(id.x); }
+      }
+      std::sort(result.begin(), result.end());
+      result.erase(std::unique(result.begin(), result.end()), result.end());
+      return result;
+    }
+
+    // Picked nodes which still exist (in node id order)
+    vector<shared_ptr<Node>> getNodes() const {
+      vector<shared_ptr<Node>> result;
+      for (auto id : getNodeIds()) {
+        if (id > nodes.size()) { continue; }
+        if (auto node = nodes[id - 1].lock()) { result.push_back(node); }
+      }
+      return result;
+    }
+  };
+  struct Pending {
+    Request request;
+    vector<std::weak_ptr<Node>> nodes;
+    GLuint pixel_buffer;
+    GLsync fence;
+  };
+
+  shared_ptr<utils::gl::Program> program_;
+  vector<Pending> pending_;
+  vector<GLuint> free_pixel_buffers_;
+
+  PickingRenderer() {
+    #include "scene_example_shaders.hpp"
+    program_ = utils::gl::ProgramCache::get().getProgram(picking_vertex_shader_source, picking_fragment_shader_source);
+  }
+
+  ~PickingRenderer() {
+    for (auto& pending : pending_) {
+      glDeleteSync(pending.fence);
+      free_pixel_buffers_.push_back(pending.pixel_buffer);
+    }
+    glDeleteBuffers(free_pixel_buffers_.size(), free_pixel_buffers_.data());
+  }
+
+  // Framebuffer needs id attachment (depth attachment is overwritten but color is kept)
+  void draw(
+      const Scene& scene, const Camera& camera, const gl::Framebuffer& framebuffer,
+      const RRMap<Mesh, MeshRR>& meshes, const Request& request) {
+    TOY_PROFILE_SCOPE("PickingRenderer::draw");
+    TOY_ASSERT(framebuffer.id_texture_handle_);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.framebuffer_handle_);
+    GLenum draw_buffers[] = {GL_NONE, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, draw_buffers);
+    glViewport(0, 0, framebuffer.size_.x, framebuffer.size_.y);
+
+    // Only requested region matters
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(request.offset.x, request.offset.y, request.size.x, request.size.y);
+    GLuint clear_id[] = {0, 0, 0, 0};
+    glClearBufferuiv(GL_COLOR, 1, clear_id);
+    float depth = 1;
+    glClearBufferfv(GL_DEPTH, 0, &depth);
+    glEnable(GL_DEPTH_TEST);
+
+    glUseProgram(program_->handle_);
+    program_->setUniform("view_inv_xform_", utils::inverseTR(camera.transform_));
+    program_->setUniform("view_projection_", camera.getPerspectiveProjection());
+    GLuint node_id = 0;
+    vector<std::weak_ptr<Node>> nodes;
+    for (auto& node : scene.nodes_) {
+      if (!node->mesh_) { continue; }
+      nodes.push_back(node);
+      node_id++;
+      program_->setUniform("model_xform_", node->transform_);
+      program_->setUniform("node_id_", node_id);
+      bool double_sided = node->material_ && node->material_->double_sided_;
+      double_sided ? glDisable(GL_CULL_FACE) : glEnable(GL_CULL_FACE);
+      meshes.at(*node->mesh_).draw();
+    }
+    glDisable(GL_SCISSOR_TEST);
+    glDrawBuffer(GL_COLOR_ATTACHMENT0);
+
+    // Read back asynchronously
+    GLuint pixel_buffer;
+    if (free_pixel_buffers_.empty()) {
+      glGenBuffers(1, &pixel_buffer);
+    } else {
+      pixel_buffer = free_pixel_buffers_.back();
+      free_pixel_buffers_.pop_back();
+    }
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.framebuffer_handle_);
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixel_buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, request.size.x * request.size.y * sizeof(glm::uvec2), nullptr, GL_STREAM_READ);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(request.offset.x, request.offset.y, request.size.x, request.size.y, GL_RG_INTEGER, GL_UNSIGNED_INT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    pending_.push_back({request, std::move(nodes), pixel_buffer, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+  }
+
+  // Oldest completed request (if any)
+  std::optional<Result> poll() {
+    if (pending_.empty()) { return {}; }
+    auto pending = pending_.front();
+    if (glClientWaitSync(pending.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) { return {}; }
+    pending_.erase(pending_.begin());
+    glDeleteSync(pending.fence);
+
+    auto& request = pending.request;
+    Result result{request.id, request.size, vector<glm::uvec2>(request.size.x * request.size.y), std::move(pending.nodes)};
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.pixel_buffer);
+    glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, result.ids.size() * sizeof(glm::uvec2), result.ids.data());
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    free_pixel_buffers_.push_back(pending.pixel_buffer);
+    return result;
+  }
+};
+
+// Cascaded shadow map of a single directional light (cf. shadow::Cascade)
+// - cascades are layers of a depth texture array sampled with hardware comparison (sampler2DArrayShadow)
+// - casters are culled per cascade by mesh bounds (cf. MeshBVH)
+// - cascade is re-rendered only when what it draws changed (i.e. its snapped projection, casters or their transforms)
+//   so that cascades of static geometry stay cached while camera moves within a texel or scene doesn't change at all
+struct ShadowRenderer {
+  struct CascadeState {
+    shadow::Cascade cascade;
+    uint64_t signature = 0; // of what's in the layer now
+    size_t num_draws = 0;
+    bool cached = false;    // (not re-rendered at last `draw`)
+  };
+  constexpr static const char* kScopeNames[shadow::kMaxCascades] = {
+      "shadow cascade 0", "shadow cascade 1", "shadow cascade 2", "shadow cascade 3"};
+
+  shared_ptr<utils::gl::Program> program_;
+  unique_ptr<utils::gl::Texture> texture_;
+  GLuint framebuffer_;
+  int resolution_ = 0;
+  vector<CascadeState> cascades_;
+  vector<const Node*> nodes_;                  // (temporary for `draw`)
+  vector<std::pair<fvec3, fvec3>> bounds_;     // (light space bounds of `nodes_`)
+  vector<uint32_t> casters_;
+  render_queue::RenderQueue queue_;
+
+  ShadowRenderer() {
+    #include "scene_example_shaders.hpp"
+    program_ = utils::gl::ProgramCache::get().getProgram(shadow_vertex_shader_source, depth_only_fragment_shader_source);
+    glGenFramebuffers(1, &framebuffer_);
+  }
+
+  ~ShadowRenderer() {
+    glDeleteFramebuffers(1, &framebuffer_);
+  }
+
+  void _allocate(int resolution, int num_cascades) {
+    texture_.reset(new utils::gl::Texture);
+    texture_->target_ = GL_TEXTURE_2D_ARRAY;
+    texture_->format_triple_ = {GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_FLOAT};
+    texture_->params_ = {
+        {GL_TEXTURE_MIN_FILTER, GL_LINEAR}, {GL_TEXTURE_MAG_FILTER, GL_LINEAR},
+        {GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE}, {GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE},
+        {GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE}, {GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL}};
+    texture_->setStorageArray({resolution, resolution}, num_cascades, 1, GL_DEPTH_COMPONENT24);
+    resolution_ = resolution;
+    cascades_.assign(num_cascades, {});
+  }
+
+  // `direction` is where light travels (in world), and cascades cover camera's view depth [near, far]
+  void draw(
+      const Scene& scene, const Camera& camera, fvec3 direction, float near, float far,
+      int num_cascades, int resolution, const RRMap<Mesh, MeshRR>& meshes, profiler::GpuProfiler& gpu_profiler) {
+    TOY_PROFILE_SCOPE("ShadowRenderer::draw");
+    TOY_ASSERT(0 < num_cascades && num_cascades <= shadow::kMaxCascades);
+    if (!texture_ || resolution != resolution_ || num_cascades != (int)cascades_.size()) {
+      _allocate(resolution, num_cascades);
+    }
+
+    // casters' bounds in light space
+    auto light_rotation = shadow::getLightRotation(direction);
+    nodes_.clear();
+    bounds_.clear();
+    for (auto& node : scene.nodes_) {
+      if (!node->mesh_ || !node->mesh_->bvh_) { continue; }
+      auto& bvh = *node->mesh_->bvh_;
+      nodes_.push_back(node.get());
+      bounds_.push_back(shadow::transformBounds(light_rotation * node->transform_, bvh.lo_, bvh.hi_));
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+    glDrawBuffer(GL_NONE);
+    glViewport(0, 0, resolution, resolution);
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE); // (both sides cast so that open meshes do too)
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2, 4);
+    glUseProgram(program_->handle_);
+
+    auto splits = shadow::getSplits(near, far, num_cascades);
+    for (auto i : utils::Range{num_cascades}) {
+      auto& state = cascades_[i];
+      state.cascade.fit(
+          light_rotation, camera.transform_, camera.yfov_, camera.aspect_ratio_, splits[i], splits[i + 1], resolution);
+      state.cascade.cullCasters(bounds_, light_rotation, casters_);
+      state.num_draws = casters_.size();
+
+      auto signature = utils::hashFnv1a(&state.cascade.view_projection_, sizeof(fmat4));
+      for (auto index : casters_) {
+        auto node = nodes_[index];
+        const void* ptrs[] = {node, node->mesh_.get()};
+        signature = utils::hashFnv1a(ptrs, sizeof(ptrs), signature);
+        signature = utils::hashFnv1a(&node->transform_, sizeof(fmat4), signature);
+      }
+      state.cached = (signature == state.signature);
+      if (state.cached) { continue; }
+      state.signature = signature;
+
+      TOY_PROFILE_GPU_SCOPE(&gpu_profiler, kScopeNames[i]);
+      glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture_->handle_, 0, i);
+      float depth = 1;
+      glClearBufferfv(GL_DEPTH, 0, &depth);
+      program_->setUniform("view_projection_", state.cascade.view_projection_);
+
+      // nearest to light first (for early-z)
+      queue_.clear();
+      for (auto index : casters_) {
+        auto depth_key = render_queue::getDepthKey(bounds_[index].second.z, 32, true);
+        queue_.push(render_queue::KeyPacker{}.push(depth_key, 32).get(), index);
+      }
+      queue_.sort();
+      for (auto& item : queue_.items_) {
+        auto node = nodes_[item.payload];
+        program_->setUniform("model_xform_", node->transform_);
+        meshes.at(*node->mesh_).draw();
+      }
+    }
+    glDisable(GL_POLYGON_OFFSET_FILL);
+  }
+
+  // For receivers (cf. computeShadow in lighting_shader_source), `num_cascades = 0` disables shadow
+  void setUniforms(utils::gl::Program& program, const Camera& camera, int num_cascades, GLint unit) {
+    program.setUniform("shadow_map_", unit);
+    program.setUniform("num_shadow_cascades_", (GLint)num_cascades);
+    if (num_cascades == 0) { return; }
+    // clip [-1, 1] to texture coordinates [0, 1]
+    fmat4 bias = {
+      0.5,   0,   0, 0,
+        0, 0.5,   0, 0,
+        0,   0, 0.5, 0,
+      0.5, 0.5, 0.5, 1,
+    };
+    fmat4 xforms[shadow::kMaxCascades];
+    fvec4 splits{0}, texel_sizes{0};
+    for (auto i : utils::Range{num_cascades}) {
+      auto& cascade = cascades_[i].cascade;
+      xforms[i] = bias * cascade.view_projection_ * camera.transform_;
+      splits[i] = cascade.far_;
+      texel_sizes[i] = cascade.texel_size_;
+    }
+    program.setUniform("shadow_xforms_", xforms, num_cascades);
+    program.setUniform("shadow_splits_", splits);
+    program.setUniform("shadow_texel_sizes_", texel_sizes);
+  }
+};
+
+// Weighted blended order-independent transparency (cf. WEIGHTED_OIT in fragment_shader_source)
+// - transparent draws accumulate into own targets sharing scene's depth (tested but not written),
+//   then result is composited over opaque color by fullscreen triangle, so draw order doesn't matter
+// - both targets go with a single blend state (GL 3.3 has no per target blending) i.e.
+//   RGBA16F (weighted color, revealage) by rgb (GL_ONE, GL_ONE) and alpha (GL_ZERO, GL_ONE_MINUS_SRC_ALPHA),
+//   R16F weight by (GL_ONE, GL_ONE)
+// - multisampled depth is resolved into framebuffer's single sampled depth texture first
+//   (so transparent surfaces' edges are not anti-aliased)
+struct WeightedOitRenderer {
+  shared_ptr<utils::gl::Program> program_;
+  GLuint framebuffer_, vertex_array_;
+  GLuint accum_texture_ = 0, weight_texture_ = 0;
+  ivec2 capacity_ = {0, 0};
+
+  WeightedOitRenderer() {
+    #include "scene_example_shaders.hpp"
+    program_ = utils::gl::ProgramCache::get().getProgram(
+        far_plane_vertex_shader_source, oit_composite_fragment_shader_source);
+    glGenFramebuffers(1, &framebuffer_);
+    glGenVertexArrays(1, &vertex_array_);
+  }
+
+  ~WeightedOitRenderer() {
+    _release();
+    glDeleteFramebuffers(1, &framebuffer_);
+    glDeleteVertexArrays(1, &vertex_array_);
+  }
+
+  void _release() {
+    if (!accum_texture_) { return; }
+    gl::RenderTargetPool::destroy(accum_texture_, 1);
+    gl::RenderTargetPool::destroy(weight_texture_, 1);
+    accum_texture_ = weight_texture_ = 0;
+  }
+
+  void _allocate(ivec2 capacity) {
+    _release();
+    capacity_ = capacity;
+    accum_texture_ = gl::RenderTargetPool::create(capacity, GL_RGBA16F, 1);
+    weight_texture_ = gl::RenderTargetPool::create(capacity, GL_R16F, 1);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accum_texture_, 0);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weight_texture_, 0);
+    GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glDrawBuffers(2, draw_buffers);
+  }
+
+  // Binds cleared accumulation targets with blend state for WEIGHTED_OIT draws (after opaque ones are drawn)
+  void begin(const gl::Framebuffer& framebuffer) {
+    if (capacity_ != framebuffer.capacity_) {
+      _allocate(framebuffer.capacity_);
+    }
+    auto size = framebuffer.size_;
+    if (framebuffer.samples_ > 1) {
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer.msaa_framebuffer_handle_);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.framebuffer_handle_);
+      glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_);
+    // (attached every time since framebuffer's depth texture changes when it's reallocated)
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, framebuffer.depth_texture_handle_, 0);
+    fvec4 clear_accum = {0, 0, 0, 1}, clear_weight = {0, 0, 0, 0};
+    glClearBufferfv(GL_COLOR, 0, (GLfloat*)&clear_accum);
+    glClearBufferfv(GL_COLOR, 1, (GLfloat*)&clear_weight);
+    glEnable(GL_BLEND);
+    glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+  }
+
+  // Back to framebuffer and composite accumulated transparency over it
+  void end(const gl::Framebuffer& framebuffer) {
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.getDrawHandle());
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    glUseProgram(program_->handle_);
+    program_->setUniform("accum_", 0);
+    program_->setUniform("weight_", 1);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, accum_texture_);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, weight_texture_);
+    glBindVertexArray(vertex_array_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glEnable(GL_DEPTH_TEST);
+  }
+};
+
+// Owns all GL resources of scene's assets (cf. RRMap) so that assets are only read here
 struct SceneRenderer {
-  unique_ptr<utils::gl::Program> program_;
+  // Knobs from UI (copied as a whole since renderer might live on other thread, cf. RenderThread)
+  struct Settings {
+    bool use_multi_draw_ = true;
+    bool use_texture_compression_ = true; // BC1/BC3 (otherwise RGBA8), applied to textures loaded after toggling
+    bool use_texture_atlas_ = true;       // applied to textures loaded after toggling
+    bool use_depth_prepass_ = false;
+    bool use_weighted_oit_ = false;       // order independent transparency instead of back to front sorting
+    bool debug_overdraw_ = false;         // shows shaded fragments per pixel (cf. Stats::overdraw_)
+    size_t texture_budget_ = size_t{256} << 20;
+    int shadow_cascades_ = 4; // 0 disables shadow
+    int shadow_resolution_ = 2048;
+    float shadow_distance_ = 50; // (cascades cover view depth up to this)
+
+    uint64_t getSignature(uint64_t hash) const {
+      bool flags[] = {
+          use_multi_draw_, use_texture_compression_, use_texture_atlas_, use_depth_prepass_, use_weighted_oit_,
+          debug_overdraw_};
+      hash = utils::hashFnv1a(flags, sizeof(flags), hash);
+      int shadow[] = {shadow_cascades_, shadow_resolution_};
+      hash = utils::hashFnv1a(shadow, sizeof(shadow), hash);
+      hash = utils::hashFnv1a(&shadow_distance_, sizeof(float), hash);
+      return utils::hashFnv1a(&texture_budget_, sizeof(texture_budget_), hash);
+    }
+  };
+
+  // Copied back to UI (cf. SceneMetricsPanel)
+  struct Stats {
+    struct Atlas {
+      size_t num_textures_ = 0;
+      int num_layers_ = 0; // (pages in use)
+      ivec2 page_size_ = {0, 0};
+      float efficiency_ = 0;
+    };
+    bool support_multi_draw_ = false;
+    bool support_texture_compression_ = false;
+    size_t texture_used_ = 0, texture_used_low_ = 0;
+    size_t num_textures_ = 0, num_resident_ = 0, num_pending_ = 0;
+    size_t num_evicted_ = 0, num_streamed_ = 0, num_failed_ = 0;
+    Atlas atlas_;
+    size_t num_lights_ = 0, num_light_indices_ = 0, num_cluster_overflows_ = 0;
+    uint32_t max_lights_per_cluster_ = 0;
+    size_t environment_used_ = 0;
+    struct ShadowCascade {
+      float far_;
+      size_t num_draws_;
+      bool cached_;
+    };
+    vector<ShadowCascade> shadow_cascades_;
+    float overdraw_ = 0; // shaded samples per covered sample (measured only when debug_overdraw_)
+  };
+
+  Settings settings_;
+  unique_ptr<GeometryArena> arena_;
+  RRMap<Mesh, MeshRR> meshes_;
+  RRMap<Environment, EnvironmentRR> environments_;
+
+  // Programs per shader variant (compiled on first use, cf. getProgram)
+  std::unordered_map<ShaderVariant, shared_ptr<utils::gl::Program>> programs_, mdi_programs_;
+
+  // Draw order of per-node submission (cf. _sortDraws), transparent ones after `num_opaque_draws_`
+  struct DrawItem {
+    ShaderVariant variant;
+    float depth; // view depth of bounds center
+    const Node* node;
+  };
+  vector<DrawItem> draws_, sorted_draws_;
+  size_t num_opaque_draws_ = 0;
+
+  // (cf. DrawKeyBuilder)
+  render_queue::RenderQueue render_queue_;
+  DrawKeyBuilder draw_keys_;
+
+  WeightedOitRenderer oit_renderer_;
+
+  // Depth pre-pass (cf. getDepthProgram) and overdraw measurement by occlusion queries (shaded, covered)
+  shared_ptr<utils::gl::Program> depth_programs_[2], far_plane_program_;
+  GLuint overdraw_queries_[2], far_plane_vertex_array_;
+  bool overdraw_pending_ = false;
+  float overdraw_ = 0;
+
+  // Variant using all vertex attributes (so that GeometryArena can look up their locations)
+  constexpr static ShaderVariant kFullVariant =
+      shader_variant::kBaseColorTexture | shader_variant::kVertexColor | shader_variant::kLighting;
+
+  // Clustered lighting (cf. lighting::ClusterGrid)
+  // - scene without light nor environment is lit by a directional light from camera
+  //   (its intensity is such that white diffuse surface facing camera shows its base color)
+  constexpr static glm::ivec3 kClusterDims = {16, 9, 24};
+  constexpr static float kClusterNear = 0.05;
+  constexpr static float kHeadlightIntensity = 3.14159265;
+  constexpr static GLint kLightTextureUnit = 2; // (lights, clusters, indices take 3 units from here)
+  lighting::ClusterGrid cluster_grid_;
+  vector<lighting::LightData> lights_;
+  int num_directional_lights_ = 0;
+  fvec4 cluster_params_;
+  unique_ptr<utils::gl::TextureBuffer> light_buffer_, cluster_buffer_, light_index_buffer_;
+
+  // Image based lighting (cf. EnvironmentRR)
+  constexpr static GLint kEnvironmentTextureUnit = 5; // (specular cubemap, BRDF LUT)
+  const Environment* environment_ = nullptr;
+  const EnvironmentRR* environment_rr_ = nullptr;
+  float environment_intensity_ = 0;
+  fmat4 environment_xform_ = fmat4{1};
+
+  // Cascaded shadow of the first directional light in scene (headlight doesn't cast)
+  // - cascades are cached per view (cf. `draw`'s view_id) so that viewports don't invalidate each other
+  constexpr static GLint kShadowTextureUnit = 7;
+  constexpr static uint64_t kShadowViewTimeout = 120; // (frames until unused view's shadow is released)
+  struct ShadowView {
+    unique_ptr<ShadowRenderer> renderer;
+    uint64_t last_used_frame;
+  };
+  std::unordered_map<uint64_t, ShadowView> shadow_views_;
+  ShadowRenderer* shadow_renderer_ = nullptr; // (of the last drawn view)
+  uint64_t frame_ = 0;
+  std::optional<fvec3> shadow_direction_; // (in world)
+  int num_shadow_cascades_ = 0;           // (0 when shadow wasn't drawn)
+
+  bool support_texture_compression_ = false;
+  TextureResidencyManager residency_;
+
+  // Small textures are packed into pages of a single texture array
+  constexpr static int kAtlasMaxTextureSize = 256;
+  constexpr static int kAtlasPageSize = 1024;
+  constexpr static int kAtlasGutter = 8;
+  unique_ptr<TextureAtlasRR> atlas_;
+  RRMap<Texture, AtlasPlacement> atlas_placements_;
+
+  profiler::GpuProfiler gpu_profiler_{"GPU (scene)"};
+  OverlayRenderer overlay_renderer_;
+
+  // multi-draw-indirect path (available only when GL 4.3)
+  bool support_multi_draw_ = false;
+  unique_ptr<utils::gl::Buffer> indirect_buffer_, draw_data_buffer_, transform_buffer_, material_buffer_;
+  vector<const Node*> multi_draw_nodes_;
+  DrawList draw_list_;
 
   SceneRenderer() {
-    #include "scene_example_shaders.hpp"
-    program_.reset(new utils::gl::Program{vertex_shader_source, fragment_shader_source});
+    arena_.reset(new GeometryArena);
+    atlas_.reset(new TextureAtlasRR{{kAtlasPageSize, kAtlasPageSize}, kAtlasGutter});
+    arena_->setFormat(getProgram(kFullVariant, false).handle_, {
+        { "vert_position_", {3, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, position)} },
+        { "vert_color_",    {4, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, color)   } },
+        { "vert_texcoord_", {2, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, texcoord)} },
+        { "vert_normal_",   {3, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, normal)  } },
+    });
+    {
+      #include "scene_example_shaders.hpp"
+      far_plane_program_ = utils::gl::ProgramCache::get().getProgram(
+          far_plane_vertex_shader_source, depth_only_fragment_shader_source);
+    }
+    glGenQueries(2, overdraw_queries_);
+    glGenVertexArrays(1, &far_plane_vertex_array_); // (no attributes but core profile requires one bound)
+    light_buffer_.reset(new utils::gl::TextureBuffer{GL_RGBA32F});
+    cluster_buffer_.reset(new utils::gl::TextureBuffer{GL_RG32UI});
+    light_index_buffer_.reset(new utils::gl::TextureBuffer{GL_R32UI});
+
+    // sRGB variants come from EXT_texture_sRGB which is core since 2.1
+    support_texture_compression_ = utils::gl::hasExtension("GL_EXT_texture_compression_s3tc");
+
+    // (prefiltered cubemap mips are too small to hide face edges otherwise)
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    support_multi_draw_ = gl3wIsSupported(4, 3);
+    if (support_multi_draw_) {
+      indirect_buffer_.reset(new utils::gl::Buffer{GL_DRAW_INDIRECT_BUFFER});
+      draw_data_buffer_.reset(new utils::gl::Buffer{GL_ARRAY_BUFFER});
+      transform_buffer_.reset(new utils::gl::Buffer{GL_SHADER_STORAGE_BUFFER});
+      material_buffer_.reset(new utils::gl::Buffer{GL_SHADER_STORAGE_BUFFER});
+
+      // per-draw data as instanced attribute (not touched by arena's reallocation since it's different buffer)
+      auto location = glGetAttribLocation(getProgram(kFullVariant, true).handle_, "vert_draw_data_");
+      TOY_ASSERT(location != -1);
+      glBindVertexArray(arena_->vertex_array_);
+      glBindBuffer(GL_ARRAY_BUFFER, draw_data_buffer_->handle_);
+      glEnableVertexAttribArray(location);
+      glVertexAttribIPointer(location, 2, GL_UNSIGNED_INT, sizeof(DrawData), 0);
+      glVertexAttribDivisor(location, 1);
+    }
+  }
+
+  ~SceneRenderer() {
+    glDeleteQueries(2, overdraw_queries_);
+    glDeleteVertexArrays(1, &far_plane_vertex_array_);
+  }
+
+  // Position only variant of vertex shader (cf. DEPTH_ONLY)
+  utils::gl::Program& getDepthProgram(bool multi_draw) {
+    auto& program = depth_programs_[multi_draw];
+    if (!program) {
+      #include "scene_example_shaders.hpp"
+      program = utils::gl::ProgramCache::get().getProgram(
+          multi_draw ? mdi_vertex_shader_source : vertex_shader_source, depth_only_fragment_shader_source, {"DEPTH_ONLY"});
+    }
+    return *program;
+  }
+
+  utils::gl::Program& getProgram(ShaderVariant variant, bool multi_draw) {
+    auto& program = (multi_draw ? mdi_programs_ : programs_)[variant];
+    if (!program) {
+      #include "scene_example_shaders.hpp"
+      auto defines = getShaderDefines(variant);
+      auto fs = utils::gl::insertAfterVersion(
+          multi_draw ? mdi_fragment_shader_source : fragment_shader_source, lighting_shader_source);
+      program = utils::gl::ProgramCache::get().getProgram(
+          multi_draw ? mdi_vertex_shader_source : vertex_shader_source, fs.data(), defines);
+    }
+    return *program;
   }
 
   void updateRenderResouce(const Scene& scene) {
+    TOY_PROFILE_SCOPE("SceneRenderer::updateRenderResouce");
     for (auto& node : scene.nodes_) {
-      if (node->mesh_ && !node->mesh_->rr_) {
-        auto mesh_rr = new MeshRR(*node->mesh_);
-        node->mesh_->rr_.reset(mesh_rr);
-        mesh_rr->base_.setFormat(program_->handle_, {
-            { "vert_position_", {3, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, position)} },
-            { "vert_color_",    {4, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, color)   } },
-            { "vert_texcoord_", {2, GL_FLOAT, GL_FALSE, sizeof(VertexAttrs), (GLvoid*)offsetof(VertexAttrs, texcoord)} },
-        });
+      if (node->mesh_ && !meshes_.find(*node->mesh_)) {
+        meshes_.emplace(node->mesh_, std::make_unique<MeshRR>(*node->mesh_, *arena_));
       }
+    }
+    if (scene.environment_ && !environments_.find(*scene.environment_)) {
+      environments_.emplace(scene.environment_, std::make_unique<EnvironmentRR>(*scene.environment_));
+    }
 
+    // Collect new textures and split small ones (to be packed into atlas) by reading only header
+    vector<shared_ptr<Texture>> textures, small_textures;
+    for (auto& node : scene.nodes_) {
       if (node->material_ && node->material_->base_color_texture_) {
-        auto texture = node->material_->base_color_texture_;
-        if (!texture->rr_) {
-          texture->rr_.reset(new TextureRR(*texture));
+        auto& texture = node->material_->base_color_texture_;
+        if (atlas_placements_.find(*texture) || residency_.contains(*texture) ||
+            std::find(textures.begin(), textures.end(), texture) != textures.end() ||
+            std::find(small_textures.begin(), small_textures.end(), texture) != small_textures.end()) {
+          continue;
         }
+        ivec2 size;
+        bool ok = stbi_info(texture->filename_.data(), &size.x, &size.y, nullptr);
+        bool small = settings_.use_texture_atlas_ && ok && std::max(size.x, size.y) <= kAtlasMaxTextureSize;
+        (small ? small_textures : textures).push_back(texture);
+      }
+    }
+
+    // Decode and build mip chains in parallel (one texture per thread), then upload from GL thread
+    vector<TextureRR::Source> sources(textures.size());
+    vector<string> errors(textures.size());
+    bool compress = support_texture_compression_ && settings_.use_texture_compression_;
+    utils::parallelFor(0, textures.size(), [&](size_t i) {
+      try {
+        sources[i] = TextureRR::prepare(textures[i]->filename_, compress, 1);
+      } catch (std::exception& e) {
+        errors[i] = e.what();
+      }
+    });
+    for (auto i : utils::Range{textures.size()}) {
+      if (errors[i].empty()) {
+        residency_.add(textures[i], sources[i]);
+      } else {
+        residency_.addFailed(textures[i], errors[i]);
       }
     }
+
+    if (!small_textures.empty()) {
+      _addToAtlas(small_textures);
+    }
   }
 
-  void _draw(const Scene& scene, const Camera& camera) {
-    glUseProgram(program_->handle_);
+  // Insert small textures into atlas pages so that they can be drawn without rebinding
+  // (their regions are released when textures are gone cf. AtlasPlacement)
+  void _addToAtlas(const vector<shared_ptr<Texture>>& textures) {
+    vector<image::Image> images(textures.size());
+    vector<string> errors(textures.size());
+    utils::parallelFor(0, textures.size(), [&](size_t i) {
+      try {
+        images[i] = image::load(textures[i]->filename_);
+      } catch (std::exception& e) {
+        errors[i] = e.what();
+      }
+    });
+
+    // Taller first packs better for skyline
+    vector<size_t> order(textures.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](auto a, auto b) {
+      return std::tie(images[a].size_.y, images[a].size_.x) > std::tie(images[b].size_.y, images[b].size_.x);
+    });
+    for (auto i : order) {
+      if (!errors[i].empty()) {
+        residency_.addFailed(textures[i], errors[i]);
+        continue;
+      }
+      auto& placement = atlas_placements_.emplace(textures[i], std::make_unique<AtlasPlacement>(*atlas_, images[i]));
+      TOY_ASSERT(placement.placement_.layer >= 0); // kAtlasMaxTextureSize should guarantee it fits
+    }
+  }
 
-    // global uniform
-    program_->setUniform("view_inv_xform_", utils::inverseTR(camera.transform_));
-    program_->setUniform("view_projection_", camera.getPerspectiveProjection());
-    program_->setUniform("base_color_texture_", 0);
+  // Once per frame before any `draw`
+  void newFrame() {
+    gpu_profiler_.newFrame();
+    meshes_.collect();
+    environments_.collect();
+    atlas_placements_.collect();
+    frame_++;
+    for (auto it = shadow_views_.begin(); it != shadow_views_.end();) {
+      if (it->second.last_used_frame + kShadowViewTimeout < frame_) {
+        if (shadow_renderer_ == it->second.renderer.get()) {
+          shadow_renderer_ = nullptr;
+          num_shadow_cascades_ = 0;
+        }
+        it = shadow_views_.erase(it);
+        continue;
+      }
+      ++it;
+    }
+    residency_.compress_ = support_texture_compression_ && settings_.use_texture_compression_;
+    residency_.budget_ = settings_.texture_budget_;
+    residency_.update();
+    _collectOverdraw();
+  }
+
+  // Cheap alternative to `getStats` for per-frame polling (e.g. ViewportPanel::_checkRedraw)
+  bool hasPendingTextures() const { return residency_.num_pending_ > 0; }
+
+  Stats getStats() const {
+    Stats result;
+    result.support_multi_draw_ = support_multi_draw_;
+    result.support_texture_compression_ = support_texture_compression_;
+    result.texture_used_ = residency_.used_;
+    result.texture_used_low_ = residency_.used_low_;
+    result.num_textures_ = residency_.entries_.size();
+    result.num_resident_ = residency_.num_resident_;
+    result.num_pending_ = residency_.num_pending_;
+    result.num_evicted_ = residency_.num_evicted_;
+    result.num_streamed_ = residency_.num_streamed_;
+    result.num_failed_ = residency_.num_failed_;
+    auto& allocator = atlas_->allocator_;
+    result.atlas_ = {allocator.num_items_, (int)allocator.pages_.size(), allocator.page_size_, allocator.getEfficiency()};
+    result.num_lights_ = lights_.size();
+    result.num_light_indices_ = cluster_grid_.indices_.size();
+    result.num_cluster_overflows_ = cluster_grid_.num_overflows_;
+    for (auto& cluster : cluster_grid_.clusters_) {
+      result.max_lights_per_cluster_ = std::max(result.max_lights_per_cluster_, cluster.y);
+    }
+    for (auto& [id, entry] : environments_.entries_) {
+      result.environment_used_ += entry.rr_->byte_size_;
+    }
+    result.overdraw_ = overdraw_;
+    for (auto i : utils::Range{num_shadow_cascades_}) {
+      auto& state = shadow_renderer_->cascades_[i];
+      result.shadow_cascades_.push_back({state.cascade.far_, state.num_draws, state.cached});
+    }
+    return result;
+  }
 
+  // Lights in view space (directional ones first) and their clusters
+  void _updateLights(const Scene& scene, const Camera& camera, ivec2 size) {
+    TOY_PROFILE_SCOPE("SceneRenderer::updateLights");
+    auto view_xform = utils::inverseTR(camera.transform_);
+    lights_.clear();
+    shadow_direction_.reset();
+    for (auto& light : scene.lights_) {
+      if (light->type_ == LightType::kDirectional && !shadow_direction_) {
+        shadow_direction_ = -fvec3{light->transform_[2]};
+      }
+      fmat4 xform = view_xform * light->transform_;
+      auto type =
+          light->type_ == LightType::kDirectional ? lighting::kDirectional :
+          light->type_ == LightType::kSpot ? lighting::kSpot : lighting::kPoint;
+      lights_.push_back(lighting::makeLightData(
+          type, fvec3{xform[3]}, -fvec3{xform[2]}, light->color_, light->intensity_,
+          light->range_, light->inner_cone_angle_, light->outer_cone_angle_));
+    }
+    if (lights_.empty() && !scene.environment_) {
+      lights_.push_back(lighting::makeLightData(
+          lighting::kDirectional, {0, 0, 0}, {0, 0, -1}, {1, 1, 1}, kHeadlightIntensity, 0, 0, 0));
+    }
+    auto it = std::stable_partition(lights_.begin(), lights_.end(), [](auto& light) {
+      return light.getType() == lighting::kDirectional;
+    });
+    num_directional_lights_ = it - lights_.begin();
+
+    cluster_grid_.setup(
+        kClusterDims, camera.getPerspectiveProjection(),
+        std::max(camera.znear_, kClusterNear), std::max(camera.zfar_, kClusterNear * 2));
+    cluster_grid_.build(lights_);
+    auto slice = cluster_grid_.getSliceParams();
+    cluster_params_ = {float(kClusterDims.x) / size.x, float(kClusterDims.y) / size.y, slice.x, slice.y};
+
+    light_buffer_->setData(lights_);
+    cluster_buffer_->setData(cluster_grid_.clusters_);
+    light_index_buffer_->setData(cluster_grid_.indices_);
+    light_buffer_->bind(kLightTextureUnit);
+    cluster_buffer_->bind(kLightTextureUnit + 1);
+    light_index_buffer_->bind(kLightTextureUnit + 2);
+
+    // environment (sampled in world space)
+    environment_rr_ = scene.environment_ ? environments_.find(*scene.environment_) : nullptr;
+    environment_ = environment_rr_ ? scene.environment_.get() : nullptr;
+    environment_intensity_ = environment_ ? scene.environment_intensity_ : 0;
+    environment_xform_ = camera.transform_;
+    if (environment_) {
+      glActiveTexture(GL_TEXTURE0 + kEnvironmentTextureUnit);
+      glBindTexture(GL_TEXTURE_CUBE_MAP, environment_rr_->specular_.handle_);
+      glActiveTexture(GL_TEXTURE0 + kEnvironmentTextureUnit + 1);
+      glBindTexture(GL_TEXTURE_2D, environment_rr_->brdf_lut_.handle_);
+    }
+  }
+
+  void _setLightingUniforms(utils::gl::Program& program, const Camera& camera) {
+    program.setUniform("lights_", kLightTextureUnit);
+    program.setUniform("light_clusters_", kLightTextureUnit + 1);
+    program.setUniform("light_indices_", kLightTextureUnit + 2);
+    program.setUniform("num_directional_lights_", (GLint)num_directional_lights_);
+    program.setUniform("cluster_params_", cluster_params_);
+    program.setUniform("cluster_dims_", fvec4{kClusterDims, 0});
+    program.setUniform("env_specular_", kEnvironmentTextureUnit);
+    program.setUniform("env_brdf_lut_", kEnvironmentTextureUnit + 1);
+    program.setUniform("env_intensity_", environment_intensity_);
+    program.setUniform("env_xform_", environment_xform_);
+    if (shadow_renderer_) {
+      shadow_renderer_->setUniforms(program, camera, num_shadow_cascades_, kShadowTextureUnit);
+    }
+    if (environment_) {
+      auto& data = environment_->data_;
+      program.setUniform("env_sh_", data.sh_.data(), 9);
+      program.setUniform("env_max_lod_", float(data.specular_.size() - 1));
+    }
+  }
+
+  // Opaque ones after pre-pass only need to match depth, transparent ones are tested but not written
+  static bool isPrepassed(ShaderVariant variant) {
+    return !(variant & (shader_variant::kAlphaMask | shader_variant::kAlphaBlend));
+  }
+
+  void _setDepthState(ShaderVariant variant) {
+    bool prepassed = settings_.use_depth_prepass_ && isPrepassed(variant);
+    glDepthFunc(prepassed ? GL_EQUAL : GL_LESS);
+    glDepthMask((prepassed || (variant & shader_variant::kAlphaBlend)) ? GL_FALSE : GL_TRUE);
+  }
+
+  static void _setCullFace(ShaderVariant variant) {
+    (variant & shader_variant::kDoubleSided) ? glDisable(GL_CULL_FACE) : glEnable(GL_CULL_FACE);
+  }
+
+  // Weighted OIT is not used while debugging overdraw since it needs its own blend state
+  bool _useWeightedOit() const {
+    return settings_.use_weighted_oit_ && !settings_.debug_overdraw_;
+  }
+
+  ShaderVariant _getVariant(const Node& node) const {
+    auto& material = node.material_;
+    bool atlased = material && material->base_color_texture_ && atlas_placements_.find(*material->base_color_texture_);
+    return getShaderVariant(*node.mesh_, material.get(), atlased);
+  }
+
+  ShaderVariant _getDrawVariant(ShaderVariant variant) const {
+    if (settings_.debug_overdraw_) { return variant | shader_variant::kDebugOverdraw; }
+    if (_useWeightedOit() && (variant & shader_variant::kAlphaBlend)) { return variant | shader_variant::kWeightedOit; }
+    return variant;
+  }
+
+  // Opaque ones by state (fewer program/texture switches) then front to back (for early-z),
+  // and transparent ones back to front after them (or by state with weighted OIT since their order doesn't matter)
+  void _sortDraws(const Scene& scene, const Camera& camera, bool multi_draw) {
+    using namespace shader_variant;
+    TOY_PROFILE_SCOPE("SceneRenderer::sortDraws");
+    auto view_xform = utils::inverseTR(camera.transform_);
+    draws_.clear();
+    render_queue_.clear();
+    draw_keys_.clear();
+    draw_keys_.multi_draw_ = multi_draw;
+    draw_keys_.weighted_oit_ = _useWeightedOit();
     for (auto& node : scene.nodes_) {
       if (!node->mesh_) { continue; }
+      fvec3 center{0};
+      if (auto& bvh = node->mesh_->bvh_) { center = (bvh->lo_ + bvh->hi_) / 2.f; }
+      float depth = -(view_xform * node->transform_ * fvec4{center, 1}).z;
+      auto variant = _getVariant(*node);
+      const void* texture =
+          (variant & kBaseColorAtlas) ? (const void*)atlas_.get() :
+          (variant & kBaseColorTexture) ? (const void*)node->material_->base_color_texture_.get() : nullptr;
+      draw_keys_.add(variant, texture, node->material_.get(), node->mesh_.get(), depth);
+      draws_.push_back({variant, depth, node.get()});
+    }
+    draw_keys_.build(render_queue_);
+    render_queue_.sort();
 
-      // per-node uniform
-      program_->setUniform("model_xform_", node->transform_);
+    sorted_draws_.clear();
+    for (auto& item : render_queue_.items_) { sorted_draws_.push_back(draws_[item.payload]); }
+    draws_.swap(sorted_draws_);
+    num_opaque_draws_ = render_queue_.lowerBound(DrawKeyBuilder::getTransparentBegin());
+  }
+
+  // Depth only (color writes off) for opaque ones without alpha test
+  void _drawDepthPrepass(const Camera& camera, bool multi_draw) {
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "depth pre-pass");
+    auto& program = getDepthProgram(multi_draw);
+    glUseProgram(program.handle_);
+    program.setUniform("view_inv_xform_", utils::inverseTR(camera.transform_));
+    program.setUniform("view_projection_", camera.getPerspectiveProjection());
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    if (multi_draw) {
+      for (auto& bucket : draw_list_.buckets_) {
+        if (!isPrepassed(bucket.variant)) { continue; }
+        _setCullFace(bucket.variant);
+        _multiDraw(bucket);
+      }
+    } else {
+      for (auto i : utils::Range{num_opaque_draws_}) {
+        auto& draw = draws_[i];
+        if (!isPrepassed(draw.variant)) { continue; }
+        _setCullFace(draw.variant);
+        program.setUniform("model_xform_", draw.node->transform_);
+        meshes_.at(*draw.node->mesh_).draw();
+      }
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  }
+
+  // Per node submission of `draws_[begin, end)`
+  void _drawNodes(size_t begin, size_t end, const Camera& camera) {
+    using namespace shader_variant;
+    Material default_material;
+    utils::gl::Program* program = nullptr;
+    for (auto i : utils::Range{begin, end}) {
+      auto& draw = draws_[i];
+      auto variant = draw.variant;
+      auto node = draw.node;
+      if (i == begin || variant != draws_[i - 1].variant) {
+        program = &getProgram(_getDrawVariant(variant), false);
+        glUseProgram(program->handle_);
+        _setDepthState(variant);
+        _setCullFace(variant);
+
+        // per-variant uniform
+        program->setUniform("view_inv_xform_", utils::inverseTR(camera.transform_));
+        program->setUniform("view_projection_", camera.getPerspectiveProjection());
+        if (variant & kBaseColorTexture) {
+          program->setUniform((variant & kBaseColorAtlas) ? "base_color_atlas_" : "base_color_texture_", 0);
+        }
+        if (variant & kLighting) {
+          _setLightingUniforms(*program, camera);
+        }
+      }
 
-      if (auto mat = node->material_) {
-        program_->setUniform("base_color_factor_", mat->base_color_factor_);
-        bool use_texture = mat->base_color_texture_ && mat->use_base_color_texture_;
+      // per-node uniform
+      program->setUniform("model_xform_", node->transform_);
 
-        auto& texture_rr = mat->base_color_texture_->rr_;
-        TOY_ASSERT(texture_rr);
+      auto& mat = node->material_ ? *node->material_ : default_material;
+      if (variant & kBaseColorAtlas) {
+        auto& placement = atlas_placements_.at(*mat.base_color_texture_);
+        program->setUniform("atlas_layer_", (GLint)placement.placement_.layer);
+        program->setUniform("atlas_rect_", placement.rect_);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, placement.atlas_.base_->handle_);
+      } else if (variant & kBaseColorTexture) {
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, use_texture ? texture_rr->base_.handle_ : 0);
-        program_->setUniform("use_base_color_texture_", (GLint)use_texture);
+        glBindTexture(GL_TEXTURE_2D, residency_.acquire(*mat.base_color_texture_));
+      } else {
+        program->setUniform("base_color_factor_", mat.base_color_factor_);
+      }
+      if (variant & kAlphaMask) {
+        program->setUniform("alpha_cutoff_", mat.alpha_cutoff_);
+      }
+      if (variant & kLighting) {
+        program->setUniform("metallic_factor_", mat.metallic_factor_);
+        program->setUniform("roughness_factor_", mat.roughness_factor_);
       }
 
       // draw
-      TOY_ASSERT(node->mesh_->rr_);
-      node->mesh_->rr_->base_.draw();
+      meshes_.at(*node->mesh_).draw();
+    }
+  }
+
+  // Transparent ones are always per node since they need to be sorted across variants
+  void _drawTransparent(const Camera& camera, const gl::Framebuffer& framebuffer) {
+    if (num_opaque_draws_ == draws_.size()) { return; }
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "transparent");
+    if (_useWeightedOit()) {
+      oit_renderer_.begin(framebuffer);
+      _drawNodes(num_opaque_draws_, draws_.size(), camera);
+      oit_renderer_.end(framebuffer);
+      return;
+    }
+    if (!settings_.debug_overdraw_) {
+      glEnable(GL_BLEND);
+      glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     }
+    _drawNodes(num_opaque_draws_, draws_.size(), camera);
+  }
+
+  // Build and upload draw list of opaque ones in sorted order (cf. _sortDraws and DrawList)
+  void _prepareMultiIndirect() {
+    {
+      TOY_PROFILE_SCOPE("buildDrawList");
+      multi_draw_nodes_.clear();
+      for (auto i : utils::Range{num_opaque_draws_}) {
+        multi_draw_nodes_.push_back(draws_[i].node);
+      }
+      buildDrawList(multi_draw_nodes_, draw_list_, [&](const Mesh& mesh) {
+        return meshes_.at(mesh).range_;
+      }, [&](const Texture& texture) {
+        return atlas_placements_.find(texture);
+      });
+    }
+    indirect_buffer_->setData(draw_list_.commands_);
+    draw_data_buffer_->setData(draw_list_.draw_data_);
+    transform_buffer_->setData(draw_list_.transforms_);
+    material_buffer_->setData(draw_list_.materials_);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, transform_buffer_->handle_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, material_buffer_->handle_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer_->handle_);
+  }
+
+  void _multiDraw(const DrawList::Bucket& bucket) {
+    glBindVertexArray(arena_->vertex_array_);
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES, arena_->index_type_,
+        (GLvoid*)(bucket.offset * sizeof(utils::gl::DrawElementsIndirectCommand)),
+        bucket.count, 0);
+  }
+
+  // Either per node or a single glMultiDrawElementsIndirect per texture bucket
+  void _drawOpaque(const Camera& camera, bool multi_draw) {
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "opaque");
+    if (!multi_draw) {
+      _drawNodes(0, num_opaque_draws_, camera);
+      return;
+    }
+    ShaderVariant current = ~0u;
+    for (auto& bucket : draw_list_.buckets_) {
+      if (bucket.variant != current) {
+        current = bucket.variant;
+        auto& program = getProgram(_getDrawVariant(bucket.variant), true);
+        glUseProgram(program.handle_);
+        _setDepthState(bucket.variant);
+        _setCullFace(bucket.variant);
+        program.setUniform("view_inv_xform_", utils::inverseTR(camera.transform_));
+        program.setUniform("view_projection_", camera.getPerspectiveProjection());
+        if (bucket.variant & shader_variant::kBaseColorTexture) {
+          program.setUniform(bucket.atlas ? "base_color_atlas_" : "base_color_texture_", 0);
+        }
+        if (bucket.variant & shader_variant::kLighting) {
+          _setLightingUniforms(program, camera);
+        }
+      }
+      glActiveTexture(GL_TEXTURE0);
+      if (bucket.atlas) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, bucket.atlas->base_->handle_);
+      } else if (bucket.texture) {
+        glBindTexture(GL_TEXTURE_2D, residency_.acquire(*bucket.texture));
+      }
+      _multiDraw(bucket);
+    }
+  }
+
+  // Shaded samples / covered samples of the last measured draw (results are collected without waiting)
+  void _collectOverdraw() {
+    if (!overdraw_pending_) { return; }
+    GLuint available = 0;
+    glGetQueryObjectuiv(overdraw_queries_[1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) { return; }
+    GLuint64 shaded = 0, covered = 0;
+    glGetQueryObjectui64v(overdraw_queries_[0], GL_QUERY_RESULT, &shaded);
+    glGetQueryObjectui64v(overdraw_queries_[1], GL_QUERY_RESULT, &covered);
+    overdraw_ = covered ? float(shaded) / covered : 0;
+    overdraw_pending_ = false;
   }
 
   void draw(
       const Scene& scene,
       const Camera& camera,
       const gl::Framebuffer& framebuffer,
+      uint64_t view_id = 0, // (viewport identity across frames, keys cached shadow)
       fvec4 clear_color = {0, 0, 0, 0}) {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.framebuffer_handle_);
+    TOY_PROFILE_SCOPE("SceneRenderer::draw");
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "scene");
+
+    // lights and shadow (into its own framebuffer)
+    _updateLights(scene, camera, framebuffer.size_);
+    num_shadow_cascades_ = 0;
+    if (shadow_direction_ && settings_.shadow_cascades_ > 0) {
+      TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "shadow");
+      num_shadow_cascades_ = std::min(settings_.shadow_cascades_, shadow::kMaxCascades);
+      float near = std::max(camera.znear_, kClusterNear);
+      auto& view = shadow_views_[view_id];
+      if (!view.renderer) { view.renderer = std::make_unique<ShadowRenderer>(); }
+      view.last_used_frame = frame_;
+      shadow_renderer_ = view.renderer.get();
+      shadow_renderer_->draw(
+          scene, camera, *shadow_direction_, near, std::max(std::min(camera.zfar_, settings_.shadow_distance_), 2 * near),
+          num_shadow_cascades_, settings_.shadow_resolution_, meshes_, gpu_profiler_);
+      glActiveTexture(GL_TEXTURE0 + kShadowTextureUnit);
+      glBindTexture(GL_TEXTURE_2D_ARRAY, shadow_renderer_->texture_->handle_);
+    }
+
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer.getDrawHandle());
 
-    // rendering configuration
-    glEnable(GL_CULL_FACE); // TODO: cull face per material
+    // rendering configuration (culling is per variant cf. _setCullFace)
     glEnable(GL_DEPTH_TEST);
 
+    // overdraw visualization accumulates constant color per shaded fragment (cf. DEBUG_OVERDRAW)
+    _collectOverdraw();
+    bool measure_overdraw = settings_.debug_overdraw_ && !overdraw_pending_;
+    if (settings_.debug_overdraw_) {
+      clear_color = {0, 0, 0, 1};
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE, GL_ONE);
+    }
+
     // clear buffer
     glClearBufferfv(GL_COLOR, 0, (GLfloat*)&clear_color);
     float depth = 1;
@@ -92,7 +1187,284 @@ struct SceneRenderer {
 
     // really draw
     glViewport(0, 0, framebuffer.size_.x, framebuffer.size_.y);
-    _draw(scene, camera);
+    bool multi_draw = support_multi_draw_ && settings_.use_multi_draw_;
+    _sortDraws(scene, camera, multi_draw);
+    if (multi_draw) {
+      _prepareMultiIndirect();
+    }
+    if (settings_.use_depth_prepass_) {
+      _drawDepthPrepass(camera, multi_draw);
+    }
+    if (measure_overdraw) {
+      glBeginQuery(GL_SAMPLES_PASSED, overdraw_queries_[0]);
+    }
+    _drawOpaque(camera, multi_draw);
+    _drawTransparent(camera, framebuffer);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_TRUE);
+
+    if (measure_overdraw) {
+      // (pre-pass is not counted since its fragments aren't shaded)
+      glEndQuery(GL_SAMPLES_PASSED);
+
+      // covered samples i.e. depth nearer than far plane
+      glBeginQuery(GL_SAMPLES_PASSED, overdraw_queries_[1]);
+      glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+      glDepthMask(GL_FALSE);
+      glDepthFunc(GL_GREATER);
+      glUseProgram(far_plane_program_->handle_);
+      glBindVertexArray(far_plane_vertex_array_);
+      glDrawArrays(GL_TRIANGLES, 0, 3);
+      glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+      glDepthMask(GL_TRUE);
+      glEndQuery(GL_SAMPLES_PASSED);
+      overdraw_pending_ = true;
+    }
+    glDepthFunc(GL_LESS);
+  }
+
+  // After `draw` into the same framebuffer
+  void drawOverlay(const utils::imgui::Overlay3D& overlay, const Camera& camera, const gl::Framebuffer& framebuffer) {
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "overlay");
+    overlay_renderer_.draw(overlay, camera, framebuffer);
+  }
+
+  // After all draws into the framebuffer
+  void resolve(const gl::Framebuffer& framebuffer) {
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "resolve");
+    framebuffer.resolve();
+  }
+
+  // Result is collected by `picker.poll()` in later frames
+  void pick(const Scene& scene, const Camera& camera, const gl::Framebuffer& framebuffer,
+            PickingRenderer& picker, const PickingRenderer::Request& request) {
+    TOY_PROFILE_GPU_SCOPE(&gpu_profiler_, "picking");
+    picker.draw(scene, camera, framebuffer, meshes_, request);
+  }
+};
+
+//
+// SceneRenderer running on its own thread with a context sharing objects with UI's
+// - UI thread publishes a snapshot (scene copy, settings, views) via triple buffer and never waits for rendering
+// - render thread draws each view into triple buffered framebuffers and UI shows the latest completed one
+// - fences order both directions i.e. UI samples after drawing finished, and
+//   render thread overwrites after UI's draw commands sampling it finished
+//
+struct RenderThread {
+  struct View {
+    uint32_t target_id_;
+    Camera camera_;
+    ivec2 size_;
+    int samples_;
+    utils::imgui::Overlay3D overlay_;
+  };
+
+  struct Snapshot {
+    Scene scene_;
+    uint64_t version_ = 0; // SceneManager::version_ (new resources to upload when changed)
+    SceneRenderer::Settings settings_;
+    vector<View> views_;
+  };
+
+  struct Frame {
+    unique_ptr<gl::Framebuffer> framebuffer_; // created lazily on render thread (FBO is not shared)
+    GLsync draw_fence_ = 0;    // inserted by render thread, waited by UI
+    GLsync display_fence_ = 0; // inserted by UI, waited by render thread
+
+    ~Frame() {
+      if (draw_fence_) { glDeleteSync(draw_fence_); }
+      if (display_fence_) { glDeleteSync(display_fence_); }
+    }
+  };
+
+  // Render thread produces, UI consumes
+  struct Target {
+    utils::TripleBuffer<Frame> frames_;
+    bool displayed_ = false; // (only touched by UI)
+  };
+
+  GLFWwindow* context_;
+  std::thread thread_;
+  utils::TripleBuffer<Snapshot> snapshots_; // UI produces, render thread consumes
+
+  // Guarded by `mutex_`
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  bool snapshot_fresh_ = false;
+  uint32_t next_target_id_ = 1;
+  map<uint32_t, unique_ptr<Target>> targets_; // added by UI, removed by render thread after `releaseTarget`
+  vector<uint32_t> released_targets_;
+  SceneRenderer::Stats stats_;
+  utils::FrameStats frame_stats_;
+  size_t num_dropped_ = 0; // snapshots overwritten before render thread consumed them
+
+  std::atomic<bool> has_pending_textures_ = false; // (polled every frame, so without lock)
+
+  RenderThread(Window& window) {
+    context_ = window.createSharedContext();
+    thread_ = std::thread{[this]() { _run(); }};
+  }
+
+  ~RenderThread() {
+    {
+      std::lock_guard lock{mutex_};
+      stop_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+    glfwDestroyWindow(context_);
+  }
+
+  //
+  // UI thread API
+  //
+
+  uint32_t createTarget() {
+    std::lock_guard lock{mutex_};
+    auto id = next_target_id_++;
+    targets_[id].reset(new Target);
+    return id;
+  }
+
+  void releaseTarget(uint32_t id) {
+    std::lock_guard lock{mutex_};
+    released_targets_.push_back(id);
+  }
+
+  Target* _findTarget(uint32_t id) {
+    std::lock_guard lock{mutex_};
+    auto it = targets_.find(id);
+    return (it == targets_.end()) ? nullptr : it->second.get();
+  }
+
+  // Latest completed frame of the target (nullptr until the first one)
+  const gl::Framebuffer* acquireFrame(uint32_t id) {
+    auto target = _findTarget(id);
+    TOY_ASSERT(target);
+    target->frames_.acquire();
+    auto& frame = target->frames_.front();
+    if (!frame.framebuffer_) { return nullptr; }
+    glWaitSync(frame.draw_fence_, 0, GL_TIMEOUT_IGNORED);
+    target->displayed_ = true;
+    return frame.framebuffer_.get();
+  }
+
+  void submit(Snapshot&& snapshot) {
+    snapshots_.back() = std::move(snapshot);
+    bool dropped = snapshots_.publish();
+    {
+      std::lock_guard lock{mutex_};
+      snapshot_fresh_ = true;
+      num_dropped_ += dropped;
+    }
+    cv_.notify_one();
+  }
+
+  // After UI's draw commands (i.e. sampling acquired frames) are issued
+  void endDisplay() {
+    std::lock_guard lock{mutex_};
+    for (auto& [id, target] : targets_) {
+      if (!target->displayed_) { continue; }
+      target->displayed_ = false;
+      auto& frame = target->frames_.front();
+      if (frame.display_fence_) { glDeleteSync(frame.display_fence_); }
+      frame.display_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    glFlush(); // fence has to be flushed before other context waits for it
+  }
+
+  SceneRenderer::Stats getStats() {
+    std::lock_guard lock{mutex_};
+    return stats_;
+  }
+
+  bool hasPendingTextures() const { return has_pending_textures_; }
+
+  std::pair<utils::FrameStats, size_t> getFrameStats() {
+    std::lock_guard lock{mutex_};
+    return {frame_stats_, num_dropped_};
+  }
+
+  //
+  // Render thread
+  //
+
+  void _run() {
+    profiler::Profiler::get().setThreadName("render");
+    glfwMakeContextCurrent(context_);
+    unique_ptr<SceneRenderer> renderer{new SceneRenderer};
+    unique_ptr<gl::RenderTargetPool> render_target_pool{new gl::RenderTargetPool};
+    uint64_t version = 0;
+    vector<Target*> drawn;
+
+    while (true) {
+      {
+        std::unique_lock lock{mutex_};
+        cv_.wait(lock, [&]() { return stop_ || snapshot_fresh_; });
+        if (stop_) { break; }
+        snapshot_fresh_ = false;
+        for (auto id : released_targets_) {
+          targets_.erase(id);
+        }
+        released_targets_.clear();
+      }
+      TOY_PROFILE_SCOPE("RenderThread::frame");
+      snapshots_.acquire();
+      auto& snapshot = snapshots_.front();
+
+      renderer->settings_ = snapshot.settings_;
+      if (version != snapshot.version_) {
+        version = snapshot.version_;
+        renderer->updateRenderResouce(snapshot.scene_);
+      }
+      renderer->newFrame();
+      render_target_pool->newFrame();
+
+      drawn.clear();
+      for (auto& view : snapshot.views_) {
+        auto target = _findTarget(view.target_id_);
+        if (!target) { continue; }
+        auto& frame = target->frames_.back();
+        if (frame.display_fence_) {
+          glWaitSync(frame.display_fence_, 0, GL_TIMEOUT_IGNORED);
+          glDeleteSync(frame.display_fence_);
+          frame.display_fence_ = 0;
+        }
+        if (!frame.framebuffer_) {
+          frame.framebuffer_.reset(new gl::Framebuffer{render_target_pool.get()});
+        }
+        frame.framebuffer_->setSize(view.size_);
+        frame.framebuffer_->setSamples(view.samples_);
+        renderer->draw(snapshot.scene_, view.camera_, *frame.framebuffer_, view.target_id_);
+        renderer->drawOverlay(view.overlay_, view.camera_, *frame.framebuffer_);
+        renderer->resolve(*frame.framebuffer_);
+        if (frame.draw_fence_) { glDeleteSync(frame.draw_fence_); }
+        frame.draw_fence_ = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        drawn.push_back(target);
+      }
+      glFlush();
+      for (auto target : drawn) {
+        target->frames_.publish();
+      }
+      if (!drawn.empty()) {
+        glfwPostEmptyEvent(); // UI might be sleeping in glfwWaitEvents (cf. App::exec)
+      }
+
+      has_pending_textures_ = renderer->hasPendingTextures();
+      auto stats = renderer->getStats();
+      {
+        std::lock_guard lock{mutex_};
+        stats_ = std::move(stats);
+        frame_stats_.tick();
+      }
+    }
+
+    // GL objects owned by this context
+    targets_.clear();
+    render_target_pool.reset();
+    renderer.reset();
+    glfwMakeContextCurrent(nullptr);
   }
 };
 
@@ -103,12 +1475,26 @@ struct Editor {
 struct SceneManager {
   Editor editor_; // todo: make it upside down (Editor owns SceneManager)
   unique_ptr<Scene> scene_;
-  unique_ptr<SceneRenderer> renderer_;
+  unique_ptr<SceneRenderer> renderer_;      // either this
+  unique_ptr<RenderThread> render_thread_;  // or this
+  SceneRenderer::Settings render_settings_;
+  gl::RenderTargetPool render_target_pool_; // for framebuffers drawn on UI thread
+  uint64_t version_ = 1;      // bumped when nodes or environment are added
+  uint64_t edit_version_ = 0; // bumped on any other change of what renderer reads (cf. markEdited)
+  vector<RenderThread::View> views_; // collected during frame (only when render thread)
+  bool continuous_ = false; // redraw every frame (e.g. animation) instead of only when something changed
+  size_t num_redraws_ = 0;  // views redrawn during frame (App sleeps once nothing is redrawn for a while)
+  bool keep_awake_ = false; // e.g. waiting GPU readback
+  utils::FrameStats frame_stats_;
   vector<unique_ptr<AssetRepository>> asset_repositories_;
 
-  SceneManager() {
+  SceneManager(Window& window, bool use_render_thread) {
     scene_.reset(new Scene);
-    renderer_.reset(new SceneRenderer);
+    if (use_render_thread) {
+      render_thread_.reset(new RenderThread{window});
+    } else {
+      renderer_.reset(new SceneRenderer);
+    }
   }
 
   void loadGltf(const char* filename) {
@@ -117,49 +1503,83 @@ struct SceneManager {
     for (auto& node : new_assets->nodes_) {
       scene_->nodes_.push_back(node);
     }
-    renderer_->updateRenderResouce(*scene_);
+    for (auto& light : new_assets->lights_) {
+      scene_->lights_.push_back(light);
+    }
+    version_++;
+    if (renderer_) {
+      renderer_->updateRenderResouce(*scene_);
+    }
     SceneManager::setupBVH(*scene_);
   }
 
-  // TODO: Not sure where to put this
-  static void setupBVH(const Scene& scene) {
-    for (auto& node : scene.nodes_) {
-      if (node->mesh_ && !node->mesh_->bvh_) {
-        Mesh& mesh = *node->mesh_;
-        mesh.bvh_.reset(new MeshBVH{mesh});
+  // Equirectangular HDR as image based lighting (replaces current one)
+  void loadEnvironment(const char* filename) {
+    auto environment = std::make_shared<Environment>();
+    environment->filename_ = filename;
+    environment->data_ = ibl::loadOrPrefilter(filename);
+    scene_->environment_ = environment;
+    version_++;
+    if (renderer_) {
+      renderer_->updateRenderResouce(*scene_);
+    }
+  }
+
+  void newFrame() {
+    frame_stats_.tick();
+    num_redraws_ = 0;
+    keep_awake_ = false;
+    render_target_pool_.newFrame();
+    if (renderer_) {
+      renderer_->settings_ = render_settings_;
+      renderer_->newFrame();
+    }
+  }
+
+  // After UI's draw commands are issued
+  void endFrame() {
+    if (render_thread_) {
+      TOY_PROFILE_SCOPE("SceneManager::submit");
+      render_thread_->endDisplay();
+      if (!views_.empty()) {
+        render_thread_->submit({makeSnapshot(*scene_), version_, render_settings_, std::move(views_)});
+        views_.clear();
       }
     }
   }
 
-  struct SceneRayIntersection {
-    MeshBVH::RayTestResult result;
-    shared_ptr<Node> node;
-  };
+  SceneRenderer::Stats getRenderStats() {
+    return renderer_ ? renderer_->getStats() : render_thread_->getStats();
+  }
 
-  SceneRayIntersection rayIntersection(const fvec3& src, const fvec3& dir) const {
-    MeshBVH::RayTestResult result = { .hit = false, .t = FLT_MAX };
-    shared_ptr<Node> hit_node;
+  bool hasPendingTextures() const {
+    return renderer_ ? renderer_->hasPendingTextures() : render_thread_->hasPendingTextures();
+  }
 
-    for (auto& node : scene_->nodes_) {
-      if (!node->mesh_) { continue; }
+  // Called by whoever edits scene (e.g. transform, environment intensity) instead of hashing scene every frame
+  void markEdited() { edit_version_++; }
 
-      Mesh& mesh = *node->mesh_;
-      auto tmp_result = mesh.bvh_->rayTest(
-          glm::inverse(node->transform_) * fvec4{src, 1},
-          glm::inverse(fmat3{node->transform_}) * dir);
-      if (!tmp_result.hit) { continue; }
-      if (!(tmp_result.t < result.t)) { continue; }
+  // Hash of everything renderer reads except view (cf. ViewportPanel::processPostUI)
+  uint64_t getSignature() const {
+    uint64_t versions[] = {version_, edit_version_};
+    auto hash = utils::hashFnv1a(versions, sizeof(versions));
+    return render_settings_.getSignature(hash);
+  }
 
-      result.hit = true;
-      result.t = tmp_result.t;
-      result.point = fvec3{node->transform_ * fvec4{tmp_result.point, 1}};
-      for (auto i : Range{3}) {
-        result.face[i] = fvec3{node->transform_ * fvec4{tmp_result.face[i], 1}};
+  // TODO: Not sure where to put this
+  static void setupBVH(const Scene& scene) {
+    for (auto& node : scene.nodes_) {
+      if (node->mesh_ && !node->mesh_->bvh_) {
+        Mesh& mesh = *node->mesh_;
+        mesh.bvh_.reset(new MeshBVH{mesh});
       }
-      hit_node = node;
     }
+  }
 
-    return SceneRayIntersection{result, hit_node};
+  SceneRayIntersection rayIntersection(
+      const fvec3& src, const fvec3& dir, const SceneRayIntersection* hint = nullptr) const {
+    TOY_PROFILE_SCOPE("SceneManager::rayIntersection");
+    return scene::rayIntersection(*scene_, src, dir, hint);
   }
 };
 
@@ -170,7 +1590,8 @@ struct SceneManager {
 
 struct ViewportPanel : Panel {
   constexpr static const char* type = "Viewport";
-  unique_ptr<utils::gl::Framebuffer> framebuffer_;
+  unique_ptr<utils::gl::Framebuffer> framebuffer_; // either this
+  uint32_t render_target_id_ = 0;                  // or this (when render thread)
   SceneManager& mng_;
   ImDrawList* draw_list_;
   Camera camera_;
@@ -209,11 +1630,42 @@ struct ViewportPanel : Panel {
     shared_ptr<Node> active_node;
 
     bool overlay = true;
+    bool gpu_overlay = true; // lines and grids drawn by GL with depth test (otherwise by ImGui)
+    bool gpu_picking = true; // id buffer readback instead of CPU ray cast (only when rendering on UI thread)
+    std::optional<fvec2> marquee_begin; // imguiCo
+    vector<shared_ptr<Node>> selection; // by marquee (or click)
+    int msaa_samples = 4;
+    bool dynamic_msaa = true; // no multisampling while camera moves (restored once it stops)
+    bool camera_interaction = false;
     int debug_ray_test = 0; // bool
   } ctx_;
+  utils::imgui::Overlay3D overlay_;
+
+  // Redraw only when something affecting the image changed (otherwise previous framebuffer is shown as is)
+  bool needs_redraw_ = true; // invalidated explicitly for what signature doesn't cover
+  uint64_t signature_ = 0;   // of last redraw
+
+  // Hover query is re-run only when its ray (or scene) changed, deferred a few frames while mouse moves fast
+  constexpr static float kHoverFastSpeed = 16; // pixels per frame
+  constexpr static int kHoverMaxDeferred = 3;
+  struct Hover {
+    uint64_t signature = 0; // of ray and scene at last query
+    SceneRayIntersection intersection;
+    int num_deferred = 0;
+  } hover_;
+
+  // GPU picking (only when framebuffer_)
+  unique_ptr<PickingRenderer> picker_;
+  std::optional<PickingRenderer::Request> pick_request_; // issued at processPostUI
+  uint64_t next_pick_id_ = 1;
 
   ViewportPanel(SceneManager& mng) : mng_{mng} {
-    framebuffer_.reset(new utils::gl::Framebuffer);
+    if (mng_.render_thread_) {
+      render_target_id_ = mng_.render_thread_->createTarget();
+    } else {
+      framebuffer_.reset(new utils::gl::Framebuffer{&mng_.render_target_pool_});
+      picker_.reset(new PickingRenderer);
+    }
     camera_.transform_[3] = fvec4{0, 0, 4, 1};
     mng_.editor_.ctx_ = &ctx_;
   }
@@ -223,6 +1675,9 @@ struct ViewportPanel : Panel {
     if (mng_.editor_.ctx_ == &ctx_) {
       mng_.editor_.ctx_ = nullptr;
     }
+    if (render_target_id_) {
+      mng_.render_thread_->releaseTarget(render_target_id_);
+    }
   }
 
   void setupContext() {
@@ -239,9 +1694,13 @@ struct ViewportPanel : Panel {
     ctx_.mouse_direction = ctx_.mouse_position_scene - ctx_.camera_position;
 
     ctx_.imguiCo_to_sceneCo * fvec3{ctx_.mouse_position_imgui, 1};
-    ctx_.imgui3d = {
-        draw_list_, &ctx_.camera_position, &ctx_.mouse_position_scene,
-        &ctx_.sceneCo_to_clipCo, &ctx_.ndCo_to_imguiCo};
+    ctx_.imgui3d.draw_list = draw_list_;
+    ctx_.imgui3d.camera_position = &ctx_.camera_position;
+    ctx_.imgui3d.mouse_position = &ctx_.mouse_position_scene;
+    ctx_.imgui3d.sceneCo_to_clipCo = &ctx_.sceneCo_to_clipCo;
+    ctx_.imgui3d.ndCo_to_imguiCo = &ctx_.ndCo_to_imguiCo;
+    ctx_.imgui3d.overlay = ctx_.gpu_overlay ? &overlay_ : nullptr;
+    overlay_.clear();
 
     if (ctx_.active_node) {
       ctx_.gizmo.setup(ctx_.imgui3d, ctx_.active_node->transform_);
@@ -253,6 +1712,13 @@ struct ViewportPanel : Panel {
       if (ImGui::MenuItem("Overlay", nullptr, ctx_.overlay)) {
         ctx_.overlay = !ctx_.overlay;
       }
+      if (ImGui::MenuItem("GPU Overlay", nullptr, ctx_.gpu_overlay)) {
+        ctx_.gpu_overlay = !ctx_.gpu_overlay;
+        needs_redraw_ = true; // overlay goes back to ImGui so GL one has to be erased
+      }
+      if (ImGui::MenuItem("GPU Picking", nullptr, ctx_.gpu_picking, framebuffer_ != nullptr)) {
+        ctx_.gpu_picking = !ctx_.gpu_picking;
+      }
     }
   }
 
@@ -269,6 +1735,13 @@ struct ViewportPanel : Panel {
                 { "Scale",       utils::imgui::TransformGizmo::Mode::kScale       }, });
         }
 
+        if (auto _ = ImScoped::TreeNodeEx("MSAA")) {
+          utils::imgui::RadioButtons(
+              &ctx_.msaa_samples,
+              { { "Off", 1 }, { "2x", 2 }, { "4x", 4 }, { "8x", 8 }, });
+          ImGui::Checkbox("off while moving camera", &ctx_.dynamic_msaa);
+        }
+
         if (auto _ = ImScoped::TreeNodeEx("Axis/Grid")) {
           ImGui::InputInt("bound", &ctx_.axis_bound);
           ImGui::InputInt("division", &ctx_.grid_division);
@@ -282,6 +1755,27 @@ struct ViewportPanel : Panel {
         // ray-face intersection
         ImGui::SliderInt("ray-face intersect", &ctx_.debug_ray_test, 0, 1, "");
 
+        // renderer submission path
+        auto stats = mng_.getRenderStats();
+        auto& settings = mng_.render_settings_;
+        if (stats.support_multi_draw_) {
+          ImGui::Checkbox("multi-draw indirect", &settings.use_multi_draw_);
+        } else {
+          ImGui::TextDisabled("multi-draw indirect (requires OpenGL 4.3)");
+        }
+        if (stats.support_texture_compression_) {
+          ImGui::Checkbox("texture compression (BC1/BC3)", &settings.use_texture_compression_);
+        } else {
+          ImGui::TextDisabled("texture compression (requires S3TC)");
+        }
+        ImGui::Checkbox("depth pre-pass", &settings.use_depth_prepass_);
+        ImGui::Checkbox("weighted OIT", &settings.use_weighted_oit_);
+        ImGui::Checkbox("overdraw", &settings.debug_overdraw_);
+        if (settings.debug_overdraw_) {
+          ImGui::SameLine();
+          ImGui::Text("(%.2f shaded per covered sample)", stats.overdraw_);
+        }
+
         if (auto _ = ImScoped::TreeNodeEx("Size/Offset")) {
           // offset
           ImGui::InputInt2("offset_", (int*)&offset_, ImGuiInputTextFlags_ReadOnly);
@@ -318,8 +1812,10 @@ struct ViewportPanel : Panel {
     ctx_.imgui3d.addGridPlanes(ctx_.axis_bound, ctx_.grid_division, ctx_.grid);
 
     // (temporary) viewport camera interaction demo
+    ctx_.camera_interaction = false;
     if (ImGui::IsMouseDown(1)) {
-      fvec2 delta = ImGui::GetIO().MouseDelta.glm() / fvec2{framebuffer_->size_};
+      ctx_.camera_interaction = ImGui::GetIO().KeyCtrl || ImGui::GetIO().KeyAlt || ImGui::GetIO().KeyShift;
+      fvec2 delta = ImGui::GetIO().MouseDelta.glm() / fvec2{content_size_};
       if (ImGui::GetIO().KeyCtrl) {
         pivotControl(camera_.transform_, ctx_.pivot, delta * fvec2{2 * 3.14, 3.14}, PivotControlType::ROTATION);
       }
@@ -346,42 +1842,118 @@ struct ViewportPanel : Panel {
 
     if (ctx_.active_node) {
       // todo: "scale by diagonal" is not working?
+      ctx_.imgui3d.depth_test = false; // gizmo is always visible
+      auto xform = ctx_.active_node->transform_;
       ctx_.gizmo.use();
+      if (ctx_.active_node->transform_ != xform) { mng_.markEdited(); }
+      ctx_.imgui3d.depth_test = true;
     }
 
     // todo: detect only clicked on viewport
     if (ImGui::IsMouseClicked(0)) {
       if (!ctx_.gizmo.hovered()) {
-        auto intersection = mng_.rayIntersection(ctx_.camera_position, ctx_.mouse_direction);
-        if (intersection.result.hit) {
-          ctx_.active_node = intersection.node;
+        if (_useGpuPicking()) {
+          pick_request_ = _makePickRequest(ctx_.mouse_position_imgui, ctx_.mouse_position_imgui);
+          if (ImGui::IsWindowHovered()) {
+            ctx_.marquee_begin = ctx_.mouse_position_imgui;
+          }
         } else {
-          ctx_.active_node = nullptr;
+          auto intersection = mng_.rayIntersection(ctx_.camera_position, ctx_.mouse_direction);
+          if (intersection.result.hit) {
+            ctx_.active_node = intersection.node;
+          } else {
+            ctx_.active_node = nullptr;
+          }
+        }
+      }
+    }
+
+    // Marquee selection (by reading back whole rectangle of ids)
+    if (ctx_.marquee_begin) {
+      fvec2 p0 = *ctx_.marquee_begin, p1 = ctx_.mouse_position_imgui;
+      bool dragged = glm::length(p1 - p0) > 3;
+      if (dragged) {
+        draw_list_->AddRectFilled(ImVec2{glm::min(p0, p1)}, ImVec2{glm::max(p0, p1)}, ImColor{.3f, .5f, 1.f, .2f});
+        draw_list_->AddRect(ImVec2{glm::min(p0, p1)}, ImVec2{glm::max(p0, p1)}, ImColor{.3f, .5f, 1.f, .8f});
+      }
+      if (!ImGui::IsMouseDown(0)) {
+        if (dragged) {
+          pick_request_ = _makePickRequest(p0, p1);
         }
+        ctx_.marquee_begin.reset();
       }
     }
 
     // (temporary) ray intersection triangle demo
     if (ctx_.debug_ray_test) {
-      auto intersection = mng_.rayIntersection(ctx_.camera_position, ctx_.mouse_direction);
+      auto& intersection = _queryHover();
       if (intersection.result.hit) {
-        array<fvec3, 3>& face = intersection.result.face;
+        const array<fvec3, 3>& face = intersection.result.face;
         ctx_.imgui3d.addConvexFill({face[0], face[1], face[2]}, {1, 0, 1, .5});
       }
     }
   }
 
   void UI_Image() {
+    // Latest one from render thread (which might lag behind a frame or two)
+    auto framebuffer = framebuffer_.get();
+    if (render_target_id_) {
+      framebuffer = mng_.render_thread_->acquireFrame(render_target_id_);
+      if (!framebuffer) { return; }
+    }
+    // Only [0, size_) of texture is drawn (cf. gl::Framebuffer::capacity_)
+    auto uv_max = framebuffer->getUvMax();
     ImGui::GetWindowDrawList()->AddImage(
-      reinterpret_cast<ImTextureID>(framebuffer_->texture_handle_),
+      reinterpret_cast<ImTextureID>(framebuffer->texture_handle_),
       ImVec2{content_offset_}, ImVec2{content_offset_ + content_size_},
-        /* uv0 */ {0, 1}, /* uv1 */ {1, 0});
+        /* uv0 */ {0, uv_max.y}, /* uv1 */ {uv_max.x, 0});
+  }
+
+  const SceneRayIntersection& _queryHover() {
+    auto hash = utils::hashFnv1a(&ctx_.camera_position, sizeof(fvec3), mng_.getSignature());
+    hash = utils::hashFnv1a(&ctx_.mouse_direction, sizeof(fvec3), hash);
+    if (hash == hover_.signature) { return hover_.intersection; }
+    bool fast = glm::length(fvec2{ctx_.mouse_position_imgui_delta}) > kHoverFastSpeed;
+    if (fast && hover_.num_deferred < kHoverMaxDeferred) {
+      hover_.num_deferred++;
+      return hover_.intersection;
+    }
+    hover_.num_deferred = 0;
+    hover_.signature = hash;
+    hover_.intersection = mng_.rayIntersection(ctx_.camera_position, ctx_.mouse_direction, &hover_.intersection);
+    return hover_.intersection;
+  }
+
+  bool _useGpuPicking() const {
+    return ctx_.gpu_picking && picker_;
+  }
+
+  // imguiCo rectangle (inclusive) to framebuffer pixels (y up) clamped within viewport
+  PickingRenderer::Request _makePickRequest(fvec2 p0, fvec2 p1) {
+    ivec2 size = glm::max(content_size_, ivec2{1});
+    ivec2 lo = glm::clamp(ivec2{glm::min(p0, p1)} - content_offset_, ivec2{0}, size - 1);
+    ivec2 hi = glm::clamp(ivec2{glm::max(p0, p1)} - content_offset_ + 1, lo + 1, size);
+    return {next_pick_id_++, {lo.x, size.y - hi.y}, hi - lo};
+  }
+
+  void _collectPicks() {
+    if (!picker_) { return; }
+    while (auto result = picker_->poll()) {
+      // (resolved by nodes at request time cf. PickingRenderer::Result::getNodes)
+      ctx_.selection = result->getNodes();
+      ctx_.active_node = ctx_.selection.empty() ? nullptr : ctx_.selection.front();
+    }
   }
 
   void processUI() override {
+    _collectPicks();
+
     // Setup state
     camera_.aspect_ratio_ = (float)content_size_[0] / content_size_[1];
-    framebuffer_->setSize({content_size_[0], content_size_[1]});
+    if (framebuffer_ && framebuffer_->size_ != content_size_) {
+      framebuffer_->setSize({content_size_[0], content_size_[1]});
+      needs_redraw_ = true; // texture is reallocated
+    }
     draw_list_ = ImGui::GetWindowDrawList();
     setupContext();
 
@@ -391,8 +1963,52 @@ struct ViewportPanel : Panel {
     UI_Overlay();
   }
 
+  int getSamples() const {
+    return (ctx_.dynamic_msaa && ctx_.camera_interaction) ? 1 : ctx_.msaa_samples;
+  }
+
+  bool _checkRedraw() {
+    int samples = getSamples();
+    auto hash = scene::getSignature(camera_, mng_.getSignature());
+    hash = utils::hashFnv1a(&content_size_, sizeof(content_size_), hash);
+    hash = utils::hashFnv1a(&samples, sizeof(samples), hash);
+    hash = overlay_.getSignature(hash);
+    // Texture streaming changes image without any change on UI side
+    bool streaming = mng_.hasPendingTextures();
+    if (!needs_redraw_ && !mng_.continuous_ && !streaming && hash == signature_) { return false; }
+    needs_redraw_ = false;
+    signature_ = hash;
+    mng_.num_redraws_++;
+    return true;
+  }
+
   void processPostUI() override {
-    mng_.renderer_->draw(*mng_.scene_, camera_, *framebuffer_);
+    if (content_size_.x <= 0 || content_size_.y <= 0) { return; }
+    if (framebuffer_ && framebuffer_->ids_ != _useGpuPicking()) {
+      framebuffer_->setIds(_useGpuPicking());
+      needs_redraw_ = true; // attachments are reallocated
+    }
+    if (_checkRedraw()) {
+      _draw();
+    }
+    if (pick_request_) {
+      mng_.renderer_->pick(*mng_.scene_, camera_, *framebuffer_, *picker_, *pick_request_);
+      pick_request_.reset();
+    }
+    if (picker_ && !picker_->pending_.empty()) {
+      mng_.keep_awake_ = true; // to collect readback
+    }
+  }
+
+  void _draw() {
+    if (framebuffer_) {
+      framebuffer_->setSamples(getSamples());
+      mng_.renderer_->draw(*mng_.scene_, camera_, *framebuffer_, reinterpret_cast<uintptr_t>(this));
+      mng_.renderer_->drawOverlay(overlay_, camera_, *framebuffer_);
+      mng_.renderer_->resolve(*framebuffer_);
+    } else {
+      mng_.views_.push_back({render_target_id_, camera_, content_size_, getSamples(), overlay_});
+    }
   }
 };
 
@@ -409,7 +2025,7 @@ struct AssetsPanel : Panel {
   void UI_GltfImporter() {
     auto dd_active = ImGui::GetCurrentContext()->DragDropActive;
     if (!dd_active) {
-      ImGui::InputTextWithHint("", "Type .gltf file or drag&drop here", filename_.data(), filename_.capacity() + 1);
+      ImGui::InputTextWithHint("", "Type .gltf/.hdr file or drag&drop here", filename_.data(), filename_.capacity() + 1);
     } else {
       auto _ = ImScoped::StyleColor(ImGuiCol_Button, ImGui::GetColorU32(ImGuiCol_ButtonHovered));
       ImGui::Button("DROP A FILE HERE", {ImGui::CalcItemWidth(), 0});
@@ -434,7 +2050,11 @@ struct AssetsPanel : Panel {
     if (ImGui::ButtonEx("LOAD", {0, 0}, dd_active ? ImGuiButtonFlags_Disabled : 0)) {
       try {
         // TODO: we can defer actual loading somewhere else
-        mng_.loadGltf(filename_.data());
+        if (std::filesystem::path{filename_.data()}.extension() == ".hdr") {
+          mng_.loadEnvironment(filename_.data());
+        } else {
+          mng_.loadGltf(filename_.data());
+        }
         filename_ = "";
       } catch (std::runtime_error e) {
         fmt::print("=== exception ===\n{}\n", e.what());
@@ -449,25 +2069,41 @@ struct AssetsPanel : Panel {
 
         if (auto _ = ImScoped::TreeNodeEx("Transform", ImGuiTreeNodeFlags_DefaultOpen)) {
           ImGui::SameLine();
-          if (ImGui::SmallButton("Reset")) { node->transform_ = fmat4{1}; };
-          imgui::InputTransform(node->transform_);
+          if (ImGui::SmallButton("Reset")) { node->transform_ = fmat4{1}; mng_.markEdited(); };
+          if (imgui::InputTransform(node->transform_)) { mng_.markEdited(); }
         }
 
         if (auto _ = ImScoped::TreeNodeEx("(Transform Matrix)")) {
           for (auto i : utils::Range{4}) {
             auto _ = ImScoped::ID(i);
-            ImGui::DragFloat4(fmt::format("transform[{}]", i).data(), (float*)&node->transform_[i], .05);
+            if (ImGui::DragFloat4(fmt::format("transform[{}]", i).data(), (float*)&node->transform_[i], .05)) {
+              mng_.markEdited();
+            }
           }
         }
       }
     }
 
+    if (auto& environment = mng_.scene_->environment_) {
+      if (auto _ = ImScoped::TreeNodeEx("Environment", ImGuiTreeNodeFlags_DefaultOpen)) {
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Remove")) {
+          environment.reset();
+          mng_.markEdited();
+        }
+        if (environment) {
+          ImGui::TextUnformatted(environment->filename_.data());
+          if (ImGui::DragFloat("intensity", &mng_.scene_->environment_intensity_, 0.01, 0, 16)) { mng_.markEdited(); }
+        }
+      }
+    }
+
     if (auto _ = ImScoped::TreeNodeEx("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
       auto& camera = mng_.scene_->camera_;
       if (auto _ = ImScoped::TreeNodeEx("Transform", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::SameLine();
-        if (ImGui::SmallButton("Reset")) { camera.transform_ = fmat4{1}; };
-        imgui::InputTransform(camera.transform_);
+        if (ImGui::SmallButton("Reset")) { camera.transform_ = fmat4{1}; mng_.markEdited(); };
+        if (imgui::InputTransform(camera.transform_)) { mng_.markEdited(); }
       }
     }
   }
@@ -483,14 +2119,16 @@ struct AssetsPanel : Panel {
 
       if (auto _ = ImScoped::TreeNodeEx("Transform", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::SameLine();
-        if (ImGui::SmallButton("Reset")) { node->transform_ = fmat4{1}; };
-        imgui::InputTransform(node->transform_);
+        if (ImGui::SmallButton("Reset")) { node->transform_ = fmat4{1}; mng_.markEdited(); };
+        if (imgui::InputTransform(node->transform_)) { mng_.markEdited(); }
       }
 
       if (auto _ = ImScoped::TreeNodeEx("(Transform Matrix)")) {
         for (auto i : utils::Range{4}) {
           auto _ = ImScoped::ID(i);
-          ImGui::DragFloat4(fmt::format("transform[{}]", i).data(), (float*)&node->transform_[i], .05);
+          if (ImGui::DragFloat4(fmt::format("transform[{}]", i).data(), (float*)&node->transform_[i], .05)) {
+            mng_.markEdited();
+          }
         }
       }
     }
@@ -518,20 +2156,107 @@ struct AssetsPanel : Panel {
   }
 };
 
+// Renderer statistics on top of imgui's metrics
+struct SceneMetricsPanel : Panel {
+  constexpr static const char* type = "Metrics";
+  SceneManager& mng_;
+
+  SceneMetricsPanel(SceneManager& mng) : mng_{mng} {}
+
+  static void UI_FrameStats(const char* label, const utils::FrameStats& stats) {
+    float average = stats.getAverage();
+    ImGui::Text("%-10s : %5.1f fps (avg %5.2f ms, max %5.2f ms)",
+        label, average > 0 ? 1000 / average : 0, average, stats.getMax());
+    ImGui::PlotLines(
+        fmt::format("##{}", label).data(), stats.history_.data(), stats.size(), stats.getOffset(),
+        nullptr, 0, 50, ImVec2{0, 40});
+  }
+
+  void processUI() override {
+    auto stats = mng_.getRenderStats();
+    auto& settings = mng_.render_settings_;
+    if (ImGui::CollapsingHeader("Frame Pacing", ImGuiTreeNodeFlags_DefaultOpen)) {
+      UI_FrameStats("ui", mng_.frame_stats_);
+      if (mng_.render_thread_) {
+        auto [render_stats, num_dropped] = mng_.render_thread_->getFrameStats();
+        UI_FrameStats("render", render_stats);
+        ImGui::Text("dropped    : %zu snapshots", num_dropped);
+      } else {
+        ImGui::TextDisabled("render on ui thread (run with --render-thread to split)");
+      }
+      ImGui::Checkbox("continuous (otherwise redraw only on change)", &mng_.continuous_);
+    }
+    if (ImGui::CollapsingHeader("Textures", ImGuiTreeNodeFlags_DefaultOpen)) {
+      constexpr float kMiB = 1 << 20;
+      int budget = settings.texture_budget_ >> 20;
+      if (ImGui::InputInt("budget (MiB)", &budget)) {
+        settings.texture_budget_ = size_t(std::max(budget, 0)) << 20;
+      }
+      ImGui::Text("used       : %.1f MiB (+ %.1f MiB low mips)", stats.texture_used_ / kMiB, stats.texture_used_low_ / kMiB);
+      ImGui::Text("resident   : %zu / %zu", stats.num_resident_, stats.num_textures_);
+      ImGui::Text("streaming  : %zu", stats.num_pending_);
+      ImGui::Text("evicted    : %zu", stats.num_evicted_);
+      ImGui::Text("streamed   : %zu", stats.num_streamed_);
+      ImGui::Text("failed     : %zu", stats.num_failed_);
+    }
+    if (ImGui::CollapsingHeader("Texture Atlas")) {
+      ImGui::Checkbox("pack small textures", &settings.use_texture_atlas_);
+      auto& atlas = stats.atlas_;
+      ImGui::BulletText(
+          "%zu textures, %d layers (%dx%d), efficiency %.1f%%",
+          atlas.num_textures_, atlas.num_layers_,
+          atlas.page_size_.x, atlas.page_size_.y, 100 * atlas.efficiency_);
+    }
+    if (ImGui::CollapsingHeader("Lighting")) {
+      ImGui::Text("lights     : %zu", stats.num_lights_);
+      ImGui::Text("indices    : %zu (max %u per cluster)", stats.num_light_indices_, stats.max_lights_per_cluster_);
+      ImGui::Text("overflows  : %zu clusters", stats.num_cluster_overflows_);
+      ImGui::Text("environment: %.1f MiB", stats.environment_used_ / float(1 << 20));
+      ImGui::SliderInt("shadow cascades", &settings.shadow_cascades_, 0, shadow::kMaxCascades);
+      if (ImGui::InputInt("shadow resolution", &settings.shadow_resolution_, 512)) {
+        settings.shadow_resolution_ = std::clamp(settings.shadow_resolution_, 256, 8192);
+      }
+      ImGui::DragFloat("shadow distance", &settings.shadow_distance_, 0.5, 1, 1000);
+      for (auto i : utils::Range{stats.shadow_cascades_.size()}) {
+        auto& cascade = stats.shadow_cascades_[i];
+        ImGui::BulletText(
+            "cascade %zu: up to %.1f, %zu draws%s", i, cascade.far_, cascade.num_draws_, cascade.cached_ ? " (cached)" : "");
+      }
+    }
+    if (ImGui::CollapsingHeader("Programs")) {
+      auto program_stats = utils::gl::ProgramCache::get().getStats();
+      ImGui::Text("compiled   : %zu", program_stats.num_compiled_);
+      ImGui::Text("from disk  : %zu (rejected %zu)", program_stats.num_loaded_, program_stats.num_rejected_);
+      ImGui::Text("shared     : %zu", program_stats.num_shared_);
+    }
+    if (ImGui::CollapsingHeader("ImGui")) {
+      ImGui::ShowMetricsWindow(nullptr, /* no_window */ true);
+    }
+  }
+};
+
 struct App {
   unique_ptr<toy::Window> window_;
+  unique_ptr<profiler::GpuProfiler> gpu_profiler_; // for UI's draw commands
+  unique_ptr<SceneManager> scene_manager_; // (outlives panels referencing it)
   unique_ptr<PanelManager> panel_manager_;
-  unique_ptr<SceneManager> scene_manager_;
   vector<string> drag_drop_files_;
   bool done_ = false;
 
-  App() {
+  // Sleep in glfwWaitEvents after this many frames without input nor redraw
+  // (ImGui takes a few frames to settle e.g. hover state after mouse leaves)
+  constexpr static int kIdleFrames = 3;
+  int idle_frames_ = 0;
+
+  App(bool use_render_thread) {
     window_.reset(new Window{"My Window", {800, 600}, { .gl_debug = true, .hint_maximized = true }});
+    profiler::Profiler::get().setThreadName("main");
+    gpu_profiler_.reset(new profiler::GpuProfiler{"GPU (ui)"});
     window_->drop_callback_ = [&](const vector<string>& paths) {
       drag_drop_files_ = paths;
     };
 
-    scene_manager_.reset(new SceneManager);
+    scene_manager_.reset(new SceneManager{*window_, use_render_thread});
 
     // load asssets
     scene_manager_->loadGltf(GLTF_MODEL_PATH("BoxTextured"));
@@ -541,8 +2266,10 @@ struct App {
     // panel system setup
     panel_manager_.reset(new PanelManager{*window_});
     panel_manager_->registerPanelType<StyleEditorPanel>();
-    panel_manager_->registerPanelType<MetricsPanel>();
     panel_manager_->registerPanelType<DemoPanel>();
+    panel_manager_->registerPanelType<ProfilerPanel>();
+    panel_manager_->registerPanelType<SceneMetricsPanel>([&]() {
+        return new SceneMetricsPanel{*scene_manager_}; });
 
     panel_manager_->registerPanelType<ViewportPanel>([&]() {
         return new ViewportPanel{*scene_manager_}; });
@@ -589,13 +2316,48 @@ struct App {
     panel_manager_->processUI();
   }
 
+  static bool hasInput() {
+    auto& io = ImGui::GetIO();
+    return io.MouseDelta.x != 0 || io.MouseDelta.y != 0 || io.MouseWheel != 0 || io.MouseWheelH != 0 ||
+        ImGui::IsAnyMouseDown() || !io.InputQueueCharacters.empty() ||
+        std::any_of(std::begin(io.KeysDown), std::end(io.KeysDown), [](bool down) { return down; });
+  }
+
+  // Other threads can wake it up by glfwPostEmptyEvent (e.g. RenderThread finishing frame)
+  void updateIdle() {
+    bool active = scene_manager_->continuous_ || scene_manager_->num_redraws_ > 0 || scene_manager_->keep_awake_ ||
+        hasInput() || !drag_drop_files_.empty();
+    idle_frames_ = active ? 0 : idle_frames_ + 1;
+    window_->wait_event_ = idle_frames_ >= kIdleFrames;
+  }
+
   int exec() {
     while(!done_) {
-      window_->newFrame();
-      processUI();
-      panel_manager_->processPostUI();
-      window_->render();
+      window_->pollEvents(); // (before frame begins since it might sleep when idle)
+      profiler::Profiler::get().newFrame();
+      gpu_profiler_->newFrame();
+      {
+        TOY_PROFILE_SCOPE("Window::newFrame");
+        window_->newFrame(/*poll_events*/ false);
+      }
+      scene_manager_->newFrame();
+      {
+        TOY_PROFILE_SCOPE("App::processUI");
+        processUI();
+      }
+      {
+        TOY_PROFILE_SCOPE("PanelManager::processPostUI");
+        panel_manager_->processPostUI();
+      }
+      {
+        TOY_PROFILE_SCOPE("Window::render");
+        TOY_PROFILE_GPU_SCOPE(gpu_profiler_.get(), "imgui");
+        window_->render();
+      }
+      scene_manager_->endFrame();
       panel_manager_->endFrame();
+      updateIdle();
+      profiler::Profiler::get().endFrame();
       done_ = done_ || window_->shouldClose();
     }
     return 0;
@@ -606,6 +2368,10 @@ struct App {
 
 
 int main(const int argc, const char* argv[]) {
-  toy::App app{};
+  toy::utils::Cli cli{argc, argv};
+  toy::App app{cli.checkArg("--render-thread")};
+  if (auto environment = cli.getArg<std::string>("--environment")) {
+    app.scene_manager_->loadEnvironment(environment->data());
+  }
   return app.exec();
 }
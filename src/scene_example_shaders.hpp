@@ -1,3 +1,5 @@
+// DEPTH_ONLY variant is for depth pre-pass (cf. SceneRenderer::getDepthProgram) and position is invariant
+// so that main pass can test depth by GL_EQUAL
 constexpr static const char* vertex_shader_source = R"(
 #version 330
 uniform mat4 view_projection_;
@@ -5,33 +7,587 @@ uniform mat4 view_inv_xform_;
 uniform mat4 model_xform_;
 
 layout (location = 0) in vec3 vert_position_;
+invariant gl_Position;
+
+#ifndef DEPTH_ONLY
 layout (location = 1) in vec4 vert_color_;
 layout (location = 2) in vec2 vert_texcoord_;
 
 out vec4 interp_color_;
 out vec2 interp_texcoord_;
+#endif
+
+#ifdef LIGHTING
+layout (location = 4) in vec3 vert_normal_;
+out vec3 interp_position_; // view space
+out vec3 interp_normal_;
+#endif
 
 void main() {
+#ifndef DEPTH_ONLY
   interp_color_ = vert_color_;
   interp_texcoord_ = vert_texcoord_;
-  gl_Position = view_projection_ * view_inv_xform_ * model_xform_ * vec4(vert_position_, 1);
+#endif
+  vec4 view_position = view_inv_xform_ * model_xform_ * vec4(vert_position_, 1);
+#ifdef LIGHTING
+  interp_position_ = view_position.xyz;
+  interp_normal_ = transpose(inverse(mat3(view_inv_xform_ * model_xform_))) * vert_normal_;
+#endif
+  gl_Position = view_projection_ * view_position;
 }
 )";
 
+// Features are selected by defines (cf. scene::shader_variant)
+// - HAS_BASE_COLOR_TEXTURE (+ BASE_COLOR_ATLAS), HAS_VERTEX_COLOR, ALPHA_MODE_MASK, ALPHA_MODE_BLEND, LIGHTING
+// - DOUBLE_SIDED lights back face by flipped normal
+// - WEIGHTED_OIT (with ALPHA_MODE_BLEND) outputs weighted color and weight to be accumulated (cf. WeightedOitRenderer)
+// - DEBUG_OVERDRAW outputs constant to count shaded fragments per pixel
+// - lighting_shader_source is inserted before (cf. SceneRenderer::getProgram)
 constexpr static const char* fragment_shader_source = R"(
 #version 330
+#if defined(HAS_BASE_COLOR_TEXTURE) && defined(BASE_COLOR_ATLAS)
+uniform sampler2DArray base_color_atlas_;
+uniform int atlas_layer_;
+uniform vec4 atlas_rect_;
+#elif defined(HAS_BASE_COLOR_TEXTURE)
 uniform sampler2D base_color_texture_;
-uniform bool use_base_color_texture_;
+#else
 uniform vec4 base_color_factor_;
+#endif
+#ifdef ALPHA_MODE_MASK
+uniform float alpha_cutoff_;
+#endif
+#ifdef LIGHTING
+uniform float metallic_factor_;
+uniform float roughness_factor_;
+in vec3 interp_position_;
+in vec3 interp_normal_;
+#endif
 
 in vec4 interp_color_;
 in vec2 interp_texcoord_;
 
 layout (location = 0) out vec4 frag_color_;
+#ifdef WEIGHTED_OIT
+layout (location = 1) out float frag_weight_;
+#endif
+
+// Textures are sampled as sRGB (i.e. decoded to linear), so encode back since framebuffer is plain RGBA8
+vec3 linearToSrgb(vec3 c) {
+  return mix(12.92 * c, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, c));
+}
+
+// Depth weight falling off with view depth (i.e. 1 / gl_FragCoord.w) so that nearer layers dominate
+// cf. McGuire and Bavoil, "Weighted Blended Order-Independent Transparency" (eq. 10)
+float getOitWeight(float alpha) {
+  float z = 1.0 / gl_FragCoord.w;
+  return alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+// Atlased texture is wrapped manually, so gradients are taken from original texcoord (otherwise mip jumps at wrap)
+#if defined(HAS_BASE_COLOR_TEXTURE) && defined(BASE_COLOR_ATLAS)
+vec4 sampleBaseColor(vec2 uv) {
+  vec2 atlas_uv = atlas_rect_.xy + fract(uv) * atlas_rect_.zw;
+  return textureGrad(base_color_atlas_, vec3(atlas_uv, atlas_layer_), dFdx(uv) * atlas_rect_.zw, dFdy(uv) * atlas_rect_.zw);
+}
+#elif defined(HAS_BASE_COLOR_TEXTURE)
+vec4 sampleBaseColor(vec2 uv) {
+  return texture(base_color_texture_, uv);
+}
+#endif
+
+void main() {
+#ifdef HAS_BASE_COLOR_TEXTURE
+  vec4 base_color = sampleBaseColor(interp_texcoord_);
+#else
+  vec4 base_color = base_color_factor_;
+#endif
+#ifdef HAS_VERTEX_COLOR
+  base_color *= interp_color_;
+#endif
+#ifdef ALPHA_MODE_MASK
+  if (base_color.a < alpha_cutoff_) { discard; }
+#endif
+#ifdef LIGHTING
+  vec3 normal = normalize(interp_normal_);
+#ifdef DOUBLE_SIDED
+  if (!gl_FrontFacing) { normal = -normal; }
+#endif
+  base_color.rgb = computeLighting(base_color.rgb, metallic_factor_, roughness_factor_, interp_position_, normal);
+#endif
+#ifndef ALPHA_MODE_BLEND
+  base_color.a = 1;
+#endif
+  frag_color_ = vec4(linearToSrgb(base_color.rgb), base_color.a);
+#ifdef WEIGHTED_OIT
+  // (color and revealage into one target, weight into the other, cf. WeightedOitRenderer)
+  frag_weight_ = getOitWeight(base_color.a);
+  frag_color_ = vec4(frag_color_.rgb * frag_weight_, base_color.a);
+#endif
+#ifdef DEBUG_OVERDRAW
+  frag_color_ = vec4(0.125, 0.0625, 0.03125, 1.0); // (accumulated additively i.e. red, yellow then white)
+#endif
+}
+)";
+
+// Same as above but for glMultiDrawElementsIndirect (requires GL 4.3 for SSBO)
+// - per-draw data comes as instanced attribute (divisor 1) fetched at `base_instance`
+// - transforms and materials are indexed from shader storage buffers
+constexpr static const char* mdi_vertex_shader_source = R"(
+#version 430
+uniform mat4 view_projection_;
+uniform mat4 view_inv_xform_;
+
+layout (std430, binding = 0) readonly buffer Transforms { mat4 transforms_[]; };
+
+layout (location = 0) in vec3 vert_position_;
+layout (location = 3) in uvec2 vert_draw_data_; // (transform index, material index)
+invariant gl_Position;
+
+#ifndef DEPTH_ONLY
+layout (location = 1) in vec4 vert_color_;
+layout (location = 2) in vec2 vert_texcoord_;
+
+out vec4 interp_color_;
+out vec2 interp_texcoord_;
+flat out uint interp_material_index_;
+#endif
+
+#ifdef LIGHTING
+layout (location = 4) in vec3 vert_normal_;
+out vec3 interp_position_; // view space
+out vec3 interp_normal_;
+#endif
+
+void main() {
+#ifndef DEPTH_ONLY
+  interp_color_ = vert_color_;
+  interp_texcoord_ = vert_texcoord_;
+  interp_material_index_ = vert_draw_data_.y;
+#endif
+  mat4 model_xform = transforms_[vert_draw_data_.x];
+  vec4 view_position = view_inv_xform_ * model_xform * vec4(vert_position_, 1);
+#ifdef LIGHTING
+  interp_position_ = view_position.xyz;
+  interp_normal_ = transpose(inverse(mat3(view_inv_xform_ * model_xform))) * vert_normal_;
+#endif
+  gl_Position = view_projection_ * view_position;
+}
+)";
+
+// (same defines as fragment_shader_source)
+constexpr static const char* mdi_fragment_shader_source = R"(
+#version 430
+struct MaterialData {
+  vec4 base_color_factor;
+  int use_base_color_texture;
+  int atlas_layer;
+  float alpha_cutoff;
+  vec4 atlas_rect;
+  float metallic;
+  float roughness;
+};
+
+layout (std430, binding = 1) readonly buffer Materials { MaterialData materials_[]; };
+
+#if defined(HAS_BASE_COLOR_TEXTURE) && defined(BASE_COLOR_ATLAS)
+uniform sampler2DArray base_color_atlas_;
+#elif defined(HAS_BASE_COLOR_TEXTURE)
+uniform sampler2D base_color_texture_;
+#endif
+
+in vec4 interp_color_;
+in vec2 interp_texcoord_;
+flat in uint interp_material_index_;
+#ifdef LIGHTING
+in vec3 interp_position_;
+in vec3 interp_normal_;
+#endif
+
+layout (location = 0) out vec4 frag_color_;
+#ifdef WEIGHTED_OIT
+layout (location = 1) out float frag_weight_;
+#endif
+
+// cf. fragment_shader_source
+vec3 linearToSrgb(vec3 c) {
+  return mix(12.92 * c, 1.055 * pow(c, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, c));
+}
+
+// cf. fragment_shader_source
+float getOitWeight(float alpha) {
+  float z = 1.0 / gl_FragCoord.w;
+  return alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+}
+
+// cf. fragment_shader_source
+#if defined(HAS_BASE_COLOR_TEXTURE) && defined(BASE_COLOR_ATLAS)
+vec4 sampleBaseColor(vec2 uv, MaterialData material) {
+  vec4 rect = material.atlas_rect;
+  vec2 atlas_uv = rect.xy + fract(uv) * rect.zw;
+  return textureGrad(base_color_atlas_, vec3(atlas_uv, material.atlas_layer), dFdx(uv) * rect.zw, dFdy(uv) * rect.zw);
+}
+#elif defined(HAS_BASE_COLOR_TEXTURE)
+vec4 sampleBaseColor(vec2 uv, MaterialData material) {
+  return texture(base_color_texture_, uv);
+}
+#endif
+
+void main() {
+  MaterialData material = materials_[interp_material_index_];
+#ifdef HAS_BASE_COLOR_TEXTURE
+  vec4 base_color = sampleBaseColor(interp_texcoord_, material);
+#else
+  vec4 base_color = material.base_color_factor;
+#endif
+#ifdef HAS_VERTEX_COLOR
+  base_color *= interp_color_;
+#endif
+#ifdef ALPHA_MODE_MASK
+  if (base_color.a < material.alpha_cutoff) { discard; }
+#endif
+#ifdef LIGHTING
+  vec3 normal = normalize(interp_normal_);
+#ifdef DOUBLE_SIDED
+  if (!gl_FrontFacing) { normal = -normal; }
+#endif
+  base_color.rgb = computeLighting(base_color.rgb, material.metallic, material.roughness, interp_position_, normal);
+#endif
+#ifndef ALPHA_MODE_BLEND
+  base_color.a = 1;
+#endif
+  frag_color_ = vec4(linearToSrgb(base_color.rgb), base_color.a);
+#ifdef WEIGHTED_OIT
+  // (color and revealage into one target, weight into the other, cf. WeightedOitRenderer)
+  frag_weight_ = getOitWeight(base_color.a);
+  frag_color_ = vec4(frag_color_.rgb * frag_weight_, base_color.a);
+#endif
+#ifdef DEBUG_OVERDRAW
+  frag_color_ = vec4(0.125, 0.0625, 0.03125, 1.0); // (accumulated additively i.e. red, yellow then white)
+#endif
+}
+)";
+
+// Overlay lines (cf. OverlayRenderer)
+// - each segment is an instance expanded into screen space quad (GL_TRIANGLE_STRIP of 4 vertices)
+// - quad is widened by 1px and faded out at the edge for anti-aliasing
+constexpr static const char* overlay_line_vertex_shader_source = R"(
+#version 330
+uniform mat4 sceneCo_to_clipCo_;
+uniform vec4 viewport_size_; // (only xy)
+
+in vec4 seg_p0_; // (position, thickness)
+in vec4 seg_p1_;
+in vec4 seg_color_;
+
+out vec4 interp_color_;
+out float interp_offset_; // signed distance from center line in pixels
+flat out float interp_half_width_;
+
+void main() {
+  // (end, side) = (0, -1), (0, 1), (1, -1), (1, 1)
+  float end = float(gl_VertexID / 2);
+  float side = float(gl_VertexID % 2) * 2 - 1;
+
+  // Clip to front of camera so that perspective division is valid (then near plane clips the rest)
+  const float kMinW = 1e-5;
+  vec4 c0 = sceneCo_to_clipCo_ * vec4(seg_p0_.xyz, 1);
+  vec4 c1 = sceneCo_to_clipCo_ * vec4(seg_p1_.xyz, 1);
+  if (c0.w < kMinW && c1.w < kMinW) { c0 = c1 = vec4(0, 0, 2, 1); }
+  if (c0.w < kMinW) { c0 = mix(c0, c1, (kMinW - c0.w) / (c1.w - c0.w)); }
+  if (c1.w < kMinW) { c1 = mix(c1, c0, (kMinW - c1.w) / (c0.w - c1.w)); }
+
+  vec2 size = viewport_size_.xy;
+  vec2 dir = (c1.xy / c1.w - c0.xy / c0.w) * size / 2;
+  dir = (length(dir) > 1e-6) ? normalize(dir) : vec2(1, 0);
+  vec2 normal = vec2(-dir.y, dir.x);
+
+  float half_width = seg_p0_.w / 2 + 1;
+  vec4 c = (end == 0) ? c0 : c1;
+  gl_Position = c + vec4(normal * side * half_width / size * 2 * c.w, 0, 0);
+  interp_color_ = seg_color_;
+  interp_offset_ = side * half_width;
+  interp_half_width_ = half_width;
+}
+)";
+
+constexpr static const char* overlay_line_fragment_shader_source = R"(
+#version 330
+in vec4 interp_color_;
+in float interp_offset_;
+flat in float interp_half_width_;
+
+layout (location = 0) out vec4 frag_color_;
+
+void main() {
+  float coverage = clamp(interp_half_width_ - abs(interp_offset_), 0, 1);
+  frag_color_ = vec4(interp_color_.rgb, interp_color_.a * coverage);
+}
+)";
+
+// Infinite grid technique, i.e. full screen triangle where each pixel's ray is intersected with grid plane
+// - lines are about 1px wide at any distance (by screen space derivative) and faded out where denser than pixels
+// - depth is written for the intersection so that grid is occluded by scene
+constexpr static const char* overlay_grid_vertex_shader_source = R"(
+#version 330
+out vec2 interp_ndCo_;
+
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2 - 1;
+  interp_ndCo_ = p;
+  gl_Position = vec4(p, 0, 1);
+}
+)";
+
+constexpr static const char* overlay_grid_fragment_shader_source = R"(
+#version 330
+uniform mat4 sceneCo_to_clipCo_;
+uniform mat4 clipCo_to_sceneCo_;
+uniform int plane_; // normal axis
+uniform vec4 grid_; // (bound, division, alpha (integral), alpha (fractional))
+
+in vec2 interp_ndCo_;
+
+layout (location = 0) out vec4 frag_color_;
+
+float gridLine(vec2 c) {
+  vec2 w = fwidth(c);
+  vec2 d = abs(fract(c - 0.5) - 0.5) / w;
+  float line = 1 - min(min(d.x, d.y), 1);
+  return line * (1 - smoothstep(0.2, 0.5, max(w.x, w.y)));
+}
+
+void main() {
+  vec4 near = clipCo_to_sceneCo_ * vec4(interp_ndCo_, -1, 1);
+  vec4 far  = clipCo_to_sceneCo_ * vec4(interp_ndCo_,  1, 1);
+  vec3 p0 = near.xyz / near.w;
+  vec3 p1 = far.xyz / far.w;
+  float t = -p0[plane_] / (p1[plane_] - p0[plane_]);
+  vec3 p = mix(p0, p1, t);
+  vec2 c = vec2(p[(plane_ + 1) % 3], p[(plane_ + 2) % 3]);
+
+  // (derivatives are taken before any discard)
+  float alpha = max(grid_.z * gridLine(c), grid_.w * gridLine(c * grid_.y));
+  bool inside = all(lessThanEqual(abs(c) - fwidth(c), vec2(grid_.x)));
+  if (!(0 < t && t <= 1) || !inside || alpha <= 0) { discard; }
+
+  vec4 clip = sceneCo_to_clipCo_ * vec4(p, 1);
+  gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+  frag_color_ = vec4(1, 1, 1, alpha);
+}
+)";
+
+//
+// Picking pass (cf. PickingRenderer)
+//
+
+constexpr static const char* picking_vertex_shader_source = R"(
+#version 330
+uniform mat4 view_projection_;
+uniform mat4 view_inv_xform_;
+uniform mat4 model_xform_;
+
+layout (location = 0) in vec3 vert_position_;
+
+void main() {
+  gl_Position = view_projection_ * view_inv_xform_ * model_xform_ * vec4(vert_position_, 1);
+}
+)";
+
+constexpr static const char* picking_fragment_shader_source = R"(
+#version 330
+uniform uint node_id_;
+
+layout (location = 1) out uvec2 frag_id_; // (node, triangle) where 0 is background
+
+void main() {
+  frag_id_ = uvec2(node_id_, uint(gl_PrimitiveID) + 1u);
+}
+)";
+
+// Depth only for shadow map (cf. ShadowRenderer)
+constexpr static const char* shadow_vertex_shader_source = R"(
+#version 330
+uniform mat4 view_projection_;
+uniform mat4 model_xform_;
+
+layout (location = 0) in vec3 vert_position_;
 
 void main() {
-  vec4 uniform_base_color = (use_base_color_texture_) ? texture(base_color_texture_, interp_texcoord_) : base_color_factor_;
-  vec4 base_color = interp_color_ * uniform_base_color;
-  frag_color_ = base_color;
+  gl_Position = view_projection_ * model_xform_ * vec4(vert_position_, 1);
+}
+)";
+
+// Fullscreen triangle at far plane (with GL_GREATER, it passes only where something is drawn cf. SceneRenderer::draw)
+constexpr static const char* far_plane_vertex_shader_source = R"(
+#version 330
+void main() {
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(2.0 * p - 1.0, 1.0, 1.0);
+}
+)";
+
+// (also for depth pre-pass)
+constexpr static const char* depth_only_fragment_shader_source = R"(
+#version 330
+void main() {}
+)";
+
+// Resolves weighted blended transparency over opaque color (drawn by far_plane_vertex_shader_source without depth test)
+// - average color is premultiplied by coverage (1 - revealage) so that it's blended as (GL_ONE, GL_ONE_MINUS_SRC_ALPHA)
+constexpr static const char* oit_composite_fragment_shader_source = R"(
+#version 330
+uniform sampler2D accum_;  // (sum of weighted color, revealage)
+uniform sampler2D weight_; // sum of weight
+
+layout (location = 0) out vec4 frag_color_;
+
+void main() {
+  ivec2 p = ivec2(gl_FragCoord.xy);
+  vec4 accum = texelFetch(accum_, p, 0);
+  float coverage = 1.0 - accum.a;
+  if (coverage <= 0.0) { discard; }
+  vec3 color = accum.rgb / max(texelFetch(weight_, p, 0).r, 1e-5);
+  frag_color_ = vec4(color * coverage, coverage);
+}
+)";
+
+// Clustered punctual lights with glTF metallic-roughness BRDF (inserted into fragment shaders, cf. SceneRenderer::getProgram)
+// - lights, clusters and light indices come as texture buffers so that it works without SSBO (cf. lighting::ClusterGrid)
+// - directional lights are not clustered and evaluated for all fragments
+constexpr static const char* lighting_shader_source = R"(
+#ifdef LIGHTING
+uniform samplerBuffer lights_;          // 4 texels per light (cf. lighting::LightData)
+uniform usamplerBuffer light_clusters_; // (offset, count) per cluster
+uniform usamplerBuffer light_indices_;
+uniform int num_directional_lights_;    // (first ones of lights_)
+uniform vec4 cluster_params_;           // (tile per pixel x, tile per pixel y, slice scale, slice bias)
+uniform vec4 cluster_dims_;
+
+// Image based lighting (cf. ibl::Prefiltered), no-op when env_intensity_ = 0
+uniform vec3 env_sh_[9];             // irradiance
+uniform samplerCube env_specular_;   // GGX prefiltered with roughness = lod / env_max_lod_
+uniform sampler2D env_brdf_lut_;     // (scale, bias) of F0 at (NdotV, roughness)
+uniform float env_intensity_;
+uniform float env_max_lod_;
+uniform mat4 env_xform_;             // view to world
+
+// Cascaded shadow of the first directional light (cf. ShadowRenderer), disabled when num_shadow_cascades_ = 0
+uniform sampler2DArrayShadow shadow_map_;
+uniform mat4 shadow_xforms_[4];      // view to shadow map coordinates ([0, 1]^3) per cascade
+uniform vec4 shadow_splits_;         // far view depth per cascade
+uniform vec4 shadow_texel_sizes_;    // (for normal offset)
+uniform int num_shadow_cascades_;
+
+const float kPi = 3.14159265;
+
+// cf. https://github.com/KhronosGroup/glTF/blob/master/specification/2.0/README.md#appendix-b-brdf-implementation
+vec3 evaluateBrdf(vec3 base_color, float metallic, float roughness, vec3 N, vec3 V, vec3 L) {
+  vec3 H = normalize(L + V);
+  float NdotL = clamp(dot(N, L), 0.0, 1.0);
+  float NdotV = clamp(abs(dot(N, V)), 0.001, 1.0);
+  float NdotH = clamp(dot(N, H), 0.0, 1.0);
+  float VdotH = clamp(dot(V, H), 0.0, 1.0);
+  float alpha = roughness * roughness;
+  float alpha2 = alpha * alpha;
+
+  vec3 f0 = mix(vec3(0.04), base_color, metallic);
+  vec3 c_diff = mix(base_color, vec3(0.0), metallic);
+  vec3 F = f0 + (1.0 - f0) * pow(1.0 - VdotH, 5.0);
+
+  float denom = NdotH * NdotH * (alpha2 - 1.0) + 1.0;
+  float D = alpha2 / (kPi * denom * denom);
+  float vis_v = NdotL * sqrt(NdotV * NdotV * (1.0 - alpha2) + alpha2);
+  float vis_l = NdotV * sqrt(NdotL * NdotL * (1.0 - alpha2) + alpha2);
+  float Vis = (vis_v + vis_l > 0.0) ? 0.5 / (vis_v + vis_l) : 0.0;
+
+  return ((1.0 - F) * c_diff / kPi + F * D * Vis) * NdotL;
+}
+
+vec3 evaluateLight(int index, vec3 base_color, float metallic, float roughness, vec3 P, vec3 N, vec3 V) {
+  vec4 position = texelFetch(lights_, 4 * index + 0);
+  vec4 direction = texelFetch(lights_, 4 * index + 1);
+  vec4 color = texelFetch(lights_, 4 * index + 2);
+  vec4 spot = texelFetch(lights_, 4 * index + 3);
+  if (direction.w == 0.0) {
+    return evaluateBrdf(base_color, metallic, roughness, N, V, -direction.xyz) * color.rgb;
+  }
+  vec3 to_light = position.xyz - P;
+  float d2 = max(dot(to_light, to_light), 1e-4);
+  vec3 L = to_light * inversesqrt(d2);
+
+  // cf. "Range Property" and "Inner and Outer Cone Angles" in KHR_lights_punctual
+  float ratio2 = d2 / (position.w * position.w);
+  float attenuation = clamp(1.0 - ratio2 * ratio2, 0.0, 1.0) / d2;
+  if (direction.w == 2.0) {
+    float t = clamp(dot(-L, direction.xyz) * spot.x + spot.y, 0.0, 1.0);
+    attenuation *= t * t;
+  }
+  return evaluateBrdf(base_color, metallic, roughness, N, V, L) * color.rgb * attenuation;
+}
+
+float computeShadow(vec3 P, vec3 N) {
+  float depth = -P.z;
+  int cascade = 0;
+  while (cascade < num_shadow_cascades_ - 1 && depth > shadow_splits_[cascade]) { cascade++; }
+  if (depth > shadow_splits_[cascade]) { return 1.0; }
+
+  // offset along normal by texel size against acne, then 2x2 taps of hardware PCF
+  vec3 coord = (shadow_xforms_[cascade] * vec4(P + N * 1.5 * shadow_texel_sizes_[cascade], 1.0)).xyz;
+  vec2 texel = 1.0 / vec2(textureSize(shadow_map_, 0).xy);
+  float result = 0.0;
+  for (int i = 0; i < 4; i++) {
+    vec2 offset = (vec2(i & 1, i >> 1) - 0.5) * texel;
+    result += texture(shadow_map_, vec4(coord.xy + offset, float(cascade), coord.z));
+  }
+  return result / 4.0;
+}
+
+// cf. ibl::getSH9Basis
+vec3 evaluateIrradiance(vec3 n) {
+  return
+      env_sh_[0] * 0.282095 +
+      env_sh_[1] * 0.488603 * n.y + env_sh_[2] * 0.488603 * n.z + env_sh_[3] * 0.488603 * n.x +
+      env_sh_[4] * 1.092548 * n.x * n.y + env_sh_[5] * 1.092548 * n.y * n.z +
+      env_sh_[6] * 0.315392 * (3.0 * n.z * n.z - 1.0) +
+      env_sh_[7] * 1.092548 * n.x * n.z + env_sh_[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+// Split sum approximation (cf. Karis, "Real Shading in Unreal Engine 4")
+vec3 evaluateEnvironment(vec3 base_color, float metallic, float roughness, vec3 N, vec3 V) {
+  vec3 f0 = mix(vec3(0.04), base_color, metallic);
+  vec3 c_diff = mix(base_color, vec3(0.0), metallic);
+  float NdotV = clamp(abs(dot(N, V)), 0.001, 1.0);
+  vec3 N_world = mat3(env_xform_) * N;
+  vec3 R_world = mat3(env_xform_) * reflect(-V, N);
+  vec3 irradiance = max(evaluateIrradiance(N_world), vec3(0.0));
+  vec3 prefiltered = textureLod(env_specular_, R_world, roughness * env_max_lod_).rgb;
+  vec2 brdf = texture(env_brdf_lut_, vec2(NdotV, roughness)).rg;
+  return (c_diff * irradiance / kPi + prefiltered * (f0 * brdf.x + brdf.y)) * env_intensity_;
+}
+
+vec3 computeLighting(vec3 base_color, float metallic, float roughness, vec3 P, vec3 N) {
+  vec3 V = normalize(-P);
+  vec3 result = vec3(0.0);
+  if (env_intensity_ > 0.0) {
+    result += evaluateEnvironment(base_color, metallic, roughness, N, V);
+  }
+  for (int i = 0; i < num_directional_lights_; i++) {
+    float shadow = (i == 0 && num_shadow_cascades_ > 0) ? computeShadow(P, N) : 1.0;
+    if (shadow > 0.0) {
+      result += evaluateLight(i, base_color, metallic, roughness, P, N, V) * shadow;
+    }
+  }
+
+  ivec3 dims = ivec3(cluster_dims_.xyz);
+  vec3 cluster_f = floor(vec3(gl_FragCoord.xy * cluster_params_.xy, log(max(-P.z, 1e-4)) * cluster_params_.z + cluster_params_.w));
+  ivec3 cluster = clamp(ivec3(cluster_f), ivec3(0), dims - 1);
+  uvec2 range = texelFetch(light_clusters_, (cluster.z * dims.y + cluster.y) * dims.x + cluster.x).xy;
+  for (uint i = 0u; i < range.y; i++) {
+    int index = int(texelFetch(light_indices_, int(range.x + i)).r);
+    result += evaluateLight(index, base_color, metallic, roughness, P, N, V);
+  }
+  return result;
 }
+#endif
 )";
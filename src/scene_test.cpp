@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <fmt/format.h>
+#include <random>
 
 #include "scene.hpp"
 
@@ -46,3 +47,280 @@ TEST(SceneTest, gltf_load_unsupported) {
     }
   }
 }
+
+TEST(SceneTest, makeSnapshot) {
+  using std::make_shared;
+  auto mat = make_shared<scene::Material>();
+  auto mesh = make_shared<scene::Mesh>();
+  scene::Scene scene;
+  for (auto& node_mesh : {mesh, mesh, std::shared_ptr<scene::Mesh>{}}) {
+    auto& node = scene.nodes_.emplace_back(new scene::Node);
+    node->mesh_ = node_mesh;
+    node->material_ = mat;
+  }
+
+  auto snapshot = scene::makeSnapshot(scene);
+  ASSERT_EQ(snapshot.nodes_.size(), 2); // node without mesh is skipped
+  EXPECT_NE(snapshot.nodes_[0], scene.nodes_[0]);
+  EXPECT_EQ(snapshot.nodes_[0]->mesh_, mesh);
+  EXPECT_NE(snapshot.nodes_[0]->material_, mat);
+  EXPECT_EQ(snapshot.nodes_[0]->material_, snapshot.nodes_[1]->material_);
+
+  // Later edits don't leak into snapshot
+  scene.nodes_[0]->transform_[3] = {1, 2, 3, 1};
+  mat->base_color_factor_ = {1, 0, 0, 1};
+  EXPECT_EQ(snapshot.nodes_[0]->transform_, glm::fmat4{1});
+  EXPECT_EQ(snapshot.nodes_[0]->material_->base_color_factor_, (glm::fvec4{1, 1, 1, 1}));
+
+  // Lights are copied too
+  auto& light = scene.lights_.emplace_back(new scene::Light);
+  snapshot = scene::makeSnapshot(scene);
+  ASSERT_EQ(snapshot.lights_.size(), 1);
+  light->intensity_ = 2;
+  EXPECT_EQ(snapshot.lights_[0]->intensity_, 1);
+
+  // Environment is shared (immutable after loading)
+  scene.environment_ = std::make_shared<scene::Environment>();
+  snapshot = scene::makeSnapshot(scene);
+  EXPECT_EQ(snapshot.environment_, scene.environment_);
+}
+
+TEST(SceneTest, getSignature) {
+  auto mat = std::make_shared<scene::Material>();
+  scene::Scene scene;
+  auto& node = scene.nodes_.emplace_back(new scene::Node);
+  node->mesh_ = std::make_shared<scene::Mesh>();
+  node->material_ = mat;
+  auto signature = scene::getSignature(scene);
+  EXPECT_EQ(scene::getSignature(scene), signature);
+  EXPECT_NE(scene::getSignature(scene::makeSnapshot(scene)), signature); // nodes are hashed by identity
+
+  node->transform_[3] = {1, 2, 3, 1};
+  auto signature_moved = scene::getSignature(scene);
+  EXPECT_NE(signature_moved, signature);
+
+  mat->base_color_factor_ = {1, 0, 0, 1};
+  EXPECT_NE(scene::getSignature(scene), signature_moved);
+
+  mat->base_color_factor_ = {1, 1, 1, 1};
+  EXPECT_EQ(scene::getSignature(scene), signature_moved);
+
+  scene.camera_.yfov_ /= 2;
+  auto signature_camera = scene::getSignature(scene);
+  EXPECT_NE(signature_camera, signature_moved);
+
+  auto& light = scene.lights_.emplace_back(new scene::Light);
+  auto signature_light = scene::getSignature(scene);
+  EXPECT_NE(signature_light, signature_camera);
+  light->intensity_ = 2;
+  EXPECT_NE(scene::getSignature(scene), signature_light);
+
+  auto signature_no_environment = scene::getSignature(scene);
+  scene.environment_ = std::make_shared<scene::Environment>();
+  auto signature_environment = scene::getSignature(scene);
+  EXPECT_NE(signature_environment, signature_no_environment);
+  scene.environment_intensity_ = 2;
+  EXPECT_NE(scene::getSignature(scene), signature_environment);
+}
+
+TEST(SceneTest, rayIntersection) {
+  // Unit quad on xy-plane as two triangles
+  auto mesh = std::make_shared<scene::Mesh>();
+  for (auto [x, y] : {std::pair{-1, -1}, {1, -1}, {1, 1}, {-1, 1}}) {
+    mesh->vertices_.emplace_back().position = {x, y, 0};
+  }
+  mesh->indices_ = {0, 1, 2, 0, 2, 3};
+  mesh->bvh_.reset(new scene::MeshBVH{*mesh});
+  EXPECT_EQ(mesh->bvh_->lo_, (glm::fvec3{-1, -1, 0}));
+  EXPECT_EQ(mesh->bvh_->hi_, (glm::fvec3{1, 1, 0}));
+
+  scene::Scene scene;
+  for (float z : {-2, 0}) {
+    auto& node = scene.nodes_.emplace_back(new scene::Node);
+    node->mesh_ = mesh;
+    node->transform_[3] = {0, 0, z, 1};
+  }
+  glm::fvec3 src = {0.5, -0.5, 5}, dir = {0, 0, -1};
+  auto front = scene::rayIntersection(scene, src, dir);
+  ASSERT_TRUE(front.result.hit);
+  EXPECT_EQ(front.node, scene.nodes_[1]);
+  EXPECT_EQ(front.result.triangle, 0);
+  EXPECT_FLOAT_EQ(front.result.t, 5);
+
+  // Hint doesn't change result even when it's not the closest
+  auto back = scene::rayIntersection(scene, src, dir, &front);
+  back.node = scene.nodes_[0];
+  auto with_hint = scene::rayIntersection(scene, glm::fvec3{-0.5, 0.5, 5}, dir, &back);
+  ASSERT_TRUE(with_hint.result.hit);
+  EXPECT_EQ(with_hint.node, scene.nodes_[1]);
+  EXPECT_EQ(with_hint.result.triangle, 1);
+
+  // Miss by bounds
+  EXPECT_FALSE(scene::rayIntersection(scene, glm::fvec3{2, 0, 5}, dir).result.hit);
+}
+
+TEST(SceneTest, buildDrawList) {
+  using std::shared_ptr, std::make_shared;
+  auto tex = make_shared<scene::Texture>();
+  auto mat1 = make_shared<scene::Material>(); mat1->base_color_texture_ = tex;
+  auto mat2 = make_shared<scene::Material>(); mat2->base_color_factor_ = {1, 0, 0, 1};
+  auto mesh1 = make_shared<scene::Mesh>(); mesh1->indices_.resize(3);
+  auto mesh2 = make_shared<scene::Mesh>(); mesh2->indices_.resize(6);
+
+  // node 0: textured, node 1: untextured, node 2: textured, node 3: no material
+  std::vector<std::pair<shared_ptr<scene::Mesh>, shared_ptr<scene::Material>>> node_specs = {
+      {mesh1, mat1}, {mesh2, mat2}, {mesh2, mat1}, {mesh1, nullptr}};
+  std::vector<shared_ptr<scene::Node>> nodes;
+  for (auto& [mesh, mat] : node_specs) {
+    auto& node = nodes.emplace_back(new scene::Node);
+    node->mesh_ = mesh;
+    node->material_ = mat;
+  }
+
+  scene::DrawList draw_list;
+  auto build = [&](std::vector<int> order) {
+    std::vector<const scene::Node*> ordered;
+    for (auto i : order) { ordered.push_back(nodes[i].get()); }
+    scene::buildDrawList(ordered, draw_list, [&](const scene::Mesh& mesh) {
+      return &mesh == mesh1.get() ? scene::GeometryArena::Range{0, 3, 0} : scene::GeometryArena::Range{3, 6, 100};
+    }, [](const scene::Texture&) -> const scene::AtlasPlacement* { return nullptr; });
+  };
+
+  // consecutive draws of the same state share a bucket
+  build({0, 1, 2, 3});
+  EXPECT_EQ(draw_list.buckets_.size(), 4);
+
+  build({1, 3, 0, 2}); // (i.e. sorted by state)
+  EXPECT_EQ(draw_list.draw_data_.size(), 4);
+  EXPECT_EQ(draw_list.transforms_.size(), 4);
+  EXPECT_EQ(draw_list.materials_.size(), 3); // default + mat2 + mat1
+  EXPECT_EQ(draw_list.materials_[1].use_base_color_texture, 0);
+  EXPECT_EQ(draw_list.materials_[2].use_base_color_texture, 1);
+
+  ASSERT_EQ(draw_list.buckets_.size(), 2);
+  EXPECT_EQ(draw_list.buckets_[0].variant, 0);
+  EXPECT_EQ(draw_list.buckets_[0].texture, nullptr);
+  EXPECT_EQ(draw_list.buckets_[0].offset, 0);
+  EXPECT_EQ(draw_list.buckets_[0].count, 2);
+  EXPECT_EQ(draw_list.buckets_[1].variant, scene::shader_variant::kBaseColorTexture);
+  EXPECT_EQ(draw_list.buckets_[1].texture, tex.get());
+  EXPECT_EQ(draw_list.buckets_[1].offset, 2);
+  EXPECT_EQ(draw_list.buckets_[1].count, 2);
+
+  // commands keep given order and point back to per-draw data via base_instance
+  for (auto i : utils::Range{draw_list.commands_.size()}) {
+    EXPECT_EQ(draw_list.commands_[i].base_instance, i);
+    EXPECT_EQ(draw_list.commands_[i].instance_count, 1);
+  }
+  EXPECT_EQ(draw_list.commands_[0].count, 6);
+  EXPECT_EQ(draw_list.commands_[0].first_index, 3);
+  EXPECT_EQ(draw_list.commands_[0].base_vertex, 100);
+  EXPECT_EQ(draw_list.draw_data_[1].material_index, 0);
+}
+
+TEST(SceneTest, DrawKeyBuilder_multiDraw) {
+  // Opaque commands are front to back within each (variant, texture) bucket (cf. SceneRenderer::_sortDraws)
+  using std::shared_ptr, std::make_shared;
+  auto tex1 = make_shared<scene::Texture>(), tex2 = make_shared<scene::Texture>();
+  std::vector<shared_ptr<scene::Material>> mats(3, nullptr);
+  for (auto& mat : mats) { mat = make_shared<scene::Material>(); }
+  mats[0]->base_color_texture_ = tex1;
+  mats[1]->base_color_texture_ = tex1; // (shares bucket with mats[0])
+  mats[2]->base_color_texture_ = tex2;
+  auto mesh1 = make_shared<scene::Mesh>(), mesh2 = make_shared<scene::Mesh>();
+
+  std::mt19937 rng{0};
+  std::vector<shared_ptr<scene::Node>> nodes;
+  std::vector<float> depths;
+  scene::DrawKeyBuilder keys;
+  keys.multi_draw_ = true;
+  render_queue::RenderQueue queue;
+  for (auto i : utils::Range{64}) {
+    auto& node = nodes.emplace_back(new scene::Node);
+    node->mesh_ = (i % 2) ? mesh1 : mesh2;
+    node->material_ = mats[rng() % 3];
+    float depth = float(rng() % 1000) / 10;
+    node->transform_[3] = {0, 0, -depth, 1};
+    auto variant = scene::getShaderVariant(*node->mesh_, node->material_.get());
+    keys.add(variant, node->material_->base_color_texture_.get(), node->material_.get(), node->mesh_.get(), depth);
+  }
+  keys.build(queue);
+  queue.sort();
+  EXPECT_EQ(queue.lowerBound(scene::DrawKeyBuilder::getTransparentBegin()), nodes.size());
+
+  std::vector<const scene::Node*> sorted;
+  for (auto& item : queue.items_) { sorted.push_back(nodes[item.payload].get()); }
+  scene::DrawList draw_list;
+  scene::buildDrawList(sorted, draw_list, [](const scene::Mesh&) {
+    return scene::GeometryArena::Range{0, 3, 0};
+  }, [](const scene::Texture&) -> const scene::AtlasPlacement* { return nullptr; });
+
+  ASSERT_EQ(draw_list.buckets_.size(), 2);
+  for (auto& bucket : draw_list.buckets_) {
+    for (auto i : utils::Range{bucket.offset + 1, bucket.offset + bucket.count}) {
+      auto prev = draw_list.commands_[i - 1].base_instance, curr = draw_list.commands_[i].base_instance;
+      EXPECT_LE(-draw_list.transforms_[prev][3].z, -draw_list.transforms_[curr][3].z);
+    }
+  }
+}
+
+TEST(SceneTest, DrawKeyBuilder_manyIds) {
+  // More materials than 2^14 still sort by material before depth (i.e. ids aren't clamped)
+  size_t num_materials = (1 << 14) + 1000;
+  std::vector<scene::Material> materials(num_materials);
+  scene::Mesh mesh;
+  scene::DrawKeyBuilder keys;
+  render_queue::RenderQueue queue;
+  for (auto i : utils::Range{num_materials}) {
+    keys.add(0, nullptr, &materials[i], &mesh, float(num_materials - i)); // (depth in reverse of material id)
+  }
+  keys.build(queue);
+  EXPECT_EQ(keys.material_bits_, 15);
+  EXPECT_EQ(keys.mesh_bits_, 1);
+  EXPECT_EQ(keys.depth_bits_, scene::DrawKeyBuilder::kMaxDepthBits); // (rest of 64 bits is more than enough)
+  queue.sort();
+  ASSERT_EQ(queue.size(), num_materials);
+  for (auto i : utils::Range{num_materials}) {
+    ASSERT_EQ(queue.items_[i].payload, i);
+  }
+}
+
+TEST(SceneTest, getShaderVariant) {
+  using namespace scene::shader_variant;
+  scene::Mesh mesh;
+  scene::Material mat;
+  EXPECT_EQ(scene::getShaderVariant(mesh, nullptr), 0);
+  EXPECT_EQ(scene::getShaderVariant(mesh, &mat), 0);
+
+  mesh.has_vertex_color_ = true;
+  mat.base_color_texture_ = std::make_shared<scene::Texture>();
+  mat.alpha_mode_ = scene::AlphaMode::kMask;
+  EXPECT_EQ(scene::getShaderVariant(mesh, &mat), kVertexColor | kBaseColorTexture | kAlphaMask);
+
+  mat.use_base_color_texture_ = false;
+  mat.alpha_mode_ = scene::AlphaMode::kBlend;
+  EXPECT_EQ(scene::getShaderVariant(mesh, &mat), kVertexColor | kAlphaBlend);
+
+  mat.double_sided_ = true;
+  EXPECT_EQ(scene::getShaderVariant(mesh, &mat), kVertexColor | kAlphaBlend | kDoubleSided);
+
+  EXPECT_EQ(scene::getShaderDefines(0), (std::vector<std::string>{}));
+  EXPECT_EQ(scene::getShaderDefines(kBaseColorTexture | kAlphaMask),
+            (std::vector<std::string>{"HAS_BASE_COLOR_TEXTURE", "ALPHA_MODE_MASK"}));
+}
+
+TEST(SceneTest, TextureResidencyManager_selectEvictions) {
+  using Candidate = scene::TextureResidencyManager::EvictionCandidate;
+  std::vector<Candidate> candidates = {
+    {5, 100}, // 0: used in current frame
+    {2, 100}, // 1
+    {4, 100}, // 2
+    {1, 100}, // 3
+  };
+  // within budget
+  EXPECT_EQ(scene::TextureResidencyManager::selectEvictions(candidates, 400, 400, 5), (std::vector<size_t>{}));
+  // least recently used first
+  EXPECT_EQ(scene::TextureResidencyManager::selectEvictions(candidates, 400, 250, 5), (std::vector<size_t>{3, 1}));
+  // never evict ones used in current frame even if still over budget
+  EXPECT_EQ(scene::TextureResidencyManager::selectEvictions(candidates, 400, 0, 5), (std::vector<size_t>{3, 1, 2}));
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include "utils.hpp"
+
+//
+// Cascaded shadow maps for a single directional light
+// - camera frustum is split into slices (cf. getSplits) and each slice gets its own orthographic projection
+// - projection covers slice's bounding sphere (independent of camera rotation) and its origin is snapped
+//   to shadow map texels so that moving camera doesn't make shadow edges shimmer
+// - light space: light rotation only (no translation, cf. getLightRotation), light points to -z
+//   so that larger z is closer to light
+// - casters are culled by their light space bounds, and near plane is pulled toward light to
+//   include casters outside of slice
+//
+// cf. Zhang et al., "Parallel-Split Shadow Maps on Programmable GPUs" (GPU Gems 3)
+//     Valient, "Stable Rendering of Cascaded Shadow Maps" (ShaderX6)
+//
+
+namespace toy {
+namespace shadow {
+
+namespace {
+using std::vector;
+using glm::fvec3, glm::fvec4, glm::fmat4;
+}
+
+constexpr int kMaxCascades = 4;
+
+// View depths of split boundaries (`num_cascades + 1` values from `near` to `far`)
+// blending logarithmic (`lambda = 1`) and uniform (`lambda = 0`) schemes
+inline vector<float> getSplits(float near, float far, int num_cascades, float lambda = 0.75) {
+  vector<float> result(num_cascades + 1);
+  for (auto i : utils::Range{num_cascades + 1}) {
+    float t = float(i) / num_cascades;
+    float log_split = near * std::pow(far / near, t);
+    float uniform_split = near + (far - near) * t;
+    result[i] = lambda * log_split + (1 - lambda) * uniform_split;
+  }
+  result[0] = near;
+  result[num_cascades] = far;
+  return result;
+}
+
+// World to light space for light traveling along `direction`
+inline fmat4 getLightRotation(fvec3 direction) {
+  fvec3 z = -glm::normalize(direction);
+  fvec3 up = std::abs(z.y) < 0.99f ? fvec3{0, 1, 0} : fvec3{1, 0, 0};
+  fvec3 x = glm::normalize(glm::cross(up, z));
+  fvec3 y = glm::cross(z, x);
+  return glm::transpose(fmat4{fvec4{x, 0}, fvec4{y, 0}, fvec4{z, 0}, fvec4{0, 0, 0, 1}});
+}
+
+// Smallest sphere containing perspective frustum between view depth `near` and `far`
+// (center is on view axis at depth `center_depth`)
+struct SliceSphere {
+  float center_depth;
+  float radius;
+};
+
+inline SliceSphere getSliceSphere(float yfov, float aspect_ratio, float near, float far) {
+  // squared distance of slice's corner from view axis is `k * depth^2`
+  float t = std::tan(yfov / 2);
+  float k = t * t * (1 + aspect_ratio * aspect_ratio);
+  // equidistant from near and far corners unless far plane alone is wider
+  float c = std::min(0.5f * (near + far) * (1 + k), far);
+  float radius = std::sqrt(std::max((c - near) * (c - near) + k * near * near, (far - c) * (far - c) + k * far * far));
+  return {c, radius};
+}
+
+// Axis aligned bounds of transformed box
+inline std::pair<fvec3, fvec3> transformBounds(const fmat4& xform, const fvec3& lo, const fvec3& hi) {
+  fvec3 result_lo{FLT_MAX}, result_hi{-FLT_MAX};
+  for (auto i : utils::Range{8}) {
+    fvec3 corner = {(i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y, (i & 4) ? hi.z : lo.z};
+    fvec3 p = fvec3{xform * fvec4{corner, 1}};
+    result_lo = glm::min(result_lo, p);
+    result_hi = glm::max(result_hi, p);
+  }
+  return {result_lo, result_hi};
+}
+
+struct Cascade {
+  float near_ = 0, far_ = 0; // view depth range of this slice
+  fvec3 lo_, hi_;            // orthographic box in light space
+  float texel_size_ = 0;     // (in world unit)
+  fmat4 view_projection_;    // world to shadow clip
+
+  // Covers slice of `camera` between view depth `near` and `far`
+  // `xform` is camera's transform (view to world)
+  void fit(const fmat4& light_rotation, const fmat4& xform, float yfov, float aspect_ratio, float near, float far, int resolution) {
+    near_ = near;
+    far_ = far;
+    auto sphere = getSliceSphere(yfov, aspect_ratio, near, far);
+    // (quantize radius so that float noise of camera parameters doesn't change texel size)
+    float radius = std::ceil(sphere.radius * 16) / 16;
+    texel_size_ = 2 * radius / resolution;
+    fvec3 center = fvec3{light_rotation * xform * fvec4{0, 0, -sphere.center_depth, 1}};
+    center.x = std::floor(center.x / texel_size_) * texel_size_;
+    center.y = std::floor(center.y / texel_size_) * texel_size_;
+    lo_ = center - radius;
+    hi_ = center + radius;
+    updateViewProjection(light_rotation);
+  }
+
+  void updateViewProjection(const fmat4& light_rotation) {
+    view_projection_ = glm::orthoRH_NO(lo_.x, hi_.x, lo_.y, hi_.y, -hi_.z, -lo_.z) * light_rotation;
+  }
+
+  // Caster with light space bounds can shadow this slice (i.e. overlaps in xy and not entirely below slice)
+  bool testCaster(const fvec3& lo, const fvec3& hi) const {
+    return lo.x <= hi_.x && lo_.x <= hi.x && lo.y <= hi_.y && lo_.y <= hi.y && lo_.z <= hi.z;
+  }
+
+  // Indices of casters (by light space bounds) shadowing this slice, then near plane is pulled toward light to include them
+  void cullCasters(const vector<std::pair<fvec3, fvec3>>& bounds, const fmat4& light_rotation, vector<uint32_t>& result) {
+    result.clear();
+    float z_max = hi_.z;
+    for (auto i : utils::Range{bounds.size()}) {
+      auto& [lo, hi] = bounds[i];
+      if (testCaster(lo, hi)) {
+        result.push_back(i);
+        z_max = std::max(z_max, hi.z);
+      }
+    }
+    if (z_max > hi_.z) {
+      hi_.z = z_max;
+      updateViewProjection(light_rotation);
+    }
+  }
+};
+
+} // namespace shadow
+} // namespace toy
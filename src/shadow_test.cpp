@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "shadow.hpp"
+
+using namespace toy;
+using glm::fvec3, glm::fvec4, glm::fmat4;
+
+TEST(ShadowTest, getSplits) {
+  auto splits = shadow::getSplits(0.1, 100, 4);
+  ASSERT_EQ(splits.size(), 5);
+  EXPECT_EQ(splits[0], 0.1f);
+  EXPECT_EQ(splits[4], 100.f);
+  for (auto i : utils::Range{4}) {
+    EXPECT_LT(splits[i], splits[i + 1]);
+  }
+  // Logarithmic puts more resolution near camera than uniform
+  EXPECT_LT(splits[1], shadow::getSplits(0.1, 100, 4, 0)[1]);
+}
+
+TEST(ShadowTest, getSliceSphere) {
+  float yfov = 1, aspect = 16.f / 9.f, near = 1, far = 5;
+  auto sphere = shadow::getSliceSphere(yfov, aspect, near, far);
+  float t = std::tan(yfov / 2);
+  for (auto depth : {near, far}) {
+    fvec3 corner = {depth * t * aspect, depth * t, -depth};
+    EXPECT_LE(glm::length(corner - fvec3{0, 0, -sphere.center_depth}), sphere.radius + 1e-4);
+  }
+}
+
+TEST(ShadowTest, Cascade_fit) {
+  auto light_rotation = shadow::getLightRotation(glm::normalize(fvec3{1, -2, -1}));
+  float yfov = 1, aspect = 4.f / 3.f;
+  fmat4 xform{1};
+  xform[3] = fvec4{1, 2, 3, 1};
+
+  shadow::Cascade cascade;
+  cascade.fit(light_rotation, xform, yfov, aspect, 2, 10, 1024);
+
+  // Frustum slice's corners are within shadow clip volume
+  float t = std::tan(yfov / 2);
+  for (auto i : utils::Range{8}) {
+    float depth = (i & 4) ? 10 : 2;
+    fvec3 corner = {((i & 1) ? 1 : -1) * depth * t * aspect, ((i & 2) ? 1 : -1) * depth * t, -depth};
+    fvec4 p = cascade.view_projection_ * xform * fvec4{corner, 1};
+    EXPECT_LE(glm::abs(p.x), 1);
+    EXPECT_LE(glm::abs(p.y), 1);
+    EXPECT_LE(glm::abs(p.z), 1);
+  }
+
+  // Small camera move shifts projection by whole texels and keeps its size
+  shadow::Cascade moved;
+  xform[3] += fvec4{0.123, 0.0456, 0.789, 0};
+  moved.fit(light_rotation, xform, yfov, aspect, 2, 10, 1024);
+  EXPECT_EQ(moved.texel_size_, cascade.texel_size_);
+  fvec3 shift = (moved.lo_ - cascade.lo_) / cascade.texel_size_;
+  EXPECT_NEAR(shift.x, std::round(shift.x), 1e-2);
+  EXPECT_NEAR(shift.y, std::round(shift.y), 1e-2);
+}
+
+TEST(ShadowTest, Cascade_cullCasters) {
+  auto light_rotation = shadow::getLightRotation({0, -1, 0}); // straight down (light space z = world y)
+  shadow::Cascade cascade;
+  cascade.fit(light_rotation, fmat4{1}, 1, 1, 1, 4, 512);
+  float hi_z = cascade.hi_.z;
+
+  auto bounds = [&](fvec3 lo, fvec3 hi) { return shadow::transformBounds(light_rotation, lo, hi); };
+  std::vector<std::pair<fvec3, fvec3>> casters = {
+    bounds({-0.5, 0, -3}, {0.5, 1, -2}),      // inside
+    bounds({-0.5, 50, -3}, {0.5, 51, -2}),    // far above (i.e. toward light)
+    bounds({100, 0, -3}, {101, 1, -2}),       // aside
+    bounds({-0.5, -100, -3}, {0.5, -99, -2}), // below
+  };
+  std::vector<uint32_t> result;
+  cascade.cullCasters(casters, light_rotation, result);
+  EXPECT_EQ(result, (std::vector<uint32_t>{0, 1}));
+  EXPECT_GE(cascade.hi_.z, 51);
+  EXPECT_GT(cascade.hi_.z, hi_z);
+
+  // Caster above is still within clip volume
+  fvec4 p = cascade.view_projection_ * fvec4{0, 51, -2.5, 1};
+  EXPECT_LE(glm::abs(p.z), 1 + 1e-5);
+}
@@ -8,6 +8,20 @@
 #include <map>
 #include <sstream>
 #include <numeric> // iota
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include <filesystem>
+#include <cstdlib> // getenv
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cfloat> // FLT_MAX
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TOY_SSE2
+#endif
 
 #include <fmt/format.h>
 #include <imgui.h>
@@ -19,6 +33,22 @@
 #include <GL/gl3w.h>
 #include <cgltf.h>
 
+// Core in GL 4.6 (same values as EXT_texture_filter_anisotropic)
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+// EXT_texture_compression_s3tc + EXT_texture_sRGB (not in gl3w's core profile header)
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
 
 //
 // Delete move/copy constructure/assignment
@@ -175,6 +205,325 @@ struct Enumerate {
   Iterator end() { return Iterator{end_, data}; };
 };
 
+// Calls func(i) for i in [start, end) from a few worker threads (each pulls the next index from shared counter)
+// - work items should be coarse (e.g. image row, texture, mesh) since this spawns threads on every call
+//   (pass `getNumThreads(work)` when total work might be small e.g. small images, coarse mip levels)
+template<typename Func>
+inline void parallelFor(size_t start, size_t end, Func&& func, size_t num_threads = 0) {
+  if (start >= end) { return; }
+  if (num_threads == 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  num_threads = std::min(num_threads, end - start);
+  if (num_threads == 1) {
+    for (auto i = start; i < end; i++) { func(i); }
+    return;
+  }
+  std::atomic<size_t> next = start;
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < end;) { func(i); }
+  };
+  vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; t++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) { thread.join(); }
+}
+
+// Threads for `parallelFor` over total `work` (e.g. texels) i.e. 1 (serial) when thread spawn would cost more
+constexpr size_t kParallelMinWork = 1 << 16;
+
+inline size_t getNumThreads(size_t work, size_t num_threads = 0) {
+  return work < kParallelMinWork ? 1 : num_threads;
+}
+
+// FNV-1a (64bit), used for cache keys (pass previous result as `hash` to combine)
+inline uint64_t hashFnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+  auto bytes = reinterpret_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+inline uint64_t hashFnv1a(const string& s, uint64_t hash = 0xcbf29ce484222325ull) {
+  return hashFnv1a(s.data(), s.size(), hash);
+}
+
+// Directory for derived data which can be regenerated anytime (e.g. compressed textures)
+// - $XDG_CACHE_HOME/toy-3d/<name> or ~/.cache/toy-3d/<name> (created on demand)
+inline std::filesystem::path getCacheDirectory(const string& name) {
+  std::filesystem::path root;
+  if (auto xdg = std::getenv("XDG_CACHE_HOME")) {
+    root = xdg;
+  } else if (auto home = std::getenv("HOME")) {
+    root = std::filesystem::path{home} / ".cache";
+  } else {
+    root = std::filesystem::temp_directory_path();
+  }
+  auto result = root / "toy-3d" / name;
+  std::error_code error;
+  std::filesystem::create_directories(result, error);
+  return result;
+}
+
+// Unsigned integer whose order is same as float's (i.e. flip all bits of negative, only sign bit of positive)
+inline uint32_t floatToSortable(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// LSD radix sort by unsigned keys (8 bits per pass), which is stable
+// - histograms of all digits are counted in a single sweep, then passes where all keys share a digit are skipped
+// - with `num_chunks > 1`, items are split into chunks whose histogram and scatter run on threads
+//   (chunk's items go before next chunk's ones of the same digit, so it's still stable)
+// - buffers are kept between calls so that sorting every frame doesn't allocate
+template<typename Key>
+struct RadixSorter {
+  static_assert(std::is_unsigned_v<Key>);
+  constexpr static int kNumDigits = sizeof(Key);
+  using Counts = array<uint32_t, 256>;
+  vector<array<Counts, kNumDigits>> counts_; // per chunk
+  vector<uint32_t> order_, tmp_;             // (for `sort`)
+
+  // Sorts `data` by `getKey(item)` using `tmp` of the same size
+  // @return either `data` or `tmp` which has the result
+  template<typename T, typename GetKey>
+  T* sortItems(T* data, T* tmp, size_t size, GetKey&& getKey, size_t num_chunks = 1) {
+    if (size <= 1) { return data; }
+    size_t chunk_size = (size + num_chunks - 1) / std::max<size_t>(num_chunks, 1);
+    num_chunks = (size + chunk_size - 1) / chunk_size;
+    auto forEachChunk = [&](auto&& func) {
+      parallelFor(0, num_chunks, [&](size_t c) {
+        func(counts_[c], c * chunk_size, std::min(size, (c + 1) * chunk_size));
+      }, num_chunks);
+    };
+
+    counts_.resize(num_chunks);
+    forEachChunk([&](auto& counts, size_t begin, size_t end) {
+      for (auto& count : counts) { count.fill(0); }
+      for (auto i = begin; i < end; i++) {
+        Key key = getKey(data[i]);
+        for (int d = 0; d < kNumDigits; d++) { counts[d][(key >> (8 * d)) & 0xff]++; }
+      }
+    });
+
+    Key first_key = getKey(data[0]);
+    bool counted = true; // (chunks' counts match with current order until the first scatter)
+    for (int d = 0; d < kNumDigits; d++) {
+      uint32_t total = 0;
+      for (auto& counts : counts_) { total += counts[d][(first_key >> (8 * d)) & 0xff]; }
+      if (total == size) { continue; }
+
+      if (!counted && num_chunks > 1) {
+        forEachChunk([&](auto& counts, size_t begin, size_t end) {
+          counts[d].fill(0);
+          for (auto i = begin; i < end; i++) { counts[d][(getKey(data[i]) >> (8 * d)) & 0xff]++; }
+        });
+      }
+      counted = false;
+
+      // counts to offsets (digit major, chunk minor)
+      uint32_t offset = 0;
+      for (int v = 0; v < 256; v++) {
+        for (auto& counts : counts_) {
+          auto next = offset + counts[d][v];
+          counts[d][v] = offset;
+          offset = next;
+        }
+      }
+      forEachChunk([&](auto& counts, size_t begin, size_t end) {
+        for (auto i = begin; i < end; i++) {
+          tmp[counts[d][(getKey(data[i]) >> (8 * d)) & 0xff]++] = data[i];
+        }
+      });
+      std::swap(data, tmp);
+    }
+    return data;
+  }
+
+  // @return indices into `keys` in ascending order
+  const vector<uint32_t>& sort(const Key* keys, size_t size, size_t num_chunks = 1) {
+    order_.resize(size);
+    tmp_.resize(size);
+    std::iota(order_.begin(), order_.end(), 0);
+    auto result = sortItems(order_.data(), tmp_.data(), size, [&](uint32_t i) { return keys[i]; }, num_chunks);
+    if (result != order_.data()) { order_.swap(tmp_); }
+    return order_;
+  }
+
+  const vector<uint32_t>& sort(const vector<Key>& keys, size_t num_chunks = 1) {
+    return sort(keys.data(), keys.size(), num_chunks);
+  }
+};
+
+// First fit sub-allocator of [0, capacity) whose released ranges are merged with free neighbors
+// (e.g. for sharing a single GL buffer among meshes cf. gl::GeometryArena)
+struct RangeAllocator {
+  std::map<size_t, size_t> free_; // offset -> size
+  size_t capacity_ = 0;
+  size_t used_ = 0;
+
+  // @return offset (nullopt when no free range is large enough i.e. needs `grow`)
+  std::optional<size_t> allocate(size_t size) {
+    if (size == 0) { return 0; }
+    for (auto it = free_.begin(); it != free_.end(); it++) {
+      auto [offset, free_size] = *it;
+      if (free_size < size) { continue; }
+      free_.erase(it);
+      if (free_size > size) { free_[offset + size] = free_size - size; }
+      used_ += size;
+      return offset;
+    }
+    return {};
+  }
+
+  void release(size_t offset, size_t size) {
+    if (size == 0) { return; }
+    TOY_ASSERT(offset + size <= capacity_ && size <= used_);
+    used_ -= size;
+    auto next = free_.lower_bound(offset);
+    TOY_ASSERT(next == free_.end() || offset + size <= next->first);
+    if (next != free_.end() && offset + size == next->first) {
+      size += next->second;
+      next = free_.erase(next);
+    }
+    if (next != free_.begin()) {
+      auto prev = std::prev(next);
+      TOY_ASSERT(prev->first + prev->second <= offset);
+      if (prev->first + prev->second == offset) {
+        prev->second += size;
+        return;
+      }
+    }
+    free_[offset] = size;
+  }
+
+  // Appends [capacity, new_capacity) as free
+  void grow(size_t new_capacity) {
+    TOY_ASSERT(new_capacity >= capacity_);
+    auto old_capacity = capacity_;
+    capacity_ = new_capacity;
+    used_ += new_capacity - old_capacity; // (as if allocated then released)
+    release(old_capacity, new_capacity - old_capacity);
+  }
+
+  // Offset where everything after is free (i.e. how much of storage has to be kept when reallocating)
+  size_t getEnd() const {
+    if (!free_.empty()) {
+      auto last = std::prev(free_.end());
+      if (last->first + last->second == capacity_) { return last->first; }
+    }
+    return capacity_;
+  }
+};
+
+// Vector with fixed inline capacity (never allocates, so exceeding capacity is an error)
+template<typename T, size_t N>
+struct SmallVector {
+  std::array<T, N> data_;
+  size_t size_ = 0;
+
+  SmallVector() = default;
+  SmallVector(std::initializer_list<T> values) {
+    for (auto& value : values) { push_back(value); }
+  }
+
+  constexpr static size_t capacity() { return N; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  T* data() { return data_.data(); }
+  const T* data() const { return data_.data(); }
+  T& operator[](size_t i) { return data_[i]; }
+  const T& operator[](size_t i) const { return data_[i]; }
+  T& back() { return data_[size_ - 1]; }
+  T* begin() { return data(); }
+  T* end() { return data() + size_; }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size_; }
+  auto rbegin() { return std::reverse_iterator<T*>{end()}; }
+  auto rend() { return std::reverse_iterator<T*>{begin()}; }
+
+  void clear() { size_ = 0; }
+
+  void resize(size_t size) {
+    TOY_ASSERT(size <= N);
+    size_ = size;
+  }
+
+  void push_back(const T& value) {
+    TOY_ASSERT(size_ < N);
+    data_[size_++] = value;
+  }
+};
+
+// Single producer / single consumer triple buffer (lock-free)
+// - producer fills `back()` then `publish()`, consumer `acquire()` then reads `front()`
+// - consumer always gets the latest published slot (older ones are dropped when consumer is slower)
+template<typename T>
+struct TripleBuffer {
+  constexpr static uint8_t kFresh = 0b100;
+  constexpr static uint8_t kIndex = 0b011;
+  std::array<T, 3> slots_;
+  std::atomic<uint8_t> middle_ = 1; // index of slot in between (with kFresh flag if not acquired yet)
+  uint8_t back_ = 0;  // (only touched by producer)
+  uint8_t front_ = 2; // (only touched by consumer)
+
+  T& back() { return slots_[back_]; }
+  T& front() { return slots_[front_]; }
+
+  // Returns true if previously published one is dropped without being acquired
+  bool publish() {
+    auto prev = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+    back_ = prev & kIndex;
+    return prev & kFresh;
+  }
+
+  // Returns false (and `front()` stays as is) if nothing is published since last acquire
+  bool acquire() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh)) { return false; }
+    auto prev = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = prev & kIndex;
+    return true;
+  }
+};
+
+// Frame interval history of a loop (e.g. UI thread and render thread)
+struct FrameStats {
+  using Clock = std::chrono::steady_clock;
+  constexpr static size_t kHistory = 120;
+  std::array<float, kHistory> history_ = {}; // milliseconds (ring buffer)
+  size_t count_ = 0;
+  std::optional<Clock::time_point> last_;
+
+  void tick() {
+    auto now = Clock::now();
+    if (last_) {
+      add(std::chrono::duration<float, std::milli>(now - *last_).count());
+    }
+    last_ = now;
+  }
+
+  void add(float ms) { history_[count_++ % kHistory] = ms; }
+
+  size_t size() const { return std::min(count_, kHistory); }
+
+  // Oldest entry within `history_` (e.g. for ImGui::PlotLines's `values_offset`)
+  size_t getOffset() const { return (count_ < kHistory) ? 0 : count_ % kHistory; }
+
+  float getAverage() const {
+    if (size() == 0) { return 0; }
+    return std::accumulate(history_.begin(), history_.begin() + size(), 0.f) / size();
+  }
+
+  float getMax() const {
+    if (size() == 0) { return 0; }
+    return *std::max_element(history_.begin(), history_.begin() + size());
+  }
+};
+
 template<glm::length_t N>
 inline bool isSmall(glm::vec<N, float> v) {
   return glm::length(v) < glm::epsilon<float>();
@@ -293,16 +642,37 @@ inline RayTriangleResult Ray_Triangle(
   return result;
 }
 
-inline vector<fvec4> clip4D_ConvexPoly_HalfSpace(
-    const vector<fvec4>& vs, // dim(span{vi - v0 | i}) = 2 (thus vs.size() >= 3)
+// Slab test against axis aligned box [lo, hi]
+// @return smallest t >= 0 where ray is within box (i.e. 0 when src is inside) or nothing if missed
+inline std::optional<float> Ray_AABB(const fvec3& src, const fvec3& dir, const fvec3& lo, const fvec3& hi) {
+  float t0 = 0, t1 = FLT_MAX;
+  for (auto i : Range{3}) {
+    if (dir[i] == 0) {
+      if (src[i] < lo[i] || hi[i] < src[i]) { return {}; }
+      continue;
+    }
+    float inv = 1 / dir[i];
+    float a = (lo[i] - src[i]) * inv, b = (hi[i] - src[i]) * inv;
+    t0 = std::max(t0, std::min(a, b));
+    t1 = std::min(t1, std::max(a, b));
+    if (t1 < t0) { return {}; }
+  }
+  return t0;
+}
+
+// Writes clipped polygon into `out` which has room for `size + 1` vertices (`out` can't alias `vs`)
+// @return number of vertices written (0 if all outside)
+inline size_t clip4D_ConvexPoly_HalfSpace(
+    const fvec4* vs,         // dim(span{vi - v0 | i}) = 2 (thus size >= 3)
+    size_t size,
     const fvec4& q,          // half space as { u | dot(u - q, v) >= 0 }
-    const fvec4& n
+    const fvec4& n,
+    fvec4* out
 ) {
   using glm::dot;
   auto mod = [](int i, int m) { return (i + m) % m; };
 
-  int N = vs.size();
-  float dots[vs.size()]; // dots[i] > 0  <=>  vs[i] \in (interior of) HalfSpace
+  int N = size;
   int start = -1, end = -1;
   //
   // Compute start >= 0, end >=0 s.t.
@@ -318,23 +688,24 @@ inline vector<fvec4> clip4D_ConvexPoly_HalfSpace(
   //
   // (Then, later, find intersection u1, u2 and returns new polygon vs[i+1], ... vs[j], u1, u2)
   //
+  // NOTE: "inside" is `dot(vs[i] - q, n) > 0` (dot products are recomputed later instead of kept in buffer)
+  //
   {
-    dots[0] = dot(vs[0] - q, n);
-    bool in_first = dots[0] > 0;
+    bool in_first = dot(vs[0] - q, n) > 0;
     bool in_tmp   = in_first;
     int in_out_idx = -1; // by convexty, e.g. "in -> out -> in -> out" is impossible
     int out_in_idx = -1;
     for (auto i : Range{1, N}) {
-      dots[i] = dot(vs[i] - q, n);
-      if ( in_tmp && !(dots[i] > 0)) { in_out_idx = i; in_tmp = false; }
-      if (!in_tmp &&   dots[i] > 0 ) { out_in_idx = i; in_tmp = true;  }
+      bool in = dot(vs[i] - q, n) > 0;
+      if ( in_tmp && !in) { in_out_idx = i; in_tmp = false; }
+      if (!in_tmp &&  in) { out_in_idx = i; in_tmp = true;  }
     }
     if (in_first) {
-      if (in_out_idx == -1) { return vs; } // all inside
+      if (in_out_idx == -1) { std::copy(vs, vs + N, out); return N; } // all inside
       start = out_in_idx == -1 ? 0 : out_in_idx;
       end = in_out_idx;
     } else {
-      if (out_in_idx == -1) { return {}; } // all outside
+      if (out_in_idx == -1) { return 0; } // all outside
       start = out_in_idx;
       end = in_out_idx == -1 ? 0 : in_out_idx;
     }
@@ -346,12 +717,12 @@ inline vector<fvec4> clip4D_ConvexPoly_HalfSpace(
   //              |
   //      (w2)<---u2-----p2
   //
-  fvec4 p1 = vs[mod(start - 1, N)];   // outside
-  float d1 = dots[mod(start - 1, N)]; // <p1 - q, n> <= 0
+  fvec4 p1 = vs[mod(start - 1, N)]; // outside
+  float d1 = dot(p1 - q, n);        // <p1 - q, n> <= 0
   fvec4 w1 = vs[start] - p1;
 
-  fvec4 p2 = vs[mod(end - 1, N)];     // inside
-  float d2 = dots[mod(end - 1, N)];   // <p2 - q, n> >  0
+  fvec4 p2 = vs[mod(end - 1, N)];   // inside
+  float d2 = dot(p2 - q, n);        // <p2 - q, n> >  0
   fvec4 w2 = vs[end] - p2;
 
   // <(p + t w) - q, n> = 0  <=> t <w, n> = - <p - q, n>
@@ -362,34 +733,179 @@ inline vector<fvec4> clip4D_ConvexPoly_HalfSpace(
   fvec4 u1 = p1 + t1 * w1; // NOTE: at the same time, you could interpolate vertex attribute if any.
   fvec4 u2 = p2 + t2 * w2; //
 
-  vector<fvec4> result = { u2, u1 };
-  result.reserve(mod(end - start, N) + 2);
-
-  if (start < end) {
-    result.insert(result.end(), vs.begin() + start, vs.begin() + end);
-  } else {
-    result.insert(result.end(), vs.begin() + start, vs.end());
-    result.insert(result.end(), vs.begin(), vs.begin() + end);
+  size_t result = 0;
+  out[result++] = u2;
+  out[result++] = u1;
+  for (int i = start; i != end; i = (i + 1) % N) {
+    out[result++] = vs[i];
   }
   return result;
 };
 
+inline vector<fvec4> clip4D_ConvexPoly_HalfSpace(
+    const vector<fvec4>& vs, const fvec4& q, const fvec4& n) {
+  vector<fvec4> result(vs.size() + 1);
+  result.resize(clip4D_ConvexPoly_HalfSpace(vs.data(), vs.size(), q, n, result.data()));
+  return result;
+};
+
+//
+// "ClipVolume" as intersection of 7 half spaces { u | dot(u, n) > 0 }
+// (each bit of "outcode" is set when vertex is not inside of corresponding half space)
+//
+inline const std::array<fvec4, 7> kClipVolumeNormals = {{
+  { 0, 0, 0, 1}, { 1, 0, 0, 1}, {-1, 0, 0, 1}, { 0, 1, 0, 1}, { 0,-1, 0, 1}, { 0, 0, 1, 1}, { 0, 0,-1, 1}
+}};
+
+inline uint8_t clip4D_Outcode(float x, float y, float z, float w) {
+  return
+      (uint8_t(!(w     > 0)) << 0) |
+      (uint8_t(!(w + x > 0)) << 1) |
+      (uint8_t(!(w - x > 0)) << 2) |
+      (uint8_t(!(w + y > 0)) << 3) |
+      (uint8_t(!(w - y > 0)) << 4) |
+      (uint8_t(!(w + z > 0)) << 5) |
+      (uint8_t(!(w - z > 0)) << 6);
+}
+
+inline uint8_t clip4D_Outcode(const fvec4& p) { return clip4D_Outcode(p.x, p.y, p.z, p.w); }
+
+// Clips only against half spaces in `code_or` (i.e. vertices inside of the others stay inside since polygon is convex)
+// by ping-pong between two buffers with room for `size + 7` vertices each (result always ends up in `buffer0`)
+// @return number of vertices (0 if clipped out)
+inline size_t _clip4D_ConvexPoly_ClipVolume(
+    const fvec4* poly, size_t size, uint8_t code_or, fvec4* buffer0, fvec4* buffer1) {
+  int num_passes = 0;
+  for (auto i : Range{7}) { num_passes += (code_or >> i) & 1; }
+  if (num_passes == 0) {
+    std::copy(poly, poly + size, buffer0);
+    return size;
+  }
+  // Start from the buffer s.t. last pass writes into `buffer0`
+  fvec4* dst = (num_passes % 2) ? buffer0 : buffer1;
+  fvec4* other = (num_passes % 2) ? buffer1 : buffer0;
+  const fvec4* src = poly;
+  fvec4 q = {0, 0, 0, 0};
+  for (auto i : Range{7}) {
+    if (!((code_or >> i) & 1)) { continue; }
+    size = clip4D_ConvexPoly_HalfSpace(src, size, q, kClipVolumeNormals[i], dst);
+    if (size < 3) { return 0; }
+    src = dst;
+    std::swap(dst, other);
+  }
+  return size;
+}
+
+inline size_t clip4D_ConvexPoly_ClipVolume(
+    const fvec4* poly, size_t size, fvec4* buffer0, fvec4* buffer1) {
+  TOY_ASSERT(size >= 3); // and also assert dim(poly) = 2
+  uint8_t code_or = 0, code_and = 0x7f;
+  for (auto i : Range{size}) {
+    auto code = clip4D_Outcode(poly[i]);
+    code_or |= code;
+    code_and &= code;
+  }
+  if (code_and) { return 0; } // all outside of some half space
+  return _clip4D_ConvexPoly_ClipVolume(poly, size, code_or, buffer0, buffer1);
+}
+
+// Polygon on stack for allocation-free clipping (7 more than input polygon's size is needed)
+constexpr size_t kClipPolyCapacity = 64;
+using ClipPoly = SmallVector<fvec4, kClipPolyCapacity>;
+
+inline void clip4D_ConvexPoly_ClipVolume(const fvec4* poly, size_t size, ClipPoly& result) {
+  TOY_ASSERT(size + 7 <= kClipPolyCapacity);
+  ClipPoly buffer;
+  result.resize(clip4D_ConvexPoly_ClipVolume(poly, size, result.data(), buffer.data()));
+}
+
 inline vector<fvec4> clip4D_ConvexPoly_ClipVolume(const vector<fvec4>& poly) {
-  vector<fvec4> result = poly;
-  TOY_ASSERT(result.size() >= 3); // and also assert dim(poly) = 2
+  TOY_ASSERT(poly.size() >= 3);
+  if (poly.size() + 7 <= kClipPolyCapacity) {
+    ClipPoly result;
+    clip4D_ConvexPoly_ClipVolume(poly.data(), poly.size(), result);
+    return {result.begin(), result.end()};
+  }
+  vector<fvec4> buffer0(poly.size() + 7), buffer1(poly.size() + 7);
+  buffer0.resize(clip4D_ConvexPoly_ClipVolume(poly.data(), poly.size(), buffer0.data(), buffer1.data()));
+  return buffer0;
+};
 
-  // "ClipVolume" as intersection of 7 half spaces
-  fvec4 q  = {0, 0, 0, 0};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, { 0, 0, 0, 1}); if (result.size() < 3) return {};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, { 1, 0, 0, 1}); if (result.size() < 3) return {};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, {-1, 0, 0, 1}); if (result.size() < 3) return {};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, { 0, 1, 0, 1}); if (result.size() < 3) return {};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, { 0,-1, 0, 1}); if (result.size() < 3) return {};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, { 0, 0, 1, 1}); if (result.size() < 3) return {};
-  result = clip4D_ConvexPoly_HalfSpace(result, q, { 0, 0,-1, 1});
-  return result;
+// Convex polygons in SoA layout (e.g. for clipping many of them at once)
+struct ClipPolyBatch {
+  vector<float> x_, y_, z_, w_;
+  vector<uint32_t> offsets_ = {0}; // i-th polygon is vertices [offsets_[i], offsets_[i + 1])
+  vector<uint8_t> codes_;          // (scratch for input's outcodes when this is clipping output)
+
+  size_t size() const { return offsets_.size() - 1; }
+  size_t getNumVertices(size_t i) const { return offsets_[i + 1] - offsets_[i]; }
+  fvec4 getVertex(size_t v) const { return {x_[v], y_[v], z_[v], w_[v]}; }
+
+  // Keeps capacity so that refilling doesn't allocate
+  void clear() {
+    x_.clear(); y_.clear(); z_.clear(); w_.clear();
+    offsets_.resize(1);
+  }
+
+  void push(const fvec4* poly, size_t size) {
+    for (auto i : Range{size}) {
+      x_.push_back(poly[i].x);
+      y_.push_back(poly[i].y);
+      z_.push_back(poly[i].z);
+      w_.push_back(poly[i].w);
+    }
+    offsets_.push_back(x_.size());
+  }
 };
 
+// Batched version where outcodes are computed in a single SoA pass (which compiler can vectorize),
+// then only polygons straddling clip volume are gathered into stack buffers and clipped.
+// Clipped-out polygons are kept as empty ones so that `output`'s indices match with `input`.
+inline void clip4D_ConvexPoly_ClipVolume(const ClipPolyBatch& input, ClipPolyBatch& output) {
+  TOY_ASSERT(&input != &output);
+  output.clear();
+  size_t num_vertices = input.x_.size();
+  auto& codes = output.codes_;
+  codes.resize(num_vertices);
+  {
+    const float *x = input.x_.data(), *y = input.y_.data(), *z = input.z_.data(), *w = input.w_.data();
+    uint8_t* c = codes.data();
+    for (size_t v = 0; v < num_vertices; v++) {
+      c[v] = clip4D_Outcode(x[v], y[v], z[v], w[v]);
+    }
+  }
+  ClipPoly poly, buffer0, buffer1;
+  for (auto i : Range{input.size()}) {
+    uint32_t begin = input.offsets_[i], end = input.offsets_[i + 1];
+    uint8_t code_or = 0, code_and = 0x7f;
+    for (auto v : Range{begin, end}) {
+      code_or |= codes[v];
+      code_and &= codes[v];
+    }
+    if (code_and) {
+      // All outside
+      output.offsets_.push_back(output.x_.size());
+      continue;
+    }
+    if (!code_or) {
+      // All inside
+      for (auto v : Range{begin, end}) {
+        output.x_.push_back(input.x_[v]);
+        output.y_.push_back(input.y_[v]);
+        output.z_.push_back(input.z_[v]);
+        output.w_.push_back(input.w_[v]);
+      }
+      output.offsets_.push_back(output.x_.size());
+      continue;
+    }
+    TOY_ASSERT(end - begin >= 3 && end - begin + 7 <= kClipPolyCapacity);
+    poly.clear();
+    for (auto v : Range{begin, end}) { poly.push_back(input.getVertex(v)); }
+    auto size = _clip4D_ConvexPoly_ClipVolume(poly.data(), poly.size(), code_or, buffer0.data(), buffer1.data());
+    output.push(buffer0.data(), size);
+  }
+}
+
 inline std::optional<std::array<fvec4, 2>> clip4D_Line_HalfSpace(
     const std::array<fvec4, 2>& ps, // line segment
     const fvec4& q,                 // half space as { u | dot(u - q, v) >= 0 }
@@ -431,6 +947,177 @@ inline std::optional<std::array<fvec4, 2>> clip4D_Line_ClipVolume(const std::arr
   return result;
 };
 
+//
+// Batched line clipping (e.g. paths and grids with thousands of segments per frame)
+// 1. transform points once into clip coordinate in SoA (adjacent segments of path share them)
+// 2. outcodes of 4 points at once (SSE2)
+// 3. trivially reject/accept segments by outcodes (Cohen–Sutherland)
+// 4. Liang–Barsky (i.e. clip parameter range [t0, t1] against all 7 half spaces) for the rest, 4 segments at once
+// Resulting `lines_` are in order of segments (and same as `clip4D_Line_ClipVolume` up to rounding)
+//
+struct LineClipper {
+  vector<float> x_, y_, z_, w_;      // points in clip coordinate
+  vector<uint8_t> codes_;            // outcode per point
+  vector<uint32_t> straddling_;      // segments needing actual clipping
+  vector<float> t0_, t1_;            // clipped parameter range per segment (empty if t0 >= t1)
+  vector<std::array<fvec4, 2>> lines_;
+
+  // Segments (ps[i], ps[i + 1]) (and (ps[size - 1], ps[0]) if `closed`)
+  void clipPath(const fmat4& xform, const fvec3* ps, size_t size, bool closed) {
+    lines_.clear();
+    if (size < 2) { return; }
+    _clip(xform, ps, size, closed ? size : size - 1, 1);
+  }
+
+  // Segments (ps[2 i], ps[2 i + 1])
+  void clipLines(const fmat4& xform, const fvec3* ps, size_t size) {
+    TOY_ASSERT(size % 2 == 0);
+    lines_.clear();
+    if (size < 2) { return; }
+    _clip(xform, ps, size, size / 2, 2);
+  }
+
+  // Segment i is (points[stride i], points[(stride i + 1) % size])
+  void _clip(const fmat4& m, const fvec3* ps, size_t size, size_t num_segments, size_t stride) {
+    // 1.
+    x_.resize(size); y_.resize(size); z_.resize(size); w_.resize(size);
+    for (auto i : Range{size}) {
+      auto& p = ps[i];
+      x_[i] = m[0][0] * p.x + m[1][0] * p.y + m[2][0] * p.z + m[3][0];
+      y_[i] = m[0][1] * p.x + m[1][1] * p.y + m[2][1] * p.z + m[3][1];
+      z_[i] = m[0][2] * p.x + m[1][2] * p.y + m[2][2] * p.z + m[3][2];
+      w_[i] = m[0][3] * p.x + m[1][3] * p.y + m[2][3] * p.z + m[3][3];
+    }
+
+    // 2.
+    codes_.resize(size);
+    _computeOutcodes();
+
+    // 3.
+    t0_.resize(num_segments);
+    t1_.resize(num_segments);
+    straddling_.clear();
+    for (auto i : Range{num_segments}) {
+      auto a = stride * i, b = (a + 1) % size;
+      uint8_t c0 = codes_[a], c1 = codes_[b];
+      t0_[i] = (c0 & c1) ? 1 : 0;
+      t1_[i] = (c0 & c1) ? 0 : 1;
+      if (!(c0 & c1) && (c0 | c1)) { straddling_.push_back(i); }
+    }
+
+    // 4.
+    _clipStraddling(size, stride);
+
+    for (auto i : Range{num_segments}) {
+      float t0 = t0_[i], t1 = t1_[i];
+      if (!(t0 < t1)) { continue; }
+      auto a = stride * i, b = (a + 1) % size;
+      fvec4 p0 = {x_[a], y_[a], z_[a], w_[a]};
+      fvec4 p1 = {x_[b], y_[b], z_[b], w_[b]};
+      fvec4 v = p1 - p0;
+      lines_.push_back({
+          t0 == 0 ? p0 : p0 + t0 * v,
+          t1 == 1 ? p1 : p0 + t1 * v});
+    }
+  }
+
+  void _computeOutcodes() {
+    size_t size = codes_.size();
+    size_t i = 0;
+#ifdef TOY_SSE2
+    __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= size; i += 4) {
+      __m128 x = _mm_loadu_ps(&x_[i]), y = _mm_loadu_ps(&y_[i]), z = _mm_loadu_ps(&z_[i]), w = _mm_loadu_ps(&w_[i]);
+      // Bit k of masks[j] is "!(dot(point k, normal j) > 0)" (cf. kClipVolumeNormals)
+      int masks[7] = {
+        _mm_movemask_ps(_mm_cmpngt_ps(w, zero)),
+        _mm_movemask_ps(_mm_cmpngt_ps(_mm_add_ps(w, x), zero)),
+        _mm_movemask_ps(_mm_cmpngt_ps(_mm_sub_ps(w, x), zero)),
+        _mm_movemask_ps(_mm_cmpngt_ps(_mm_add_ps(w, y), zero)),
+        _mm_movemask_ps(_mm_cmpngt_ps(_mm_sub_ps(w, y), zero)),
+        _mm_movemask_ps(_mm_cmpngt_ps(_mm_add_ps(w, z), zero)),
+        _mm_movemask_ps(_mm_cmpngt_ps(_mm_sub_ps(w, z), zero)),
+      };
+      for (auto k : Range{4}) {
+        uint8_t code = 0;
+        for (auto j : Range{7}) { code |= ((masks[j] >> k) & 1) << j; }
+        codes_[i + k] = code;
+      }
+    }
+#endif
+    for (; i < size; i++) {
+      codes_[i] = clip4D_Outcode(x_[i], y_[i], z_[i], w_[i]);
+    }
+  }
+
+  // NOTE: both endpoints can't be outside of the same half space since their outcodes don't share bits
+  void _clipStraddling(size_t size, size_t stride) {
+    size_t n = straddling_.size();
+    size_t k = 0;
+#ifdef TOY_SSE2
+    auto select = [](__m128 mask, __m128 a, __m128 b) {
+      return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    };
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    for (; k + 4 <= n; k += 4) {
+      uint32_t a[4], b[4];
+      for (auto l : Range{4}) {
+        a[l] = stride * straddling_[k + l];
+        b[l] = (a[l] + 1) % size;
+      }
+      auto gather = [](const vector<float>& v, const uint32_t* idx) {
+        return _mm_setr_ps(v[idx[0]], v[idx[1]], v[idx[2]], v[idx[3]]);
+      };
+      __m128 x0 = gather(x_, a), y0 = gather(y_, a), z0 = gather(z_, a), w0 = gather(w_, a);
+      __m128 x1 = gather(x_, b), y1 = gather(y_, b), z1 = gather(z_, b), w1 = gather(w_, b);
+      __m128 t0 = zero, t1 = one;
+      auto clip = [&](__m128 d0, __m128 d1) {
+        __m128 in0 = _mm_cmpgt_ps(d0, zero);
+        __m128 in1 = _mm_cmpgt_ps(d1, zero);
+        __m128 t = _mm_div_ps(d0, _mm_sub_ps(d0, d1)); // (only used when either one is inside)
+        t0 = select(_mm_andnot_ps(in0, in1), _mm_max_ps(t0, t), t0); // entering
+        t1 = select(_mm_andnot_ps(in1, in0), _mm_min_ps(t1, t), t1); // leaving
+      };
+      clip(w0, w1);
+      clip(_mm_add_ps(w0, x0), _mm_add_ps(w1, x1));
+      clip(_mm_sub_ps(w0, x0), _mm_sub_ps(w1, x1));
+      clip(_mm_add_ps(w0, y0), _mm_add_ps(w1, y1));
+      clip(_mm_sub_ps(w0, y0), _mm_sub_ps(w1, y1));
+      clip(_mm_add_ps(w0, z0), _mm_add_ps(w1, z1));
+      clip(_mm_sub_ps(w0, z0), _mm_sub_ps(w1, z1));
+      float t0s[4], t1s[4];
+      _mm_storeu_ps(t0s, t0);
+      _mm_storeu_ps(t1s, t1);
+      for (auto l : Range{4}) {
+        t0_[straddling_[k + l]] = t0s[l];
+        t1_[straddling_[k + l]] = t1s[l];
+      }
+    }
+#endif
+    for (; k < n; k++) {
+      auto i = straddling_[k];
+      auto a = stride * i, b = (a + 1) % size;
+      float t0 = 0, t1 = 1;
+      auto clip = [&](float d0, float d1) {
+        bool in0 = d0 > 0, in1 = d1 > 0;
+        if (!in0 && in1) { t0 = std::max(t0, d0 / (d0 - d1)); } // entering
+        if (in0 && !in1) { t1 = std::min(t1, d0 / (d0 - d1)); } // leaving
+      };
+      float x0 = x_[a], y0 = y_[a], z0 = z_[a], w0 = w_[a];
+      float x1 = x_[b], y1 = y_[b], z1 = z_[b], w1 = w_[b];
+      clip(w0, w1);
+      clip(w0 + x0, w1 + x1);
+      clip(w0 - x0, w1 - x1);
+      clip(w0 + y0, w1 + y1);
+      clip(w0 - y0, w1 - y1);
+      clip(w0 + z0, w1 + z1);
+      clip(w0 - z0, w1 - z1);
+      t0_[i] = t0;
+      t1_[i] = t1;
+    }
+  }
+};
+
 } // hit
 
 
@@ -971,6 +1658,17 @@ namespace gl {
     glDebugMessageCallback(callback, 0);
   }
 
+  inline bool hasExtension(const char* name) {
+    GLint num_extensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+    for (auto i : Range{num_extensions}) {
+      if (std::strcmp(name, (const char*)glGetStringi(GL_EXTENSIONS, i)) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   inline std::pair<bool, std::string> checkShader(GLuint handle) {
     std::string log;
     GLint status = 0, log_length = 0;
@@ -996,9 +1694,13 @@ namespace gl {
   }
 
   struct Program {
-    GLuint handle_, vertex_shader_, fragment_shader_;
+    GLuint handle_, vertex_shader_ = 0, fragment_shader_ = 0;
+
+    // Adopt already linked program (e.g. from glProgramBinary cf. ProgramCache)
+    explicit Program(GLuint handle) : handle_{handle} {}
 
-    Program(const char* vs_src, const char* fs_src) {
+    // `retrievable` to read back by glGetProgramBinary (GL 4.1 or ARB_get_program_binary)
+    Program(const char* vs_src, const char* fs_src, bool retrievable = false) {
       vertex_shader_ = glCreateShader(GL_VERTEX_SHADER);
       fragment_shader_ = glCreateShader(GL_FRAGMENT_SHADER);
       handle_ = glCreateProgram();
@@ -1017,16 +1719,21 @@ namespace gl {
 
       glAttachShader(handle_, vertex_shader_);
       glAttachShader(handle_, fragment_shader_);
+      if (retrievable) {
+        glProgramParameteri(handle_, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+      }
       glLinkProgram(handle_);
       if (auto result = checkProgram(handle_); !result.first) {
         throw std::runtime_error{"glLinkProgram(handle_) faild\n" + result.second};
       }
     }
     ~Program() {
-      glDetachShader(handle_, vertex_shader_);
-      glDetachShader(handle_, fragment_shader_);
-      glDeleteShader(vertex_shader_);
-      glDeleteShader(fragment_shader_);
+      if (vertex_shader_) {
+        glDetachShader(handle_, vertex_shader_);
+        glDetachShader(handle_, fragment_shader_);
+        glDeleteShader(vertex_shader_);
+        glDeleteShader(fragment_shader_);
+      }
       glDeleteProgram(handle_);
     }
 
@@ -1042,53 +1749,267 @@ namespace gl {
       glUniformMatrix4fv(location, 1, GL_FALSE, (GLfloat*)&value);
     }
 
+    void setUniform(const char* name, const glm::fmat4* values, GLsizei count) {
+      auto location = glGetUniformLocation(handle_, name);
+      TOY_ASSERT_CUSTOM(location != -1, fmt::format("Uniform ({}) not found", name));
+      glUniformMatrix4fv(location, count, GL_FALSE, (GLfloat*)values);
+    }
+
+    void setUniform(const char* name, const glm::fvec3* values, GLsizei count) {
+      auto location = glGetUniformLocation(handle_, name);
+      TOY_ASSERT_CUSTOM(location != -1, fmt::format("Uniform ({}) not found", name));
+      glUniform3fv(location, count, (GLfloat*)values);
+    }
+
+    void setUniform(const char* name, GLfloat value) {
+      auto location = glGetUniformLocation(handle_, name);
+      TOY_ASSERT_CUSTOM(location != -1, fmt::format("Uniform ({}) not found", name));
+      glUniform1f(location, value);
+    }
+
     void setUniform(const char* name, GLint value) {
       auto location = glGetUniformLocation(handle_, name);
       TOY_ASSERT_CUSTOM(location != -1, fmt::format("Uniform ({}) not found", name));
       glUniform1i(location, value);
     }
+
+    void setUniform(const char* name, GLuint value) {
+      auto location = glGetUniformLocation(handle_, name);
+      TOY_ASSERT_CUSTOM(location != -1, fmt::format("Uniform ({}) not found", name));
+      glUniform1ui(location, value);
+    }
   };
 
+  // Textures (or multisample renderbuffers) for render targets recycled across framebuffers and frames
+  // by (size, internal format, samples)
+  // - sizes are rounded up to `kBucket` so that interactive resize (e.g. dragging panel separator)
+  //   doesn't reallocate on every pixel
+  // - textures unused for `kMaxAge` frames are deleted at `newFrame`
+  // - not thread safe (use one per thread)
+  struct RenderTargetPool {
+    TOY_CLASS_DELETE_COPY(RenderTargetPool)
+    constexpr static int kBucket = 128;
+    constexpr static uint64_t kMaxAge = 120;
+
+    struct Entry {
+      GLuint handle;
+      glm::ivec2 size;
+      GLenum internal_format;
+      int samples; // renderbuffer when > 1
+      uint64_t last_used;
+    };
+    vector<Entry> free_;
+    uint64_t frame_ = 0;
+    size_t num_allocated_ = 0; // (stats) textures created so far
+
+    RenderTargetPool() = default;
+
+    ~RenderTargetPool() {
+      for (auto& entry : free_) { destroy(entry.handle, entry.samples); }
+    }
+
+    static glm::ivec2 getBucketSize(const glm::ivec2& size) {
+      return (size + kBucket - 1) / kBucket * kBucket;
+    }
+
+    static std::pair<GLenum, GLenum> getFormatType(GLenum internal_format) {
+      switch (internal_format) {
+        case GL_RGBA8:              return {GL_RGBA, GL_UNSIGNED_BYTE};
+        case GL_RGBA16F:            return {GL_RGBA, GL_HALF_FLOAT};
+        case GL_R16F:               return {GL_RED, GL_HALF_FLOAT};
+        case GL_R32UI:              return {GL_RED_INTEGER, GL_UNSIGNED_INT};
+        case GL_RG32UI:             return {GL_RG_INTEGER, GL_UNSIGNED_INT};
+        case GL_DEPTH_COMPONENT32F: return {GL_DEPTH_COMPONENT, GL_FLOAT};
+      }
+      throw std::runtime_error{fmt::format("Unsupported render target format ({:#x})", internal_format)};
+    }
+
+    static GLuint createTexture(const glm::ivec2& size, GLenum internal_format) {
+      auto [format, type] = getFormatType(internal_format);
+      GLuint handle;
+      glGenTextures(1, &handle);
+      glBindTexture(GL_TEXTURE_2D, handle);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage2D(GL_TEXTURE_2D, 0, internal_format, size.x, size.y, 0, format, type, nullptr);
+      return handle;
+    }
+
+    static GLuint createRenderbuffer(const glm::ivec2& size, GLenum internal_format, int samples) {
+      GLuint handle;
+      glGenRenderbuffers(1, &handle);
+      glBindRenderbuffer(GL_RENDERBUFFER, handle);
+      glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internal_format, size.x, size.y);
+      return handle;
+    }
+
+    static GLuint create(const glm::ivec2& size, GLenum internal_format, int samples) {
+      return (samples > 1) ? createRenderbuffer(size, internal_format, samples) : createTexture(size, internal_format);
+    }
+
+    static void destroy(GLuint handle, int samples) {
+      (samples > 1) ? glDeleteRenderbuffers(1, &handle) : glDeleteTextures(1, &handle);
+    }
+
+    // `size` has to be bucketed one (cf. getBucketSize)
+    GLuint acquire(const glm::ivec2& size, GLenum internal_format, int samples = 1) {
+      for (auto it = free_.begin(); it != free_.end(); it++) {
+        if (it->size == size && it->internal_format == internal_format && it->samples == samples) {
+          auto handle = it->handle;
+          free_.erase(it);
+          return handle;
+        }
+      }
+      num_allocated_++;
+      return create(size, internal_format, samples);
+    }
+
+    void release(GLuint handle, const glm::ivec2& size, GLenum internal_format, int samples = 1) {
+      free_.push_back({handle, size, internal_format, samples, frame_});
+    }
+
+    void newFrame() {
+      frame_++;
+      auto it = std::remove_if(free_.begin(), free_.end(), [&](auto& entry) {
+        if (frame_ - entry.last_used <= kMaxAge) { return false; }
+        destroy(entry.handle, entry.samples);
+        return true;
+      });
+      free_.erase(it, free_.end());
+    }
+  };
+
+  // Color (RGBA8) and depth (32F) attachments
+  // - textures are allocated by `capacity_` which can be larger than `size_` (only [0, size_) is drawn),
+  //   so sample it by uv up to `getUvMax()`
+  // - attachments come from `pool` when given (otherwise owned by itself)
+  // - with `samples_ > 1`, draw into multisample renderbuffers (cf. getDrawHandle) then `resolve` into texture
+  // - with `setIds(true)`, single sampled RG32UI is attached at GL_COLOR_ATTACHMENT1 (e.g. for picking)
   struct Framebuffer {
     TOY_CLASS_DELETE_COPY(Framebuffer)
     GLuint framebuffer_handle_, texture_handle_, depth_texture_handle_;
+    GLuint id_texture_handle_ = 0;
+    GLuint msaa_framebuffer_handle_ = 0, msaa_color_handle_ = 0, msaa_depth_handle_ = 0;
     glm::ivec2 size_ = {1, 1};
+    glm::ivec2 capacity_ = {1, 1};
+    int samples_ = 1;
+    bool ids_ = false;
+    RenderTargetPool* pool_;
 
-    Framebuffer() {
+    Framebuffer(RenderTargetPool* pool = nullptr) : pool_{pool} {
       glGenFramebuffers(1, &framebuffer_handle_);
-      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_handle_);
+      _allocate();
+    }
 
-      // color attachment
-      glGenTextures(1, &texture_handle_);
-      glBindTexture(GL_TEXTURE_2D, texture_handle_);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size_.x, size_.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-      glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_handle_, 0);
-      glDrawBuffer(GL_COLOR_ATTACHMENT0);
+    ~Framebuffer() {
+      _release();
+      if (msaa_framebuffer_handle_) { glDeleteFramebuffers(1, &msaa_framebuffer_handle_); }
+      glDeleteFramebuffers(1, &framebuffer_handle_);
+    }
 
-      // depth attachment
-      glGenTextures(1, &depth_texture_handle_);
-      glBindTexture(GL_TEXTURE_2D, depth_texture_handle_);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, size_.x, size_.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    static int getMaxSamples() {
+      GLint result = 1;
+      glGetIntegerv(GL_MAX_SAMPLES, &result);
+      return result;
+    }
+
+    GLuint _acquire(GLenum internal_format, int samples) {
+      return pool_ ? pool_->acquire(capacity_, internal_format, samples)
+                   : RenderTargetPool::create(capacity_, internal_format, samples);
+    }
+
+    void _release(GLuint handle, GLenum internal_format, int samples) {
+      pool_ ? pool_->release(handle, capacity_, internal_format, samples)
+            : RenderTargetPool::destroy(handle, samples);
+    }
+
+    void _allocate() {
+      texture_handle_ = _acquire(GL_RGBA8, 1);
+      depth_texture_handle_ = _acquire(GL_DEPTH_COMPONENT32F, 1);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_handle_);
+      glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_handle_, 0);
       glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth_texture_handle_, 0);
+      if (ids_) {
+        id_texture_handle_ = _acquire(GL_RG32UI, 1);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, id_texture_handle_, 0);
+      } else {
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
+      }
+      glDrawBuffer(GL_COLOR_ATTACHMENT0);
+      if (samples_ > 1) {
+        if (!msaa_framebuffer_handle_) { glGenFramebuffers(1, &msaa_framebuffer_handle_); }
+        msaa_color_handle_ = _acquire(GL_RGBA8, samples_);
+        msaa_depth_handle_ = _acquire(GL_DEPTH_COMPONENT32F, samples_);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, msaa_framebuffer_handle_);
+        glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, msaa_color_handle_);
+        glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, msaa_depth_handle_);
+        glDrawBuffer(GL_COLOR_ATTACHMENT0);
+      }
     }
 
-    ~Framebuffer() {
-      glDeleteTextures(1, &depth_texture_handle_);
-      glDeleteTextures(1, &texture_handle_);
-      glDeleteFramebuffers(1, &framebuffer_handle_);
+    void _release() {
+      _release(texture_handle_, GL_RGBA8, 1);
+      _release(depth_texture_handle_, GL_DEPTH_COMPONENT32F, 1);
+      if (id_texture_handle_) {
+        _release(id_texture_handle_, GL_RG32UI, 1);
+        id_texture_handle_ = 0;
+      }
+      if (msaa_color_handle_) {
+        _release(msaa_color_handle_, GL_RGBA8, samples_);
+        _release(msaa_depth_handle_, GL_DEPTH_COMPONENT32F, samples_);
+        msaa_color_handle_ = msaa_depth_handle_ = 0;
+      }
     }
 
+    // Reallocate only when `size` doesn't fit or current capacity is wastefully large (i.e. over 4x area)
     void setSize(const glm::ivec2& size) {
       if (size[0] == 0 || size[1] == 0) {
         throw std::runtime_error{"Invalid argument: size[0] == 0 || size[1] == 0"};
       }
+      if (size == size_) { return; }
       size_ = size;
-      glBindTexture(GL_TEXTURE_2D, texture_handle_);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size_.x, size_.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-      glBindTexture(GL_TEXTURE_2D, depth_texture_handle_);
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, size_.x, size_.y, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+      auto bucket = RenderTargetPool::getBucketSize(size);
+      bool fits = size.x <= capacity_.x && size.y <= capacity_.y;
+      bool too_large = int64_t(capacity_.x) * capacity_.y > 4 * int64_t(bucket.x) * bucket.y;
+      if (fits && !too_large) { return; }
+      _release();
+      capacity_ = bucket;
+      _allocate();
+    }
+
+    // 1 (or 0) to disable multisampling (clamped by GL_MAX_SAMPLES)
+    void setSamples(int samples) {
+      static const int max_samples = getMaxSamples();
+      samples = std::clamp(samples, 1, max_samples);
+      if (samples == samples_) { return; }
+      _release();
+      samples_ = samples;
+      _allocate();
+    }
+
+    void setIds(bool ids) {
+      if (ids == ids_) { return; }
+      _release();
+      ids_ = ids;
+      _allocate();
+    }
+
+    // Framebuffer to draw into
+    GLuint getDrawHandle() const {
+      return (samples_ > 1) ? msaa_framebuffer_handle_ : framebuffer_handle_;
+    }
+
+    // After drawing, make multisampled color available to `texture_handle_` (no-op without multisampling)
+    void resolve() const {
+      if (samples_ <= 1) { return; }
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, msaa_framebuffer_handle_);
+      glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer_handle_);
+      glBlitFramebuffer(0, 0, size_.x, size_.y, 0, 0, size_.x, size_.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+
+    glm::fvec2 getUvMax() const {
+      return glm::fvec2{size_} / glm::fvec2{capacity_};
     }
   };
 
@@ -1121,6 +2042,122 @@ namespace gl {
           size.x, size.y, 0, std::get<1>(format_triple_),
           std::get<2>(format_triple_), data);
     }
+
+    // Allocate all mip levels at once (immutable when GL 4.2, otherwise emulated by glTexImage2D per level)
+    // then fill each level by `setSubData`
+    void setStorage(const ivec2& size, GLsizei num_levels, GLenum internal_format) {
+      size_ = size;
+      num_levels_ = num_levels;
+      params_[GL_TEXTURE_MAX_LEVEL] = num_levels - 1;
+      applyParams();
+      if (gl3wIsSupported(4, 2)) {
+        glTexStorage2D(target_, num_levels, internal_format, size.x, size.y);
+        return;
+      }
+      for (auto level : Range{num_levels}) {
+        ivec2 level_size = glm::max(ivec2{1, 1}, ivec2{size.x >> level, size.y >> level});
+        glTexImage2D(
+            target_, level, internal_format, level_size.x, level_size.y, 0,
+            std::get<1>(format_triple_), std::get<2>(format_triple_), nullptr);
+      }
+    }
+
+    void setSubData(GLint level, const ivec2& size, const GLvoid* data) {
+      glBindTexture(target_, handle_);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexSubImage2D(
+          target_, level, 0, 0, size.x, size.y,
+          std::get<1>(format_triple_), std::get<2>(format_triple_), data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    // GL_TEXTURE_2D_ARRAY variants
+    void setStorageArray(const ivec2& size, GLsizei num_layers, GLsizei num_levels, GLenum internal_format) {
+      size_ = size;
+      num_levels_ = num_levels;
+      params_[GL_TEXTURE_MAX_LEVEL] = num_levels - 1;
+      applyParams();
+      if (gl3wIsSupported(4, 2)) {
+        glTexStorage3D(target_, num_levels, internal_format, size.x, size.y, num_layers);
+        return;
+      }
+      for (auto level : Range{num_levels}) {
+        ivec2 level_size = glm::max(ivec2{1, 1}, ivec2{size.x >> level, size.y >> level});
+        glTexImage3D(
+            target_, level, internal_format, level_size.x, level_size.y, num_layers, 0,
+            std::get<1>(format_triple_), std::get<2>(format_triple_), nullptr);
+      }
+    }
+
+    void setSubDataArray(GLint level, GLint layer, const ivec2& size, const GLvoid* data, const ivec2& offset = {0, 0}) {
+      glBindTexture(target_, handle_);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexSubImage3D(
+          target_, level, offset.x, offset.y, layer, size.x, size.y, 1,
+          std::get<1>(format_triple_), std::get<2>(format_triple_), data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    // GL_TEXTURE_CUBE_MAP variants (`face` is offset from GL_TEXTURE_CUBE_MAP_POSITIVE_X)
+    void setStorageCube(GLsizei size, GLsizei num_levels, GLenum internal_format) {
+      target_ = GL_TEXTURE_CUBE_MAP;
+      size_ = {size, size};
+      num_levels_ = num_levels;
+      params_[GL_TEXTURE_MAX_LEVEL] = num_levels - 1;
+      applyParams();
+      if (gl3wIsSupported(4, 2)) {
+        glTexStorage2D(target_, num_levels, internal_format, size, size);
+        return;
+      }
+      for (auto level : Range{num_levels}) {
+        GLsizei level_size = std::max(1, size >> level);
+        for (auto face : Range{6}) {
+          glTexImage2D(
+              GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, internal_format, level_size, level_size, 0,
+              std::get<1>(format_triple_), std::get<2>(format_triple_), nullptr);
+        }
+      }
+    }
+
+    void setSubDataCube(GLint level, GLint face, GLsizei size, const GLvoid* data) {
+      glBindTexture(target_, handle_);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+      glTexSubImage2D(
+          GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size,
+          std::get<1>(format_triple_), std::get<2>(format_triple_), data);
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+
+    void setCompressedSubData(GLint level, const ivec2& size, GLenum internal_format, const vector<uint8_t>& data) {
+      glBindTexture(target_, handle_);
+      glCompressedTexSubImage2D(target_, level, 0, 0, size.x, size.y, internal_format, data.size(), data.data());
+    }
+
+    // Trilinear + anisotropic (clamped by implementation limit, no-op if not supported)
+    void setFilterTrilinear(float anisotropy = 8) {
+      params_[GL_TEXTURE_MIN_FILTER] = GL_LINEAR_MIPMAP_LINEAR;
+      params_[GL_TEXTURE_MAG_FILTER] = GL_LINEAR;
+      applyParams();
+      float max_anisotropy = getMaxAnisotropy();
+      if (max_anisotropy > 0) {
+        glTexParameterf(target_, GL_TEXTURE_MAX_ANISOTROPY, std::min(anisotropy, max_anisotropy));
+      }
+    }
+
+    static float getMaxAnisotropy() {
+      // Core in 4.6 but widely available as extension (EXT/ARB_texture_filter_anisotropic share enums)
+      static float result = [](){
+        float value = 0;
+        if (gl3wIsSupported(4, 6) || hasExtension("GL_EXT_texture_filter_anisotropic") ||
+            hasExtension("GL_ARB_texture_filter_anisotropic")) {
+          glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &value);
+        }
+        return value;
+      }();
+      return result;
+    }
+
+    GLsizei num_levels_ = 1;
   };
 
 
@@ -1186,6 +2223,206 @@ namespace gl {
       glDrawElements(primitive_mode_, num_indices_, index_type_, 0);
     }
   };
+
+  // Generic buffer object which is refilled as a whole (e.g. per frame)
+  struct Buffer {
+    TOY_CLASS_DELETE_COPY(Buffer)
+    GLuint handle_;
+    GLenum target_;
+    GLenum usage_;
+    GLsizeiptr capacity_ = 0; // in bytes
+
+    Buffer(GLenum target, GLenum usage = GL_STREAM_DRAW) : target_{target}, usage_{usage} {
+      glGenBuffers(1, &handle_);
+    }
+    ~Buffer() {
+      glDeleteBuffers(1, &handle_);
+    }
+
+    // Reallocate only when growing, otherwise orphan the old storage and refill
+    template<typename T>
+    void setData(const std::vector<T>& data) {
+      GLsizeiptr size = data.size() * sizeof(T);
+      glBindBuffer(target_, handle_);
+      if (size > capacity_) {
+        capacity_ = size;
+        glBufferData(target_, capacity_, data.data(), usage_);
+        return;
+      }
+      glBufferData(target_, capacity_, nullptr, usage_);
+      glBufferSubData(target_, 0, size, data.data());
+    }
+  };
+
+  // Buffer read as texture (i.e. samplerBuffer) for per-frame arrays without SSBO (core since GL 3.1)
+  struct TextureBuffer {
+    TOY_CLASS_DELETE_COPY(TextureBuffer)
+    Buffer buffer_{GL_TEXTURE_BUFFER};
+    GLuint handle_;
+
+    TextureBuffer(GLenum internal_format) {
+      glGenTextures(1, &handle_);
+      glBindBuffer(GL_TEXTURE_BUFFER, buffer_.handle_); // (buffer object is created on first bind)
+      glBindTexture(GL_TEXTURE_BUFFER, handle_);
+      glTexBuffer(GL_TEXTURE_BUFFER, internal_format, buffer_.handle_);
+    }
+    ~TextureBuffer() {
+      glDeleteTextures(1, &handle_);
+    }
+
+    template<typename T>
+    void setData(const std::vector<T>& data) {
+      buffer_.setData(data);
+    }
+
+    void bind(GLuint unit) const {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      glBindTexture(GL_TEXTURE_BUFFER, handle_);
+    }
+  };
+
+  // Same layout as what glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER
+  // cf. https://www.khronos.org/opengl/wiki/Vertex_Rendering#Indirect_rendering
+  struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint  base_vertex;
+    GLuint base_instance;
+  };
+
+  //
+  // Vertex/index storage shared by many meshes.
+  // Each mesh is addressed by `Range`, so that all of them can be drawn from a single VAO
+  // (cf. glDrawElementsBaseVertex, glMultiDrawElementsIndirect).
+  // - `add` takes first fitting free range (cf. RangeAllocator), so ranges of `release`d meshes are reused
+  // - when nothing fits, buffer is reallocated (at least doubling) and existing content is copied on GPU
+  //
+  template<typename TVertex, typename TIndex>
+  struct GeometryArena {
+    TOY_CLASS_DELETE_COPY(GeometryArena)
+    using FormatParam = VertexRenderer::FormatParam;
+
+    struct Range {
+      GLuint first_index = 0;
+      GLuint count = 0;
+      GLint  base_vertex = 0;
+      GLuint num_vertices = 0; // (for `release`)
+    };
+
+    GLuint vertex_array_, array_buffer_, element_array_buffer_;
+    GLenum index_type_;
+    RangeAllocator vertices_, indices_; // ranges of released meshes are reused by later `add`
+    std::vector<std::pair<GLint, FormatParam>> formats_; // re-applied when `array_buffer_` is reallocated
+
+    GeometryArena() {
+      glGenBuffers(1, &array_buffer_);
+      glGenBuffers(1, &element_array_buffer_);
+      glGenVertexArrays(1, &vertex_array_);
+      if constexpr (std::is_same_v<TIndex, uint8_t >) { index_type_ = GL_UNSIGNED_BYTE;  }
+      if constexpr (std::is_same_v<TIndex, uint16_t>) { index_type_ = GL_UNSIGNED_SHORT; }
+      if constexpr (std::is_same_v<TIndex, uint32_t>) { index_type_ = GL_UNSIGNED_INT;   }
+      reserve(1 << 16, 1 << 16);
+    }
+
+    ~GeometryArena() {
+      glDeleteBuffers(1, &array_buffer_);
+      glDeleteBuffers(1, &element_array_buffer_);
+      glDeleteVertexArrays(1, &vertex_array_);
+    }
+
+    // Copy old content into newly allocated storage
+    static void _reallocate(GLuint& handle, size_t old_size, size_t new_size) {
+      GLuint new_handle;
+      glGenBuffers(1, &new_handle);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, new_handle);
+      glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+      if (old_size > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, handle);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+      }
+      glDeleteBuffers(1, &handle);
+      handle = new_handle;
+    }
+
+    void reserve(size_t num_vertices, size_t num_indices) {
+      bool changed = false;
+      if (num_vertices > vertices_.capacity_) {
+        size_t new_capacity = std::max(num_vertices, 2 * vertices_.capacity_);
+        _reallocate(array_buffer_, vertices_.getEnd() * sizeof(TVertex), new_capacity * sizeof(TVertex));
+        vertices_.grow(new_capacity);
+        changed = true;
+      }
+      if (num_indices > indices_.capacity_) {
+        size_t new_capacity = std::max(num_indices, 2 * indices_.capacity_);
+        _reallocate(element_array_buffer_, indices_.getEnd() * sizeof(TIndex), new_capacity * sizeof(TIndex));
+        indices_.grow(new_capacity);
+        changed = true;
+      }
+      if (changed) {
+        _applyFormats();
+      }
+    }
+
+    // First fit within ranges released so far, otherwise storage grows
+    Range add(const std::vector<TVertex>& vertices, const std::vector<TIndex>& indices) {
+      auto vertex_offset = vertices_.allocate(vertices.size());
+      if (!vertex_offset) {
+        reserve(vertices_.getEnd() + vertices.size(), 0);
+        vertex_offset = vertices_.allocate(vertices.size());
+      }
+      auto index_offset = indices_.allocate(indices.size());
+      if (!index_offset) {
+        reserve(0, indices_.getEnd() + indices.size());
+        index_offset = indices_.allocate(indices.size());
+      }
+      TOY_ASSERT(vertex_offset && index_offset);
+      Range range = {(GLuint)*index_offset, (GLuint)indices.size(), (GLint)*vertex_offset, (GLuint)vertices.size()};
+
+      // NOTE: upload via GL_COPY_WRITE_BUFFER not to disturb currently bound VAO
+      glBindBuffer(GL_COPY_WRITE_BUFFER, array_buffer_);
+      glBufferSubData(
+          GL_COPY_WRITE_BUFFER, *vertex_offset * sizeof(TVertex),
+          vertices.size() * sizeof(TVertex), vertices.data());
+      glBindBuffer(GL_COPY_WRITE_BUFFER, element_array_buffer_);
+      glBufferSubData(
+          GL_COPY_WRITE_BUFFER, *index_offset * sizeof(TIndex),
+          indices.size() * sizeof(TIndex), indices.data());
+      return range;
+    }
+
+    // Range's storage can be reused by later `add` (it must not be drawn anymore)
+    void release(const Range& range) {
+      vertices_.release(range.base_vertex, range.num_vertices);
+      indices_.release(range.first_index, range.count);
+    }
+
+    void _applyFormats() {
+      glBindVertexArray(vertex_array_);
+      glBindBuffer(GL_ARRAY_BUFFER, array_buffer_);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_array_buffer_);
+      for (auto& [location, f] : formats_) {
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, f.size, f.type, f.normalized, f.stride, f.pointer);
+      }
+    }
+
+    void setFormat(GLuint program, std::map<const char*, FormatParam> format_args) {
+      for (auto& [name, f] : format_args) {
+        auto location = glGetAttribLocation(program, name);
+        TOY_ASSERT_CUSTOM(location != -1, fmt::format("Vertex attribute ({}) not found", name));
+        formats_.emplace_back(location, f);
+      }
+      _applyFormats();
+    }
+
+    void draw(const Range& range, GLenum primitive_mode = GL_TRIANGLES) {
+      glBindVertexArray(vertex_array_);
+      glDrawElementsBaseVertex(
+          primitive_mode, range.count, index_type_,
+          (GLvoid*)(range.first_index * sizeof(TIndex)), range.base_vertex);
+    }
+  };
 }
 
 
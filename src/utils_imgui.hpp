@@ -60,6 +60,45 @@ inline bool InputTransform(
   return changed;
 };
 
+//
+// World space lines and grids drawn by GL into viewport's framebuffer (cf. OverlayRenderer in scene_example.cpp),
+// so that they are depth tested against scene instead of projected on CPU into ImGui's draw list
+//
+struct Overlay3D {
+  struct Segment {
+    fvec3 p0; float thickness; // in pixels
+    fvec3 p1; float _padding;
+    fvec4 color;
+  };
+  struct Grid {
+    int plane; // normal axis (0 : yz, 1 : zx, 2 : xy)
+    float bound;
+    float division;
+    fvec2 alpha; // (integral, fractional)
+  };
+  vector<Segment> segments;
+  vector<Segment> segments_on_top; // (not depth tested e.g. gizmo)
+  vector<Grid> grids;
+
+  void clear() {
+    segments.clear();
+    segments_on_top.clear();
+    grids.clear();
+  }
+
+  bool empty() const {
+    return segments.empty() && segments_on_top.empty() && grids.empty();
+  }
+
+  uint64_t getSignature(uint64_t hash) const {
+    size_t sizes[] = {segments.size(), segments_on_top.size(), grids.size()};
+    hash = hashFnv1a(sizes, sizeof(sizes), hash);
+    hash = hashFnv1a(segments.data(), segments.size() * sizeof(Segment), hash);
+    hash = hashFnv1a(segments_on_top.data(), segments_on_top.size() * sizeof(Segment), hash);
+    return hashFnv1a(grids.data(), grids.size() * sizeof(Grid), hash);
+  }
+};
+
 // TODO: Rename to ImGui3D
 struct DrawList3D {
   ImDrawList* draw_list;
@@ -68,6 +107,37 @@ struct DrawList3D {
   const fmat4* sceneCo_to_clipCo;
   const fmat3* ndCo_to_imguiCo;
 
+  // When set, lines and grids go to GL overlay instead of ImGui's draw list (fills stay with ImGui)
+  Overlay3D* overlay = nullptr;
+  bool depth_test = true; // (only for overlay)
+
+  // (scratch for batched clipping, kept to reuse allocation)
+  hit::LineClipper line_clipper;
+
+  // Local space templates reused across frames
+  // - grid templates and projected lines not used during the previous view are dropped on view change (cf. _newView)
+  struct GridTemplate {
+    uint32_t view_version = 0; // (last used)
+    vector<fvec3> points;
+  };
+  std::map<int, vector<fvec2>> unit_circles;                 // keyed by num_segments
+  struct CircleBasis {
+    fvec3 axis{0}, u, v; // (u, v) spans plane normal to axis
+  };
+  std::array<CircleBasis, 4> circle_bases; // last used axes (e.g. gizmo's rotation axes) replaced in round robin
+  size_t next_circle_basis = 0;
+  std::map<std::array<int, 4>, GridTemplate> grid_templates; // keyed by (bound, division, plane, fractional)
+
+  // Projected static geometry (e.g. grid) memoized until view changes (cf. _addStaticLines)
+  struct ProjectedLines {
+    uint32_t view_version = 0;
+    vector<array<ImVec2, 2>> lines;
+  };
+  std::map<std::array<int, 4>, ProjectedLines> projected_lines; // keyed by (primitive, params...)
+  fmat4 projected_sceneCo_to_clipCo{0};
+  fmat3 projected_ndCo_to_imguiCo{0};
+  uint32_t view_version = 0;
+
   ImVec2 clipCo_to_imguiCo(const fvec4& p) {
     fvec2 q = fvec2{p.x, p.y} / p.w;                 // NDCo (without depth)
     return ImVec2{(*ndCo_to_imguiCo) * fvec3{q, 1}}; // imguiCo
@@ -78,10 +148,19 @@ struct DrawList3D {
     return clipCo_to_imguiCo(p2);
   }
 
+  void _addOverlaySegment(const fvec3& p0, const fvec3& p1, const fvec4& color, float thickness) {
+    auto& segments = depth_test ? overlay->segments : overlay->segments_on_top;
+    segments.push_back({p0, thickness, p1, 0, color});
+  }
+
   void addLine(
       const std::array<fvec3, 2>& ps,
       const fvec4& color,
       float thickness = 1.0f) {
+    if (overlay) {
+      _addOverlaySegment(ps[0], ps[1], color, thickness);
+      return;
+    }
     auto cp0_cp1 = hit::clip4D_Line_ClipVolume({
         (*sceneCo_to_clipCo) * fvec4{ps[0], 1},
         (*sceneCo_to_clipCo) * fvec4{ps[1], 1}});
@@ -110,138 +189,185 @@ struct DrawList3D {
   // NOTE: thought this might be useful to hitTest in ImGui coordinate but not utilized yet...
   // @return possibly disconnected lines due to clipping
   vector<array<ImVec2, 2>> getImguiCo_Path(const vector<fvec3>& ps, bool closed) {
-    vector<array<ImVec2, 2>> lines;
-    size_t N = ps.size();
-    for (auto i : Range{closed ? N : N - 1}) {
-      // Clip
-      std::optional<array<fvec4, 2>> cp0_cp1 =
-          hit::clip4D_Line_ClipVolume({
-              (*sceneCo_to_clipCo) * fvec4{ps[i],           1},
-              (*sceneCo_to_clipCo) * fvec4{ps[(i + 1) % N], 1}});
-      if (!cp0_cp1) { continue; }
+    // Clip
+    line_clipper.clipPath(*sceneCo_to_clipCo, ps.data(), ps.size(), closed);
 
-      // Project
-      lines.push_back({
-          clipCo_to_imguiCo((*cp0_cp1)[0]),
-          clipCo_to_imguiCo((*cp0_cp1)[1])});
+    // Project
+    vector<array<ImVec2, 2>> lines;
+    lines.reserve(line_clipper.lines_.size());
+    for (auto& [p0, p1] : line_clipper.lines_) {
+      lines.push_back({clipCo_to_imguiCo(p0), clipCo_to_imguiCo(p1)});
     }
     return lines;
   }
 
-  // @return "clip-project"-ed convex vertex points
-  vector<ImVec2> getImguiCo_ConvexFill(const vector<fvec3>& ps) {
-    vector<ImVec2> result = {};
-
-    // Clip
+  // Calls `func(cs, size)` with clipped polygon (on stack unless `ps` is too large for it)
+  template<typename Func>
+  void _clipConvexPoly(const vector<fvec3>& ps, Func&& func) {
+    if (ps.size() + 7 <= hit::kClipPolyCapacity) {
+      hit::ClipPoly qs, cs;
+      for (auto& p : ps) {
+        qs.push_back((*sceneCo_to_clipCo) * fvec4{p, 1});
+      }
+      hit::clip4D_ConvexPoly_ClipVolume(qs.data(), qs.size(), cs);
+      func(cs.data(), cs.size());
+      return;
+    }
     vector<fvec4> qs{ps.size()};
     for (auto i : Range{ps.size()}) {
       qs[i] = (*sceneCo_to_clipCo) * fvec4{ps[i], 1};
     }
     vector<fvec4> cs = hit::clip4D_ConvexPoly_ClipVolume(qs);
-    if (cs.size() < 3) { return result; }
+    func(cs.data(), cs.size());
+  }
 
-    // Project
-    result.resize(cs.size());
-    for (auto i : Range{cs.size()}) {
-      result[i] = clipCo_to_imguiCo(cs[i]);
-    }
+  // @return "clip-project"-ed convex vertex points
+  vector<ImVec2> getImguiCo_ConvexFill(const vector<fvec3>& ps) {
+    vector<ImVec2> result = {};
+
+    // Clip
+    _clipConvexPoly(ps, [&](const fvec4* cs, size_t size) {
+      if (size < 3) { return; }
+
+      // Project
+      result.resize(size);
+      for (auto i : Range{size}) {
+        result[i] = clipCo_to_imguiCo(cs[i]);
+      }
+    });
     return result;
   }
 
+  void _addClippedLines(const fvec4& color, float thickness) {
+    ImU32 col = ImColor{ImVec4{color}};
+    for (auto& [p0, p1] : line_clipper.lines_) {
+      draw_list->AddLine(clipCo_to_imguiCo(p0), clipCo_to_imguiCo(p1), col, thickness);
+    }
+  }
+
   void addPath(const vector<fvec3>& ps, const fvec4& color, float thickness = 1.0f, bool closed = false) {
-    size_t N = ps.size();
-    for (auto i : Range{closed ? N : N - 1}) {
-      addLine({ps[i], ps[(i + 1) % N]}, color, thickness);
+    if (overlay) {
+      size_t N = ps.size();
+      for (size_t i = 0; i + 1 < N + closed; i++) {
+        _addOverlaySegment(ps[i], ps[(i + 1) % N], color, thickness);
+      }
+      return;
     }
+    line_clipper.clipPath(*sceneCo_to_clipCo, ps.data(), ps.size(), closed);
+    _addClippedLines(color, thickness);
   }
 
-  void addConvexFill(const vector<fvec3>& ps, const fvec4& color) {
-    vector<fvec4> qs{ps.size()};
-    for (auto i : Range{ps.size()}) {
-      qs[i] = (*sceneCo_to_clipCo) * fvec4{ps[i], 1};
+  // Independent segments (ps[2 i], ps[2 i + 1])
+  void addLines(const vector<fvec3>& ps, const fvec4& color, float thickness = 1.0f) {
+    if (overlay) {
+      for (size_t i = 0; i + 1 < ps.size(); i += 2) {
+        _addOverlaySegment(ps[i], ps[i + 1], color, thickness);
+      }
+      return;
     }
-    vector<fvec4> cs = hit::clip4D_ConvexPoly_ClipVolume(qs);
-    if (cs.size() < 3) { return; }
+    line_clipper.clipLines(*sceneCo_to_clipCo, ps.data(), ps.size());
+    _addClippedLines(color, thickness);
+  }
 
-    // Fix orientation for PathFillConvex's AA
-    bool flip; {
-      ImVec2 v1 = clipCo_to_imguiCo(cs[1] - cs[0]);
-      ImVec2 v2 = clipCo_to_imguiCo(cs[2] - cs[0]);
-      flip = v1.x * v2. y - v1.y * v2.x < 0;
+  void addConvexFill(const vector<fvec3>& ps, const fvec4& color) {
+    _clipConvexPoly(ps, [&](const fvec4* cs, size_t size) {
+      if (size < 3) { return; }
+
+      // Fix orientation for PathFillConvex's AA
+      bool flip; {
+        ImVec2 v1 = clipCo_to_imguiCo(cs[1] - cs[0]);
+        ImVec2 v2 = clipCo_to_imguiCo(cs[2] - cs[0]);
+        flip = v1.x * v2. y - v1.y * v2.x < 0;
+      }
+
+      draw_list->PathClear();
+      for (auto i : Range{size}) {
+        draw_list->PathLineTo(clipCo_to_imguiCo(cs[flip ? size - 1 - i : i]));
+      }
+      draw_list->PathFillConvex(ImColor{ImVec4{color}});
+    });
+  }
+
+  // (cos(t), sin(t)) for t = 2 pi i / num_segments
+  const vector<fvec2>& _getUnitCircle(int num_segments) {
+    auto& result = unit_circles[num_segments];
+    if (result.empty()) {
+      float pi = glm::pi<float>();
+      result.resize(num_segments);
+      for (auto i : Range{num_segments}) {
+        float t = 2 * pi * i / num_segments;
+        result[i] = {std::cos(t), std::sin(t)};
+      }
     }
+    return result;
+  }
 
-    draw_list->PathClear();
-    if (flip) {
-      for (auto& c : Reverse{cs})
-        draw_list->PathLineTo(clipCo_to_imguiCo(c));
-    } else {
-      for (auto& c : cs)
-        draw_list->PathLineTo(clipCo_to_imguiCo(c));
+  const CircleBasis& _getCircleBasis(const fvec3& axis) {
+    for (auto& basis : circle_bases) {
+      if (basis.axis == axis && axis != fvec3{0}) { return basis; }
     }
-    draw_list->PathFillConvex(ImColor{ImVec4{color}});
+    auto& result = circle_bases[next_circle_basis++ % circle_bases.size()];
+    fmat4 xform = lookatTransform({0, 0, 0}, axis, getNonParallel(axis));
+    result = {axis, fvec3{xform[0]}, fvec3{xform[1]}};
+    return result;
   }
 
   vector<fvec3> _makeCirclePoints(
       const fvec3& center, float radius, const fvec3& axis, int num_segments) {
-    float pi = glm::pi<float>();
-    fmat4 xform = lookatTransform({0, 0, 0}, axis, getNonParallel(axis));
-    fvec3 u = fvec3{xform[0]};
-    fvec3 v = fvec3{xform[1]};
+    auto& basis = _getCircleBasis(axis);
+    fvec3 u = radius * basis.u;
+    fvec3 v = radius * basis.v;
 
-    vector<fvec3> ps{(size_t)num_segments};
+    auto& circle = _getUnitCircle(num_segments);
+    vector<fvec3> result(num_segments);
     for (auto i : Range{num_segments}) {
-      using std::cos, std::sin;
-      float t = 2 * pi * i / num_segments;
-      auto& c = center;
-      auto& r = radius;
-      ps[i] = c + r * cos(t) * u + r * sin(t) * v;
+      result[i] = center + circle[i].x * u + circle[i].y * v;
     }
-    return ps;
+    return result;
   }
 
   vector<fvec3> _makeArcPoints(
       const fvec3& center, float radius, const fvec3& v1, const fvec3& v2,
       int arc_begin, int arc_end, int num_segments) {
-    float pi = glm::pi<float>();
-
-    vector<fvec3> ps; ps.reserve(arc_end - arc_begin);
+    auto& circle = _getUnitCircle(num_segments);
+    vector<fvec3> result;
+    result.reserve(std::max(arc_end - arc_begin, 0));
     for (auto i : Range{arc_begin, arc_end}) {
-      using std::cos, std::sin;
-      float t = 2 * pi * i / num_segments;
-      auto& c = center;
-      auto& r = radius;
-      ps.push_back(c + r * cos(t) * v1 + r * sin(t) * v2);
+      auto& c = circle[(i % num_segments + num_segments) % num_segments];
+      result.push_back(center + radius * c.x * v1 + radius * c.y * v2);
     }
-    return ps;
+    return result;
   }
 
+  // Arc of angle [arc_begin, arc_end] (in radian, either direction) through unit circle of `num_segments` per turn
+  // (i.e. only both ends take cos/sin)
   vector<fvec3> _makeArcPoints_v2(
       const fvec3& center, float radius, const fvec3& v1, const fvec3& v2,
       float arc_begin, float arc_end, int num_segments) {
-    float pi = glm::pi<float>();
-
-    vector<fvec3> ps; ps.resize(num_segments + 1);
-    for (auto i : Range{num_segments + 1}) {
-      using std::cos, std::sin;
-      float t = arc_begin + (arc_end - arc_begin) * i / num_segments;
-      auto& c = center;
-      auto& r = radius;
-      ps[i] = c + r * cos(t) * v1 + r * sin(t) * v2;
+    auto& circle = _getUnitCircle(num_segments);
+    auto point = [&](const fvec2& c) { return center + radius * c.x * v1 + radius * c.y * v2; };
+    float step = 2 * glm::pi<float>() / num_segments;
+    int lo = std::floor(std::min(arc_begin, arc_end) / step) + 1; // (unit circle points strictly in between)
+    int hi = std::ceil(std::max(arc_begin, arc_end) / step) - 1;
+
+    vector<fvec3> result;
+    result.reserve(std::max(hi - lo + 1, 0) + 2);
+    result.push_back(point({std::cos(arc_begin), std::sin(arc_begin)}));
+    for (int k = 0; k <= hi - lo; k++) {
+      int i = (arc_begin <= arc_end) ? lo + k : hi - k;
+      result.push_back(point(circle[(i % num_segments + num_segments) % num_segments]));
     }
-    return ps;
+    result.push_back(point({std::cos(arc_end), std::sin(arc_end)}));
+    return result;
   }
 
-  // TODO: migrate _makeArcPoints_v2
   void addArc(
       const fvec3& center, float radius, const fvec3& v1, const fvec3& v2, const fvec4& color,
       int arc_begin, int arc_end, int num_segments, float thickness = 1.0f) {
-    vector<fvec3> ps = _makeArcPoints(center, radius, v1, v2, arc_begin, arc_end, num_segments);
-    vector<array<ImVec2, 2>> qs = getImguiCo_Path(ps, /*closed*/ false);
-    for (auto& [p1, p2] : qs) {
-      draw_list->AddLine(p1, p2, ImColor{ImVec4{color}}, thickness);
-    }
+    addPath(_makeArcPoints(center, radius, v1, v2, arc_begin, arc_end, num_segments), color, thickness);
   }
 
+  // (`num_segments` per full turn cf. _makeArcPoints_v2)
   void addArcFill(
       const fvec3& center, float radius, const fvec3& v1, const fvec3& v2, const fvec4& color,
       float arc_begin, float arc_end, int num_segments) {
@@ -282,46 +408,97 @@ struct DrawList3D {
     addCircle(cone_base_center, cone_base_radius, camera_to_center, color, thickness, num_segments);
   }
 
+  // Drops memoized entries which weren't used during the previous view (i.e. since the last view change)
+  void _newView() {
+    auto previous = view_version++;
+    auto evict = [&](auto& entries) {
+      for (auto it = entries.begin(); it != entries.end();) {
+        it = (it->second.view_version < previous) ? entries.erase(it) : std::next(it);
+      }
+    };
+    evict(projected_lines);
+    evict(grid_templates);
+  }
+
+  // Adds segments (ps[2 i], ps[2 i + 1]) of `getPoints()` whose projection is memoized by `key` until view changes
+  template<typename Func>
+  void _addStaticLines(const std::array<int, 4>& key, const fvec4& color, float thickness, Func&& getPoints) {
+    if (projected_sceneCo_to_clipCo != *sceneCo_to_clipCo || projected_ndCo_to_imguiCo != *ndCo_to_imguiCo) {
+      projected_sceneCo_to_clipCo = *sceneCo_to_clipCo;
+      projected_ndCo_to_imguiCo = *ndCo_to_imguiCo;
+      _newView();
+    }
+    auto& projected = projected_lines[key];
+    if (projected.view_version != view_version) {
+      const vector<fvec3>& ps = getPoints();
+      line_clipper.clipLines(*sceneCo_to_clipCo, ps.data(), ps.size());
+      projected.lines.clear();
+      for (auto& [p0, p1] : line_clipper.lines_) {
+        projected.lines.push_back({clipCo_to_imguiCo(p0), clipCo_to_imguiCo(p1)});
+      }
+      projected.view_version = view_version;
+    }
+    ImU32 col = ImColor{ImVec4{color}};
+    for (auto& [p0, p1] : projected.lines) {
+      draw_list->AddLine(p0, p1, col, thickness);
+    }
+  }
+
   void addAxes(int bound, int show[3], float alpha = 0.4f) {
     for (auto i : Range{3}) {
       if (!show[i]) { continue; }
 
       fvec3 p{0}; p[i] = 1;
-      fvec3 p1 = p * (float)bound;
-      fvec3 p2 = - p1;
-      addLine({p1, p2}, fvec4{p, alpha});
+      if (overlay) {
+        _addOverlaySegment(p * (float)bound, - p * (float)bound, fvec4{p, alpha}, 1);
+        continue;
+      }
+      _addStaticLines({0, bound, i, 0}, fvec4{p, alpha}, 1, [&]() {
+        return vector<fvec3>{p * (float)bound, - p * (float)bound};
+      });
     }
   }
 
-  void addGridPlanes(int bound, int division, int show[3], float alpha1 = .3f, float alpha2 = .15f) {
+  // Grid lines on plane normal to axis `i` (as segments)
+  const vector<fvec3>& _getGridPoints(int bound, int division, int i, bool fractional) {
+    auto& entry = grid_templates[{bound, division, i, fractional}];
+    entry.view_version = view_version;
+    auto& result = entry.points;
+    if (!result.empty()) { return result; }
+
     auto& B = bound;
     auto& D = division;
+    auto j = (i + 1) % 3;
+    auto k = (i + 2) % 3;
+    for (auto s : Range{-B, B + 1}) {
+      if (fractional && s == B) { break; } // skip last fractional grids
+      for (auto l : Range{fractional ? 1 : 0, fractional ? D : 1}) {
+        float c = s + (float)l / D;
+        fvec3 p1_a; p1_a[i] = 0, p1_a[j] = c, p1_a[k] =  B;
+        fvec3 p2_a; p2_a[i] = 0, p2_a[j] = c, p2_a[k] = -B;
+        fvec3 p1_b; p1_b[i] = 0, p1_b[k] = c, p1_b[j] =  B;
+        fvec3 p2_b; p2_b[i] = 0, p2_b[k] = c, p2_b[j] = -B;
+        result.insert(result.end(), {p1_a, p2_a, p1_b, p2_b});
+      }
+    }
+    return result;
+  }
 
-    for (auto i : Range{3}) {
-      if (!show[i]) { continue; }
-      auto j = (i + 1) % 3;
-      auto k = (i + 2) % 3;
+  void addGridPlanes(int bound, int division, int show[3], float alpha1 = .3f, float alpha2 = .15f) {
+    if (overlay) {
+      for (auto i : Range{3}) {
+        if (!show[i]) { continue; }
+        overlay->grids.push_back({i, (float)bound, (float)division, {alpha1, alpha2}});
+      }
+      return;
+    }
 
-      for (auto s : Range{-B, B + 1}) {
-        // integral coords
-        fvec3 p1_a; p1_a[i] = 0, p1_a[j] = s, p1_a[k] =  B;
-        fvec3 p2_a; p2_a[i] = 0, p2_a[j] = s, p2_a[k] = -B;
-        fvec3 p1_b; p1_b[i] = 0, p1_b[k] = s, p1_b[j] =  B;
-        fvec3 p2_b; p2_b[i] = 0, p2_b[k] = s, p2_b[j] = -B;
-        addLine({p1_a, p2_a}, {1, 1, 1, alpha1});
-        addLine({p1_b, p2_b}, {1, 1, 1, alpha1});
-
-        if (s == B) { break; } // skip last fractional grids
-        for (auto l : Range{1, D}) {
-          // fractional coords
-          float f = (float)l / D;
-          fvec3 q1_a; q1_a[i] = 0, q1_a[j] = s + f, q1_a[k] =  B;
-          fvec3 q2_a; q2_a[i] = 0, q2_a[j] = s + f, q2_a[k] = -B;
-          fvec3 q1_b; q1_b[i] = 0, q1_b[k] = s + f, q1_b[j] =  B;
-          fvec3 q2_b; q2_b[i] = 0, q2_b[k] = s + f, q2_b[j] = -B;
-          addLine({q1_a, q2_a}, {1, 1, 1, alpha2});
-          addLine({q1_b, q2_b}, {1, 1, 1, alpha2});
-        }
+    // Integral grids first then fractional ones
+    for (auto fractional : {false, true}) {
+      for (auto i : Range{3}) {
+        if (!show[i]) { continue; }
+        _addStaticLines({1, bound, division, 2 * i + fractional}, {1, 1, 1, fractional ? alpha2 : alpha1}, 1,
+            [&]() -> const vector<fvec3>& { return _getGridPoints(bound, division, i, fractional); });
       }
     }
   }
@@ -460,7 +637,7 @@ struct GizmoRotation {
           fvec3 X = glm::normalize(v_init);
           fvec3 Y = glm::normalize(glm::cross(Z, X));
           float diff = std::atan2(dot(Y, v), dot(X, v));
-          imgui3d->addArcFill(xform_t, arc_radius, X, Y, {1, 1, 0, .5}, 0, diff, 24);
+          imgui3d->addArcFill(xform_t, arc_radius, X, Y, {1, 1, 0, .5}, 0, diff, 96);
 
         } else if (axis_ == i && hovered_) {
           fvec3 color = {0, 0, 0}; color[i] = 1;
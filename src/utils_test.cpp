@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <fmt/format.h>
+#include <random>
 
 #include "utils.hpp"
 
@@ -83,6 +84,35 @@ TEST(UtilsTest, clip4D_ConvexPoly_ClipVolume) {
   }
 }
 
+TEST(UtilsTest, clip4D_ConvexPoly_ClipVolume_ClipPolyBatch) {
+  using std::vector, glm::fvec4;
+  vector<vector<fvec4>> polys = {
+    { {-2, -2, 0, 1}, {2, -2, 0, 1}, {2, 2, 0, 1}, {-2, 2, 0, 1} },           // clipped
+    { {-1.25, -0.5, 0, 1}, {1.25, -0.5, 0, 1}, {0, 2, 0, 1} },                // clipped
+    { {-0.5, -0.5, 0, 1}, {0.5, -0.5, 0, 1}, {0, 0.5, 0, 1} },                // inside
+    { {2, 2, 0, 1}, {3, 2, 0, 1}, {3, 3, 0, 1} },                             // outside
+    { {0, 0, 0, -1}, {1, 0, 0, -1}, {0, 1, 0, -1} },                          // behind
+  };
+  utils::hit::ClipPolyBatch batch, batch_result;
+  for (auto& poly : polys) { batch.push(poly.data(), poly.size()); }
+  utils::hit::clip4D_ConvexPoly_ClipVolume(batch, batch_result);
+  ASSERT_EQ(batch_result.size(), polys.size());
+  for (auto i : utils::Range{polys.size()}) {
+    vector<fvec4> expected = utils::hit::clip4D_ConvexPoly_ClipVolume(polys[i]);
+    utils::hit::ClipPoly result;
+    utils::hit::clip4D_ConvexPoly_ClipVolume(polys[i].data(), polys[i].size(), result);
+    ASSERT_EQ(result.size(), expected.size());
+    ASSERT_EQ(batch_result.getNumVertices(i), expected.size());
+    for (auto j : utils::Range{expected.size()}) {
+      EXPECT_EQ(result[j], expected[j]);
+      EXPECT_EQ(batch_result.getVertex(batch_result.offsets_[i] + j), expected[j]);
+    }
+  }
+  EXPECT_EQ(batch_result.getNumVertices(2), 3);
+  EXPECT_EQ(batch_result.getNumVertices(3), 0);
+  EXPECT_EQ(batch_result.getNumVertices(4), 0);
+}
+
 TEST(UtilsTest, clip4D_Line_HalfSpace) {
   using std::vector, glm::fvec4, std::array;
   // Simple examples for code coverage
@@ -411,3 +441,176 @@ TEST(UtilsTest, interleave) {
 
   EXPECT_EQ(result, expected);
 }
+
+TEST(UtilsTest, LineClipper) {
+  using std::vector, glm::fvec3, glm::fvec4, glm::fmat4;
+  std::mt19937 rng{0};
+  std::uniform_real_distribution<float> dist{-3, 3};
+  vector<fvec3> ps(103); // (not multiple of 4 to cover remainder)
+  for (auto& p : ps) { p = {dist(rng), dist(rng), dist(rng)}; }
+  fmat4 xform = glm::perspectiveRH_NO(glm::pi<float>() / 3, 1.f, 0.1f, 100.f);
+  xform[3] = xform * fvec4{0, 0, -4, 1}; // camera at z = 4
+
+  auto expectSame = [&](const vector<std::array<fvec4, 2>>& result, size_t num_segments, auto getSegment) {
+    size_t j = 0;
+    for (auto i : utils::Range{num_segments}) {
+      auto [a, b] = getSegment(i);
+      auto expected = utils::hit::clip4D_Line_ClipVolume({xform * fvec4{ps[a], 1}, xform * fvec4{ps[b], 1}});
+      if (!expected) { continue; }
+      ASSERT_LT(j, result.size());
+      for (auto k : utils::Range{2}) {
+        for (auto l : utils::Range{4}) {
+          EXPECT_NEAR(result[j][k][l], (*expected)[k][l], 1e-4);
+        }
+      }
+      j++;
+    }
+    EXPECT_EQ(j, result.size());
+  };
+
+  utils::hit::LineClipper clipper;
+  clipper.clipPath(xform, ps.data(), ps.size(), /*closed*/ true);
+  EXPECT_GT(clipper.lines_.size(), 0);
+  EXPECT_GT(clipper.straddling_.size(), 4);
+  expectSame(clipper.lines_, ps.size(), [&](size_t i) { return std::pair{i, (i + 1) % ps.size()}; });
+
+  clipper.clipLines(xform, ps.data(), ps.size() - 1);
+  expectSame(clipper.lines_, ps.size() / 2, [&](size_t i) { return std::pair{2 * i, 2 * i + 1}; });
+}
+
+TEST(UtilsTest, SmallVector) {
+  utils::SmallVector<int, 4> v = {1, 2};
+  EXPECT_EQ(v.size(), 2);
+  v.push_back(3);
+  v.push_back(4);
+  EXPECT_EQ(v.back(), 4);
+  EXPECT_THROW(v.push_back(5), std::runtime_error);
+  std::vector<int> reversed{v.rbegin(), v.rend()};
+  EXPECT_EQ(reversed, (std::vector<int>{4, 3, 2, 1}));
+  v.clear();
+  EXPECT_TRUE(v.empty());
+}
+
+TEST(UtilsTest, RadixSorter) {
+  std::vector<float> values = {3.5, -1, 0, -0.25, 1e6, -1e6, 3.5, 0.125};
+  std::vector<uint32_t> keys;
+  for (auto v : values) { keys.push_back(utils::floatToSortable(v)); }
+  utils::RadixSorter<uint32_t> sorter;
+  auto& order = sorter.sort(keys);
+  EXPECT_EQ(order, (std::vector<uint32_t>{5, 1, 3, 2, 7, 0, 6, 4})); // (stable for equal keys)
+
+  // Same as std::stable_sort including skipped digits
+  std::mt19937 rng{0};
+  std::vector<uint64_t> keys64(1000);
+  for (auto& key : keys64) { key = (uint64_t(rng() % 16) << 40) | (rng() % 256); }
+  std::vector<uint32_t> expected(keys64.size());
+  std::iota(expected.begin(), expected.end(), 0);
+  std::stable_sort(expected.begin(), expected.end(), [&](auto a, auto b) { return keys64[a] < keys64[b]; });
+  utils::RadixSorter<uint64_t> sorter64;
+  EXPECT_EQ(sorter64.sort(keys64), expected);
+  EXPECT_EQ(sorter64.sort(keys64, 3), expected); // (chunks on threads)
+  EXPECT_TRUE(sorter64.sort(keys64.data(), 0).empty());
+}
+
+TEST(UtilsTest, RangeAllocator) {
+  utils::RangeAllocator allocator;
+  EXPECT_FALSE(allocator.allocate(1));
+  allocator.grow(100);
+  EXPECT_EQ(allocator.allocate(30), 0);
+  EXPECT_EQ(allocator.allocate(30), 30);
+  EXPECT_EQ(allocator.allocate(30), 60);
+  EXPECT_FALSE(allocator.allocate(30));
+  EXPECT_EQ(allocator.getEnd(), 90);
+
+  // Released range is reused (first fit)
+  allocator.release(0, 30);
+  EXPECT_EQ(allocator.allocate(20), 0);
+  EXPECT_EQ(allocator.allocate(10), 20);
+  EXPECT_EQ(allocator.used_, 90);
+
+  // Neighbors are merged
+  allocator.release(30, 30);
+  allocator.release(0, 20);
+  allocator.release(20, 10);
+  EXPECT_EQ(allocator.free_.size(), 2);
+  EXPECT_EQ(allocator.allocate(60), 0);
+  allocator.release(60, 30);
+  EXPECT_EQ(allocator.free_.size(), 1);
+  EXPECT_EQ(allocator.getEnd(), 60);
+
+  // Growing extends free tail
+  allocator.grow(200);
+  EXPECT_EQ(allocator.free_.size(), 1);
+  EXPECT_EQ(allocator.allocate(140), 60);
+  EXPECT_EQ(allocator.used_, 200);
+  EXPECT_EQ(allocator.getEnd(), 200);
+}
+
+TEST(UtilsTest, TripleBuffer) {
+  {
+    utils::TripleBuffer<int> buffer;
+    EXPECT_FALSE(buffer.acquire());
+    buffer.back() = 1;
+    EXPECT_FALSE(buffer.publish());
+    buffer.back() = 2;
+    EXPECT_TRUE(buffer.publish()); // 1 is dropped
+    EXPECT_TRUE(buffer.acquire());
+    EXPECT_EQ(buffer.front(), 2);
+    EXPECT_FALSE(buffer.acquire());
+    EXPECT_EQ(buffer.front(), 2);
+  }
+  {
+    // Consumer sees monotonic sequence
+    utils::TripleBuffer<int> buffer;
+    constexpr int kCount = 100000;
+    std::thread producer{[&]() {
+      for (int i = 1; i <= kCount; i++) {
+        buffer.back() = i;
+        buffer.publish();
+      }
+    }};
+    int last = 0;
+    bool ok = true;
+    while (last < kCount) {
+      if (!buffer.acquire()) { continue; }
+      ok = ok && buffer.front() > last;
+      last = buffer.front();
+    }
+    producer.join();
+    EXPECT_TRUE(ok);
+  }
+}
+
+TEST(UtilsTest, FrameStats) {
+  utils::FrameStats stats;
+  EXPECT_EQ(stats.getAverage(), 0);
+  stats.add(10);
+  stats.add(20);
+  EXPECT_EQ(stats.size(), 2);
+  EXPECT_FLOAT_EQ(stats.getAverage(), 15);
+  EXPECT_FLOAT_EQ(stats.getMax(), 20);
+  for (auto i : utils::Range{utils::FrameStats::kHistory}) {
+    stats.add(i < 1 ? 40 : 5);
+  }
+  EXPECT_EQ(stats.size(), utils::FrameStats::kHistory);
+  EXPECT_EQ(stats.getOffset(), 2);
+  EXPECT_FLOAT_EQ(stats.getMax(), 40);
+}
+
+TEST(UtilsTest, RenderTargetPool_getBucketSize) {
+  using Pool = utils::gl::RenderTargetPool;
+  EXPECT_EQ(Pool::getBucketSize({1, 1}), (glm::ivec2{Pool::kBucket, Pool::kBucket}));
+  EXPECT_EQ(Pool::getBucketSize({Pool::kBucket, Pool::kBucket + 1}), (glm::ivec2{Pool::kBucket, 2 * Pool::kBucket}));
+  EXPECT_EQ(Pool::getBucketSize({800, 600}), (glm::ivec2{896, 640}));
+}
+
+TEST(UtilsTest, Ray_AABB) {
+  using utils::hit::Ray_AABB;
+  glm::fvec3 lo = {-1, -1, -1}, hi = {1, 1, 1};
+  EXPECT_FLOAT_EQ(Ray_AABB({0, 0, 5}, {0, 0, -1}, lo, hi).value(), 4);
+  EXPECT_FLOAT_EQ(Ray_AABB({0, 0, 0}, {1, 2, 3}, lo, hi).value(), 0); // inside
+  EXPECT_FALSE(Ray_AABB({0, 0, 5}, {0, 0, 1}, lo, hi));               // behind
+  EXPECT_FALSE(Ray_AABB({2, 0, 5}, {0, 0, -1}, lo, hi));              // parallel outside
+  EXPECT_FALSE(Ray_AABB({0, 0, 5}, {1, 0, -1}, lo, hi));
+  EXPECT_FLOAT_EQ(Ray_AABB({0, 0, 5}, {0.1, 0, -1}, lo, hi).value(), 4);
+}
@@ -115,12 +115,27 @@ struct Window {
     glfwTerminate();
   }
 
+  // Invisible window whose context shares objects with the main one (textures, buffers, programs, syncs
+  // but not container objects e.g. VAO, FBO), so that it can be made current on other thread
+  // NOTE: glfw requires window creation on main thread
+  GLFWwindow* createSharedContext() {
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    auto result = glfwCreateWindow(1, 1, (name_ + " (shared)").data(), NULL, glfw_window_);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+    assert(result);
+    return result;
+  }
+
   bool shouldClose() {
     return glfwWindowShouldClose(glfw_window_);
   }
 
-  void newFrame() {
+  void pollEvents() {
     wait_event_ ? glfwWaitEvents() : glfwPollEvents();
+  }
+
+  void newFrame(bool poll_events = true) {
+    if (poll_events) { pollEvents(); }
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();